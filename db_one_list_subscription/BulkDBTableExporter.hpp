@@ -0,0 +1,371 @@
+#ifndef BULK_DB_TABLE_EXPORTER_HPP_
+#define BULK_DB_TABLE_EXPORTER_HPP_
+
+#include <tm_kit/infra/ChronoUtils.hpp>
+#include <tm_kit/basic/StructFieldInfoHelper.hpp>
+
+#include <soci/soci.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//High-throughput alternative to DBTableExporterFactory for tables that
+//receive a lot of rows. Rows are queued and written by a background
+//thread, batchSize rows per database transaction, using multi-row
+//"INSERT ... VALUES (...),(...)" statements (optionally with
+//"ON CONFLICT(...) DO UPDATE"). The statements are prepared once per row
+//count and reused. When more than maxQueuedRows rows are waiting, the
+//producer blocks until the writer catches up.
+//
+//The columns are the fields of T, in order, as for DBTableExporterFactory.
+//Integral, floating point and string fields are bound as such, time
+//points as local time strings, and any other field as its operator<<
+//output.
+namespace db_one_list_subscription {
+
+    struct BulkDBTableExporterConfig {
+        //rows per database transaction
+        std::size_t batchSize = 1000;
+        //queued rows are written at least this often even if the batch is not full
+        std::chrono::milliseconds flushInterval {100};
+        //the producer blocks while this many rows are waiting
+        std::size_t maxQueuedRows = 100000;
+        //if not empty, rows are upserted on these columns
+        std::vector<std::string> upsertKeyColumns;
+        //SQLite's default limit on bound parameters per statement
+        std::size_t maxParametersPerStatement = 999;
+    };
+
+    namespace bulk_db_exporter_detail {
+        template <class F, class Enable=void>
+        struct SociValue {
+            using type = std::string;
+            static std::string convert(F const &f) {
+                std::ostringstream oss;
+                oss << f;
+                return oss.str();
+            }
+        };
+        template <>
+        struct SociValue<std::string> {
+            using type = std::string;
+            static std::string const &convert(std::string const &s) {
+                return s;
+            }
+        };
+        template <class F>
+        struct SociValue<F, std::enable_if_t<std::is_integral_v<F> && sizeof(F) <= sizeof(int)>> {
+            using type = int;
+            static int convert(F f) {
+                return (int) f;
+            }
+        };
+        template <class F>
+        struct SociValue<F, std::enable_if_t<std::is_integral_v<F> && (sizeof(F) > sizeof(int))>> {
+            using type = long long;
+            static long long convert(F f) {
+                return (long long) f;
+            }
+        };
+        template <class F>
+        struct SociValue<F, std::enable_if_t<std::is_floating_point_v<F>>> {
+            using type = double;
+            static double convert(F f) {
+                return (double) f;
+            }
+        };
+        template <>
+        struct SociValue<std::chrono::system_clock::time_point> {
+            using type = std::string;
+            static std::string convert(std::chrono::system_clock::time_point const &tp) {
+                return dev::cd606::tm::infra::withtime_utils::localTimeString(tp);
+            }
+        };
+
+        template <class T, std::size_t I>
+        using FieldType = typename dev::cd606::tm::basic::StructFieldTypeInfo<T, I>::TheType;
+
+        template <class T, class Seq>
+        struct RowBuffers;
+        template <class T, std::size_t... Is>
+        struct RowBuffers<T, std::index_sequence<Is...>> {
+            using type = std::tuple<std::vector<typename SociValue<FieldType<T, Is>>::type>...>;
+        };
+    }
+
+    //Owns the queue and the writer thread. Destroying it writes whatever
+    //is still queued.
+    template <class T>
+    class BulkDBTableWriter {
+    private:
+        static constexpr std::size_t FieldCount = dev::cd606::tm::basic::StructFieldInfo<T>::FIELD_NAMES.size();
+        using Indices = std::make_index_sequence<FieldCount>;
+        using Buffers = typename bulk_db_exporter_detail::RowBuffers<T, Indices>::type;
+
+        //one prepared statement for a fixed number of rows, with the
+        //buffers its parameters are bound to
+        struct BoundStatement {
+            Buffers buffers;
+            soci::statement stmt;
+            BoundStatement(soci::session &session) : buffers(), stmt(session) {}
+        };
+
+        std::shared_ptr<soci::session> session_;
+        std::string table_;
+        BulkDBTableExporterConfig config_;
+        std::function<void(std::string const &)> logger_;
+        std::size_t rowsPerStatement_;
+        std::map<std::size_t, std::unique_ptr<BoundStatement>> statements_;
+
+        std::mutex mutex_;
+        std::condition_variable writerCond_;
+        std::condition_variable producerCond_;
+        std::vector<T> queue_;
+        uint64_t queuedTotal_;
+        uint64_t writtenTotal_;
+        uint64_t failedTotal_;
+        bool flushRequested_;
+        bool stopping_;
+        std::thread thread_;
+
+        std::string buildSql(std::size_t rowCount) const {
+            auto const &names = dev::cd606::tm::basic::StructFieldInfo<T>::FIELD_NAMES;
+            std::ostringstream oss;
+            oss << "INSERT INTO " << table_ << "(";
+            for (std::size_t ii=0; ii<FieldCount; ++ii) {
+                oss << ((ii>0)?",":"") << names[ii];
+            }
+            oss << ") VALUES ";
+            for (std::size_t jj=0; jj<rowCount; ++jj) {
+                oss << ((jj>0)?",(":"(");
+                for (std::size_t ii=0; ii<FieldCount; ++ii) {
+                    oss << ((ii>0)?",":"") << ":v" << jj << "_" << ii;
+                }
+                oss << ")";
+            }
+            if (!config_.upsertKeyColumns.empty()) {
+                oss << " ON CONFLICT(";
+                for (std::size_t ii=0; ii<config_.upsertKeyColumns.size(); ++ii) {
+                    oss << ((ii>0)?",":"") << config_.upsertKeyColumns[ii];
+                }
+                oss << ") DO ";
+                bool first = true;
+                for (auto const &n : names) {
+                    if (std::find(config_.upsertKeyColumns.begin(), config_.upsertKeyColumns.end(), n) != config_.upsertKeyColumns.end()) {
+                        continue;
+                    }
+                    oss << (first?"UPDATE SET ":",") << n << "=excluded." << n;
+                    first = false;
+                }
+                if (first) {
+                    oss << "NOTHING";
+                }
+            }
+            return oss.str();
+        }
+        template <std::size_t... Is>
+        void bindRow(BoundStatement &s, std::size_t row, std::index_sequence<Is...>) {
+            (s.stmt.exchange(soci::use(std::get<Is>(s.buffers)[row])), ...);
+        }
+        template <std::size_t... Is>
+        void fillRow(BoundStatement &s, std::size_t row, T const &t, std::index_sequence<Is...>) {
+            ((std::get<Is>(s.buffers)[row] = bulk_db_exporter_detail::SociValue<bulk_db_exporter_detail::FieldType<T, Is>>::convert(
+                dev::cd606::tm::basic::StructFieldTypeInfo<T, Is>::constAccess(t)
+            )), ...);
+        }
+        template <std::size_t... Is>
+        void sizeBuffers(BoundStatement &s, std::size_t rowCount, std::index_sequence<Is...>) {
+            (std::get<Is>(s.buffers).resize(rowCount), ...);
+        }
+        BoundStatement &statementFor(std::size_t rowCount) {
+            auto iter = statements_.find(rowCount);
+            if (iter != statements_.end()) {
+                return *(iter->second);
+            }
+            auto s = std::make_unique<BoundStatement>(*session_);
+            //the buffers must not move once bound
+            sizeBuffers(*s, rowCount, Indices {});
+            for (std::size_t jj=0; jj<rowCount; ++jj) {
+                bindRow(*s, jj, Indices {});
+            }
+            s->stmt.alloc();
+            s->stmt.prepare(buildSql(rowCount));
+            s->stmt.define_and_bind();
+            return *(statements_[rowCount] = std::move(s));
+        }
+        void writeBatch(std::vector<T> const &rows, std::size_t start, std::size_t end) {
+            try {
+                (*session_) << "BEGIN TRANSACTION";
+                for (std::size_t ii=start; ii<end; ii+=rowsPerStatement_) {
+                    auto count = std::min(rowsPerStatement_, end-ii);
+                    auto &s = statementFor(count);
+                    for (std::size_t jj=0; jj<count; ++jj) {
+                        fillRow(s, jj, rows[ii+jj], Indices {});
+                    }
+                    s.stmt.execute(true);
+                }
+                (*session_) << "COMMIT";
+            } catch (soci::soci_error const &ex) {
+                logger_("[BulkDBTableWriter] writing "+std::to_string(end-start)+" rows to "+table_+" failed: "+ex.what());
+                try {
+                    (*session_) << "ROLLBACK";
+                } catch (soci::soci_error const &) {
+                }
+                std::lock_guard<std::mutex> _(mutex_);
+                failedTotal_ += (end-start);
+            }
+        }
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true) {
+                writerCond_.wait_for(lock, config_.flushInterval, [this]() {
+                    return stopping_ || flushRequested_ || queue_.size() >= config_.batchSize;
+                });
+                if (queue_.empty()) {
+                    flushRequested_ = false;
+                    producerCond_.notify_all();
+                    if (stopping_) {
+                        return;
+                    }
+                    continue;
+                }
+                std::vector<T> rows;
+                rows.swap(queue_);
+                lock.unlock();
+                producerCond_.notify_all();
+                for (std::size_t ii=0; ii<rows.size(); ii+=config_.batchSize) {
+                    writeBatch(rows, ii, std::min(rows.size(), ii+config_.batchSize));
+                }
+                lock.lock();
+                writtenTotal_ += rows.size();
+                producerCond_.notify_all();
+            }
+        }
+        //called with the lock held
+        void waitForSpace(std::unique_lock<std::mutex> &lock, std::size_t incoming) {
+            producerCond_.wait(lock, [this,incoming]() {
+                //a single push larger than the limit is let through once the queue is empty
+                return queue_.empty() || queue_.size()+incoming <= config_.maxQueuedRows;
+            });
+        }
+    public:
+        BulkDBTableWriter(
+            std::shared_ptr<soci::session> const &session
+            , std::string const &table
+            , BulkDBTableExporterConfig const &config = BulkDBTableExporterConfig {}
+            , std::function<void(std::string const &)> const &logger = [](std::string const &s) {
+                std::cerr << s << '\n';
+            }
+        )
+            : session_(session), table_(table), config_(config), logger_(logger)
+            , rowsPerStatement_(std::max<std::size_t>(1, std::min(std::max<std::size_t>(config.batchSize, 1), config.maxParametersPerStatement/FieldCount)))
+            , statements_()
+            , mutex_(), writerCond_(), producerCond_(), queue_()
+            , queuedTotal_(0), writtenTotal_(0), failedTotal_(0)
+            , flushRequested_(false), stopping_(false), thread_()
+        {
+            config_.batchSize = std::max<std::size_t>(config_.batchSize, 1);
+            thread_ = std::thread(&BulkDBTableWriter::run, this);
+        }
+        ~BulkDBTableWriter() {
+            {
+                std::lock_guard<std::mutex> _(mutex_);
+                stopping_ = true;
+            }
+            writerCond_.notify_one();
+            thread_.join();
+        }
+        BulkDBTableWriter(BulkDBTableWriter const &) = delete;
+        BulkDBTableWriter &operator=(BulkDBTableWriter const &) = delete;
+
+        void push(T &&t) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            waitForSpace(lock, 1);
+            queue_.push_back(std::move(t));
+            ++queuedTotal_;
+            if (queue_.size() >= config_.batchSize) {
+                writerCond_.notify_one();
+            }
+        }
+        void push(std::vector<T> &&ts) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            waitForSpace(lock, ts.size());
+            queuedTotal_ += ts.size();
+            if (queue_.empty()) {
+                queue_ = std::move(ts);
+            } else {
+                std::move(ts.begin(), ts.end(), std::back_inserter(queue_));
+            }
+            if (queue_.size() >= config_.batchSize) {
+                writerCond_.notify_one();
+            }
+        }
+        //blocks until everything pushed so far has been written (or has failed)
+        void flush() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto target = queuedTotal_;
+            flushRequested_ = true;
+            writerCond_.notify_one();
+            producerCond_.wait(lock, [this,target]() {
+                return writtenTotal_ >= target;
+            });
+        }
+        uint64_t writtenCount() {
+            std::lock_guard<std::mutex> _(mutex_);
+            return writtenTotal_-failedTotal_;
+        }
+        uint64_t failedCount() {
+            std::lock_guard<std::mutex> _(mutex_);
+            return failedTotal_;
+        }
+    };
+
+    //Same shape as DBTableExporterFactory, backed by a BulkDBTableWriter
+    template <class M>
+    class BulkDBTableExporterFactory {
+    public:
+        template <class T>
+        static auto createExporter(
+            std::shared_ptr<soci::session> const &session
+            , std::string const &table
+            , BulkDBTableExporterConfig const &config = BulkDBTableExporterConfig {}
+        ) {
+            auto writer = std::make_shared<BulkDBTableWriter<T>>(session, table, config);
+            return M::template pureExporter<T>(
+                [writer](T &&t) {
+                    writer->push(std::move(t));
+                }
+            );
+        }
+        template <class T>
+        static auto createBatchExporter(
+            std::shared_ptr<soci::session> const &session
+            , std::string const &table
+            , BulkDBTableExporterConfig const &config = BulkDBTableExporterConfig {}
+        ) {
+            auto writer = std::make_shared<BulkDBTableWriter<T>>(session, table, config);
+            return M::template pureExporter<std::vector<T>>(
+                [writer](std::vector<T> &&ts) {
+                    writer->push(std::move(ts));
+                }
+            );
+        }
+    };
+
+}
+
+#endif
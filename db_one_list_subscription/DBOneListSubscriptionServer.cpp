@@ -18,6 +18,7 @@
 #include <tm_kit/transport/SyntheticMultiTransportFacility.hpp>
 
 #include "DBData.hpp"
+#include "DeltaFeed.hpp"
 
 #include <soci/soci.h>
 #include <soci/sqlite3/soci-sqlite3.h>
@@ -34,22 +35,25 @@ using TI = basic::transaction::named_value_store::TI<db_data>;
 using GS = basic::transaction::named_value_store::GS<boost::uuids::uuid,db_data>;
 
 using Data = basic::transaction::named_value_store::Collection<db_data>;
+using TheDeltaLog = DeltaLog<TI::DataDelta>;
 
 class DSComponent : public basic::transaction::v2::DataStreamEnvComponent<DI> {
 private:
     std::shared_ptr<soci::session> session_;
     std::function<void(std::string)> logger_;
+    std::shared_ptr<TheDeltaLog> deltaLog_;
     Callback *cb_;
 public:
-    DSComponent() : session_(), logger_() {
+    DSComponent() : session_(), logger_(), deltaLog_() {
     }
-    DSComponent(std::shared_ptr<soci::session> const &session, std::function<void(std::string)> const &logger) : session_(session), logger_(logger) {
+    DSComponent(std::shared_ptr<soci::session> const &session, std::function<void(std::string)> const &logger, std::shared_ptr<TheDeltaLog> const &deltaLog) : session_(session), logger_(logger), deltaLog_(deltaLog) {
     }
-    DSComponent(DSComponent &&c) : session_(std::move(c.session_)), logger_(std::move(c.logger_)) {}
+    DSComponent(DSComponent &&c) : session_(std::move(c.session_)), logger_(std::move(c.logger_)), deltaLog_(std::move(c.deltaLog_)) {}
     DSComponent &operator=(DSComponent &&c) {
         if (this != &c) {
             session_ = std::move(c.session_);
             logger_ = std::move(c.logger_);
+            deltaLog_ = std::move(c.deltaLog_);
         }
         return *this;
     }
@@ -69,6 +73,9 @@ public:
         std::ostringstream oss;
         oss << "[DSComponent] loaded " << initialData.size() << " rows";
         logger_(oss.str());
+        if (deltaLog_) {
+            deltaLog_->reset(0, initialData);
+        }
         cb_->onUpdate(DI::Update {
             0
             , std::vector<DI::OneUpdateItem> {
@@ -91,8 +98,12 @@ private:
     std::function<void(std::string)> logger_;
     std::atomic<int64_t> globalVersion_;
     DSComponent *dsComponent_;
+    std::shared_ptr<TheDeltaLog> deltaLog_;
 
     void triggerCallback(TI::TransactionResponse const &resp, TI::Key const &key, TI::DataDelta const &dataDelta) {
+        if (deltaLog_) {
+            deltaLog_->append(resp.globalVersion, dataDelta);
+        }
         dsComponent_->callback()->onUpdate(DI::Update {
             resp.globalVersion
             , std::vector<DI::OneUpdateItem> {
@@ -105,17 +116,18 @@ private:
         });
     }
 public:
-    THComponent() : session_(), logger_(), globalVersion_(0), dsComponent_(nullptr) {
+    THComponent() : session_(), logger_(), globalVersion_(0), dsComponent_(nullptr), deltaLog_() {
     }
-    THComponent(std::shared_ptr<soci::session> const &session, std::function<void(std::string)> const &logger, DSComponent *dsComponent) : session_(session), logger_(logger), globalVersion_(0), dsComponent_(dsComponent) {
+    THComponent(std::shared_ptr<soci::session> const &session, std::function<void(std::string)> const &logger, DSComponent *dsComponent, std::shared_ptr<TheDeltaLog> const &deltaLog) : session_(session), logger_(logger), globalVersion_(0), dsComponent_(dsComponent), deltaLog_(deltaLog) {
     }
-    THComponent(THComponent &&c) : session_(std::move(c.session_)), logger_(std::move(c.logger_)), globalVersion_(c.globalVersion_.load()), dsComponent_(c.dsComponent_) {}
+    THComponent(THComponent &&c) : session_(std::move(c.session_)), logger_(std::move(c.logger_)), globalVersion_(c.globalVersion_.load()), dsComponent_(c.dsComponent_), deltaLog_(std::move(c.deltaLog_)) {}
     THComponent &operator=(THComponent &&c) {
         if (this != &c) {
             session_ = std::move(c.session_);
             logger_ = std::move(c.logger_);
             globalVersion_ = c.globalVersion_.load();
             dsComponent_ = c.dsComponent_;
+            deltaLog_ = std::move(c.deltaLog_);
         }
         return *this;
     }
@@ -190,6 +202,9 @@ int main(int argc, char **argv) {
     desc.add_options()
         ("help", "display help message")
         ("db_file", po::value<std::string>(), "database file")
+        ("delta_log_size", po::value<std::size_t>()->default_value(10000), "number of versions a delta feed client can resume from")
+        ("delta_page_size", po::value<std::size_t>()->default_value(1000), "rows per delta feed page when the client does not ask for a size")
+        ("delta_feed_lease_seconds", po::value<int>()->default_value(60), "end delta feed subscriptions that are not renewed within this many seconds (0: never)")
     ;
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -235,11 +250,20 @@ int main(int argc, char **argv) {
         , vm["db_file"].as<std::string>()
     );
 
+    //a new epoch per run, since the versions restart with the server
+    auto deltaLog = std::make_shared<TheDeltaLog>(
+        TheEnvironment::id_to_string(env.new_id())
+        , vm["delta_log_size"].as<std::size_t>()
+        , vm["delta_page_size"].as<std::size_t>()
+        , std::chrono::seconds(std::max(vm["delta_feed_lease_seconds"].as<int>(), 0))
+    );
+
     env.DSComponent::operator=(DSComponent {
         session
         , [&env](std::string const &s) {
             env.log(infra::LogLevel::Info, s);
         }
+        , deltaLog
     });
     env.THComponent::operator=(THComponent {
         session
@@ -247,6 +271,7 @@ int main(int argc, char **argv) {
             env.log(infra::LogLevel::Info, s);
         }
         , static_cast<DSComponent *>(&env)
+        , deltaLog
     });
 
     env.transport::json_rest::JsonRESTComponent::setDocRoot(56788, "../db_one_list_subscription/web_root");
@@ -337,6 +362,24 @@ int main(int argc, char **argv) {
         , "synthetic_subscription_output"
         , r.facilityConnector(transactionLogicCombinationRes.subscriptionFacility)
     );
+
+    //paged snapshots and resume-from-version, see DeltaFeed.hpp
+    auto deltaFeed = M::fromAbstractOnOrderFacility(new DeltaFeedFacility<TheEnvironment, TI::DataDelta>(deltaLog));
+    r.registerOnOrderFacility("deltaFeed", deltaFeed);
+    transport::MultiTransportFacilityWrapper<R>::wrapWithProtocol
+        <basic::CBOR,DeltaFeedRequest,DeltaFeedUpdate>(
+        r
+        , deltaFeed
+        , "rabbitmq://127.0.0.1::guest:guest:test_db_one_list_delta_feed_queue"
+        , "delta_feed_wrapper/"
+    );
+    transport::MultiTransportFacilityWrapper<R>::wrapWithProtocol
+        <basic::CBOR,DeltaFeedRequest,DeltaFeedUpdate>(
+        r
+        , deltaFeed
+        , "websocket://127.0.0.1:56789:::delta_feed"
+        , "delta_feed_wrapper_2/"
+    );
     
     std::ostringstream graphOss;
     graphOss << "The graph is:\n";
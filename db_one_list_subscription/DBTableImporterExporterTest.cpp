@@ -17,6 +17,8 @@
 #include <soci/sqlite3/soci-sqlite3.h>
 
 #include "DBData.hpp"
+#include "BulkDBTableExporter.hpp"
+#include "IncrementalDBTableImporter.hpp"
 
 using namespace dev::cd606::tm;
 
@@ -39,9 +41,24 @@ using SR = infra::SynchronousRunner<M>;
 TM_BASIC_CBOR_CAPABLE_STRUCT(test_data, TestDataFields);
 TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(test_data, TestDataFields);
 
+std::vector<test_data> benchRows(std::size_t count) {
+    std::vector<test_data> v;
+    v.reserve(count);
+    auto now = std::chrono::system_clock::now();
+    for (std::size_t ii=0; ii<count; ++ii) {
+        v.push_back({"bench_"+std::to_string(ii), (int32_t) ii, basic::FixedPrecisionShortDecimal<4> {ii*0.01}, now, basic::TimePointAsString<basic::time_zone_spec::Local> {now}});
+    }
+    return v;
+}
+
+void reportRate(std::string const &label, std::size_t count, std::chrono::steady_clock::time_point start) {
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    std::cout << label << ": " << count << " rows in " << secs << " seconds (" << ((secs > 0)?count/secs:0.0) << " rows/s)\n";
+}
+
 int main(int argc, char **argv) {
     if (argc == 1) {
-        std::cerr << "Usage: db_table_importer_exporter_test DB_FILE [importer|importer-repeated|importer-repeated-with-key|exporter|exporter-batch|importer-sync|exporter-sync|exporter-batch-sync]\n";
+        std::cerr << "Usage: db_table_importer_exporter_test DB_FILE [importer|importer-repeated|importer-repeated-with-key|importer-incremental|exporter|exporter-batch|importer-sync|exporter-sync|exporter-batch-sync|exporter-bench [ROWS [BATCH_SIZE [upsert]]]]\n";
         return -1;
     }
     auto session = std::make_shared<soci::session>(
@@ -110,6 +127,32 @@ int main(int argc, char **argv) {
         })(r);
         r.finalize();
         infra::terminationController(infra::RunForever {});
+    } else if (std::string_view(argv[2]) == "importer-incremental") {
+        Env env; 
+        R r(&env);
+        infra::DeclarativeGraph<R>("", {
+            {"importer", db_one_list_subscription::IncrementalDBTableImporterFactory<M>::createImporter<test_data>(
+                session
+                , "test_table"
+                , "name"
+            )}
+            , {"print", [&env](db_one_list_subscription::DBTableChanges<test_data> &&x) {
+                std::ostringstream oss;
+                oss << "============================= " << (x.isSnapshot?"snapshot":"changes") << " up to log entry " << x.lastSeq;
+                env.log(infra::LogLevel::Info, oss.str());
+                for (auto const &r : x.upserts) {
+                    oss.str("");
+                    oss << r;
+                    env.log(infra::LogLevel::Info, oss.str());
+                }
+                for (auto const &k : x.deletedKeys) {
+                    env.log(infra::LogLevel::Info, "deleted "+k);
+                }
+            }}
+            , {"importer", "print"}
+        })(r);
+        r.finalize();
+        infra::terminationController(infra::RunForever {});
     } else if (std::string_view(argv[2]) == "exporter") {
         Env env; 
         R r(&env);
@@ -185,6 +228,45 @@ int main(int argc, char **argv) {
             {"test1", 1, basic::FixedPrecisionShortDecimal<4> {1.2}, std::chrono::system_clock::now(), basic::TimePointAsString<basic::time_zone_spec::Local> {infra::withtime_utils::parseLocalTime("2023-01-01T10:00:01.123456")}}
             , {"test2", 2, basic::FixedPrecisionShortDecimal<4> {2.3}, std::chrono::system_clock::now(), basic::TimePointAsString<basic::time_zone_spec::Local> {infra::withtime_utils::parseLocalTime("2023-01-01T11:00:02.234567")}}
         });
+    } else if (std::string_view(argv[2]) == "exporter-bench") {
+        std::size_t count = (argc > 3)?std::stoul(argv[3]):100000;
+        db_one_list_subscription::BulkDBTableExporterConfig config;
+        if (argc > 4) {
+            config.batchSize = std::stoul(argv[4]);
+        }
+        //upsert needs a unique constraint on name
+        if (argc > 5 && std::string_view(argv[5]) == "upsert") {
+            config.upsertKeyColumns = {"name"};
+        }
+
+        (*session) << "DELETE FROM test_table WHERE name LIKE 'bench_%'";
+        {
+            Env env;
+            SR r(&env);
+            auto ex = transport::db_table_importer_exporter::DBTableExporterFactory<M>::createExporter<test_data>(session, "test_table");
+            auto rows = benchRows(count);
+            auto start = std::chrono::steady_clock::now();
+            for (auto &&x : rows) {
+                r.exportItem(ex, std::move(x));
+            }
+            reportRate("DBTableExporterFactory::createExporter", count, start);
+        }
+
+        (*session) << "DELETE FROM test_table WHERE name LIKE 'bench_%'";
+        {
+            db_one_list_subscription::BulkDBTableWriter<test_data> writer(session, "test_table", config);
+            auto rows = benchRows(count);
+            auto start = std::chrono::steady_clock::now();
+            for (auto &&x : rows) {
+                writer.push(std::move(x));
+            }
+            writer.flush();
+            reportRate("BulkDBTableWriter (batch size "+std::to_string(config.batchSize)+")", writer.writtenCount(), start);
+            if (writer.failedCount() > 0) {
+                std::cerr << writer.failedCount() << " rows failed\n";
+                return 1;
+            }
+        }
     }
     return 0;
 }
\ No newline at end of file
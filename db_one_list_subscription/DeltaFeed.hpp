@@ -0,0 +1,341 @@
+#ifndef DELTA_FEED_HPP_
+#define DELTA_FEED_HPP_
+
+#include "DBData.hpp"
+
+#include <tm_kit/infra/RealTimeApp.hpp>
+#include <tm_kit/basic/ByteData.hpp>
+#include <tm_kit/basic/SerializationHelperMacros.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Versioned, paged feed of test_table for clients that cannot afford the
+//full snapshot that the named_value_store subscription sends on every
+//(re)subscription.
+//
+//A client sends a DeltaFeedRequest with the last global version it has
+//seen (or -1 if it has nothing). If that version is still covered by the
+//in-memory delta log, it only gets the net changes since then, otherwise
+//it gets the full table at the current version. Either way the initial
+//content is split into pages of at most pageSize rows, all carrying the
+//same globalVersion, with lastPage set on the last one. After that every
+//committed transaction is streamed to the client as one (non-paged) delta
+//message, until the client sends a request with unsubscribeID set to the
+//ID of its subscription request.
+//
+//Versions restart from the database on every server start, so each server
+//instance has its own epoch, sent with every update. A client resumes by
+//sending back the epoch together with its version; a request from another
+//epoch gets the full table.
+//
+//A subscription is a lease: unless the client sends a request with
+//renewID set to the ID of its subscription request at least once per
+//lease, the subscription is ended (with a final, empty update) so that
+//clients that went away without unsubscribing do not pile up. A renewal
+//is answered with the current version, or with globalVersion -1 if the
+//subscription is gone and the client has to subscribe again.
+namespace db_one_list_subscription {
+
+    #define DeltaFeedRowFields \
+        ((std::string, name)) \
+        ((db_one_list_subscription::db_data, data))
+    #define DeltaFeedRequestFields \
+        ((std::string, epoch)) \
+        ((int64_t, sinceVersion)) \
+        ((uint32_t, pageSize)) \
+        ((std::string, unsubscribeID)) \
+        ((std::string, renewID))
+    #define DeltaFeedUpdateFields \
+        ((std::string, epoch)) \
+        ((int64_t, globalVersion)) \
+        ((bool, isSnapshot)) \
+        ((bool, lastPage)) \
+        ((std::vector<db_one_list_subscription::DeltaFeedRow>, upserts)) \
+        ((std::vector<std::string>, deletes))
+
+    TM_BASIC_CBOR_CAPABLE_STRUCT(DeltaFeedRow, DeltaFeedRowFields);
+    TM_BASIC_CBOR_CAPABLE_STRUCT(DeltaFeedRequest, DeltaFeedRequestFields);
+    TM_BASIC_CBOR_CAPABLE_STRUCT(DeltaFeedUpdate, DeltaFeedUpdateFields);
+
+    //Keeps the current table and the deltas of the last maxEntries versions.
+    //DataDelta is the named_value_store delta type (deletes plus
+    //inserts_updates).
+    template <class DataDelta>
+    class DeltaLog {
+    public:
+        using Sink = std::function<void(DeltaFeedUpdate &&, bool)>;
+    private:
+        struct Entry {
+            int64_t version;
+            DataDelta delta;
+        };
+        struct Subscriber {
+            Sink sink;
+            std::chrono::steady_clock::time_point expiresAt;
+        };
+        std::string epoch_;
+        std::size_t maxEntries_;
+        std::size_t defaultPageSize_;
+        //zero means subscriptions never expire
+        std::chrono::steady_clock::duration lease_;
+        std::mutex mutex_;
+        int64_t version_;
+        //deltas after this version are all in entries_
+        int64_t oldestResumableVersion_;
+        std::map<std::string, db_data> table_;
+        std::deque<Entry> entries_;
+        std::unordered_map<std::string, Subscriber> subscribers_;
+
+        std::size_t pageSizeFor(uint32_t requested) const {
+            return std::max<std::size_t>((requested == 0)?defaultPageSize_:requested, 1);
+        }
+        DeltaFeedUpdate emptyUpdate(bool lastPage) const {
+            return DeltaFeedUpdate {epoch_, version_, false, lastPage, {}, {}};
+        }
+        std::chrono::steady_clock::time_point leaseEnd() const {
+            if (lease_ == std::chrono::steady_clock::duration::zero()) {
+                return std::chrono::steady_clock::time_point::max();
+            }
+            return std::chrono::steady_clock::now()+lease_;
+        }
+        //called with mutex_ held
+        void expireSubscribers() {
+            if (lease_ == std::chrono::steady_clock::duration::zero()) {
+                return;
+            }
+            auto now = std::chrono::steady_clock::now();
+            for (auto iter = subscribers_.begin(); iter != subscribers_.end(); ) {
+                if (iter->second.expiresAt < now) {
+                    iter->second.sink(emptyUpdate(true), true);
+                    iter = subscribers_.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+        }
+        //all pages but the last go out as soon as they are full
+        void sendPaged(
+            Sink const &sink, bool isSnapshot, std::size_t pageSize
+            , std::vector<DeltaFeedRow> &&upserts, std::vector<std::string> &&deletes
+        ) {
+            DeltaFeedUpdate page {epoch_, version_, isSnapshot, false, {}, {}};
+            auto flushIfFull = [&]() {
+                if (page.upserts.size()+page.deletes.size() >= pageSize) {
+                    sink(std::move(page), false);
+                    page = DeltaFeedUpdate {epoch_, version_, isSnapshot, false, {}, {}};
+                }
+            };
+            for (auto &d : deletes) {
+                page.deletes.push_back(std::move(d));
+                flushIfFull();
+            }
+            for (auto &u : upserts) {
+                page.upserts.push_back(std::move(u));
+                flushIfFull();
+            }
+            page.lastPage = true;
+            sink(std::move(page), false);
+        }
+    public:
+        DeltaLog(
+            std::string const &epoch
+            , std::size_t maxEntries
+            , std::size_t defaultPageSize
+            , std::chrono::steady_clock::duration lease = std::chrono::steady_clock::duration::zero()
+        )
+            : epoch_(epoch), maxEntries_(maxEntries), defaultPageSize_(defaultPageSize), lease_(lease), mutex_()
+            , version_(0), oldestResumableVersion_(0), table_(), entries_(), subscribers_()
+        {}
+        DeltaLog(DeltaLog const &) = delete;
+        DeltaLog &operator=(DeltaLog const &) = delete;
+
+        template <class Collection>
+        void reset(int64_t version, Collection const &table) {
+            std::lock_guard<std::mutex> _(mutex_);
+            version_ = version;
+            oldestResumableVersion_ = version;
+            table_.clear();
+            for (auto const &item : table) {
+                table_.insert({item.first, item.second});
+            }
+            entries_.clear();
+        }
+        //must be called in version order, which holds since the transaction
+        //handler runs them one at a time
+        void append(int64_t version, DataDelta const &delta) {
+            std::lock_guard<std::mutex> _(mutex_);
+            for (auto const &name : delta.deletes) {
+                table_.erase(name);
+            }
+            for (auto const &item : delta.inserts_updates) {
+                table_[std::get<0>(item)] = std::get<1>(item);
+            }
+            version_ = version;
+            entries_.push_back(Entry {version, delta});
+            while (entries_.size() > maxEntries_) {
+                oldestResumableVersion_ = entries_.front().version;
+                entries_.pop_front();
+            }
+            expireSubscribers();
+            if (subscribers_.empty()) {
+                return;
+            }
+            DeltaFeedUpdate update {epoch_, version, false, true, {}, delta.deletes};
+            update.upserts.reserve(delta.inserts_updates.size());
+            for (auto const &item : delta.inserts_updates) {
+                update.upserts.push_back(DeltaFeedRow {std::get<0>(item), std::get<1>(item)});
+            }
+            for (auto const &s : subscribers_) {
+                s.second.sink(DeltaFeedUpdate {update}, false);
+            }
+        }
+        //Sends the initial pages and registers the sink for live deltas in
+        //one step, so the subscriber neither misses nor repeats a version
+        void subscribe(std::string const &id, DeltaFeedRequest const &req, Sink const &sink) {
+            std::lock_guard<std::mutex> _(mutex_);
+            expireSubscribers();
+            auto pageSize = pageSizeFor(req.pageSize);
+            if (req.epoch == epoch_ && req.sinceVersion >= oldestResumableVersion_ && req.sinceVersion <= version_) {
+                //net effect per name of every delta after sinceVersion
+                std::map<std::string, bool> touched;
+                for (auto const &e : entries_) {
+                    if (e.version <= req.sinceVersion) {
+                        continue;
+                    }
+                    for (auto const &name : e.delta.deletes) {
+                        touched[name] = true;
+                    }
+                    for (auto const &item : e.delta.inserts_updates) {
+                        touched[std::get<0>(item)] = true;
+                    }
+                }
+                std::vector<DeltaFeedRow> upserts;
+                std::vector<std::string> deletes;
+                for (auto const &t : touched) {
+                    auto iter = table_.find(t.first);
+                    if (iter == table_.end()) {
+                        deletes.push_back(t.first);
+                    } else {
+                        upserts.push_back(DeltaFeedRow {iter->first, iter->second});
+                    }
+                }
+                sendPaged(sink, false, pageSize, std::move(upserts), std::move(deletes));
+            } else {
+                std::vector<DeltaFeedRow> rows;
+                rows.reserve(table_.size());
+                for (auto const &item : table_) {
+                    rows.push_back(DeltaFeedRow {item.first, item.second});
+                }
+                sendPaged(sink, true, pageSize, std::move(rows), {});
+            }
+            subscribers_[id] = Subscriber {sink, leaseEnd()};
+        }
+        //returns false if there is no such (unexpired) subscription
+        bool renew(std::string const &id) {
+            std::lock_guard<std::mutex> _(mutex_);
+            expireSubscribers();
+            auto iter = subscribers_.find(id);
+            if (iter == subscribers_.end()) {
+                return false;
+            }
+            iter->second.expiresAt = leaseEnd();
+            return true;
+        }
+        //returns the removed subscriber's sink so the caller can close it
+        std::optional<Sink> unsubscribe(std::string const &id) {
+            std::lock_guard<std::mutex> _(mutex_);
+            auto iter = subscribers_.find(id);
+            if (iter == subscribers_.end()) {
+                return std::nullopt;
+            }
+            auto sink = std::move(iter->second.sink);
+            subscribers_.erase(iter);
+            return sink;
+        }
+        //an update with no rows at the current version
+        DeltaFeedUpdate currentEmptyUpdate() {
+            std::lock_guard<std::mutex> _(mutex_);
+            return emptyUpdate(true);
+        }
+    };
+
+    template <class Env, class DataDelta>
+    class DeltaFeedFacility :
+        public infra::RealTimeApp<Env>::IExternalComponent
+        , public infra::RealTimeApp<Env>::template AbstractOnOrderFacility<DeltaFeedRequest, DeltaFeedUpdate>
+    {
+    private:
+        Env *env_;
+        std::shared_ptr<DeltaLog<DataDelta>> log_;
+    public:
+        DeltaFeedFacility(std::shared_ptr<DeltaLog<DataDelta>> const &log) : env_(nullptr), log_(log) {}
+        virtual ~DeltaFeedFacility() {}
+        virtual void start(Env *env) override final {
+            env_ = env;
+        }
+        virtual void handle(typename infra::RealTimeApp<Env>::template InnerData<
+            typename infra::RealTimeApp<Env>::template Key<DeltaFeedRequest>
+        > &&input) override final {
+            auto id = input.timedData.value.id();
+            auto const &req = input.timedData.value.key();
+            if (!req.unsubscribeID.empty()) {
+                auto sink = log_->unsubscribe(req.unsubscribeID);
+                if (sink) {
+                    (*sink)(log_->currentEmptyUpdate(), true);
+                }
+                this->publish(
+                    env_
+                    , typename infra::RealTimeApp<Env>::template Key<DeltaFeedUpdate> {
+                        id, log_->currentEmptyUpdate()
+                    }
+                    , true
+                );
+                return;
+            }
+            if (!req.renewID.empty()) {
+                auto ack = log_->currentEmptyUpdate();
+                if (!log_->renew(req.renewID)) {
+                    ack.globalVersion = -1;
+                }
+                this->publish(
+                    env_
+                    , typename infra::RealTimeApp<Env>::template Key<DeltaFeedUpdate> {
+                        id, std::move(ack)
+                    }
+                    , true
+                );
+                return;
+            }
+            log_->subscribe(
+                Env::id_to_string(id)
+                , req
+                , [this,id](DeltaFeedUpdate &&update, bool isFinal) {
+                    this->publish(
+                        env_
+                        , typename infra::RealTimeApp<Env>::template Key<DeltaFeedUpdate> {
+                            id, std::move(update)
+                        }
+                        , isFinal
+                    );
+                }
+            );
+        }
+    };
+
+}
+
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(db_one_list_subscription::DeltaFeedRow, DeltaFeedRowFields);
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(db_one_list_subscription::DeltaFeedRequest, DeltaFeedRequestFields);
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(db_one_list_subscription::DeltaFeedUpdate, DeltaFeedUpdateFields);
+
+#endif
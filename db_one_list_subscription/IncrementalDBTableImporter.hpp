@@ -0,0 +1,358 @@
+#ifndef INCREMENTAL_DB_TABLE_IMPORTER_HPP_
+#define INCREMENTAL_DB_TABLE_IMPORTER_HPP_
+
+#include <tm_kit/infra/ChronoUtils.hpp>
+#include <tm_kit/infra/RealTimeApp.hpp>
+#include <tm_kit/basic/StructFieldInfoHelper.hpp>
+
+#include <soci/soci.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//Change-data-capture replacement for
+//DBTableImporterFactory::createRepeatedImporterWithKeyCheck on SQLite.
+//
+//Instead of re-reading the whole table every period, the importer installs
+//triggers that append (key, deleted) to "<table>_cdc_log" on every insert,
+//update and delete, whoever the writer is. Each poll reads the log entries
+//after the last one it has seen, re-reads only the rows whose keys
+//changed, and emits them together with the keys that are gone, so the
+//cost of a poll follows the change rate instead of the table size. The
+//first output is a snapshot of the whole table.
+//
+//The log is trimmed to the last logRetentionEntries entries on every poll
+//(and to nothing beyond what this importer has read, with
+//pruneConsumedLog). A reader that falls behind the trimmed log gets a new
+//snapshot instead of the changes it missed. The triggers stay until
+//uninstall() is called, so a table that is no longer imported should be
+//uninstalled, or its writers keep paying for the log.
+//
+//The columns are the fields of T, in order. Integral, floating point,
+//string and time point fields (stored as local time strings) are read
+//directly, and other fields must be constructible from a time point
+//(e.g. TimePointAsString) or from a double (e.g. FixedPrecisionShortDecimal).
+namespace db_one_list_subscription {
+
+    template <class T>
+    struct DBTableChanges {
+        //sequence number of the last change log entry included
+        int64_t lastSeq;
+        bool isSnapshot;
+        std::vector<T> upserts;
+        std::vector<std::string> deletedKeys;
+    };
+
+    struct IncrementalDBTableImporterConfig {
+        std::chrono::system_clock::duration pollPeriod = std::chrono::seconds(1);
+        //at most this many log entries per poll, the rest is picked up
+        //by the next poll
+        std::size_t maxLogEntriesPerPoll = 100000;
+        //delete the log entries this importer has read; only safe when it
+        //is the only reader of the log
+        bool pruneConsumedLog = false;
+        //keep at most this many entries in the log (0: no limit)
+        std::size_t logRetentionEntries = 1000000;
+    };
+
+    namespace incremental_importer_detail {
+        inline bool isNull(soci::row const &r, std::size_t i) {
+            return r.get_indicator(i) == soci::i_null;
+        }
+        inline std::string cellAsString(soci::row const &r, std::size_t i) {
+            if (isNull(r, i)) {
+                return "";
+            }
+            switch (r.get_properties(i).get_data_type()) {
+            case soci::dt_string:
+                return r.get<std::string>(i);
+            case soci::dt_double:
+                return std::to_string(r.get<double>(i));
+            case soci::dt_integer:
+                return std::to_string(r.get<int>(i));
+            case soci::dt_long_long:
+                return std::to_string(r.get<long long>(i));
+            case soci::dt_unsigned_long_long:
+                return std::to_string(r.get<unsigned long long>(i));
+            default:
+                return "";
+            }
+        }
+        inline double cellAsDouble(soci::row const &r, std::size_t i) {
+            if (isNull(r, i)) {
+                return 0.0;
+            }
+            switch (r.get_properties(i).get_data_type()) {
+            case soci::dt_double:
+                return r.get<double>(i);
+            case soci::dt_integer:
+                return (double) r.get<int>(i);
+            case soci::dt_long_long:
+                return (double) r.get<long long>(i);
+            case soci::dt_unsigned_long_long:
+                return (double) r.get<unsigned long long>(i);
+            case soci::dt_string:
+                return std::stod(r.get<std::string>(i));
+            default:
+                return 0.0;
+            }
+        }
+        inline long long cellAsInteger(soci::row const &r, std::size_t i) {
+            if (isNull(r, i)) {
+                return 0;
+            }
+            switch (r.get_properties(i).get_data_type()) {
+            case soci::dt_integer:
+                return r.get<int>(i);
+            case soci::dt_long_long:
+                return r.get<long long>(i);
+            case soci::dt_unsigned_long_long:
+                return (long long) r.get<unsigned long long>(i);
+            case soci::dt_double:
+                return (long long) r.get<double>(i);
+            case soci::dt_string:
+                return std::stoll(r.get<std::string>(i));
+            default:
+                return 0;
+            }
+        }
+        template <class F>
+        F cellAs(soci::row const &r, std::size_t i) {
+            if constexpr (std::is_same_v<F, std::string>) {
+                return cellAsString(r, i);
+            } else if constexpr (std::is_same_v<F, bool>) {
+                return cellAsInteger(r, i) != 0;
+            } else if constexpr (std::is_integral_v<F>) {
+                return (F) cellAsInteger(r, i);
+            } else if constexpr (std::is_floating_point_v<F>) {
+                return (F) cellAsDouble(r, i);
+            } else if constexpr (std::is_same_v<F, std::chrono::system_clock::time_point>) {
+                return dev::cd606::tm::infra::withtime_utils::parseLocalTime(cellAsString(r, i));
+            } else if constexpr (std::is_constructible_v<F, std::chrono::system_clock::time_point>) {
+                return F {dev::cd606::tm::infra::withtime_utils::parseLocalTime(cellAsString(r, i))};
+            } else if constexpr (std::is_constructible_v<F, double>) {
+                return F {cellAsDouble(r, i)};
+            } else {
+                static_assert(std::is_constructible_v<F, double>, "IncrementalDBTableImporter cannot read this field type");
+            }
+        }
+        template <class T, std::size_t... Is>
+        T rowAs(soci::row const &r, std::index_sequence<Is...>) {
+            T t;
+            ((dev::cd606::tm::basic::StructFieldTypeInfo<T, Is>::access(t)
+                = cellAs<typename dev::cd606::tm::basic::StructFieldTypeInfo<T, Is>::TheType>(r, Is)), ...);
+            return t;
+        }
+    }
+
+    //Does the work of one importer; usable directly for synchronous polling
+    template <class T>
+    class IncrementalDBTableReader {
+    private:
+        static constexpr std::size_t FieldCount = dev::cd606::tm::basic::StructFieldInfo<T>::FIELD_NAMES.size();
+
+        std::shared_ptr<soci::session> session_;
+        std::string table_;
+        std::string keyColumn_;
+        std::string logTable_;
+        std::string columns_;
+        IncrementalDBTableImporterConfig config_;
+        int64_t lastSeq_;
+        bool snapshotDone_;
+
+        T rowAs(soci::row const &r) const {
+            return incremental_importer_detail::rowAs<T>(r, std::make_index_sequence<FieldCount> {});
+        }
+        //the highest seq ever handed out, which AUTOINCREMENT keeps in
+        //sqlite_sequence; MAX(seq) would go back to 0 once the log has been
+        //trimmed empty, and the next poll would take the new entries for a gap
+        int64_t currentSeq() {
+            long long seq = 0;
+            soci::indicator ind = soci::i_null;
+            (*session_) << "SELECT seq FROM sqlite_sequence WHERE name = :name"
+                , soci::use(logTable_, "name"), soci::into(seq, ind);
+            return (session_->got_data() && ind != soci::i_null)?(int64_t) seq:0;
+        }
+        //true if entries after lastSeq_ have been trimmed away
+        bool fellBehind() {
+            long long seq = 0;
+            soci::indicator ind;
+            (*session_) << ("SELECT MIN(seq) FROM "+logTable_), soci::into(seq, ind);
+            return (ind != soci::i_null && (int64_t) seq > lastSeq_+1);
+        }
+        void trimLog(int64_t consumedSeq) {
+            long long upTo = 0;
+            if (config_.pruneConsumedLog) {
+                upTo = consumedSeq;
+            }
+            if (config_.logRetentionEntries > 0) {
+                upTo = std::max<long long>(upTo, (long long) currentSeq()-(long long) config_.logRetentionEntries);
+            }
+            if (upTo > 0) {
+                (*session_) << ("DELETE FROM "+logTable_+" WHERE seq <= :upTo"), soci::use(upTo, "upTo");
+            }
+        }
+        DBTableChanges<T> snapshot() {
+            DBTableChanges<T> ret {0, true, {}, {}};
+            soci::transaction tx(*session_);
+            ret.lastSeq = currentSeq();
+            soci::rowset<soci::row> rows = session_->prepare << ("SELECT "+columns_+" FROM "+table_);
+            for (auto const &r : rows) {
+                ret.upserts.push_back(rowAs(r));
+            }
+            tx.commit();
+            lastSeq_ = ret.lastSeq;
+            snapshotDone_ = true;
+            return ret;
+        }
+    public:
+        IncrementalDBTableReader(
+            std::shared_ptr<soci::session> const &session
+            , std::string const &table
+            , std::string const &keyColumn
+            , IncrementalDBTableImporterConfig const &config = IncrementalDBTableImporterConfig {}
+        ) : session_(session), table_(table), keyColumn_(keyColumn), logTable_(table+"_cdc_log")
+            , columns_(), config_(config), lastSeq_(0), snapshotDone_(false)
+        {
+            auto const &names = dev::cd606::tm::basic::StructFieldInfo<T>::FIELD_NAMES;
+            std::ostringstream oss;
+            for (std::size_t ii=0; ii<FieldCount; ++ii) {
+                oss << ((ii>0)?",":"") << names[ii];
+            }
+            columns_ = oss.str();
+        }
+        //Creates the log table and the triggers if they are not there yet.
+        //Changes made before this are only covered by the first snapshot.
+        void install() {
+            auto const &k = keyColumn_;
+            (*session_) << ("CREATE TABLE IF NOT EXISTS "+logTable_
+                +"(seq INTEGER PRIMARY KEY AUTOINCREMENT, key TEXT NOT NULL, deleted INTEGER NOT NULL)");
+            (*session_) << ("CREATE TRIGGER IF NOT EXISTS "+table_+"_cdc_insert AFTER INSERT ON "+table_
+                +" BEGIN INSERT INTO "+logTable_+"(key, deleted) VALUES (NEW."+k+", 0); END");
+            //a changed key is a delete of the old key plus an insert of the new one
+            (*session_) << ("CREATE TRIGGER IF NOT EXISTS "+table_+"_cdc_update AFTER UPDATE ON "+table_
+                +" BEGIN INSERT INTO "+logTable_+"(key, deleted) SELECT OLD."+k+", 1 WHERE OLD."+k+" IS NOT NEW."+k+";"
+                +" INSERT INTO "+logTable_+"(key, deleted) VALUES (NEW."+k+", 0); END");
+            (*session_) << ("CREATE TRIGGER IF NOT EXISTS "+table_+"_cdc_delete AFTER DELETE ON "+table_
+                +" BEGIN INSERT INTO "+logTable_+"(key, deleted) VALUES (OLD."+k+", 1); END");
+        }
+        //Drops the triggers and the log; other importers of the same table
+        //lose their change feed too
+        void uninstall() {
+            (*session_) << ("DROP TRIGGER IF EXISTS "+table_+"_cdc_insert");
+            (*session_) << ("DROP TRIGGER IF EXISTS "+table_+"_cdc_update");
+            (*session_) << ("DROP TRIGGER IF EXISTS "+table_+"_cdc_delete");
+            (*session_) << ("DROP TABLE IF EXISTS "+logTable_);
+        }
+        //The first call returns the whole table, later calls only what
+        //changed since the previous call (std::nullopt if nothing did), or
+        //the whole table again if the log no longer covers the previous
+        //call. Throws soci::soci_error (e.g. on SQLITE_BUSY) with the read
+        //transaction rolled back, so the call can simply be retried.
+        std::optional<DBTableChanges<T>> poll() {
+            if (!snapshotDone_) {
+                return snapshot();
+            }
+
+            //the net effect per key: only whether it exists at the end matters
+            std::map<std::string, bool> touched;
+            int64_t newLastSeq = lastSeq_;
+            //rolls back in its destructor unless committed
+            soci::transaction tx(*session_);
+            if (fellBehind()) {
+                tx.rollback();
+                return snapshot();
+            }
+            {
+                long long since = lastSeq_;
+                long long limit = (long long) config_.maxLogEntriesPerPoll;
+                soci::rowset<soci::row> log = (session_->prepare
+                    << ("SELECT seq, key FROM "+logTable_+" WHERE seq > :since ORDER BY seq LIMIT :lim")
+                    , soci::use(since, "since"), soci::use(limit, "lim"));
+                for (auto const &r : log) {
+                    newLastSeq = (int64_t) incremental_importer_detail::cellAsInteger(r, 0);
+                    touched[incremental_importer_detail::cellAsString(r, 1)] = true;
+                }
+            }
+            if (touched.empty()) {
+                trimLog(lastSeq_);
+                tx.commit();
+                return std::nullopt;
+            }
+            DBTableChanges<T> ret {newLastSeq, false, {}, {}};
+            std::string key;
+            for (auto const &t : touched) {
+                key = t.first;
+                bool found = false;
+                soci::rowset<soci::row> rows = (session_->prepare
+                    << ("SELECT "+columns_+" FROM "+table_+" WHERE "+keyColumn_+" = :k")
+                    , soci::use(key, "k"));
+                for (auto const &r : rows) {
+                    ret.upserts.push_back(rowAs(r));
+                    found = true;
+                }
+                if (!found) {
+                    ret.deletedKeys.push_back(t.first);
+                }
+            }
+            trimLog(newLastSeq);
+            tx.commit();
+            lastSeq_ = newLastSeq;
+            return ret;
+        }
+    };
+
+    template <class M>
+    class IncrementalDBTableImporterFactory {
+    public:
+        //Polls every config.pollPeriod on its own thread and publishes
+        //only non-empty changes (plus the initial snapshot). A failed poll
+        //(e.g. the database is locked by a writer) is reported to
+        //errorLogger and retried in the next period.
+        template <class T>
+        static auto createImporter(
+            std::shared_ptr<soci::session> const &session
+            , std::string const &table
+            , std::string const &keyColumn
+            , IncrementalDBTableImporterConfig const &config = IncrementalDBTableImporterConfig {}
+            , std::function<void(std::string const &)> const &errorLogger = [](std::string const &s) {
+                std::cerr << s << '\n';
+            }
+        ) {
+            auto reader = std::make_shared<IncrementalDBTableReader<T>>(session, table, keyColumn, config);
+            reader->install();
+            return M::template simpleImporter<DBTableChanges<T>>(
+                [reader,period=config.pollPeriod,table,errorLogger](typename M::template PublisherCall<DBTableChanges<T>> &p) {
+                    while (true) {
+                        std::optional<DBTableChanges<T>> changes;
+                        try {
+                            changes = reader->poll();
+                        } catch (soci::soci_error const &ex) {
+                            errorLogger("[IncrementalDBTableImporter] poll of "+table+" failed, retrying: "+ex.what());
+                        }
+                        if (changes) {
+                            p(std::move(*changes));
+                        }
+                        std::this_thread::sleep_for(period);
+                    }
+                }
+                , dev::cd606::tm::infra::LiftParameters<std::chrono::system_clock::time_point>()
+                    .SuggestThreaded(true)
+            );
+        }
+    };
+
+}
+
+#endif
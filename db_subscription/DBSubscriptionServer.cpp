@@ -24,6 +24,14 @@
 #include <boost/program_options.hpp>
 
 #include <iostream>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <variant>
 
 using namespace dev::cd606::tm;
 using namespace db_subscription;
@@ -95,12 +103,38 @@ public:
     }
 };
 
+//The statements used by THComponent, prepared once. The bound values are
+//members, so a request only copies its values in and executes.
+struct PreparedStatements {
+    std::string name;
+    int value1;
+    std::string value2;
+    soci::statement insertStmt;
+    soci::statement updateStmt;
+    soci::statement deleteStmt;
+
+    PreparedStatements(soci::session &session)
+        : name(), value1(0), value2()
+        , insertStmt((session.prepare << "INSERT INTO test_table(name, value1, value2) VALUES(:name, :val1, :val2)"
+                        , soci::use(name, "name")
+                        , soci::use(value1, "val1")
+                        , soci::use(value2, "val2")))
+        , updateStmt((session.prepare << "UPDATE test_table SET value1 = :val1, value2 = :val2 WHERE name = :name"
+                        , soci::use(name, "name")
+                        , soci::use(value1, "val1")
+                        , soci::use(value2, "val2")))
+        , deleteStmt((session.prepare << "DELETE FROM test_table WHERE name = :name"
+                        , soci::use(name, "name")))
+    {}
+};
+
 class THComponent : public basic::transaction::v2::TransactionEnvComponent<TI> {
 private:
     std::shared_ptr<soci::session> session_;
     std::function<void(std::string)> logger_;
     std::atomic<int64_t> globalVersion_;
     DSComponent *dsComponent_;
+    std::shared_ptr<PreparedStatements> statements_;
 
     void triggerCallback(TI::TransactionResponse const &resp, TI::Key const &key, std::optional<TI::Data> const &data) {
         dsComponent_->callback()->onUpdate(DI::Update {
@@ -115,17 +149,21 @@ private:
         });
     }
 public:
-    THComponent() : session_(), logger_(), globalVersion_(0), dsComponent_(nullptr) {
+    THComponent() : session_(), logger_(), globalVersion_(0), dsComponent_(nullptr), statements_() {
     }
-    THComponent(std::shared_ptr<soci::session> const &session, std::function<void(std::string)> const &logger, DSComponent *dsComponent) : session_(session), logger_(logger), globalVersion_(0), dsComponent_(dsComponent) {
+    THComponent(std::shared_ptr<soci::session> const &session, std::function<void(std::string)> const &logger, DSComponent *dsComponent)
+        : session_(session), logger_(logger), globalVersion_(0), dsComponent_(dsComponent)
+        , statements_(session?std::make_shared<PreparedStatements>(*session):nullptr)
+    {
     }
-    THComponent(THComponent &&c) : session_(std::move(c.session_)), logger_(std::move(c.logger_)), globalVersion_(c.globalVersion_.load()), dsComponent_(c.dsComponent_) {}
+    THComponent(THComponent &&c) : session_(std::move(c.session_)), logger_(std::move(c.logger_)), globalVersion_(c.globalVersion_.load()), dsComponent_(c.dsComponent_), statements_(std::move(c.statements_)) {}
     THComponent &operator=(THComponent &&c) {
         if (this != &c) {
             session_ = std::move(c.session_);
             logger_ = std::move(c.logger_);
             globalVersion_ = c.globalVersion_.load();
             dsComponent_ = c.dsComponent_;
+            statements_ = std::move(c.statements_);
         }
         return *this;
     }
@@ -145,10 +183,10 @@ public:
     }
     TI::TransactionResponse handleInsert(std::string const &account, TI::Key const &key, TI::Data const &data) override final {
         if (session_) {
-            (*session_) << "INSERT INTO test_table(name, value1, value2) VALUES(:name, :val1, :val2)"
-                        , soci::use(key, "name")
-                        , soci::use(data.value1(), "val1")
-                        , soci::use(data.value2(), "val2");
+            statements_->name = key;
+            statements_->value1 = data.value1();
+            statements_->value2 = data.value2();
+            statements_->insertStmt.execute(true);
             TI::TransactionResponse resp {++globalVersion_, basic::transaction::v2::RequestDecision::Success};
             triggerCallback(resp, key, data);
             return resp;
@@ -158,10 +196,10 @@ public:
     }
     TI::TransactionResponse handleUpdate(std::string const &account, TI::Key const &key, std::optional<TI::VersionSlice> const &updateVersionSlice, TI::ProcessedUpdate const &processedUpdate) override final {
         if (session_) {
-            (*session_) << "UPDATE test_table SET value1 = :val1, value2 = :val2 WHERE name = :name"
-                        , soci::use(key, "name")
-                        , soci::use(processedUpdate.value1(), "val1")
-                        , soci::use(processedUpdate.value2(), "val2");
+            statements_->name = key;
+            statements_->value1 = processedUpdate.value1();
+            statements_->value2 = processedUpdate.value2();
+            statements_->updateStmt.execute(true);
             TI::TransactionResponse resp {++globalVersion_, basic::transaction::v2::RequestDecision::Success};
             triggerCallback(resp, key, processedUpdate);
             return resp;
@@ -171,8 +209,8 @@ public:
     }
     TI::TransactionResponse handleDelete(std::string const &account, TI::Key const &key, std::optional<TI::Version> const &versionToDelete) override final {
         if (session_) {
-            (*session_) << "DELETE FROM test_table WHERE name = :name"
-                        , soci::use(key, "name");
+            statements_->name = key;
+            statements_->deleteStmt.execute(true);
             TI::TransactionResponse resp {++globalVersion_, basic::transaction::v2::RequestDecision::Success};
             triggerCallback(resp, key, std::nullopt);
             return resp;
@@ -182,6 +220,384 @@ public:
     }
 };
 
+//Transaction facility with group commit: instead of a BEGIN/COMMIT (and so
+//an fsync) per request, the row changes of many requests are written in
+//one SQLite transaction.
+//
+//The keys are split over shardCount shards by hash. Each shard owns its
+//partition of test_table (key -> version, data), a queue and a worker
+//thread, and checks and applies its requests in memory in parallel with
+//the other shards (later requests are checked against earlier ones, even
+//before those are committed). The row changes collect in the shard's
+//pending list. One committer thread takes the pending lists of all shards
+//once the oldest change is window old (or maxRequests changes are
+//waiting, or as soon as it is free when window is zero), writes them in
+//one transaction and only after COMMIT succeeds publishes the updates, in
+//version order, and sends the responses. If the group cannot be committed,
+//every request in it, and every request applied on top of it since, is
+//answered with FailureConsistency and the shards are rolled back. Requests
+//that fail their checks are answered right away.
+//
+//This does not make the SQLite writes parallel: there is one session and
+//one committer, and a group is written by a single thread. What scales
+//with the shards is the checking and applying; the write cost is cut by
+//batching instead, so throughput is bounded by how many rows one
+//transaction can write per window.
+//
+//Like the transaction facility from transactionLogicCombination, the input
+//carries the account that the identity checker attached to the request.
+template <class Env>
+class GroupCommitTransactionFacility :
+    public infra::RealTimeApp<Env>::IExternalComponent
+    , public infra::RealTimeApp<Env>::template AbstractOnOrderFacility<std::tuple<std::string, TI::Transaction>, TI::TransactionResponse>
+{
+private:
+    struct Row {
+        int64_t version;
+        db_data data;
+    };
+    struct Op {
+        typename Env::IDType id;
+        std::string account;
+        std::string key;
+        int64_t version;
+        //std::nullopt for a delete
+        std::optional<db_data> data;
+        bool isInsert;
+        //what to put back on rollback, std::nullopt if the key was absent
+        std::optional<Row> before;
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::condition_variable cond;
+        //(id, account, transaction)
+        std::deque<std::tuple<typename Env::IDType, std::string, TI::Transaction>> queue;
+        bool stopping = false;
+        //data and pending are written by the shard thread under a shared
+        //lock of groupMutex_, and by the committer under an exclusive one
+        std::unordered_map<std::string, Row> data;
+        std::vector<Op> pending;
+        std::thread thread;
+    };
+
+    Env *env_;
+    std::shared_ptr<soci::session> session_;
+    DSComponent *dsComponent_;
+    std::unique_ptr<PreparedStatements> statements_;
+    std::chrono::milliseconds window_;
+    std::size_t maxRequests_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::shared_mutex groupMutex_;
+    std::atomic<int64_t> lastVersion_;
+    std::atomic<int64_t> committedVersion_;
+
+    std::mutex commitMutex_;
+    std::condition_variable commitCond_;
+    std::size_t pendingCount_;
+    std::chrono::steady_clock::time_point firstPendingAt_;
+    bool stopping_;
+    uint64_t commits_;
+    uint64_t committedRequests_;
+    uint64_t failedRequests_;
+    std::thread committer_;
+
+    Shard &shardFor(std::string const &key) {
+        return *shards_[std::hash<std::string>()(key) % shards_.size()];
+    }
+    void respond(typename Env::IDType const &id, TI::TransactionResponse const &resp) {
+        this->publish(
+            env_
+            , typename infra::RealTimeApp<Env>::template Key<TI::TransactionResponse> {id, resp}
+            , true
+        );
+    }
+    TI::TransactionResponse failure(basic::transaction::v2::RequestDecision decision) const {
+        return {committedVersion_.load(), decision};
+    }
+    //called on the shard's own thread with a shared lock of groupMutex_;
+    //returns the op to add to the group, or the failure to answer with
+    std::variant<Op, TI::TransactionResponse> apply(Shard &shard, typename Env::IDType const &id, std::string const &account, TI::Transaction const &t) {
+        return std::visit([this,&shard,&id,&account](auto const &action) -> std::variant<Op, TI::TransactionResponse> {
+            using A = std::decay_t<decltype(action)>;
+            auto iter = shard.data.find(action.key);
+            std::optional<Row> before = std::nullopt;
+            if (iter != shard.data.end()) {
+                before = iter->second;
+            }
+            if constexpr (std::is_same_v<A, TI::InsertAction>) {
+                if (before) {
+                    return failure(basic::transaction::v2::RequestDecision::FailurePrecondition);
+                }
+                auto version = ++lastVersion_;
+                shard.data[action.key] = Row {version, action.data};
+                return Op {id, account, action.key, version, action.data, true, before};
+            } else if constexpr (std::is_same_v<A, TI::UpdateAction>) {
+                if (!before
+                    || (action.oldVersionSlice && *action.oldVersionSlice != before->version)
+                    || (action.oldDataSummary && !(*action.oldDataSummary == before->data))) {
+                    return failure(basic::transaction::v2::RequestDecision::FailurePrecondition);
+                }
+                auto version = ++lastVersion_;
+                iter->second = Row {version, action.dataDelta};
+                return Op {id, account, action.key, version, action.dataDelta, false, before};
+            } else {
+                if (!before
+                    || (action.oldVersion && *action.oldVersion != before->version)
+                    || (action.oldDataSummary && !(*action.oldDataSummary == before->data))) {
+                    return failure(basic::transaction::v2::RequestDecision::FailurePrecondition);
+                }
+                auto version = ++lastVersion_;
+                shard.data.erase(iter);
+                return Op {id, account, action.key, version, std::nullopt, false, before};
+            }
+        }, t.value);
+    }
+    void runShard(Shard &shard) {
+        while (true) {
+            std::deque<std::tuple<typename Env::IDType, std::string, TI::Transaction>> work;
+            {
+                std::unique_lock<std::mutex> lock(shard.mutex);
+                shard.cond.wait(lock, [&shard]() {
+                    return shard.stopping || !shard.queue.empty();
+                });
+                if (shard.queue.empty()) {
+                    return;
+                }
+                work.swap(shard.queue);
+            }
+            std::vector<std::tuple<typename Env::IDType, TI::TransactionResponse>> rejected;
+            std::size_t added = 0;
+            {
+                //the version is taken and the op queued under the same
+                //lock, so a group never misses a version below its last one
+                std::shared_lock<std::shared_mutex> _(groupMutex_);
+                for (auto const &item : work) {
+                    auto res = apply(shard, std::get<0>(item), std::get<1>(item), std::get<2>(item));
+                    if (std::holds_alternative<Op>(res)) {
+                        shard.pending.push_back(std::get<Op>(std::move(res)));
+                        ++added;
+                    } else {
+                        rejected.push_back({std::get<0>(item), std::get<TI::TransactionResponse>(res)});
+                    }
+                }
+            }
+            if (added > 0) {
+                std::lock_guard<std::mutex> _(commitMutex_);
+                if (pendingCount_ == 0) {
+                    firstPendingAt_ = std::chrono::steady_clock::now();
+                }
+                pendingCount_ += added;
+                commitCond_.notify_one();
+            }
+            for (auto const &r : rejected) {
+                respond(std::get<0>(r), std::get<1>(r));
+            }
+        }
+    }
+    //called with an exclusive lock of groupMutex_
+    std::vector<Op> takePending() {
+        std::vector<Op> ops;
+        for (auto &s : shards_) {
+            std::move(s->pending.begin(), s->pending.end(), std::back_inserter(ops));
+            s->pending.clear();
+        }
+        std::sort(ops.begin(), ops.end(), [](Op const &a, Op const &b) {
+            return a.version < b.version;
+        });
+        return ops;
+    }
+    //called with an exclusive lock of groupMutex_, undoes ops newest first
+    void rollback(std::vector<Op> const &ops) {
+        for (auto iter = ops.rbegin(); iter != ops.rend(); ++iter) {
+            auto &shard = shardFor(iter->key);
+            if (iter->before) {
+                shard.data[iter->key] = *(iter->before);
+            } else {
+                shard.data.erase(iter->key);
+            }
+        }
+    }
+    bool writeGroup(std::vector<Op> const &group) {
+        try {
+            //rolls back in its destructor unless committed
+            soci::transaction tx(*session_);
+            for (auto const &op : group) {
+                statements_->name = op.key;
+                if (!op.data) {
+                    statements_->deleteStmt.execute(true);
+                    continue;
+                }
+                statements_->value1 = op.data->value1();
+                statements_->value2 = op.data->value2();
+                if (op.isInsert) {
+                    statements_->insertStmt.execute(true);
+                } else {
+                    statements_->updateStmt.execute(true);
+                }
+            }
+            tx.commit();
+            return true;
+        } catch (soci::soci_error const &ex) {
+            env_->log(infra::LogLevel::Error, std::string("[GroupCommitTransactionFacility] commit of ")+std::to_string(group.size())+" requests failed: "+ex.what());
+            return false;
+        }
+    }
+    void publishGroup(std::vector<Op> const &group) {
+        //only the committer publishes, so the updates stay in version order
+        for (auto const &op : group) {
+            dsComponent_->callback()->onUpdate(DI::Update {
+                op.version
+                , std::vector<DI::OneUpdateItem> {
+                    { DI::OneFullUpdateItem {
+                        op.key
+                        , op.version
+                        , op.data
+                    } }
+                }
+            });
+        }
+        for (auto const &op : group) {
+            respond(op.id, {op.version, basic::transaction::v2::RequestDecision::Success});
+        }
+    }
+    void run() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(commitMutex_);
+                while (true) {
+                    if (pendingCount_ == 0) {
+                        if (stopping_) {
+                            return;
+                        }
+                        commitCond_.wait(lock);
+                        continue;
+                    }
+                    if (!stopping_ && pendingCount_ < maxRequests_ && std::chrono::steady_clock::now() < firstPendingAt_+window_) {
+                        commitCond_.wait_until(lock, firstPendingAt_+window_);
+                        continue;
+                    }
+                    break;
+                }
+                pendingCount_ = 0;
+            }
+            std::vector<Op> group;
+            {
+                std::unique_lock<std::shared_mutex> _(groupMutex_);
+                group = takePending();
+            }
+            if (group.empty()) {
+                continue;
+            }
+            if (writeGroup(group)) {
+                committedVersion_ = group.back().version;
+                ++commits_;
+                committedRequests_ += group.size();
+                publishGroup(group);
+                continue;
+            }
+            //requests applied since the group was taken may build on it
+            std::vector<Op> later;
+            {
+                std::unique_lock<std::shared_mutex> _(groupMutex_);
+                later = takePending();
+                rollback(later);
+                rollback(group);
+            }
+            failedRequests_ += group.size()+later.size();
+            for (auto const *ops : {&group, &later}) {
+                for (auto const &op : *ops) {
+                    env_->log(infra::LogLevel::Warning, "[GroupCommitTransactionFacility] request on '"+op.key+"' from '"+op.account+"' not committed");
+                    respond(op.id, failure(basic::transaction::v2::RequestDecision::FailureConsistency));
+                }
+            }
+        }
+    }
+public:
+    GroupCommitTransactionFacility(
+        std::shared_ptr<soci::session> const &session
+        , DSComponent *dsComponent
+        , std::size_t shardCount
+        , std::chrono::milliseconds window
+        , std::size_t maxRequests
+    )
+        : env_(nullptr), session_(session), dsComponent_(dsComponent)
+        , statements_(std::make_unique<PreparedStatements>(*session))
+        , window_(window), maxRequests_(std::max<std::size_t>(maxRequests, 1)), shards_()
+        , groupMutex_(), lastVersion_(0), committedVersion_(0)
+        , commitMutex_(), commitCond_(), pendingCount_(0), firstPendingAt_(), stopping_(false)
+        , commits_(0), committedRequests_(0), failedRequests_(0), committer_()
+    {
+        for (std::size_t ii=0; ii<std::max<std::size_t>(shardCount, 1); ++ii) {
+            shards_.push_back(std::make_unique<Shard>());
+        }
+    }
+    virtual ~GroupCommitTransactionFacility() {
+        for (auto &s : shards_) {
+            {
+                std::lock_guard<std::mutex> _(s->mutex);
+                s->stopping = true;
+            }
+            s->cond.notify_one();
+            if (s->thread.joinable()) {
+                s->thread.join();
+            }
+        }
+        //the committer writes what the shards left before it stops
+        {
+            std::lock_guard<std::mutex> _(commitMutex_);
+            stopping_ = true;
+        }
+        commitCond_.notify_one();
+        if (committer_.joinable()) {
+            committer_.join();
+        }
+        if (env_) {
+            std::ostringstream oss;
+            oss << "[GroupCommitTransactionFacility] " << committedRequests_ << " requests in " << commits_ << " commits, " << failedRequests_ << " failed";
+            env_->log(infra::LogLevel::Info, oss.str());
+        }
+    }
+    virtual void start(Env *env) override final {
+        env_ = env;
+        //same starting point as DSComponent: every row at version 0
+        soci::rowset<soci::row> res =
+            session_->prepare << "SELECT name, value1, value2 FROM test_table";
+        for (auto const &r : res) {
+            auto name = r.get<std::string>(0);
+            db_data item;
+            item.set_value1(r.get<int>(1));
+            item.set_value2(r.get<std::string>(2));
+            shardFor(name).data[name] = Row {0, std::move(item)};
+        }
+        std::ostringstream oss;
+        oss << "[GroupCommitTransactionFacility] " << shards_.size() << " shards:";
+        for (auto &s : shards_) {
+            oss << ' ' << s->data.size();
+        }
+        env_->log(infra::LogLevel::Info, oss.str());
+        committer_ = std::thread(&GroupCommitTransactionFacility::run, this);
+        for (auto &s : shards_) {
+            s->thread = std::thread(&GroupCommitTransactionFacility::runShard, this, std::ref(*s));
+        }
+    }
+    virtual void handle(typename infra::RealTimeApp<Env>::template InnerData<
+        typename infra::RealTimeApp<Env>::template Key<std::tuple<std::string, TI::Transaction>>
+    > &&input) override final {
+        auto const &account = std::get<0>(input.timedData.value.key());
+        auto const &t = std::get<1>(input.timedData.value.key());
+        auto const &key = std::visit([](auto const &action) -> std::string const & {
+            return action.key;
+        }, t.value);
+        auto &shard = shardFor(key);
+        {
+            std::lock_guard<std::mutex> _(shard.mutex);
+            shard.queue.push_back({input.timedData.value.id(), account, t});
+        }
+        shard.cond.notify_one();
+    }
+};
+
 int main(int argc, char **argv) {
     namespace po = boost::program_options;
 
@@ -189,6 +605,9 @@ int main(int argc, char **argv) {
     desc.add_options()
         ("help", "display help message")
         ("db_file", po::value<std::string>(), "database file")
+        ("group_commit_ms", po::value<int>(), "commit in groups: write the requests of up to this many milliseconds in one SQLite transaction (each request is answered once its group is committed)")
+        ("group_commit_max", po::value<std::size_t>(), "with group_commit_ms, commit early once this many requests are in the group (default 1000)")
+        ("shards", po::value<std::size_t>(), "check and apply transactions on this many shards (keys are hashed to shards, each with its own thread); the SQLite writes are still done by one thread, in groups (see group_commit_ms, default 0: commit whatever is waiting)")
     ;
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -203,6 +622,16 @@ int main(int argc, char **argv) {
         std::cerr << "Please provide database file\n";
         return 1;
     }
+    std::optional<std::chrono::milliseconds> groupCommitWindow = std::nullopt;
+    if (vm.count("group_commit_ms")) {
+        if (vm["group_commit_ms"].as<int>() <= 0) {
+            std::cerr << "group_commit_ms must be positive\n";
+            return 1;
+        }
+        groupCommitWindow = std::chrono::milliseconds(vm["group_commit_ms"].as<int>());
+    }
+    std::size_t groupCommitMaxRequests = vm.count("group_commit_max")?vm["group_commit_max"].as<std::size_t>():1000;
+    std::size_t shardCount = vm.count("shards")?vm["shards"].as<std::size_t>():0;
 
     using TheEnvironment = infra::Environment<
         infra::CheckTimeComponent<false>,
@@ -240,8 +669,10 @@ int main(int argc, char **argv) {
             env.log(infra::LogLevel::Info, s);
         }
     });
+    //with shards or group commit, THComponent is not used, and the storage
+    //belongs to the facility that takes the requests
     env.THComponent::operator=(THComponent {
-        session
+        (shardCount > 0 || groupCommitWindow)?nullptr:session
         , [&env](std::string const &s) {
             env.log(infra::LogLevel::Info, s);
         }
@@ -271,20 +702,50 @@ int main(int argc, char **argv) {
     r.setMaxOutputConnectivity(transactionLogicCombinationRes.transactionFacility, 2);
     r.setMaxOutputConnectivity(transactionLogicCombinationRes.subscriptionFacility, 2);
 
-    transport::MultiTransportFacilityWrapper<R>::wrapWithProtocol
-        <basic::CBOR, TI::Transaction,TI::TransactionResponse,DI::Update>(
-        r
-        , transactionLogicCombinationRes.transactionFacility
-        , "rabbitmq://127.0.0.1::guest:guest:test_db_cmd_transaction_queue"
-        , "transaction_wrapper/"
-    );
-    transport::MultiTransportFacilityWrapper<R>::wrapWithProtocol
-        <basic::proto_interop::Proto, TI::Transaction,TI::TransactionResponse,DI::Update>(
-        r
-        , transactionLogicCombinationRes.transactionFacility
-        , "grpc_interop://127.0.0.1:12345:::db_subscription/Main/Transaction"
-        , "transaction_wrapper_2/"
-    );
+    if (shardCount > 0 || groupCommitWindow) {
+        //the transaction facility from transactionLogicCombination still
+        //keeps the data store for the subscriptions up to date (it gets
+        //the updates through DSComponent), but the requests go here; with
+        //or without shards they come through the same identity-checked
+        //wrappers, and each shard's apply gets the caller's account
+        auto facility = M::fromAbstractOnOrderFacility(new GroupCommitTransactionFacility<TheEnvironment>(
+            session
+            , static_cast<DSComponent *>(&env)
+            , shardCount
+            , groupCommitWindow.value_or(std::chrono::milliseconds(0))
+            , groupCommitMaxRequests
+        ));
+        r.registerOnOrderFacility("transactionFacility", facility);
+        transport::MultiTransportFacilityWrapper<R>::wrapWithProtocol
+            <basic::CBOR, TI::Transaction,TI::TransactionResponse>(
+            r
+            , facility
+            , "rabbitmq://127.0.0.1::guest:guest:test_db_cmd_transaction_queue"
+            , "transaction_wrapper/"
+        );
+        transport::MultiTransportFacilityWrapper<R>::wrapWithProtocol
+            <basic::proto_interop::Proto, TI::Transaction,TI::TransactionResponse>(
+            r
+            , facility
+            , "grpc_interop://127.0.0.1:12345:::db_subscription/Main/Transaction"
+            , "transaction_wrapper_2/"
+        );
+    } else {
+        transport::MultiTransportFacilityWrapper<R>::wrapWithProtocol
+            <basic::CBOR, TI::Transaction,TI::TransactionResponse,DI::Update>(
+            r
+            , transactionLogicCombinationRes.transactionFacility
+            , "rabbitmq://127.0.0.1::guest:guest:test_db_cmd_transaction_queue"
+            , "transaction_wrapper/"
+        );
+        transport::MultiTransportFacilityWrapper<R>::wrapWithProtocol
+            <basic::proto_interop::Proto, TI::Transaction,TI::TransactionResponse,DI::Update>(
+            r
+            , transactionLogicCombinationRes.transactionFacility
+            , "grpc_interop://127.0.0.1:12345:::db_subscription/Main/Transaction"
+            , "transaction_wrapper_2/"
+        );
+    }
     transport::MultiTransportFacilityWrapper<R>::wrapWithProtocol
         <basic::nlohmann_json_interop::Json, GS::Input,GS::Output,GS::SubscriptionUpdate>(
         r
@@ -0,0 +1,121 @@
+#include <tm_kit/infra/Environments.hpp>
+#include <tm_kit/infra/TerminationController.hpp>
+#include <tm_kit/infra/RealTimeApp.hpp>
+
+#include <tm_kit/basic/ByteData.hpp>
+#include <tm_kit/basic/SpdLoggingComponent.hpp>
+#include <tm_kit/basic/real_time_clock/ClockComponent.hpp>
+
+#include <tm_kit/transport/CrossGuidComponent.hpp>
+#include <tm_kit/transport/rabbitmq/RabbitMQComponent.hpp>
+#include <tm_kit/transport/MultiTransportFacilityWrapper.hpp>
+#include <tm_kit/transport/HeartbeatAndAlertComponent.hpp>
+
+#include <soci/sqlite3/soci-sqlite3.h>
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+
+#include "ReadOnlyDBData.hpp"
+#include "HybridReadOnlyStore.hpp"
+
+using namespace dev::cd606::tm;
+
+int main(int argc, char **argv) {
+    namespace po = boost::program_options;
+
+    db_subscription::hybrid_read_only::HybridReadOnlyConfig config;
+
+    po::options_description desc("allowed options");
+    desc.add_options()
+        ("help", "display help message")
+        ("db_file", po::value<std::string>(), "database file")
+        ("hot_where", po::value<std::string>(), "SQL condition selecting the rows to preload (default: any rows)")
+        ("hot_limit", po::value<std::size_t>(), "at most this many rows are preloaded (default 100000)")
+        ("lru_size", po::value<std::size_t>(), "number of other keys cached after being read on demand (default 100000)")
+        ("chunk_size", po::value<std::size_t>(), "rows per result chunk for prefix and range queries that do not give one (default 1000)")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << "\n";
+        return 0;
+    }
+
+    if (!vm.count("db_file")) {
+        std::cerr << "Please provide database file\n";
+        return 1;
+    }
+    if (vm.count("hot_where")) {
+        config.hotWhereClause = vm["hot_where"].as<std::string>();
+    }
+    if (vm.count("hot_limit")) {
+        config.hotLimit = vm["hot_limit"].as<std::size_t>();
+    }
+    if (vm.count("lru_size")) {
+        config.lruSize = vm["lru_size"].as<std::size_t>();
+    }
+    if (vm.count("chunk_size")) {
+        config.defaultChunkSize = vm["chunk_size"].as<std::size_t>();
+    }
+
+    using TheEnvironment = infra::Environment<
+        infra::CheckTimeComponent<false>,
+        infra::TrivialExitControlComponent,
+        basic::TimeComponentEnhancedWithSpdLogging<basic::real_time_clock::ClockComponent>,
+        transport::CrossGuidComponent,
+        transport::AllNetworkTransportComponents,
+        transport::HeartbeatAndAlertComponent
+    >;
+    using M = infra::RealTimeApp<TheEnvironment>;
+    using R = infra::AppRunner<M>;
+
+    TheEnvironment env;
+
+    transport::HeartbeatAndAlertComponentInitializer<TheEnvironment,transport::rabbitmq::RabbitMQComponent>()
+        (&env, "hybrid_read_only_db_server.heartbeat", transport::ConnectionLocator::parse("127.0.0.1::guest:guest:amq.topic[durable=true]"));
+
+    R r(&env);
+
+    //the hot set loader, the point lookups and the scans each get their
+    //own session
+    auto dbFile = vm["db_file"].as<std::string>();
+    auto sessionFactory = [dbFile]() {
+        return std::make_shared<soci::session>(
+#ifdef _MSC_VER
+            *soci::factory_sqlite3()
+#else
+            soci::sqlite3
+#endif
+            , dbFile
+        );
+    };
+    auto queryFacility = M::fromAbstractOnOrderFacility(
+        new db_subscription::hybrid_read_only::HybridReadOnlyFacility<TheEnvironment>(sessionFactory, config)
+    );
+    r.registerOnOrderFacility("queryFacility", queryFacility);
+    transport::MultiTransportFacilityWrapper<R>::wrapWithProtocol
+        <basic::nlohmann_json_interop::Json, HybridDBQuery,HybridDBQueryResult>(
+        r
+        , queryFacility
+        , "rabbitmq://127.0.0.1::guest:guest:test_db_hybrid_read_only_queue"
+        , "server_wrapper/"
+    );
+    
+    std::ostringstream graphOss;
+    graphOss << "The graph is:\n";
+    r.writeGraphVizDescription(graphOss, "hybrid_read_only_db_server");
+    r.finalize();
+
+    env.setStatus("program", transport::HeartbeatMessage::Status::Good);
+    env.sendAlert("hybrid_read_only_db_server.alert", infra::LogLevel::Info, "Hybrid read-only DB server started");
+    env.log(infra::LogLevel::Info, graphOss.str());
+    env.log(infra::LogLevel::Info, "Hybrid read-only DB server started");
+
+    infra::terminationController(infra::RunForever {&env});
+
+    return 0;
+}
@@ -0,0 +1,350 @@
+#ifndef HYBRID_READ_ONLY_STORE_HPP_
+#define HYBRID_READ_ONLY_STORE_HPP_
+
+#include <tm_kit/infra/RealTimeApp.hpp>
+
+#include <soci/soci.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "ReadOnlyDBData.hpp"
+
+//Read-only server for test_table that does not load the whole table:
+//
+//  - a hot set (the rows matching hotWhereClause, at most hotLimit of
+//    them) is loaded on a background thread into an open-addressing hash
+//    index, so startup does not wait for it
+//  - other keys (and every key until the hot set is loaded) are read from
+//    the database and kept in an LRU cache of lruSize entries, misses
+//    included
+//  - prefix and range queries are run against the database on their own
+//    thread and streamed back in chunks, in order of name
+namespace db_subscription { namespace hybrid_read_only {
+
+    struct HybridReadOnlyConfig {
+        std::string table = "test_table";
+        //empty means any rows
+        std::string hotWhereClause;
+        std::size_t hotLimit = 100000;
+        std::size_t lruSize = 100000;
+        std::size_t defaultChunkSize = 1000;
+    };
+
+    //Immutable once built. Slots hold the key hash and the position of the
+    //row in entries_, probed linearly; the table is kept at most 70% full.
+    class HotIndex {
+    private:
+        static constexpr uint32_t EmptySlot = 0xffffffff;
+        struct Slot {
+            uint64_t hash;
+            uint32_t entry;
+        };
+        std::vector<Slot> slots_;
+        std::vector<HybridDBRow> entries_;
+        uint64_t mask_;
+    public:
+        explicit HotIndex(std::vector<HybridDBRow> &&rows) : slots_(), entries_(std::move(rows)), mask_(0) {
+            std::size_t capacity = 16;
+            while (capacity*7 < entries_.size()*10) {
+                capacity *= 2;
+            }
+            slots_.assign(capacity, Slot {0, EmptySlot});
+            mask_ = capacity-1;
+            for (uint32_t ii=0; ii<(uint32_t) entries_.size(); ++ii) {
+                auto h = (uint64_t) std::hash<std::string>()(entries_[ii].name);
+                for (auto pos = h & mask_; ; pos = (pos+1) & mask_) {
+                    auto &s = slots_[pos];
+                    if (s.entry == EmptySlot) {
+                        s = Slot {h, ii};
+                        break;
+                    }
+                    if (s.hash == h && entries_[s.entry].name == entries_[ii].name) {
+                        //duplicate name, the later row wins
+                        s.entry = ii;
+                        break;
+                    }
+                }
+            }
+        }
+        DBData const *find(std::string const &name) const {
+            auto h = (uint64_t) std::hash<std::string>()(name);
+            for (auto pos = h & mask_; ; pos = (pos+1) & mask_) {
+                auto const &s = slots_[pos];
+                if (s.entry == EmptySlot) {
+                    return nullptr;
+                }
+                if (s.hash == h && entries_[s.entry].name == name) {
+                    return &(entries_[s.entry].data);
+                }
+            }
+        }
+        std::size_t size() const {
+            return entries_.size();
+        }
+    };
+
+    //Remembers both found rows and misses (std::nullopt)
+    class LRUCache {
+    private:
+        using Entry = std::tuple<std::string, std::optional<DBData>>;
+        std::size_t capacity_;
+        std::list<Entry> order_;
+        std::unordered_map<std::string, std::list<Entry>::iterator> map_;
+    public:
+        LRUCache(std::size_t capacity) : capacity_(capacity), order_(), map_() {}
+        std::optional<std::optional<DBData>> get(std::string const &name) {
+            auto iter = map_.find(name);
+            if (iter == map_.end()) {
+                return std::nullopt;
+            }
+            order_.splice(order_.begin(), order_, iter->second);
+            return std::get<1>(*(iter->second));
+        }
+        void put(std::string const &name, std::optional<DBData> const &data) {
+            if (capacity_ == 0) {
+                return;
+            }
+            auto iter = map_.find(name);
+            if (iter != map_.end()) {
+                std::get<1>(*(iter->second)) = data;
+                order_.splice(order_.begin(), order_, iter->second);
+                return;
+            }
+            order_.push_front(Entry {name, data});
+            map_[name] = order_.begin();
+            if (order_.size() > capacity_) {
+                map_.erase(std::get<0>(order_.back()));
+                order_.pop_back();
+            }
+        }
+    };
+
+    //the smallest string greater than every string starting with prefix,
+    //or std::nullopt if there is none
+    inline std::optional<std::string> prefixUpperBound(std::string prefix) {
+        while (!prefix.empty() && (unsigned char) prefix.back() == 0xff) {
+            prefix.pop_back();
+        }
+        if (prefix.empty()) {
+            return std::nullopt;
+        }
+        prefix.back() = (char) ((unsigned char) prefix.back()+1);
+        return prefix;
+    }
+
+    template <class Env>
+    class HybridReadOnlyFacility :
+        public dev::cd606::tm::infra::RealTimeApp<Env>::IExternalComponent
+        , public dev::cd606::tm::infra::RealTimeApp<Env>::template AbstractOnOrderFacility<HybridDBQuery, HybridDBQueryResult>
+    {
+    private:
+        using M = dev::cd606::tm::infra::RealTimeApp<Env>;
+        struct Scan {
+            typename Env::IDType id;
+            std::string from;
+            std::optional<std::string> to;
+            std::size_t chunkSize;
+        };
+
+        Env *env_;
+        std::function<std::shared_ptr<soci::session>()> sessionFactory_;
+        HybridReadOnlyConfig config_;
+
+        std::shared_ptr<HotIndex const> hot_;
+        LRUCache cache_;
+
+        //point lookups, only used on the facility's own thread
+        std::shared_ptr<soci::session> pointSession_;
+        std::string pointName_;
+        int pointValue1_;
+        std::string pointValue2_;
+        std::unique_ptr<soci::statement> pointStmt_;
+
+        std::mutex scanMutex_;
+        std::condition_variable scanCond_;
+        std::deque<Scan> scans_;
+        bool stopping_;
+        std::thread loaderThread_;
+        std::thread scanThread_;
+
+        void publishResult(typename Env::IDType const &id, HybridDBQueryResult &&result, bool isFinal) {
+            this->publish(
+                env_
+                , typename M::template Key<HybridDBQueryResult> {id, std::move(result)}
+                , isFinal
+            );
+        }
+        void loadHotSet() {
+            auto start = std::chrono::steady_clock::now();
+            try {
+                auto session = sessionFactory_();
+                std::ostringstream sql;
+                sql << "SELECT name, value1, value2 FROM " << config_.table;
+                if (!config_.hotWhereClause.empty()) {
+                    sql << " WHERE " << config_.hotWhereClause;
+                }
+                sql << " LIMIT " << config_.hotLimit;
+                std::vector<HybridDBRow> rows;
+                soci::rowset<soci::row> res = session->prepare << sql.str();
+                for (auto const &r : res) {
+                    rows.push_back(HybridDBRow {r.get<std::string>(0), DBData {r.get<int>(1), r.get<std::string>(2)}});
+                }
+                auto index = std::make_shared<HotIndex const>(std::move(rows));
+                std::ostringstream oss;
+                oss << "[HybridReadOnlyFacility] loaded " << index->size() << " hot rows in "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-start).count() << "ms";
+                std::atomic_store(&hot_, std::shared_ptr<HotIndex const>(std::move(index)));
+                env_->log(dev::cd606::tm::infra::LogLevel::Info, oss.str());
+            } catch (soci::soci_error const &ex) {
+                env_->log(dev::cd606::tm::infra::LogLevel::Error, std::string("[HybridReadOnlyFacility] loading hot rows failed, serving everything on demand: ")+ex.what());
+            }
+        }
+        void runScans() {
+            auto session = sessionFactory_();
+            while (true) {
+                Scan scan;
+                {
+                    std::unique_lock<std::mutex> lock(scanMutex_);
+                    scanCond_.wait(lock, [this]() {
+                        return stopping_ || !scans_.empty();
+                    });
+                    if (stopping_) {
+                        return;
+                    }
+                    scan = std::move(scans_.front());
+                    scans_.pop_front();
+                }
+                HybridDBQueryResult chunk {{}, false};
+                try {
+                    std::string sql = "SELECT name, value1, value2 FROM "+config_.table+" WHERE name >= :from";
+                    std::string to = scan.to.value_or("");
+                    if (scan.to) {
+                        sql += " AND name < :to";
+                    }
+                    sql += " ORDER BY name";
+                    auto run = [&](soci::rowset<soci::row> &&res) {
+                        for (auto const &r : res) {
+                            chunk.rows.push_back(HybridDBRow {r.get<std::string>(0), DBData {r.get<int>(1), r.get<std::string>(2)}});
+                            if (chunk.rows.size() >= scan.chunkSize) {
+                                publishResult(scan.id, std::move(chunk), false);
+                                chunk = HybridDBQueryResult {{}, false};
+                            }
+                        }
+                    };
+                    if (scan.to) {
+                        run(soci::rowset<soci::row>((session->prepare << sql, soci::use(scan.from, "from"), soci::use(to, "to"))));
+                    } else {
+                        run(soci::rowset<soci::row>((session->prepare << sql, soci::use(scan.from, "from"))));
+                    }
+                } catch (soci::soci_error const &ex) {
+                    env_->log(dev::cd606::tm::infra::LogLevel::Error, std::string("[HybridReadOnlyFacility] scan failed: ")+ex.what());
+                }
+                chunk.complete = true;
+                publishResult(scan.id, std::move(chunk), true);
+            }
+        }
+        std::optional<DBData> lookup(std::string const &name) {
+            if (auto hot = std::atomic_load(&hot_)) {
+                if (auto const *d = hot->find(name)) {
+                    return *d;
+                }
+            }
+            if (auto cached = cache_.get(name)) {
+                return *cached;
+            }
+            std::optional<DBData> ret = std::nullopt;
+            try {
+                pointName_ = name;
+                if (pointStmt_->execute(true)) {
+                    ret = DBData {pointValue1_, pointValue2_};
+                }
+            } catch (soci::soci_error const &ex) {
+                env_->log(dev::cd606::tm::infra::LogLevel::Error, std::string("[HybridReadOnlyFacility] lookup failed: ")+ex.what());
+                return std::nullopt;
+            }
+            cache_.put(name, ret);
+            return ret;
+        }
+    public:
+        HybridReadOnlyFacility(std::function<std::shared_ptr<soci::session>()> const &sessionFactory, HybridReadOnlyConfig const &config)
+            : env_(nullptr), sessionFactory_(sessionFactory), config_(config)
+            , hot_(), cache_(config.lruSize)
+            , pointSession_(), pointName_(), pointValue1_(0), pointValue2_(), pointStmt_()
+            , scanMutex_(), scanCond_(), scans_(), stopping_(false), loaderThread_(), scanThread_()
+        {
+            config_.defaultChunkSize = std::max<std::size_t>(config_.defaultChunkSize, 1);
+        }
+        virtual ~HybridReadOnlyFacility() {
+            {
+                std::lock_guard<std::mutex> _(scanMutex_);
+                stopping_ = true;
+            }
+            scanCond_.notify_all();
+            if (scanThread_.joinable()) {
+                scanThread_.join();
+            }
+            if (loaderThread_.joinable()) {
+                loaderThread_.join();
+            }
+        }
+        virtual void start(Env *env) override final {
+            env_ = env;
+            pointSession_ = sessionFactory_();
+            pointStmt_ = std::make_unique<soci::statement>((pointSession_->prepare
+                << ("SELECT value1, value2 FROM "+config_.table+" WHERE name = :name")
+                , soci::into(pointValue1_), soci::into(pointValue2_)
+                , soci::use(pointName_, "name")));
+            loaderThread_ = std::thread(&HybridReadOnlyFacility::loadHotSet, this);
+            scanThread_ = std::thread(&HybridReadOnlyFacility::runScans, this);
+        }
+        virtual void handle(typename M::template InnerData<
+            typename M::template Key<HybridDBQuery>
+        > &&input) override final {
+            auto id = input.timedData.value.id();
+            auto const &q = input.timedData.value.key();
+            if (q.prefix || q.rangeFrom || q.rangeTo) {
+                Scan scan {
+                    id
+                    , ""
+                    , std::nullopt
+                    , (q.maxRowsPerChunk > 0)?(std::size_t) q.maxRowsPerChunk:config_.defaultChunkSize
+                };
+                if (q.prefix) {
+                    scan.from = *q.prefix;
+                    scan.to = prefixUpperBound(*q.prefix);
+                } else {
+                    scan.from = q.rangeFrom.value_or("");
+                    scan.to = q.rangeTo;
+                }
+                {
+                    std::lock_guard<std::mutex> _(scanMutex_);
+                    scans_.push_back(std::move(scan));
+                }
+                scanCond_.notify_one();
+                return;
+            }
+            HybridDBQueryResult result {{}, true};
+            if (auto d = lookup(q.name)) {
+                result.rows.push_back(HybridDBRow {q.name, std::move(*d)});
+            }
+            publishResult(id, std::move(result), true);
+        }
+    };
+
+} }
+
+#endif
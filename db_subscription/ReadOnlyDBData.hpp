@@ -20,4 +20,32 @@ TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE(DBKey, DBKeyFields);
 using DBQuery = DBKey;
 using DBQueryResult = dev::cd606::tm::basic::transaction::complex_key_value_store::KeyBasedQueryResult<DBData>;
 
+//Queries for the hybrid read-only server. With neither prefix nor range
+//set, this is a lookup of name. Prefix and range queries are answered in
+//order of name, in chunks of up to maxRowsPerChunk rows (0 means the
+//server's default), the last one with complete set.
+#define HybridDBQueryFields \
+    ((std::string, name)) \
+    ((std::optional<std::string>, prefix)) \
+    ((std::optional<std::string>, rangeFrom)) \
+    ((std::optional<std::string>, rangeTo)) \
+    ((uint32_t, maxRowsPerChunk))
+
+TM_BASIC_CBOR_CAPABLE_STRUCT(HybridDBQuery, HybridDBQueryFields);
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE(HybridDBQuery, HybridDBQueryFields);
+
+#define HybridDBRowFields \
+    ((std::string, name)) \
+    ((DBData, data))
+
+TM_BASIC_CBOR_CAPABLE_STRUCT(HybridDBRow, HybridDBRowFields);
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE(HybridDBRow, HybridDBRowFields);
+
+#define HybridDBQueryResultFields \
+    ((std::vector<HybridDBRow>, rows)) \
+    ((bool, complete))
+
+TM_BASIC_CBOR_CAPABLE_STRUCT(HybridDBQueryResult, HybridDBQueryResultFields);
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE(HybridDBQueryResult, HybridDBQueryResultFields);
+
 #endif
\ No newline at end of file
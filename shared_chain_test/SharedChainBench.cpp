@@ -0,0 +1,332 @@
+#include <tm_kit/infra/Environments.hpp>
+
+#include <tm_kit/basic/SerializationHelperMacros.hpp>
+#include <tm_kit/basic/simple_shared_chain/InMemoryWithLockChain.hpp>
+#include <tm_kit/basic/simple_shared_chain/InMemoryLockFreeChain.hpp>
+
+#include <tm_kit/transport/redis_shared_chain/RedisChain.hpp>
+#include <tm_kit/transport/lock_free_in_memory_shared_chain/LockFreeInBoostSharedMemoryChain.hpp>
+
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <thread>
+#include <vector>
+
+using namespace dev::cd606::tm;
+
+//Benchmark for the local shared chain backends: N writer threads append
+//concurrently (each append is a fetch-to-tail then a compare-and-swap style
+//appendAfter, retried on conflict), while M reader threads follow the chain.
+//Every record carries the steady-clock time of its (successful) append
+//attempt, so readers measure commit-to-visible latency. After the writers
+//are done a fresh reader walks the whole chain to measure catch-up speed.
+//Each run prints one JSON object per line for regression tracking.
+
+#define BenchRecordFields \
+    ((int32_t, writer)) \
+    ((int64_t, seq)) \
+    ((int64_t, appendNanos))
+
+TM_BASIC_CBOR_CAPABLE_STRUCT(BenchRecord, BenchRecordFields);
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE(BenchRecord, BenchRecordFields);
+
+struct BenchConfig {
+    int writers;
+    int readers;
+    int64_t appendsPerWriter;
+};
+
+inline int64_t steadyNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+//exact percentile (nearest rank) over sorted samples, percentile in [0, 100]
+inline int64_t sortedPercentile(std::vector<int64_t> const &sorted, double percentile) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto rank = (std::size_t) std::ceil(std::clamp(percentile, 0.0, 100.0)/100.0*sorted.size());
+    return sorted[(rank > 0) ? (rank-1) : 0];
+}
+
+template <class Chain>
+nlohmann::json runBench(Chain *chain, std::string const &backend, BenchConfig const &config) {
+    //one sample vector per reader, so that recording needs no synchronization
+    std::vector<std::vector<int64_t>> visibleLatency(config.readers);
+    std::atomic<uint64_t> casAttempts {0};
+    std::atomic<uint64_t> casFailures {0};
+    std::atomic<uint64_t> maxRetries {0};
+    std::atomic<int> readyThreads {0};
+    std::atomic<bool> go {false};
+    uint64_t total = (uint64_t) config.writers*(uint64_t) config.appendsPerWriter;
+
+    auto waitForGo = [&readyThreads,&go]() {
+        ++readyThreads;
+        while (!go.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    };
+
+    std::vector<std::thread> readers;
+    for (int ii=0; ii<config.readers; ++ii) {
+        readers.emplace_back([&,ii]() {
+            auto &samples = visibleLatency[ii];
+            samples.reserve(total);
+            auto current = chain->head(nullptr);
+            waitForGo();
+            uint64_t seen = 0;
+            while (seen < total) {
+                auto next = chain->fetchNext(current);
+                if (!next) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                auto now = steadyNanos();
+                current = std::move(*next);
+                auto const *data = Chain::extractData(current);
+                if (data) {
+                    samples.push_back((now-data->appendNanos)/1000);
+                    ++seen;
+                }
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int ii=0; ii<config.writers; ++ii) {
+        writers.emplace_back([&,ii]() {
+            auto current = chain->head(nullptr);
+            waitForGo();
+            uint64_t localAttempts = 0, localFailures = 0, localMaxRetries = 0;
+            for (int64_t seq=0; seq<config.appendsPerWriter; ++seq) {
+                uint64_t retries = 0;
+                while (true) {
+                    while (true) {
+                        auto next = chain->fetchNext(current);
+                        if (!next) {
+                            break;
+                        }
+                        current = std::move(*next);
+                    }
+                    ++localAttempts;
+                    if (chain->appendAfter(
+                        current
+                        , chain->formChainItem(chain->newStorageID(), BenchRecord {ii, seq, steadyNanos()})
+                    )) {
+                        break;
+                    }
+                    ++localFailures;
+                    ++retries;
+                }
+                localMaxRetries = std::max(localMaxRetries, retries);
+            }
+            casAttempts += localAttempts;
+            casFailures += localFailures;
+            auto prev = maxRetries.load();
+            while (prev < localMaxRetries && !maxRetries.compare_exchange_weak(prev, localMaxRetries)) {
+            }
+        });
+    }
+
+    while (readyThreads.load() < config.readers+config.writers) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto &w : writers) {
+        w.join();
+    }
+    auto appendSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    for (auto &r : readers) {
+        r.join();
+    }
+    auto followSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+    //catch-up: a reader that starts from the head with everything already there
+    uint64_t caughtUp = 0;
+    auto catchUpStart = std::chrono::steady_clock::now();
+    {
+        auto current = chain->head(nullptr);
+        while (true) {
+            auto next = chain->fetchNext(current);
+            if (!next) {
+                break;
+            }
+            current = std::move(*next);
+            if (Chain::extractData(current)) {
+                ++caughtUp;
+            }
+        }
+    }
+    auto catchUpSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-catchUpStart).count();
+
+    std::vector<int64_t> latency;
+    for (auto &samples : visibleLatency) {
+        latency.insert(latency.end(), samples.begin(), samples.end());
+        std::vector<int64_t>().swap(samples);
+    }
+    std::sort(latency.begin(), latency.end());
+    double latencySum = 0.0;
+    for (auto v : latency) {
+        latencySum += v;
+    }
+
+    nlohmann::json ret;
+    ret["backend"] = backend;
+    ret["time"] = infra::withtime_utils::localTimeString(std::chrono::system_clock::now());
+    ret["writers"] = config.writers;
+    ret["readers"] = config.readers;
+    ret["appends_per_writer"] = config.appendsPerWriter;
+    ret["appends"] = total;
+    ret["append_seconds"] = appendSeconds;
+    ret["appends_per_second"] = (appendSeconds > 0) ? total/appendSeconds : 0.0;
+    ret["cas_attempts"] = casAttempts.load();
+    ret["cas_failures"] = casFailures.load();
+    ret["cas_failure_ratio"] = (casAttempts.load() > 0) ? 1.0*casFailures.load()/casAttempts.load() : 0.0;
+    ret["max_retries_for_one_append"] = maxRetries.load();
+    ret["readers_done_seconds"] = followSeconds;
+    ret["visible_latency_us"] = {
+        {"count", latency.size()}
+        , {"mean", latency.empty() ? 0.0 : latencySum/latency.size()}
+        , {"p50", sortedPercentile(latency, 50)}
+        , {"p90", sortedPercentile(latency, 90)}
+        , {"p99", sortedPercentile(latency, 99)}
+        , {"p99_9", sortedPercentile(latency, 99.9)}
+        , {"max", latency.empty() ? 0 : latency.back()}
+    };
+    ret["catch_up_items"] = caughtUp;
+    ret["catch_up_seconds"] = catchUpSeconds;
+    ret["catch_up_items_per_second"] = (catchUpSeconds > 0) ? caughtUp/catchUpSeconds : 0.0;
+    return ret;
+}
+
+std::optional<std::vector<int>> parseIntList(std::string const &s) {
+    std::vector<std::string> parts;
+    boost::split(parts, s, boost::is_any_of(","));
+    std::vector<int> ret;
+    try {
+        for (auto const &p : parts) {
+            ret.push_back(boost::lexical_cast<int>(boost::trim_copy(p)));
+        }
+    } catch (boost::bad_lexical_cast const &) {
+        return std::nullopt;
+    }
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    namespace po = boost::program_options;
+
+    po::options_description desc("allowed options");
+    desc.add_options()
+        ("help", "display help message")
+        ("backends", po::value<std::string>(), "comma-separated backends: in-mem, lock-free-in-mem, lock-free-in-shared-mem, redis (default: the three local ones)")
+        ("writers", po::value<std::string>(), "comma-separated writer thread counts to run (default: 1,2,4)")
+        ("readers", po::value<std::string>(), "comma-separated reader thread counts to run (default: 1,4)")
+        ("appends", po::value<int64_t>(), "appends per writer (default: 10000)")
+        ("sharedMemorySize", po::value<std::size_t>(), "size in bytes of the shared memory segment for lock-free-in-shared-mem (default: 256MB)")
+        ("redisHeadKey", po::value<std::string>(), "head key prefix for the redis backend (default: shared_chain_bench)")
+        ("output", po::value<std::string>(), "also append the JSON lines to this file")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << "\n";
+        return 0;
+    }
+    std::vector<std::string> backends {"in-mem", "lock-free-in-mem", "lock-free-in-shared-mem"};
+    if (vm.count("backends")) {
+        backends.clear();
+        boost::split(backends, vm["backends"].as<std::string>(), boost::is_any_of(","));
+        for (auto &b : backends) {
+            boost::trim(b);
+            if (b != "in-mem" && b != "lock-free-in-mem" && b != "lock-free-in-shared-mem" && b != "redis") {
+                std::cerr << "Unknown backend '" << b << "'\n";
+                return 1;
+            }
+        }
+    }
+    auto writerCounts = parseIntList(vm.count("writers") ? vm["writers"].as<std::string>() : std::string {"1,2,4"});
+    auto readerCounts = parseIntList(vm.count("readers") ? vm["readers"].as<std::string>() : std::string {"1,4"});
+    if (!writerCounts || !readerCounts
+        || std::any_of(writerCounts->begin(), writerCounts->end(), [](int x) {return x <= 0;})
+        || std::any_of(readerCounts->begin(), readerCounts->end(), [](int x) {return x < 0;})) {
+        std::cerr << "Writer counts must be positive and reader counts non-negative\n";
+        return 1;
+    }
+    int64_t appends = vm.count("appends") ? vm["appends"].as<int64_t>() : 10000;
+    if (appends <= 0) {
+        std::cerr << "Appends must be positive\n";
+        return 1;
+    }
+    std::size_t sharedMemorySize = vm.count("sharedMemorySize") ? vm["sharedMemorySize"].as<std::size_t>() : (std::size_t) 256*1024*1024;
+    std::string redisHeadKey = vm.count("redisHeadKey") ? vm["redisHeadKey"].as<std::string>() : std::string {"shared_chain_bench"};
+    std::ofstream ofs;
+    if (vm.count("output")) {
+        ofs.open(vm["output"].as<std::string>(), std::ios::app);
+    }
+
+    int runID = 0;
+    for (auto const &backend : backends) {
+        for (auto w : *writerCounts) {
+            for (auto r : *readerCounts) {
+                BenchConfig config {w, r, appends};
+                //every run gets a fresh chain
+                nlohmann::json result;
+                if (backend == "in-mem") {
+                    basic::simple_shared_chain::InMemoryWithLockChain<BenchRecord> chain;
+                    result = runBench(&chain, backend, config);
+                } else if (backend == "lock-free-in-mem") {
+                    basic::simple_shared_chain::InMemoryLockFreeChain<BenchRecord> chain;
+                    result = runBench(&chain, backend, config);
+                } else if (backend == "lock-free-in-shared-mem") {
+                    auto name = "shared_chain_bench_"+std::to_string(runID);
+                    boost::interprocess::shared_memory_object::remove(name.c_str());
+                    {
+                        transport::lock_free_in_memory_shared_chain::LockFreeInBoostSharedMemoryChain<
+                            BenchRecord
+                            , transport::lock_free_in_memory_shared_chain::BoostSharedMemoryChainFastRecoverSupport::ByName
+                            , transport::lock_free_in_memory_shared_chain::BoostSharedMemoryChainExtraDataProtectionStrategy::Unsafe
+                        > chain {name, sharedMemorySize};
+                        result = runBench(&chain, backend, config);
+                    }
+                    boost::interprocess::shared_memory_object::remove(name.c_str());
+                } else {
+                    transport::redis_shared_chain::RedisChain<BenchRecord> chain {
+                        transport::redis_shared_chain::RedisChainConfiguration()
+                            .HeadKey(redisHeadKey+"-"+std::to_string(runID)+"-"+std::to_string(std::time(nullptr))+"-head")
+                    };
+                    result = runBench(&chain, backend, config);
+                }
+                ++runID;
+                std::cerr << backend << " writers=" << w << " readers=" << r
+                    << ": " << result["appends_per_second"].get<double>() << " appends/s"
+                    << ", cas failure ratio " << result["cas_failure_ratio"].get<double>()
+                    << ", visible p99 " << result["visible_latency_us"]["p99"].get<int64_t>() << "us"
+                    << ", catch-up " << result["catch_up_items_per_second"].get<double>() << " items/s\n";
+                std::cout << result.dump() << std::endl;
+                if (ofs.is_open()) {
+                    ofs << result.dump() << std::endl;
+                }
+            }
+        }
+    }
+    return 0;
+}
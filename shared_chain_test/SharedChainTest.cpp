@@ -17,6 +17,10 @@
 #include <tm_kit/transport/redis_shared_chain/RedisChain.hpp>
 #include <tm_kit/transport/lock_free_in_memory_shared_chain/LockFreeInBoostSharedMemoryChain.hpp>
 
+#include "shared_chain_utils/StateCheckpoints.hpp"
+
+#include <boost/lexical_cast.hpp>
+
 using namespace dev::cd606::tm;
 
 using AccountInfo = std::array<char,11>;
@@ -38,9 +42,19 @@ TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE(TransferRequest, TransferRequestFields);
 TM_BASIC_CBOR_CAPABLE_EMPTY_STRUCT(Process);
 TM_BASIC_CBOR_CAPABLE_EMPTY_STRUCT_SERIALIZE(Process);
 
+//A batch of transfer requests is written as a single chain item, so it costs
+//one append (one CAS round-trip on etcd/redis) however many requests it holds,
+//while the folder still applies the requests one by one, in order. A batch is
+//accepted or rejected as a whole, and counts as one pending request.
+#define TransferBatchFields \
+    ((std::vector<TransferRequest>, requests))
+
+TM_BASIC_CBOR_CAPABLE_STRUCT(TransferBatch, TransferBatchFields);
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE(TransferBatch, TransferBatchFields);
+
 //The reason we want to wrap it is because if we keep std::variant as the data type
 //then there will be some issue using it as data flow object type in our applicatives
-using DataOnChain = basic::CBOR<std::variant<TransferRequest, Process>>;
+using DataOnChain = basic::CBOR<std::variant<TransferRequest, Process, TransferBatch>>;
 
 //The reason we use this instead of a std::string to hold lastSeenID is to
 //facilitate printing as well as to make it trivially copiable. 
@@ -59,20 +73,36 @@ using DataOnChain = basic::CBOR<std::variant<TransferRequest, Process>>;
     ((int32_t, a_pending)) \
     ((int32_t, b_pending)) \
     ((uint16_t, pendingRequestCount)) \
-    ((LastSeenIDType, lastSeenID))
+    ((LastSeenIDType, lastSeenID)) \
+    ((uint32_t, foldedCount))
 
 TM_BASIC_CBOR_CAPABLE_STRUCT(LastSeenIDType, LastSeenIDTypeFields);
 TM_BASIC_CBOR_CAPABLE_STRUCT(State, StateFields);
 TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE(LastSeenIDType, LastSeenIDTypeFields);
 TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE(State, StateFields);
 
+//pendingRequestCount is counted per chain item, so the callers add to it
+inline void applyTransfer(State &state, TransferRequest const &x) {
+    if (std::strcmp(x.from.data(), "a") == 0) {
+        state.a_pending -= x.amount;
+    } else if (std::strcmp(x.from.data(), "b") == 0) {
+        state.b_pending -= x.amount;
+    }
+    if (std::strcmp(x.to.data(), "a") == 0) {
+        state.a_pending += x.amount;
+    } else if (std::strcmp(x.to.data(), "b") == 0) {
+        state.b_pending += x.amount;
+    }
+}
+
 template <class Chain>
 struct EnvValues {
     Chain *chain;
     std::string todayStr;
     bool dontLog;
-    EnvValues() : chain(nullptr), todayStr(), dontLog(false) {}
-    EnvValues(Chain *p, std::string const &s, bool d) : chain(p), todayStr(s), dontLog(d) {}
+    std::size_t batchSize;
+    EnvValues() : chain(nullptr), todayStr(), dontLog(false), batchSize(1) {}
+    EnvValues(Chain *p, std::string const &s, bool d, std::size_t b=1) : chain(p), todayStr(s), dontLog(d), batchSize(b) {}
 };
 
 template <class Env, class Chain>
@@ -83,18 +113,14 @@ public:
     using ResultType = State;
     State initialize(Env *env, Chain *chain) {
         env_ = env;
-        if constexpr (Chain::SupportsExtraData) {
-            auto val = chain->template loadExtraData<State>(
-                env->value().todayStr+"-state"
-            );
-            if (val) {
-                return *val;
-            } else {
-                return State {1000, 1000, 0, 0, 0, {0, {""}}};
-            }
-        } else {
-            return State {1000, 1000, 0, 0, 0, {0, {""}}};
+        //start from the snapshot furthest along the chain, if any
+        auto val = shared_chain_utils::checkpoints::loadLatestCheckpoint<State>(
+            chain, env->value().todayStr+"-state"
+        );
+        if (val) {
+            return *val;
         }
+        return State {1000, 1000, 0, 0, 0, {0, {""}}, 0};
     }
     static typename std::string chainIDForState(State const &s) {
         return std::string {s.lastSeenID.id.data(), s.lastSeenID.len};
@@ -104,15 +130,13 @@ public:
             using T = std::decay_t<decltype(x)>;
             if constexpr (std::is_same_v<T, TransferRequest>) {
                 State newState = lastState;
-                if (std::strcmp(x.from.data(), "a") == 0) {
-                    newState.a_pending -= x.amount;
-                } else if (std::strcmp(x.from.data(), "b") == 0) {
-                    newState.b_pending -= x.amount;
-                }
-                if (std::strcmp(x.to.data(), "a") == 0) {
-                    newState.a_pending += x.amount;
-                } else if (std::strcmp(x.to.data(), "b") == 0) {
-                    newState.b_pending += x.amount;
+                applyTransfer(newState, x);
+                ++(newState.pendingRequestCount);
+                return newState;
+            } else if constexpr (std::is_same_v<T, TransferBatch>) {
+                State newState = lastState;
+                for (auto const &req : x.requests) {
+                    applyTransfer(newState, req);
                 }
                 ++(newState.pendingRequestCount);
                 return newState;
@@ -135,6 +159,7 @@ public:
             newState->lastSeenID.len = storageIDView.length();
             std::memset(newState->lastSeenID.id.data(), 0, 40);
             std::memcpy(newState->lastSeenID.id.data(), storageIDView.data(), storageIDView.length());
+            ++(newState->foldedCount);
             return *newState;
         } else {
             return lastState;
@@ -153,42 +178,76 @@ public:
     void initialize(Env *env, Chain *chain) {
         dontLog_ = env->value().dontLog;
     }
+    bool checkPending(Env *env, State const &currentState) const {
+        if (currentState.pendingRequestCount >= 10) {
+            if (!dontLog_) {
+                env->log(infra::LogLevel::Warning, "too many pending requests");
+            }
+            return false;
+        }
+        return true;
+    }
+    bool checkTransfer(Env *env, TransferRequest const &x, State const &currentState) const {
+        if ((std::strcmp(x.from.data(), "a") != 0 && std::strcmp(x.from.data(), "b") != 0) || (std::strcmp(x.to.data(), "a") != 0 && std::strcmp(x.to.data(), "b") != 0)) {
+            if (!dontLog_) {
+                env->log(infra::LogLevel::Warning, "can only transfer between a and b");
+            }
+            return false;
+        }
+        if (std::strcmp(x.from.data(), "a") == 0 && (static_cast<int64_t>(currentState.a)+static_cast<int64_t>(currentState.a_pending-x.amount) < 0)) {
+            if (!dontLog_) {
+                std::ostringstream oss;
+                oss << currentState;
+                env->log(infra::LogLevel::Warning, "not enough amount "+std::to_string(x.amount)+" in a, current state is "+oss.str());
+            }
+            return false;
+        }
+        if (std::strcmp(x.from.data(), "b") == 0 && (static_cast<int64_t>(currentState.b)+static_cast<int64_t>(currentState.b_pending-x.amount) < 0)) {
+            if (!dontLog_) {
+                std::ostringstream oss;
+                oss << currentState;
+                env->log(infra::LogLevel::Warning, "not enough amount "+std::to_string(x.amount)+" in b, current state is "+oss.str());
+            }
+            return false;
+        }
+        return true;
+    }
     std::tuple<ResponseType, std::optional<DataOnChain>> basicHandleInput(Env *env, typename App::template TimedDataType<typename App::template Key<InputType>> const &input, State const &currentState) {
         auto idStr = Env::id_to_string(input.value.id());
         return std::visit([this,env,&idStr,&currentState](auto &&x) -> std::tuple<ResponseType, std::optional<DataOnChain>> {
             using T = std::decay_t<decltype(x)>;
             if constexpr (std::is_same_v<T, TransferRequest>) {
-                if (currentState.pendingRequestCount >= 10) {
-                    if (!dontLog_) {
-                        env->log(infra::LogLevel::Warning, "too many pending requests");
-                    }
+                if (!checkPending(env, currentState) || !checkTransfer(env, x, currentState)) {
                     return {false, std::nullopt};
                 }
-                if ((std::strcmp(x.from.data(), "a") != 0 && std::strcmp(x.from.data(), "b") != 0) || (std::strcmp(x.to.data(), "a") != 0 && std::strcmp(x.to.data(), "b") != 0)) {
-                    if (!dontLog_) {
-                        env->log(infra::LogLevel::Warning, "can only transfer between a and b");
-                    }
-                    return {false, std::nullopt};
+                if (!dontLog_) {
+                    std::ostringstream oss;
+                    oss << "Appending request " << x << " with ID " << idStr << ", curent state is " << currentState;
+                    env->log(infra::LogLevel::Info, oss.str());
                 }
-                if (std::strcmp(x.from.data(), "a") == 0 && (static_cast<int64_t>(currentState.a)+static_cast<int64_t>(currentState.a_pending-x.amount) < 0)) {
-                    if (!dontLog_) {
-                        std::ostringstream oss;
-                        oss << currentState;
-                        env->log(infra::LogLevel::Warning, "not enough amount "+std::to_string(x.amount)+" in a, current state is "+oss.str());
-                    }
+                return {true, DataOnChain {std::move(x)}};
+            } else if constexpr (std::is_same_v<T, TransferBatch>) {
+                //each request is checked against the state as it would be after
+                //the ones before it, and the batch is all or nothing: one
+                //failing request rejects the whole batch, so the single bool
+                //response always describes every request in it; the whole
+                //batch takes one pending slot, whatever its size
+                if (!checkPending(env, currentState)) {
                     return {false, std::nullopt};
                 }
-                if (std::strcmp(x.from.data(), "b") == 0 && (static_cast<int64_t>(currentState.b)+static_cast<int64_t>(currentState.b_pending-x.amount) < 0)) {
-                    if (!dontLog_) {
-                        std::ostringstream oss;
-                        oss << currentState;
-                        env->log(infra::LogLevel::Warning, "not enough amount "+std::to_string(x.amount)+" in b, current state is "+oss.str());
+                State projected = currentState;
+                for (auto const &req : x.requests) {
+                    if (!checkTransfer(env, req, projected)) {
+                        return {false, std::nullopt};
                     }
+                    applyTransfer(projected, req);
+                }
+                if (x.requests.empty()) {
                     return {false, std::nullopt};
                 }
                 if (!dontLog_) {
                     std::ostringstream oss;
-                    oss << "Appending request " << x << " with ID " << idStr << ", curent state is " << currentState;
+                    oss << "Appending batch of " << x.requests.size() << " request(s) with ID " << idStr << ", curent state is " << currentState;
                     env->log(infra::LogLevel::Info, oss.str());
                 }
                 return {true, DataOnChain {std::move(x)}};
@@ -255,11 +314,24 @@ void run(typename A::EnvironmentType *env, Chain *chain, std::string const &part
     r.registerExporter("printState", printState);
     r.exportItem(printState, r.execute(readerAction, r.importItem(readerClockImporter)));
 
+    std::shared_ptr<shared_chain_utils::checkpoints::Checkpointer<State>> checkpointer;
     if constexpr (Chain::SupportsExtraData) {
         if (part == "" || part == "process") {
-            auto saveState = A::template pureExporter<State>(
-                [env,chain](State &&s) {
-                    chain->saveExtraData(env->value().todayStr+"-state", s);
+            //versioned snapshots every 100 folded items or 10 minutes of
+            //chain time, written off the exporter thread by the checkpointer
+            checkpointer = std::make_shared<shared_chain_utils::checkpoints::Checkpointer<State>>(
+                shared_chain_utils::checkpoints::CheckpointConfig {env->value().todayStr+"-state", 100, 600000, 8}
+            );
+            auto saveState = A::template simpleExporter<State>(
+                [chain,checkpointer](typename A::template InnerData<State> &&data) {
+                    auto const &s = data.timedData.value;
+                    checkpointer->maybeSave(
+                        chain
+                        , s
+                        , StateFolder<TheEnvironment,Chain>::chainIDForState(s)
+                        , (int64_t) s.foldedCount
+                        , infra::withtime_utils::sinceEpoch<std::chrono::milliseconds>(data.timedData.timePoint)
+                    );
                 }
             );
             r.registerExporter("saveState", saveState);
@@ -277,7 +349,19 @@ void run(typename A::EnvironmentType *env, Chain *chain, std::string const &part
             , [](typename TheEnvironment::TimePointType const &tp) -> typename TheEnvironment::DurationType {
                 return std::chrono::seconds(std::rand()%5+1);
             }
-            , [](typename TheEnvironment::TimePointType const &tp) -> DataOnChain {
+            , [env](typename TheEnvironment::TimePointType const &tp) -> DataOnChain {
+                auto batchSize = env->value().batchSize;
+                if (batchSize > 1) {
+                    TransferBatch batch;
+                    for (std::size_t ii=0; ii<batchSize; ++ii) {
+                        TransferRequest req;
+                        req.from = account("a");
+                        req.to = account("b");
+                        req.amount = static_cast<uint16_t>(std::max<std::size_t>(1, (std::rand()%9+1)*100/batchSize));
+                        batch.requests.push_back(req);
+                    }
+                    return {{std::move(batch)}};
+                }
                 TransferRequest req;
                 req.from = account("a");
                 req.to = account("b");
@@ -295,7 +379,19 @@ void run(typename A::EnvironmentType *env, Chain *chain, std::string const &part
             , [](typename TheEnvironment::TimePointType const &tp) -> typename TheEnvironment::DurationType {
                 return std::chrono::seconds(std::rand()%5+1);
             }
-            , [](typename TheEnvironment::TimePointType const &tp) -> DataOnChain {
+            , [env](typename TheEnvironment::TimePointType const &tp) -> DataOnChain {
+                auto batchSize = env->value().batchSize;
+                if (batchSize > 1) {
+                    TransferBatch batch;
+                    for (std::size_t ii=0; ii<batchSize; ++ii) {
+                        TransferRequest req;
+                        req.from = account("b");
+                        req.to = account("a");
+                        req.amount = static_cast<uint16_t>(std::max<std::size_t>(1, (std::rand()%9+1)*100/batchSize));
+                        batch.requests.push_back(req);
+                    }
+                    return {{std::move(batch)}};
+                }
                 TransferRequest req;
                 req.from = account("b");
                 req.to = account("a");
@@ -327,10 +423,35 @@ void run(typename A::EnvironmentType *env, Chain *chain, std::string const &part
     r.finalize();
 
     tc();
+
+    if (checkpointer) {
+        checkpointer->waitForSave();
+    }
+}
+
+//number of TransferBatch items on the chain
+template <class Chain>
+std::size_t countBatches(Chain *chain) {
+    std::size_t count = 0;
+    auto current = chain->head(nullptr);
+    while (true) {
+        auto next = chain->fetchNext(current);
+        if (!next) {
+            break;
+        }
+        current = std::move(*next);
+        auto const *data = Chain::extractData(current);
+        if (data && std::holds_alternative<TransferBatch>(data->value)) {
+            ++count;
+        }
+    }
+    return count;
 }
 
+//returns false if batches were asked for (and a transfer part was run) but
+//none made it onto the chain
 template <class Chain>
-void histRun(Chain *chain, std::string const &part, std::string const &todayStr, bool dontLog) {
+bool histRun(Chain *chain, std::string const &part, std::string const &todayStr, bool dontLog, std::size_t batchSize) {
     using TheEnvironment = infra::Environment<
         infra::CheckTimeComponent<true>,
         infra::FlagExitControlComponent,
@@ -342,7 +463,7 @@ void histRun(Chain *chain, std::string const &part, std::string const &todayStr,
     using A = infra::SinglePassIterationApp<TheEnvironment>;
     TheEnvironment env;  
     env.infra::template ConstValueHolderComponent<EnvValues<Chain>>::operator=(
-        infra::ConstValueHolderComponent<EnvValues<Chain>> {chain, todayStr, dontLog}
+        infra::ConstValueHolderComponent<EnvValues<Chain>> {chain, todayStr, dontLog, batchSize}
     );  
     std::chrono::steady_clock::time_point tp1, tp2;
     if (dontLog) {
@@ -358,10 +479,16 @@ void histRun(Chain *chain, std::string const &part, std::string const &todayStr,
         auto micros = std::chrono::duration_cast<std::chrono::microseconds>(tp2-tp1).count();
         std::cerr << "Used time: " << micros << " micros\n";
     }
+    if (batchSize > 1 && part != "process") {
+        auto batches = countBatches(chain);
+        std::cerr << batches << " batch(es) of " << batchSize << " appended\n";
+        return (batches > 0);
+    }
+    return true;
 }
 
 template <class Chain>
-void simRun(Chain *chain, std::string const &part, std::string const &todayStr) {
+void simRun(Chain *chain, std::string const &part, std::string const &todayStr, std::size_t batchSize) {
     using TheEnvironment = infra::Environment<
         infra::CheckTimeComponent<true>,
         infra::FlagExitControlComponent,
@@ -381,7 +508,7 @@ void simRun(Chain *chain, std::string const &part, std::string const &todayStr)
         basic::real_time_clock::ClockComponent(clockSettings)
     );
     env.infra::template ConstValueHolderComponent<EnvValues<Chain>>::operator=(
-        infra::ConstValueHolderComponent<EnvValues<Chain>> {chain, todayStr, false}
+        infra::ConstValueHolderComponent<EnvValues<Chain>> {chain, todayStr, false, batchSize}
     );
     run<A,ClockImp,Chain>(&env, chain, part, [&env,todayStr]() {
         infra::terminationController(infra::TerminateAtTimePoint {
@@ -395,7 +522,7 @@ void simRun(Chain *chain, std::string const &part, std::string const &todayStr)
 }
 
 template <class Chain>
-void rtRun(Chain *chain, std::string const &part, std::string const &todayStr) {
+void rtRun(Chain *chain, std::string const &part, std::string const &todayStr, std::size_t batchSize) {
     using TheEnvironment = infra::Environment<
         infra::CheckTimeComponent<true>,
         infra::FlagExitControlComponent,
@@ -407,7 +534,7 @@ void rtRun(Chain *chain, std::string const &part, std::string const &todayStr) {
     using A = infra::RealTimeApp<TheEnvironment>;
     TheEnvironment env;
     env.infra::template ConstValueHolderComponent<EnvValues<Chain>>::operator=(
-        infra::ConstValueHolderComponent<EnvValues<Chain>> {chain, todayStr, false}
+        infra::ConstValueHolderComponent<EnvValues<Chain>> {chain, todayStr, false, batchSize}
     );
     run<A,ClockImp,Chain>(&env, chain, part, []() {
         infra::terminationController(infra::TerminateAfterDuration {
@@ -420,7 +547,7 @@ void rtRun(Chain *chain, std::string const &part, std::string const &todayStr) {
 
 int main(int argc, char **argv) {
     if (argc > 1 && std::string(argv[1]) == "help") {
-        std::cout << "Usage: shared_chain_test (rt|hist|sim) (etcd1|etcd2|redis|in-mem|lock-free-in-mem|lock-free-in-shared-mem) [a-to-b|b-to-a|process]\n";
+        std::cout << "Usage: shared_chain_test (rt|hist|sim) (etcd1|etcd2|redis|in-mem|lock-free-in-mem|lock-free-in-shared-mem) [a-to-b|b-to-a|process] [batch size]\n";
         return 0;
     }
     enum {
@@ -456,6 +583,16 @@ int main(int argc, char **argv) {
         chainChoice = Etcd1;
     }
     std::string part = ((argc <= 3)?"":argv[3]);
+    std::size_t batchSize = 1;
+    if (argc > 4) {
+        try {
+            batchSize = std::max<std::size_t>(1, boost::lexical_cast<std::size_t>(argv[4]));
+        } catch (boost::bad_lexical_cast const &) {
+            std::cerr << "Batch size must be a positive integer\n";
+            return 1;
+        }
+    }
+    bool ok = true;
     switch (mode) {
     case RT:
         if (chainChoice == InMem || chainChoice == LockFreeInMem) {
@@ -469,7 +606,7 @@ int main(int argc, char **argv) {
                 , transport::lock_free_in_memory_shared_chain::BoostSharedMemoryChainFastRecoverSupport::ByOffset
                 , transport::lock_free_in_memory_shared_chain::BoostSharedMemoryChainExtraDataProtectionStrategy::MutexProtected
             > sharedMemChain {today+"-chain", 10*1024*1024};
-            rtRun(&sharedMemChain, part, today);
+            rtRun(&sharedMemChain, part, today, batchSize);
         } else 
         if (chainChoice == Redis) {
             std::string today = infra::withtime_utils::localTimeString(std::chrono::system_clock::now()).substr(0,10);
@@ -477,7 +614,7 @@ int main(int argc, char **argv) {
                     transport::redis_shared_chain::RedisChainConfiguration()
                         .HeadKey(today+"-head")
                 };
-            rtRun(&redisChain, part, today);
+            rtRun(&redisChain, part, today, batchSize);
         } else {
             std::string today = infra::withtime_utils::localTimeString(std::chrono::system_clock::now()).substr(0,10);
             transport::etcd_shared_chain::EtcdChain<DataOnChain> etcdChain {
@@ -489,7 +626,7 @@ int main(int argc, char **argv) {
                     .AutomaticallyDuplicateToRedis(true)
                     .UseWatchThread(true)
             };
-            rtRun(&etcdChain, part, today);
+            rtRun(&etcdChain, part, today, batchSize);
         }
         break;
     case Sim:
@@ -503,14 +640,14 @@ int main(int argc, char **argv) {
                 , transport::lock_free_in_memory_shared_chain::BoostSharedMemoryChainFastRecoverSupport::ByOffset
                 , transport::lock_free_in_memory_shared_chain::BoostSharedMemoryChainExtraDataProtectionStrategy::MutexProtected
             > sharedMemChain {"2020-01-01-chain", 10*1024*1024};
-            simRun(&sharedMemChain, part, "2020-01-01");
+            simRun(&sharedMemChain, part, "2020-01-01", batchSize);
         } else 
         if (chainChoice == Redis) {
             transport::redis_shared_chain::RedisChain<DataOnChain> redisChain {
                 transport::redis_shared_chain::RedisChainConfiguration()
                     .HeadKey("2020-01-01-head")
             };
-            simRun(&redisChain, part, "2020-01-01");
+            simRun(&redisChain, part, "2020-01-01", batchSize);
         } else {
             transport::etcd_shared_chain::EtcdChain<DataOnChain> etcdChain {
                 transport::etcd_shared_chain::EtcdChainConfiguration()
@@ -521,11 +658,13 @@ int main(int argc, char **argv) {
                     .AutomaticallyDuplicateToRedis(true)
                     .UseWatchThread(true)
             };
-            simRun(&etcdChain, part, "2020-01-01");
+            simRun(&etcdChain, part, "2020-01-01", batchSize);
         }
         break;
     case Hist:
     case HistNoLog:
+        //a hist run with a batch size is also the check that batches get
+        //appended: it fails if none did
         switch (chainChoice) {
         case Etcd1:
             {
@@ -536,7 +675,7 @@ int main(int argc, char **argv) {
                         .DuplicateFromRedis(false)
                         .UseWatchThread(false)
                 };
-                histRun(&etcdChain, part, "2020-01-01", (mode == HistNoLog));
+                ok = histRun(&etcdChain, part, "2020-01-01", (mode == HistNoLog), batchSize);
             }
             break;
         case Etcd2:
@@ -548,7 +687,7 @@ int main(int argc, char **argv) {
                         .DuplicateFromRedis(false)
                         .UseWatchThread(false)
                 };
-                histRun(&etcdChain, part, "2020-01-01", (mode == HistNoLog));
+                ok = histRun(&etcdChain, part, "2020-01-01", (mode == HistNoLog), batchSize);
             }
             break;
         case Redis:
@@ -557,19 +696,19 @@ int main(int argc, char **argv) {
                     transport::redis_shared_chain::RedisChainConfiguration()
                         .HeadKey("2020-01-01-head")
                 };
-                histRun(&redisChain, part, "2020-01-01", (mode == HistNoLog));
+                ok = histRun(&redisChain, part, "2020-01-01", (mode == HistNoLog), batchSize);
             }
             break;
         case InMem:
             {
                 basic::simple_shared_chain::InMemoryWithLockChain<DataOnChain> chain;
-                histRun(&chain, part, "2020-01-01", (mode == HistNoLog));
+                ok = histRun(&chain, part, "2020-01-01", (mode == HistNoLog), batchSize);
             }
             break;
         case LockFreeInMem:
             {
                 basic::simple_shared_chain::InMemoryLockFreeChain<DataOnChain> chain;
-                histRun(&chain, part, "2020-01-01", (mode == HistNoLog));
+                ok = histRun(&chain, part, "2020-01-01", (mode == HistNoLog), batchSize);
             }
             break;
         case LockFreeInSharedMem:
@@ -579,7 +718,7 @@ int main(int argc, char **argv) {
                     , transport::lock_free_in_memory_shared_chain::BoostSharedMemoryChainFastRecoverSupport::ByName
                     , transport::lock_free_in_memory_shared_chain::BoostSharedMemoryChainExtraDataProtectionStrategy::Unsafe
                 > chain {"2020-01-01-chain", 10*1024*1024};
-                histRun(&chain, part, "2020-01-01", (mode == HistNoLog));
+                ok = histRun(&chain, part, "2020-01-01", (mode == HistNoLog), batchSize);
             }
             break;
         default:
@@ -589,5 +728,5 @@ int main(int argc, char **argv) {
     default:
         break;
     }
-    return 0;
+    return ok?0:1;
 }
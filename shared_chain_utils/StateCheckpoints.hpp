@@ -0,0 +1,205 @@
+#ifndef STATE_CHECKPOINTS_HPP_
+#define STATE_CHECKPOINTS_HPP_
+
+#include <tm_kit/basic/ByteData.hpp>
+#include <tm_kit/basic/SerializationHelperMacros.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+//Versioned snapshots of a folded chain state, kept in the chain's extra data
+//storage so that a reader can start from the snapshot furthest along the
+//chain (at or before a given position) and only fold the tail of the chain.
+//
+//The snapshots rotate through a fixed number of slots ("<prefix>/<slot>"),
+//and an index ("<prefix>/index") records, for each live slot, the version,
+//the chain ID the state was folded up to, the number of folded items and the
+//state's timestamp. A slot is always written before the index entry pointing
+//to it, and every slot stores its version next to the state, so a slot that
+//was overwritten after the index was read is detected and skipped.
+//
+//Not tied to any one chain data type, so that any program on a shared chain
+//(simple_demo_chain_version, shared_chain_test) can use it.
+namespace shared_chain_utils { namespace checkpoints {
+
+    #define CheckpointEntryFields \
+        ((int64_t, version)) \
+        ((std::string, chainID)) \
+        ((int64_t, itemCount)) \
+        ((int64_t, timestamp)) \
+        ((uint32_t, slot))
+    #define CheckpointIndexFields \
+        ((std::vector<shared_chain_utils::checkpoints::CheckpointEntry>, entries))
+
+    TM_BASIC_CBOR_CAPABLE_STRUCT(CheckpointEntry, CheckpointEntryFields);
+    TM_BASIC_CBOR_CAPABLE_STRUCT(CheckpointIndex, CheckpointIndexFields);
+
+    struct CheckpointConfig {
+        std::string prefix;
+        int64_t everyItems = 1000;
+        int64_t everyMillis = 10000;
+        uint32_t slots = 8;
+    };
+
+    inline std::string checkpointIndexKey(std::string const &prefix) {
+        return prefix+"/index";
+    }
+    inline std::string checkpointSlotKey(std::string const &prefix, uint32_t slot) {
+        return prefix+"/"+std::to_string(slot);
+    }
+
+    //Returns the snapshot that has folded the most chain items, but no more
+    //than atOrBeforeItemCount, or std::nullopt if there is none (or the
+    //chain cannot store extra data). Snapshots are ordered by chain position
+    //and not by timestamp, since the state timestamps come from the items
+    //and say nothing about how far along the chain a snapshot is.
+    template <class State, class Chain>
+    std::optional<State> loadLatestCheckpoint(
+        Chain *chain
+        , std::string const &prefix
+        , int64_t atOrBeforeItemCount = std::numeric_limits<int64_t>::max()
+    ) {
+        if constexpr (Chain::SupportsExtraData) {
+            auto index = chain->template loadExtraData<CheckpointIndex>(checkpointIndexKey(prefix));
+            if (!index) {
+                return std::nullopt;
+            }
+            auto entries = std::move(index->entries);
+            std::sort(entries.begin(), entries.end(), [](CheckpointEntry const &a, CheckpointEntry const &b) {
+                if (a.itemCount != b.itemCount) {
+                    return a.itemCount > b.itemCount;
+                }
+                return a.version > b.version;
+            });
+            for (auto const &e : entries) {
+                if (e.itemCount > atOrBeforeItemCount) {
+                    continue;
+                }
+                auto val = chain->template loadExtraData<std::tuple<int64_t, State>>(checkpointSlotKey(prefix, e.slot));
+                if (val && std::get<0>(*val) == e.version) {
+                    return std::get<1>(std::move(*val));
+                }
+            }
+            return std::nullopt;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    //Writes one snapshot synchronously, as the next version after the newest
+    //one in the index. Callers must not run this concurrently for the same
+    //prefix.
+    template <class State, class Chain>
+    void saveCheckpoint(
+        Chain *chain
+        , CheckpointConfig const &config
+        , State const &state
+        , std::string const &chainID
+        , int64_t itemCount
+        , int64_t timestampMillis
+    ) {
+        if constexpr (Chain::SupportsExtraData) {
+            auto index = chain->template loadExtraData<CheckpointIndex>(checkpointIndexKey(config.prefix));
+            if (!index) {
+                index = CheckpointIndex {};
+            }
+            int64_t version = 1;
+            for (auto const &e : index->entries) {
+                version = std::max(version, e.version+1);
+            }
+            uint32_t slot = (uint32_t) (version % std::max<uint32_t>(config.slots, 1));
+            chain->template saveExtraData<std::tuple<int64_t, State>>(
+                checkpointSlotKey(config.prefix, slot)
+                , std::tuple<int64_t, State> {version, state}
+            );
+            index->entries.erase(
+                std::remove_if(index->entries.begin(), index->entries.end(), [slot](CheckpointEntry const &e) {
+                    return e.slot == slot;
+                })
+                , index->entries.end()
+            );
+            index->entries.push_back(CheckpointEntry {
+                version, chainID, itemCount, timestampMillis, slot
+            });
+            chain->template saveExtraData<CheckpointIndex>(checkpointIndexKey(config.prefix), *index);
+        }
+    }
+
+    //Decides when to take a snapshot (every config.everyItems folded items or
+    //every config.everyMillis of chain time, whichever comes first) and
+    //writes it on a background thread, so the caller (an idle worker or an
+    //exporter) is never held up by the storage round-trips. If the previous
+    //snapshot is still being written, the new one is skipped and retried on
+    //the next call.
+    template <class State>
+    class Checkpointer {
+    private:
+        CheckpointConfig config_;
+        std::optional<int64_t> lastItemCount_;
+        int64_t lastMillis_;
+        std::string lastChainID_;
+        std::shared_ptr<std::atomic<bool>> saving_;
+        std::shared_ptr<std::mutex> mutex_;
+    public:
+        Checkpointer(CheckpointConfig const &config)
+            : config_(config), lastItemCount_(std::nullopt), lastMillis_(0), lastChainID_()
+            , saving_(std::make_shared<std::atomic<bool>>(false))
+            , mutex_(std::make_shared<std::mutex>())
+        {
+            if (config_.slots == 0) {
+                config_.slots = 1;
+            }
+        }
+        CheckpointConfig const &config() const {
+            return config_;
+        }
+        //waits until the snapshot being written (if any) is done, for
+        //programs that are about to release the chain
+        void waitForSave() const {
+            while (saving_->load()) {
+                std::this_thread::yield();
+            }
+        }
+        template <class Chain>
+        void maybeSave(Chain *chain, State const &state, std::string const &chainID, int64_t itemCount, int64_t timestampMillis) {
+            if constexpr (Chain::SupportsExtraData) {
+                if (chainID == lastChainID_) {
+                    return;
+                }
+                if (!lastItemCount_) {
+                    //the first call only establishes the baseline, the state
+                    //we started from is already covered by a snapshot or by
+                    //the chain head
+                    lastItemCount_ = itemCount;
+                    lastMillis_ = timestampMillis;
+                    lastChainID_ = chainID;
+                    return;
+                }
+                if (itemCount < *lastItemCount_+config_.everyItems && timestampMillis < lastMillis_+config_.everyMillis) {
+                    return;
+                }
+                if (saving_->exchange(true)) {
+                    return;
+                }
+                lastItemCount_ = itemCount;
+                lastMillis_ = timestampMillis;
+                lastChainID_ = chainID;
+                std::thread([chain,state,chainID,itemCount,timestampMillis,config=config_,saving=saving_,mutex=mutex_]() {
+                    std::lock_guard<std::mutex> _(*mutex);
+                    saveCheckpoint<State>(chain, config, state, chainID, itemCount, timestampMillis);
+                    saving->store(false);
+                }).detach();
+            }
+        }
+    };
+
+} }
+
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(shared_chain_utils::checkpoints::CheckpointEntry, CheckpointEntryFields);
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(shared_chain_utils::checkpoints::CheckpointIndex, CheckpointIndexFields);
+
+#endif
@@ -4,6 +4,7 @@
 #include "defs.pb.h"
 #include "simple_demo_chain_version/chain_data/ChainData.hpp"
 #include "simple_demo_chain_version/calculator_logic/CalculatorStateFolder.hpp"
+#include "simple_demo_chain_version/chain_data/ChainMetrics.hpp"
 #include "simple_demo_chain_version/external_logic/ExternalCalculator.hpp"
 
 #include <tm_kit/infra/RealTimeApp.hpp>
@@ -32,6 +33,8 @@ namespace simple_demo_chain_version { namespace calculator_logic {
             ResponseType
             , std::optional<std::tuple<std::string, simple_demo_chain_version::ChainData>>
         > handleInput(Env *env, Chain *chain, RealInput<Env> const &input, CalculatorState const &state) {
+            static auto &metrics = chain_metrics::metricsFor("calculator");
+            metrics.recordAppendAttempt(Env::id_to_string(input.value.id()));
             int64_t now = infra::withtime_utils::sinceEpoch<std::chrono::milliseconds>(env->now());
             simple_demo_chain_version::ChainData d {
                 now
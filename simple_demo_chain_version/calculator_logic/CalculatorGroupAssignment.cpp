@@ -0,0 +1,56 @@
+#include "CalculatorGroupAssignment.hpp"
+
+#include <algorithm>
+
+namespace simple_demo_chain_version { namespace calculator_logic {
+    namespace {
+        //FNV-1a, so that every process computes the same hash
+        uint64_t groupHash(std::string const &workerID, uint32_t group) {
+            uint64_t h = 14695981039346656037ULL;
+            auto mix = [&h](unsigned char c) {
+                h ^= c;
+                h *= 1099511628211ULL;
+            };
+            for (auto c : workerID) {
+                mix((unsigned char) c);
+            }
+            mix('#');
+            for (int ii=0; ii<4; ++ii) {
+                mix((unsigned char) ((group >> (8*ii)) & 0xff));
+            }
+            return h;
+        }
+    }
+
+    std::vector<std::string> liveCalculatorWorkers(CalculatorState const &state) {
+        std::vector<std::string> ret;
+        for (auto const &item : state.workerLastSeen) {
+            if (item.second+WorkerLivenessMillis >= state.updateTimestamp) {
+                ret.push_back(item.first);
+            }
+        }
+        std::sort(ret.begin(), ret.end());
+        return ret;
+    }
+
+    std::vector<bool> groupsOwnedBy(CalculatorState const &state, std::string const &workerID) {
+        std::vector<bool> ret(CalculatorGroupCount, false);
+        auto workers = liveCalculatorWorkers(state);
+        if (!std::binary_search(workers.begin(), workers.end(), workerID)) {
+            return ret;
+        }
+        for (uint32_t g=0; g<CalculatorGroupCount; ++g) {
+            std::string const *winner = nullptr;
+            uint64_t best = 0;
+            for (auto const &w : workers) {
+                auto h = groupHash(w, g);
+                if (!winner || h > best) {
+                    winner = &w;
+                    best = h;
+                }
+            }
+            ret[g] = (*winner == workerID);
+        }
+        return ret;
+    }
+} }
@@ -0,0 +1,26 @@
+#ifndef CALCULATOR_GROUP_ASSIGNMENT_HPP_
+#define CALCULATOR_GROUP_ASSIGNMENT_HPP_
+
+#include "simple_demo_chain_version/calculator_logic/CalculatorStateFolder.hpp"
+
+#include <string>
+#include <vector>
+
+namespace simple_demo_chain_version { namespace calculator_logic {
+
+    //The groups are split among the live workers by rendezvous hashing: each
+    //group goes to the live worker with the highest hash of (worker, group).
+    //A worker joining or leaving only moves the groups it wins or held.
+    //Liveness is judged against the chain time of the state, so every worker
+    //that has folded up to the same chain item computes the same assignment,
+    //and the handover happens at a well-defined point of the chain.
+
+    std::vector<std::string> liveCalculatorWorkers(CalculatorState const &state);
+
+    //Returns, indexed by group, whether the group is owned by workerID.
+    //If workerID is not (yet) in the membership table, it owns nothing.
+    std::vector<bool> groupsOwnedBy(CalculatorState const &state, std::string const &workerID);
+
+} }
+
+#endif
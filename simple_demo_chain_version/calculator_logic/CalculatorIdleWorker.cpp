@@ -4,100 +4,87 @@ namespace simple_demo_chain_version { namespace calculator_logic {
     std::tuple<
         std::optional<CalculatorIdleWorker::OffChainUpdateType>
         , std::vector<std::tuple<std::string, simple_demo_chain_version::ChainData>>
-    > CalculatorIdleWorker::realWork(int64_t now, CalculatorState const &state) {
-        std::unordered_map<int, double> valueRef;
-        if (!state.newlyPlacedRequests.empty()) {
-            std::vector<std::tuple<int,double>> canAccept;
-            std::optional<int> firstToTimeout = std::nullopt;
-            for (auto const &item : state.newlyPlacedRequests) {
-                if (item.second.placedTimestamp + 1000 >= now) {
-                    canAccept.push_back({item.first, item.second.requestValue});
-                } else {
-                    firstToTimeout = item.first;
-                }
+    > CalculatorIdleWorker::realWork(int64_t now, CalculatorState const &state, std::optional<std::vector<bool>> const &ownedGroups) {
+        auto owns = [&ownedGroups](OneRequestState const &r) {
+            return (!ownedGroups || (r.group < ownedGroups->size() && (*ownedGroups)[r.group]));
+        };
+        //Everything that is ready in this pass goes out in one vector, so that
+        //the chain writer can extend the chain with all of it at once instead
+        //of paying one append round-trip per idle pass
+        OffChainUpdateType update;
+        //every newly placed request of an owned group is either accepted or
+        //timed out in this pass; the ones of other workers' groups stay in
+        //the map and are skipped again on every pass until their owner acts
+        std::vector<int> canAccept;
+        for (auto const &item : state.newlyPlacedRequests) {
+            if (!owns(item.second)) {
+                continue;
             }
-            if (!canAccept.empty()) {
-                std::vector<int> ids;
-                for (auto const &item : canAccept) {
-                    ids.push_back(std::get<0>(item));
-                    valueRef.insert({std::get<0>(item), std::get<1>(item)});
-                }
-                simple_demo_chain_version::ChainData d {
-                    now
-                    , ConfirmRequestReceipt {std::move(ids)}
-                };
-                return {
-                    OffChainUpdateType {d, valueRef}
-                    , {std::tuple<std::string, simple_demo_chain_version::ChainData> {
-                        ""
-                        , d
-                    }}
-                };
-            } else if (firstToTimeout) {
-                simple_demo_chain_version::ChainData d {
+            if (item.second.placedTimestamp + 1000 >= now) {
+                canAccept.push_back(item.first);
+                update.valueRef.insert({item.first, item.second.requestValue});
+            } else {
+                update.actions.push_back(simple_demo_chain_version::ChainData {
                     now
                     , RequestCompleted {
-                        *firstToTimeout
+                        item.first
                         , RequestCompletedFashion::TimeoutBeforeAcceptance
                     }
-                };
-                return {
-                    OffChainUpdateType {d, valueRef}
-                    , {std::tuple<std::string, simple_demo_chain_version::ChainData> {
-                        ""
-                        , d
-                    }}
-                };
+                });
             }
-        } else if (!state.requestsBeingHandled.empty()) {
-            for (auto const &item : state.requestsBeingHandled) {
-                if (item.second.finalResponseReceived) {
-                    simple_demo_chain_version::ChainData d {
-                        now
-                        , RequestCompleted {item.first, RequestCompletedFashion::Fulfilled}
-                    };
-                    return {
-                        OffChainUpdateType {d, valueRef}
-                        , {std::tuple<std::string, simple_demo_chain_version::ChainData> {
-                            ""
-                            , d
-                        }, std::tuple<std::string, simple_demo_chain_version::ChainData> {
-                            ""
-                            , d
-                        }}
-                    };
-                } else if (item.second.latestResponseTimestamp+5000 < now) {
-                    if (item.second.latestResponseTimestamp != 0) {
-                        simple_demo_chain_version::ChainData d {
-                            now
-                            , RequestCompleted {item.first, RequestCompletedFashion::PartiallyHandledThenTimeout}
-                        };
-                        return {
-                            OffChainUpdateType {d, valueRef}
-                            , {std::tuple<std::string, simple_demo_chain_version::ChainData> {
-                                ""
-                                , d
-                            }}
-                        };
-                    } else if (item.second.acceptedTimestamp+5000 < now) {
-                        simple_demo_chain_version::ChainData d {
-                            now
-                            , RequestCompleted {item.first, RequestCompletedFashion::AcceptedThenTimeoutBeforeResponse}
-                        };
-                        return {
-                            OffChainUpdateType {d, valueRef}
-                            , {std::tuple<std::string, simple_demo_chain_version::ChainData> {
-                                ""
-                                , d
-                            }}
-                        };
-                    }
+        }
+        if (!canAccept.empty()) {
+            update.actions.insert(update.actions.begin(), simple_demo_chain_version::ChainData {
+                now
+                , ConfirmRequestReceipt {std::move(canAccept)}
+            });
+        }
+        //the folder keeps the ready set and the deadline index up to date,
+        //so only the requests that are actually due are looked at here
+        for (auto const &id : state.finalResponseReceivedIDs) {
+            auto reqIter = state.requestsBeingHandled.find(id);
+            if (reqIter == state.requestsBeingHandled.end() || !owns(reqIter->second)) {
+                continue;
+            }
+            update.actions.push_back(simple_demo_chain_version::ChainData {
+                now
+                , RequestCompleted {id, RequestCompletedFashion::Fulfilled}
+            });
+        }
+        for (auto iter = state.handlingDeadlines.begin(); iter != state.handlingDeadlines.end() && iter->first < now; ++iter) {
+            for (auto const &id : iter->second) {
+                if (state.finalResponseReceivedIDs.find(id) != state.finalResponseReceivedIDs.end()) {
+                    continue;
+                }
+                auto reqIter = state.requestsBeingHandled.find(id);
+                if (reqIter == state.requestsBeingHandled.end() || !owns(reqIter->second)) {
+                    continue;
                 }
+                update.actions.push_back(simple_demo_chain_version::ChainData {
+                    now
+                    , RequestCompleted {
+                        id
+                        , (reqIter->second.latestResponseTimestamp != 0)
+                            ? RequestCompletedFashion::PartiallyHandledThenTimeout
+                            : RequestCompletedFashion::AcceptedThenTimeoutBeforeResponse
+                    }
+                });
             }
         }
+        if (update.actions.empty()) {
+            return {
+                std::nullopt
+                , {}
+            };
+        }
+        std::vector<std::tuple<std::string, simple_demo_chain_version::ChainData>> toAppend;
+        toAppend.reserve(update.actions.size());
+        for (auto const &d : update.actions) {
+            toAppend.push_back({"", d});
+        }
         return {
-            std::nullopt
-            , {}
+            std::move(update)
+            , std::move(toAppend)
         };
     }
-} }
\ No newline at end of file
+} }
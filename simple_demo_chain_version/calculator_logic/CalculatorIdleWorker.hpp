@@ -4,51 +4,118 @@
 #include "defs.pb.h"
 #include "simple_demo_chain_version/chain_data/ChainData.hpp"
 #include "simple_demo_chain_version/calculator_logic/CalculatorStateFolder.hpp"
+#include "simple_demo_chain_version/calculator_logic/CalculatorGroupAssignment.hpp"
+#include "simple_demo_chain_version/chain_data/ChainMetrics.hpp"
 
-#include <thread>
+#include <algorithm>
 
 namespace simple_demo_chain_version { namespace calculator_logic {
 
-    //This worker scans the ids and finds the first one(s) that can be marked
+    //This worker scans the ids and finds all the ones that can be marked
     //as completed. It also accepts newly placed requests.
+    //
+    //It only acts on the requests in the groups assigned to this worker (see
+    //CalculatorGroupAssignment.hpp), and puts a heartbeat for this worker on
+    //the chain when it joins, and after that only while there are requests
+    //to act on and its membership would otherwise expire, so an idle chain
+    //does not grow. After an idle spell every worker has expired when the
+    //next request comes in, and they all rejoin right away. If the folder
+    //was given a static group list, the heartbeats never show up in the
+    //state, and after a few seconds the worker stops sending them and acts
+    //on everything the folder keeps.
+    //
+    //All workers share the "calculator_state" checkpoints, so only the
+    //worker that owns group 0 saves them. With a static group list each
+    //worker only has part of the state, and none of them saves.
     
     class CalculatorIdleWorker {
     private:
-        int64_t lastSaveTime = 0;
+        shared_chain_utils::checkpoints::Checkpointer<CalculatorState> checkpointer_;
+        std::string workerID_;
+        int64_t firstHeartbeatTime_ = 0;
+        int64_t lastHeartbeatTime_ = 0;
+        bool seenSelf_ = false;
+        bool staticGroups_ = false;
+
+        bool heartbeatDue(int64_t now, CalculatorState const &state) const {
+            if (now < lastHeartbeatTime_+WorkerHeartbeatMillis) {
+                //the previous one may not be folded yet
+                return false;
+            }
+            auto iter = state.workerLastSeen.find(workerID_);
+            if (iter == state.workerLastSeen.end()) {
+                return true;
+            }
+            if (state.newlyPlacedRequests.empty() && state.requestsBeingHandled.empty()) {
+                return false;
+            }
+            return (iter->second+WorkerLivenessMillis-WorkerHeartbeatMillis <= std::max(now, state.updateTimestamp));
+        }
     public:
+        CalculatorIdleWorker()
+            : checkpointer_(shared_chain_utils::checkpoints::CheckpointConfig {"calculator_state", 1000, 10000, 8})
+        {}
+
         struct OffChainUpdateType {
-            simple_demo_chain_version::ChainData action;
+            std::vector<simple_demo_chain_version::ChainData> actions;
             std::unordered_map<int, double> valueRef;
         };
 
         template <class Env, class Chain>
-        void initialize(Env *env, Chain *chain) {}
+        void initialize(Env *env, Chain *chain) {
+            workerID_ = Env::id_to_string(env->new_id());
+        }
 
         template <class Env, class Chain>
         std::tuple<
             std::optional<OffChainUpdateType>
             , std::vector<std::tuple<std::string, simple_demo_chain_version::ChainData>>
         > work(Env *env, Chain *chain, CalculatorState const &state) {
+            static auto &metrics = chain_metrics::metricsFor("calculator");
+            chain_metrics::IdleTimer timer(metrics);
             int64_t now = infra::withtime_utils::sinceEpoch<std::chrono::milliseconds>(env->now());
-            if constexpr (Chain::SupportsExtraData) {
-                if (now > lastSaveTime+10000) {
-                    //save state every 10 seconds
-                    std::thread([chain,state]() {
-                        chain->template saveExtraData<CalculatorState>(
-                            "calculator_state", state
-                        );
-                    }).detach();
-                    lastSaveTime = now;
+            std::optional<std::vector<bool>> ownedGroups = std::nullopt;
+            if (!staticGroups_) {
+                if (!seenSelf_) {
+                    seenSelf_ = (state.workerLastSeen.find(workerID_) != state.workerLastSeen.end());
+                    if (!seenSelf_ && firstHeartbeatTime_ != 0 && state.updateTimestamp > firstHeartbeatTime_+WorkerLivenessMillis) {
+                        staticGroups_ = true;
+                        env->log(infra::LogLevel::Info, "Calculator heartbeats are not being recorded, using the static group list");
+                    }
+                }
+                if (!staticGroups_) {
+                    ownedGroups = groupsOwnedBy(state, workerID_);
+                }
+            }
+
+            if (ownedGroups && !ownedGroups->empty() && (*ownedGroups)[0]) {
+                //snapshot state every 1000 items or 10 seconds
+                checkpointer_.maybeSave(chain, state, state.latestID, state.foldedCount, state.updateTimestamp);
+            }
+
+            auto ret = realWork(now, state, ownedGroups);
+            if (!staticGroups_ && heartbeatDue(now, state)) {
+                std::get<1>(ret).push_back({
+                    ""
+                    , simple_demo_chain_version::ChainData {
+                        now
+                        , CalculatorHeartbeat {workerID_}
+                    }
+                });
+                if (firstHeartbeatTime_ == 0) {
+                    firstHeartbeatTime_ = now;
                 }
+                lastHeartbeatTime_ = now;
             }
-            return realWork(now, state);
+            return ret;
         }
 
+        //if ownedGroups is std::nullopt, all requests in the state are acted on
         std::tuple<
             std::optional<OffChainUpdateType>
             , std::vector<std::tuple<std::string, simple_demo_chain_version::ChainData>>
-        > realWork(int64_t now, CalculatorState const &state);
+        > realWork(int64_t now, CalculatorState const &state, std::optional<std::vector<bool>> const &ownedGroups = std::nullopt);
     };
 } }
 
-#endif
\ No newline at end of file
+#endif
@@ -18,14 +18,22 @@ namespace simple_demo_chain_version { namespace calculator_logic {
         typename R::template Source<ChainData> chainDataGeneratedFromCalculator;
     };
 
-    template <class R>
+    //the folder, input handler and idle worker default to the ones for a
+    //ChainData chain; a CompactChainData chain passes them through the
+    //wrappers in chain_data/CompactChainAdapters.hpp
+    template <
+        class R
+        , class Folder = CalculatorStateFolder
+        , class InputHandler = CalculatorFacilityInputHandler
+        , class IdleWorker = CalculatorIdleWorker
+    >
     CalculatorLogicProviderResult<R> calculatorLogicMain(
         R &r 
         , basic::simple_shared_chain::ChainWriterOnOrderFacilityWithExternalEffectsFactory<
             typename R::AppType 
-            , CalculatorStateFolder
-            , CalculatorFacilityInputHandler
-            , CalculatorIdleWorker
+            , Folder
+            , InputHandler
+            , IdleWorker
         > chainFacilityFactory
         , typename R::template FacilitioidConnector<ExternalCalculatorInput,ExternalCalculatorOutput> wrappedExternalCalculator
         , std::string const &graphPrefix
@@ -37,23 +45,25 @@ namespace simple_demo_chain_version { namespace calculator_logic {
         //(through the importer part of the ChainWriter), so we feed it to the 
         //external calculator through an action
 
-        using U = CalculatorIdleWorker::OffChainUpdateType;
+        using U = typename IdleWorker::OffChainUpdateType;
 
         auto sendCommandAction = M::template liftMulti<U>(
             [env](U &&u) -> std::vector<ExternalCalculatorInput> {
                 std::vector<ExternalCalculatorInput> ret;
-                std::visit([env,&u,&ret](auto &&update) {
-                    using T = std::decay_t<decltype(update)>;
-                    if constexpr (std::is_same_v<T, ConfirmRequestReceipt>) {
-                        for (auto const &item : u.valueRef) {
-                            ExternalCalculatorInput c {item.first, item.second};
-                            std::ostringstream oss;
-                            oss << "Sent external request {id=" << c.id << ", input=" << c.input << "}";
-                            env->log(infra::LogLevel::Info, oss.str());
-                            ret.push_back(std::move(c));
+                for (auto &action : u.actions) {
+                    std::visit([env,&u,&ret](auto &&update) {
+                        using T = std::decay_t<decltype(update)>;
+                        if constexpr (std::is_same_v<T, ConfirmRequestReceipt>) {
+                            for (auto const &item : u.valueRef) {
+                                ExternalCalculatorInput c {item.first, item.second};
+                                std::ostringstream oss;
+                                oss << "Sent external request {id=" << c.id << ", input=" << c.input << "}";
+                                env->log(infra::LogLevel::Info, oss.str());
+                                ret.push_back(std::move(c));
+                            }
                         }
-                    }
-                }, std::move(u.action.update));
+                    }, std::move(action.update));
+                }
                 return ret;
             }
         );
@@ -105,9 +115,9 @@ namespace simple_demo_chain_version { namespace calculator_logic {
             basic::CommonFlowUtilComponents<M>::template idFunc<ChainData>()
         );
         r.registerAction(graphPrefix+"/combiner", combiner);
-        auto takeChainDataForPrint = M::template liftPure<U>(
-            [](U &&u) -> ChainData {
-                return std::move(u.action);
+        auto takeChainDataForPrint = M::template liftMulti<U>(
+            [](U &&u) -> std::vector<ChainData> {
+                return std::move(u.actions);
             }
         );
         r.registerAction(graphPrefix+"/takeChainDataForPrint", takeChainDataForPrint);
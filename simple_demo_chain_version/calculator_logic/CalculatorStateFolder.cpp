@@ -1,15 +1,31 @@
 #include "CalculatorStateFolder.hpp"
+#include "simple_demo_chain_version/chain_data/ChainMetrics.hpp"
 #include <tm_kit/transport/ConvertChainIDStringToGroup.hpp>
 
 namespace simple_demo_chain_version { namespace calculator_logic {
+    namespace {
+        void removeDeadline(CalculatorState &state, int id, int64_t deadline) {
+            auto iter = state.handlingDeadlines.find(deadline);
+            if (iter != state.handlingDeadlines.end()) {
+                iter->second.erase(id);
+                if (iter->second.empty()) {
+                    state.handlingDeadlines.erase(iter);
+                }
+            }
+        }
+    }
+
     void CalculatorStateFolder::foldInPlace(ResultType &state, std::string_view const &storageIDView, ChainData const &item) const {
+        static auto &metrics = chain_metrics::metricsFor("calculator");
+        chain_metrics::FoldTimer timer(metrics);
         state.latestID = storageIDView;
         auto ts = item.timestamp;
         state.updateTimestamp = ts;
+        ++state.foldedCount;
         std::visit([this,ts,&storageIDView,&state](auto const &content) {
             using T = std::decay_t<decltype(content)>;
             if constexpr (std::is_same_v<T, simple_demo_chain_version::PlaceRequest>) {
-                uint32_t group = dev::cd606::tm::transport::chain_utils::convertChainIDStringToGroup(storageIDView, 10);
+                uint32_t group = dev::cd606::tm::transport::chain_utils::convertChainIDStringToGroup(storageIDView, CalculatorGroupCount);
                 if (!useTheseGroups_ || (useTheseGroups_->find(group) != useTheseGroups_->end())) {
                     OneRequestState oneReq;
                     oneReq.placedTimestamp = ts;
@@ -17,6 +33,7 @@ namespace simple_demo_chain_version { namespace calculator_logic {
                     oneReq.latestResponseTimestamp = 0;
                     oneReq.finalResponseReceived = false;
                     oneReq.requestValue = content.value;
+                    oneReq.group = group;
                     state.newlyPlacedRequests.insert({content.id, oneReq});
                 }
             } else if constexpr (std::is_same_v<T, simple_demo_chain_version::ConfirmRequestReceipt>) {
@@ -25,6 +42,7 @@ namespace simple_demo_chain_version { namespace calculator_logic {
                     if (iter != state.newlyPlacedRequests.end()) {
                         OneRequestState newOneReq = iter->second;
                         newOneReq.acceptedTimestamp = ts;
+                        state.handlingDeadlines[handlingDeadline(newOneReq)].insert(id);
                         state.requestsBeingHandled.insert({id, newOneReq});
                         state.newlyPlacedRequests.erase(iter);
                     }
@@ -32,15 +50,36 @@ namespace simple_demo_chain_version { namespace calculator_logic {
             } else if constexpr (std::is_same_v<T, simple_demo_chain_version::RespondToRequest>) {
                 auto iter = state.requestsBeingHandled.find(content.id);
                 if (iter != state.requestsBeingHandled.end()) {
+                    removeDeadline(state, content.id, handlingDeadline(iter->second));
                     iter->second.latestResponseTimestamp = ts;
+                    state.handlingDeadlines[handlingDeadline(iter->second)].insert(content.id);
                     if (content.isFinalResponse) {
                         iter->second.finalResponseReceived = true;
+                        state.finalResponseReceivedIDs.insert(content.id);
                     }
                 }
             } else if constexpr (std::is_same_v<T, simple_demo_chain_version::RequestCompleted>) {
-                state.requestsBeingHandled.erase(content.id);
+                auto iter = state.requestsBeingHandled.find(content.id);
+                if (iter != state.requestsBeingHandled.end()) {
+                    removeDeadline(state, content.id, handlingDeadline(iter->second));
+                    state.finalResponseReceivedIDs.erase(content.id);
+                    state.requestsBeingHandled.erase(iter);
+                }
                 state.newlyPlacedRequests.erase(content.id);
+            } else if constexpr (std::is_same_v<T, simple_demo_chain_version::CalculatorHeartbeat>) {
+                if (!useTheseGroups_) {
+                    state.workerLastSeen[content.workerID] = ts;
+                    //forget workers that have been gone for a long time
+                    for (auto iter = state.workerLastSeen.begin(); iter != state.workerLastSeen.end(); ) {
+                        if (iter->second+10*WorkerLivenessMillis < ts) {
+                            iter = state.workerLastSeen.erase(iter);
+                        } else {
+                            ++iter;
+                        }
+                    }
+                }
             }
         }, item.update);
+        metrics.recordHeadItem(state.foldedCount, ts);
     }
 } }
\ No newline at end of file
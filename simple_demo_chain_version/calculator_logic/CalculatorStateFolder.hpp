@@ -3,8 +3,10 @@
 
 #include "defs.pb.h"
 #include "simple_demo_chain_version/chain_data/ChainData.hpp"
+#include "shared_chain_utils/StateCheckpoints.hpp"
 
 #include <tm_kit/infra/ChronoUtils.hpp>
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
 #include <boost/lexical_cast.hpp>
@@ -19,7 +21,8 @@ namespace simple_demo_chain_version { namespace calculator_logic {
         ((int64_t, acceptedTimestamp)) \
         ((int64_t, latestResponseTimestamp)) \
         ((bool, finalResponseReceived)) \
-        ((double, requestValue))
+        ((double, requestValue)) \
+        ((uint32_t, group))
 
     TM_BASIC_CBOR_CAPABLE_STRUCT(OneRequestState, OneRequestStateFields);
 
@@ -27,18 +30,48 @@ namespace simple_demo_chain_version { namespace calculator_logic {
     #define CalculatorStateFields \
         ((TM_BASIC_CBOR_CAPABLE_STRUCT_PROTECT_TYPE(std::unordered_map<int, simple_demo_chain_version::calculator_logic::OneRequestState>), newlyPlacedRequests)) \
         ((TM_BASIC_CBOR_CAPABLE_STRUCT_PROTECT_TYPE(std::unordered_map<int, simple_demo_chain_version::calculator_logic::OneRequestState>), requestsBeingHandled)) \
+        ((TM_BASIC_CBOR_CAPABLE_STRUCT_PROTECT_TYPE(std::map<int64_t, std::unordered_set<int>>), handlingDeadlines)) \
+        ((std::unordered_set<int>, finalResponseReceivedIDs)) \
+        ((TM_BASIC_CBOR_CAPABLE_STRUCT_PROTECT_TYPE(std::unordered_map<std::string, int64_t>), workerLastSeen)) \
         ((std::string, latestID)) \
-        ((int64_t, updateTimestamp))
+        ((int64_t, updateTimestamp)) \
+        ((int64_t, foldedCount))
 #else
     #define CalculatorStateFields \
         (((std::unordered_map<int, simple_demo_chain_version::calculator_logic::OneRequestState>), newlyPlacedRequests)) \
         (((std::unordered_map<int, simple_demo_chain_version::calculator_logic::OneRequestState>), requestsBeingHandled)) \
+        (((std::map<int64_t, std::unordered_set<int>>), handlingDeadlines)) \
+        ((std::unordered_set<int>, finalResponseReceivedIDs)) \
+        (((std::unordered_map<std::string, int64_t>), workerLastSeen)) \
         ((std::string, latestID)) \
-        ((int64_t, updateTimestamp))
+        ((int64_t, updateTimestamp)) \
+        ((int64_t, foldedCount))
 #endif
 
+    //Besides the requests themselves, the state keeps two indexes that the
+    //folder maintains so that the idle worker only looks at what is due:
+    //handlingDeadlines maps the time after which a request being handled
+    //times out (5 seconds after acceptance, or after its latest response) to
+    //the request ids, and finalResponseReceivedIDs holds the requests ready
+    //to be marked as fulfilled.
+    //workerLastSeen is the membership table of calculator workers (chain time
+    //of each worker's latest heartbeat), used to split the groups among them.
     TM_BASIC_CBOR_CAPABLE_STRUCT(CalculatorState, CalculatorStateFields);
 
+    inline constexpr int64_t HandlingTimeoutMillis = 5000;
+    inline constexpr uint32_t CalculatorGroupCount = 10;
+    inline constexpr int64_t WorkerHeartbeatMillis = 1000;
+    inline constexpr int64_t WorkerLivenessMillis = 5000;
+
+    inline int64_t handlingDeadline(OneRequestState const &r) {
+        return ((r.latestResponseTimestamp != 0)?r.latestResponseTimestamp:r.acceptedTimestamp)+HandlingTimeoutMillis;
+    }
+
+    //When no group list is given, the folder keeps every request and records
+    //worker heartbeats, and the idle workers split the groups among
+    //themselves (see CalculatorGroupAssignment.hpp). When a group list is
+    //given, the folder only keeps requests of those groups and ignores
+    //heartbeats, as before.
     class CalculatorStateFolder {
     private:
         std::optional<std::unordered_set<uint32_t>> useTheseGroups_;
@@ -57,7 +90,14 @@ namespace simple_demo_chain_version { namespace calculator_logic {
         template <class Chain>
         static ResultType initialize(void *, Chain *chain) {
             if constexpr (Chain::SupportsExtraData) {
-                auto val = chain->template loadExtraData<ResultType>(
+                auto val = shared_chain_utils::checkpoints::loadLatestCheckpoint<ResultType>(
+                    chain, "calculator_state"
+                );
+                if (val) {
+                    return *val;
+                }
+                //snapshot written before checkpoints were versioned
+                val = chain->template loadExtraData<ResultType>(
                     "calculator_state"
                 );
                 if (val) {
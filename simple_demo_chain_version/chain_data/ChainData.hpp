@@ -20,6 +20,8 @@ namespace simple_demo_chain_version {
     //whole struct must be serialized instead of directly mapped onto
     //memory block for chain storage, and if the enum is serialized as
     //string, there will be waste of storage)
+    //(CompactChainData.hpp has a fixed-layout binary encoding that avoids
+    //these costs for chains that store CompactChainData)
 
     inline std::ostream &operator<<(std::ostream &os, RequestCompletedFashion x) {
         switch (x) {
@@ -55,17 +57,23 @@ namespace simple_demo_chain_version {
     #define RequestCompletedFields \
         ((int, id)) \
         ((simple_demo_chain_version::RequestCompletedFashion, fashion))
+    //Calculator workers announce themselves on the chain periodically, the
+    //request groups are split among the workers that are alive
+    #define CalculatorHeartbeatFields \
+        ((std::string, workerID))
 
     TM_BASIC_CBOR_CAPABLE_STRUCT(PlaceRequest, PlaceRequestFields);
     TM_BASIC_CBOR_CAPABLE_STRUCT(ConfirmRequestReceipt, ConfirmRequestReceiptFields);
     TM_BASIC_CBOR_CAPABLE_STRUCT(RespondToRequest, RespondToRequestFields);
     TM_BASIC_CBOR_CAPABLE_STRUCT(RequestCompleted, RequestCompletedFields);
+    TM_BASIC_CBOR_CAPABLE_STRUCT(CalculatorHeartbeat, CalculatorHeartbeatFields);
 
     using UpdateContent = std::variant<
         PlaceRequest
         , ConfirmRequestReceipt
         , RespondToRequest
         , RequestCompleted
+        , CalculatorHeartbeat
     >;
 
     #define ChainDataFields \
@@ -79,6 +87,7 @@ TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(simple_demo_chain_version:
 TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(simple_demo_chain_version::ConfirmRequestReceipt, ConfirmRequestReceiptFields);
 TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(simple_demo_chain_version::RespondToRequest, RespondToRequestFields);
 TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(simple_demo_chain_version::RequestCompleted, RequestCompletedFields);
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(simple_demo_chain_version::CalculatorHeartbeat, CalculatorHeartbeatFields);
 
 TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(simple_demo_chain_version::ChainData, ChainDataFields);
 
@@ -0,0 +1,191 @@
+#ifndef CHAIN_METRICS_HPP_
+#define CHAIN_METRICS_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+//Per-process counters for one logical chain user (e.g. "main_program" or
+//"calculator"), filled in by the folders, input handlers and idle workers:
+//
+//  - head: the position (folded item count) and item timestamp that this
+//    process's folder has reached. This is not the chain tail: a folder that
+//    falls behind the chain keeps an old head. How far behind it is, is
+//    measured against the wall clock (see ChainMetricsHeartbeat.hpp), except
+//    when the idle worker has run since the last fold, since a chain writer
+//    only calls it once it has folded everything on the chain
+//  - reader: the timestamp of the last item that the reader side (e.g. the
+//    reader half of a chain-backed facility) has passed on; its lag is
+//    counted against the recent head items
+//  - append attempts and retries: an input handler is called again for the
+//    same input when its append lost the race to another writer
+//  - time spent folding items and in idle callbacks
+//
+//executables/ChainMetricsHeartbeat.hpp publishes them as heartbeat status.
+namespace simple_demo_chain_version { namespace chain_metrics {
+
+    struct ChainMetricsSnapshot {
+        int64_t headCount = 0;
+        int64_t headTimestamp = 0;
+        bool atTail = false;
+        bool hasReader = false;
+        int64_t readerTimestamp = 0;
+        int64_t readerLagItems = 0;
+        bool readerLagItemsSaturated = false;
+        uint64_t appendAttempts = 0;
+        uint64_t appendRetries = 0;
+        uint64_t foldedItems = 0;
+        uint64_t foldNanos = 0;
+        uint64_t idleCalls = 0;
+        uint64_t idleNanos = 0;
+    };
+
+    class ChainMetrics {
+    public:
+        //how many recent head timestamps are kept for the reader lag
+        static constexpr std::size_t RecentHeadItems = 8192;
+    private:
+        mutable std::mutex mutex_;
+        int64_t headCount_ = 0;
+        int64_t headTimestamp_ = 0;
+        std::atomic<bool> atTail_ {false};
+        std::deque<int64_t> recentHeadTimestamps_;
+        bool hasReader_ = false;
+        int64_t readerTimestamp_ = 0;
+        std::string lastAppendInput_;
+        std::atomic<uint64_t> appendAttempts_ {0};
+        std::atomic<uint64_t> appendRetries_ {0};
+        std::atomic<uint64_t> foldedItems_ {0};
+        std::atomic<uint64_t> foldNanos_ {0};
+        std::atomic<uint64_t> idleCalls_ {0};
+        std::atomic<uint64_t> idleNanos_ {0};
+    public:
+        void recordHeadItem(int64_t itemCount, int64_t itemTimestamp) {
+            std::lock_guard<std::mutex> _(mutex_);
+            if (itemCount <= headCount_) {
+                //the same item folded again, e.g. into a copy of the state
+                return;
+            }
+            headCount_ = itemCount;
+            headTimestamp_ = itemTimestamp;
+            recentHeadTimestamps_.push_back(itemTimestamp);
+            if (recentHeadTimestamps_.size() > RecentHeadItems) {
+                recentHeadTimestamps_.pop_front();
+            }
+        }
+        void recordReaderItem(int64_t itemTimestamp) {
+            std::lock_guard<std::mutex> _(mutex_);
+            hasReader_ = true;
+            readerTimestamp_ = itemTimestamp;
+        }
+        void recordAppendAttempt(std::string const &inputID) {
+            ++appendAttempts_;
+            std::lock_guard<std::mutex> _(mutex_);
+            if (inputID == lastAppendInput_) {
+                ++appendRetries_;
+            } else {
+                lastAppendInput_ = inputID;
+            }
+        }
+        void recordFold(std::chrono::steady_clock::duration d) {
+            atTail_ = false;
+            ++foldedItems_;
+            foldNanos_ += std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        }
+        void recordIdle(std::chrono::steady_clock::duration d) {
+            atTail_ = true;
+            ++idleCalls_;
+            idleNanos_ += std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        }
+        ChainMetricsSnapshot snapshot() const {
+            ChainMetricsSnapshot s;
+            {
+                std::lock_guard<std::mutex> _(mutex_);
+                s.headCount = headCount_;
+                s.headTimestamp = headTimestamp_;
+                s.atTail = atTail_.load();
+                s.hasReader = hasReader_;
+                s.readerTimestamp = readerTimestamp_;
+                if (hasReader_) {
+                    //timestamps along the chain are (nearly) non-decreasing,
+                    //so walk back from the head until the reader's position
+                    for (auto iter = recentHeadTimestamps_.rbegin(); iter != recentHeadTimestamps_.rend() && *iter > readerTimestamp_; ++iter) {
+                        ++s.readerLagItems;
+                    }
+                    s.readerLagItemsSaturated = (s.readerLagItems == (int64_t) RecentHeadItems);
+                }
+            }
+            s.appendAttempts = appendAttempts_.load();
+            s.appendRetries = appendRetries_.load();
+            s.foldedItems = foldedItems_.load();
+            s.foldNanos = foldNanos_.load();
+            s.idleCalls = idleCalls_.load();
+            s.idleNanos = idleNanos_.load();
+            return s;
+        }
+    };
+
+    namespace detail {
+        struct Registry {
+            std::mutex mutex;
+            std::map<std::string, std::unique_ptr<ChainMetrics>> metrics;
+        };
+        inline Registry &registry() {
+            static Registry r;
+            return r;
+        }
+    }
+
+    //The returned reference stays valid for the life of the process, so
+    //callers on hot paths should look it up once
+    inline ChainMetrics &metricsFor(std::string const &name) {
+        auto &r = detail::registry();
+        std::lock_guard<std::mutex> _(r.mutex);
+        auto &p = r.metrics[name];
+        if (!p) {
+            p = std::make_unique<ChainMetrics>();
+        }
+        return *p;
+    }
+
+    inline std::vector<std::tuple<std::string, ChainMetricsSnapshot>> snapshotAll() {
+        auto &r = detail::registry();
+        std::lock_guard<std::mutex> _(r.mutex);
+        std::vector<std::tuple<std::string, ChainMetricsSnapshot>> ret;
+        for (auto const &item : r.metrics) {
+            ret.push_back({item.first, item.second->snapshot()});
+        }
+        return ret;
+    }
+
+    class FoldTimer {
+    private:
+        ChainMetrics &metrics_;
+        std::chrono::steady_clock::time_point start_;
+    public:
+        FoldTimer(ChainMetrics &metrics) : metrics_(metrics), start_(std::chrono::steady_clock::now()) {}
+        ~FoldTimer() {
+            metrics_.recordFold(std::chrono::steady_clock::now()-start_);
+        }
+    };
+
+    class IdleTimer {
+    private:
+        ChainMetrics &metrics_;
+        std::chrono::steady_clock::time_point start_;
+    public:
+        IdleTimer(ChainMetrics &metrics) : metrics_(metrics), start_(std::chrono::steady_clock::now()) {}
+        ~IdleTimer() {
+            metrics_.recordIdle(std::chrono::steady_clock::now()-start_);
+        }
+    };
+
+} }
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef COMPACT_CHAIN_ADAPTERS_HPP_
+#define COMPACT_CHAIN_ADAPTERS_HPP_
+
+#include "simple_demo_chain_version/chain_data/ChainData.hpp"
+#include "simple_demo_chain_version/chain_data/CompactChainData.hpp"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+//Wrappers that put the ChainData based folders, input handlers, idle workers
+//and id extractors on a chain of CompactChainData. They only unwrap items
+//coming off the chain and wrap items going onto it, everything else
+//(state, response and off-chain update types, initialize, idleCallback)
+//is the wrapped class's own.
+namespace simple_demo_chain_version { namespace compact_chain_adapters {
+
+    template <class Folder>
+    class CompactChainFolder : public Folder {
+    public:
+        using Folder::Folder;
+        using ResultType = typename Folder::ResultType;
+        void foldInPlace(ResultType &state, std::string_view const &storageIDView, CompactChainData const &item) const {
+            Folder::foldInPlace(state, storageIDView, item.data);
+        }
+    };
+
+    namespace detail {
+        inline std::optional<std::tuple<std::string, CompactChainData>> wrapItem(std::optional<std::tuple<std::string, ChainData>> &&item) {
+            if (!item) {
+                return std::nullopt;
+            }
+            return std::tuple<std::string, CompactChainData> {
+                std::move(std::get<0>(*item))
+                , CompactChainData {std::move(std::get<1>(*item))}
+            };
+        }
+        inline std::vector<std::tuple<std::string, CompactChainData>> wrapItems(std::vector<std::tuple<std::string, ChainData>> &&items) {
+            std::vector<std::tuple<std::string, CompactChainData>> ret;
+            ret.reserve(items.size());
+            for (auto &item : items) {
+                ret.push_back({
+                    std::move(std::get<0>(item))
+                    , CompactChainData {std::move(std::get<1>(item))}
+                });
+            }
+            return ret;
+        }
+    }
+
+    template <class InputHandler>
+    class CompactChainInputHandler : public InputHandler {
+    public:
+        using InputHandler::InputHandler;
+        using ResponseType = typename InputHandler::ResponseType;
+        template <class... Args>
+        std::tuple<
+            ResponseType
+            , std::optional<std::tuple<std::string, CompactChainData>>
+        > handleInput(Args &&... args) {
+            auto res = InputHandler::handleInput(std::forward<Args>(args)...);
+            return {
+                std::move(std::get<0>(res))
+                , detail::wrapItem(std::move(std::get<1>(res)))
+            };
+        }
+    };
+
+    template <class IdleWorker>
+    class CompactChainIdleWorker : public IdleWorker {
+    public:
+        using IdleWorker::IdleWorker;
+        using OffChainUpdateType = typename IdleWorker::OffChainUpdateType;
+        template <class... Args>
+        std::tuple<
+            std::optional<OffChainUpdateType>
+            , std::vector<std::tuple<std::string, CompactChainData>>
+        > work(Args &&... args) {
+            auto res = IdleWorker::work(std::forward<Args>(args)...);
+            return {
+                std::move(std::get<0>(res))
+                , detail::wrapItems(std::move(std::get<1>(res)))
+            };
+        }
+    };
+
+    template <class Extractor>
+    class CompactChainIDAndFinalFlagExtractor : public Extractor {
+    public:
+        using Extractor::Extractor;
+        auto extract(CompactChainData const &item) {
+            return Extractor::extract(item.data);
+        }
+    };
+
+} }
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef COMPACT_CHAIN_DATA_HPP_
+#define COMPACT_CHAIN_DATA_HPP_
+
+#include "simple_demo_chain_version/chain_data/ChainData.hpp"
+
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+//A fixed-layout binary encoding of ChainData, as an alternative to CBOR.
+//
+//Every item starts with a 9-byte header: one tag byte (low nibble is the
+//variant index, high nibble is the format version, currently 0) and the
+//timestamp as a little-endian int64. After that comes the fixed-width part
+//of the variant (little-endian ints, doubles as their IEEE bits, enums and
+//bools as one byte), and then the variable-length part, if any:
+//
+//  PlaceRequest          id:i32 value:f64 | externalID: varint length + bytes
+//  ConfirmRequestReceipt                  | ids: varint count + zigzag varint deltas
+//  RespondToRequest      id:i32 response:f64 isFinalResponse:u8
+//  RequestCompleted      id:i32 fashion:u8
+//  CalculatorHeartbeat                    | workerID: varint length + bytes
+//
+//Responses and completions, which are most of the chain, have no variable
+//part at all: they are 22 and 14 bytes and decode with a handful of fixed
+//offset loads. There are no field names, no per-field type headers and the
+//enum goes out as a byte.
+//
+//The demo chain of the day (executables/CommonInfo.hpp) holds this: the
+//calculator, the main logic, place_request and compact_chain --watch read
+//and write CompactChainData, through the wrappers in
+//CompactChainAdapters.hpp. print_chain (--compactChain) and
+//transcribe_chain (--compactInput/--compactOutput) read and write it on
+//request, single_pass keeps CBOR ChainData. executables/compact_encoding_test
+//checks the encoding.
+namespace simple_demo_chain_version { namespace compact_encoding {
+
+    inline constexpr uint8_t FormatVersion = 0;
+    inline constexpr std::size_t HeaderSize = 9;
+
+    namespace detail {
+        template <class T>
+        inline void putFixed(std::string &out, T x) {
+            static_assert(std::is_integral_v<T>);
+            using U = std::make_unsigned_t<T>;
+            U u = static_cast<U>(x);
+            for (std::size_t ii=0; ii<sizeof(T); ++ii) {
+                out.push_back(static_cast<char>((u >> (8*ii)) & 0xff));
+            }
+        }
+        inline void putDouble(std::string &out, double x) {
+            uint64_t u;
+            std::memcpy(&u, &x, sizeof(u));
+            putFixed<uint64_t>(out, u);
+        }
+        inline void putVarint(std::string &out, uint64_t x) {
+            while (x >= 0x80) {
+                out.push_back(static_cast<char>((x & 0x7f) | 0x80));
+                x >>= 7;
+            }
+            out.push_back(static_cast<char>(x));
+        }
+        inline void putBytes(std::string &out, std::string_view s) {
+            putVarint(out, s.length());
+            out.append(s);
+        }
+
+        class Reader {
+        private:
+            std::string_view data_;
+            std::size_t pos_;
+            bool ok_;
+        public:
+            Reader(std::string_view const &data) : data_(data), pos_(0), ok_(true) {}
+            bool ok() const {
+                return ok_;
+            }
+            bool atEnd() const {
+                return pos_ == data_.length();
+            }
+            template <class T>
+            T fixed() {
+                static_assert(std::is_integral_v<T>);
+                using U = std::make_unsigned_t<T>;
+                if (!ok_ || pos_+sizeof(T) > data_.length()) {
+                    ok_ = false;
+                    return T {};
+                }
+                U u = 0;
+                for (std::size_t ii=0; ii<sizeof(T); ++ii) {
+                    u |= static_cast<U>(static_cast<uint8_t>(data_[pos_+ii])) << (8*ii);
+                }
+                pos_ += sizeof(T);
+                return static_cast<T>(u);
+            }
+            double dbl() {
+                uint64_t u = fixed<uint64_t>();
+                double x;
+                std::memcpy(&x, &u, sizeof(x));
+                return x;
+            }
+            uint64_t varint() {
+                uint64_t x = 0;
+                for (int shift=0; shift<64; shift+=7) {
+                    if (!ok_ || pos_ >= data_.length()) {
+                        ok_ = false;
+                        return 0;
+                    }
+                    uint8_t b = static_cast<uint8_t>(data_[pos_++]);
+                    x |= static_cast<uint64_t>(b & 0x7f) << shift;
+                    if ((b & 0x80) == 0) {
+                        return x;
+                    }
+                }
+                ok_ = false;
+                return 0;
+            }
+            std::string_view bytes() {
+                uint64_t len = varint();
+                if (!ok_ || len > data_.length()-pos_) {
+                    ok_ = false;
+                    return {};
+                }
+                auto ret = data_.substr(pos_, len);
+                pos_ += len;
+                return ret;
+            }
+        };
+
+        inline uint64_t zigzag(int64_t x) {
+            return (static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63);
+        }
+        inline int64_t unzigzag(uint64_t x) {
+            return static_cast<int64_t>(x >> 1) ^ -static_cast<int64_t>(x & 1);
+        }
+    }
+
+    inline void encodeInto(ChainData const &d, std::string &out) {
+        out.push_back(static_cast<char>((FormatVersion << 4) | static_cast<uint8_t>(d.update.index())));
+        detail::putFixed<int64_t>(out, d.timestamp);
+        std::visit([&out](auto const &u) {
+            using T = std::decay_t<decltype(u)>;
+            if constexpr (std::is_same_v<T, PlaceRequest>) {
+                detail::putFixed<int32_t>(out, u.id);
+                detail::putDouble(out, u.value);
+                detail::putBytes(out, u.externalID.content);
+            } else if constexpr (std::is_same_v<T, ConfirmRequestReceipt>) {
+                //ids are usually close to each other, so deltas stay small
+                detail::putVarint(out, u.ids.size());
+                int64_t prev = 0;
+                for (auto id : u.ids) {
+                    detail::putVarint(out, detail::zigzag(static_cast<int64_t>(id)-prev));
+                    prev = id;
+                }
+            } else if constexpr (std::is_same_v<T, RespondToRequest>) {
+                detail::putFixed<int32_t>(out, u.id);
+                detail::putDouble(out, u.response);
+                detail::putFixed<uint8_t>(out, u.isFinalResponse?1:0);
+            } else if constexpr (std::is_same_v<T, RequestCompleted>) {
+                detail::putFixed<int32_t>(out, u.id);
+                detail::putFixed<uint8_t>(out, static_cast<uint8_t>(u.fashion));
+            } else if constexpr (std::is_same_v<T, CalculatorHeartbeat>) {
+                detail::putBytes(out, u.workerID);
+            }
+        }, d.update);
+    }
+
+    inline std::string encode(ChainData const &d) {
+        std::string out;
+        out.reserve(HeaderSize+16);
+        encodeInto(d, out);
+        return out;
+    }
+
+    //Returns std::nullopt on malformed input, unknown tags or trailing bytes
+    inline std::optional<ChainData> decode(std::string_view const &data) {
+        detail::Reader r(data);
+        uint8_t tag = r.fixed<uint8_t>();
+        int64_t timestamp = r.fixed<int64_t>();
+        if (!r.ok() || (tag >> 4) != FormatVersion) {
+            return std::nullopt;
+        }
+        std::optional<UpdateContent> update = std::nullopt;
+        switch (tag & 0x0f) {
+        case 0:
+            {
+                PlaceRequest x;
+                x.id = r.fixed<int32_t>();
+                x.value = r.dbl();
+                x.externalID.content = std::string(r.bytes());
+                update = UpdateContent {std::move(x)};
+            }
+            break;
+        case 1:
+            {
+                ConfirmRequestReceipt x;
+                uint64_t count = r.varint();
+                //every id takes at least one byte
+                if (!r.ok() || count > data.length()) {
+                    return std::nullopt;
+                }
+                x.ids.reserve(count);
+                int64_t prev = 0;
+                for (uint64_t ii=0; ii<count && r.ok(); ++ii) {
+                    prev += detail::unzigzag(r.varint());
+                    x.ids.push_back(static_cast<int>(prev));
+                }
+                update = UpdateContent {std::move(x)};
+            }
+            break;
+        case 2:
+            {
+                RespondToRequest x;
+                x.id = r.fixed<int32_t>();
+                x.response = r.dbl();
+                x.isFinalResponse = (r.fixed<uint8_t>() != 0);
+                update = UpdateContent {std::move(x)};
+            }
+            break;
+        case 3:
+            {
+                RequestCompleted x;
+                x.id = r.fixed<int32_t>();
+                x.fashion = static_cast<RequestCompletedFashion>(r.fixed<uint8_t>());
+                update = UpdateContent {std::move(x)};
+            }
+            break;
+        case 4:
+            {
+                CalculatorHeartbeat x;
+                x.workerID = std::string(r.bytes());
+                update = UpdateContent {std::move(x)};
+            }
+            break;
+        default:
+            return std::nullopt;
+        }
+        if (!r.ok() || !r.atEnd()) {
+            return std::nullopt;
+        }
+        return ChainData {timestamp, std::move(*update)};
+    }
+
+} }
+
+namespace simple_demo_chain_version {
+    //ChainData stored with the compact encoding. Chains (and anything else
+    //going through RunSerializer/RunDeserializer) of this type use it instead
+    //of CBOR.
+    struct CompactChainData {
+        ChainData data;
+    };
+
+    inline std::ostream &operator<<(std::ostream &os, CompactChainData const &x) {
+        os << x.data;
+        return os;
+    }
+}
+
+namespace dev { namespace cd606 { namespace tm { namespace basic { namespace bytedata_utils {
+    template <>
+    struct RunSerializer<simple_demo_chain_version::CompactChainData, void> {
+        static std::string apply(simple_demo_chain_version::CompactChainData const &x) {
+            return simple_demo_chain_version::compact_encoding::encode(x.data);
+        }
+    };
+    template <>
+    struct RunDeserializer<simple_demo_chain_version::CompactChainData, void> {
+        static std::optional<simple_demo_chain_version::CompactChainData> apply(std::string_view const &data) {
+            auto x = simple_demo_chain_version::compact_encoding::decode(data);
+            if (!x) {
+                return std::nullopt;
+            }
+            return simple_demo_chain_version::CompactChainData {std::move(*x)};
+        }
+        static std::optional<simple_demo_chain_version::CompactChainData> apply(std::string const &data) {
+            return apply(std::string_view {data});
+        }
+    };
+} } } } }
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef SIMPLE_DEMO_CHAIN_VERSION_EXECUTABLES_CHAIN_METRICS_HEARTBEAT_HPP_
+#define SIMPLE_DEMO_CHAIN_VERSION_EXECUTABLES_CHAIN_METRICS_HEARTBEAT_HPP_
+
+#include "simple_demo_chain_version/chain_data/ChainMetrics.hpp"
+
+#include <tm_kit/infra/ChronoUtils.hpp>
+#include <tm_kit/basic/VoidStruct.hpp>
+#include <tm_kit/basic/real_time_clock/ClockImporter.hpp>
+#include <tm_kit/transport/HeartbeatAndAlertComponent.hpp>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
+
+namespace simple_demo_chain_version {
+
+    //Every period, puts the chain metrics of this process (see
+    //chain_data/ChainMetrics.hpp) into the heartbeat as the status entry
+    //"chain_metrics/<name>", e.g.
+    //
+    //  head_items=1234 head_ms=... head_lag_ms=0 reader_lag_items=0 reader_lag_ms=0
+    //  append_attempts=3 append_retries=0 fold_us_per_item=1.2 idle_us_per_call=4.5
+    //
+    //head_lag_ms is how far this process's folder is behind: the current time
+    //minus the timestamp of the last folded item, or 0 if the folder is known
+    //to be at the chain tail (its idle worker ran after the last fold). For a
+    //folder without an idle worker it also grows while the chain is quiet.
+    //reader_lag_ms is on top of that, counted in chain time from the head.
+    //The append, fold and idle numbers are for the last period. The status
+    //is Warning when either lag is above lagWarningMillis. Must be called
+    //after initializeHeartbeatAndAlertComponent.
+    template <class R>
+    void attachChainMetricsToHeartbeat(
+        R &r
+        , std::chrono::system_clock::duration period = std::chrono::seconds(1)
+        , int64_t lagWarningMillis = 5000
+    ) {
+        using M = typename R::AppType;
+        using Env = typename R::EnvironmentType;
+        auto *env = r.environment();
+
+        auto clockImporter = basic::real_time_clock::ClockImporter<Env>::template createRecurringClockImporter<basic::VoidStruct>(
+            env->now()
+            , infra::withtime_utils::parseLocalTodayActualTime(23, 59, 59)
+            , period
+            , [](typename Env::TimePointType const &tp) {
+                return basic::VoidStruct {};
+            }
+        );
+        r.registerImporter("chainMetricsClock", clockImporter);
+
+        auto previous = std::make_shared<std::map<std::string, chain_metrics::ChainMetricsSnapshot>>();
+        auto publisher = M::template pureExporter<basic::VoidStruct>(
+            [env,previous,lagWarningMillis](basic::VoidStruct &&) {
+                auto nowMillis = infra::withtime_utils::sinceEpoch<std::chrono::milliseconds>(env->now());
+                for (auto const &item : chain_metrics::snapshotAll()) {
+                    auto const &name = std::get<0>(item);
+                    auto const &s = std::get<1>(item);
+                    auto &prev = (*previous)[name];
+                    auto status = transport::HeartbeatMessage::Status::Good;
+
+                    std::ostringstream oss;
+                    oss << "head_items=" << s.headCount << " head_ms=" << s.headTimestamp;
+                    if (s.headCount > 0) {
+                        auto headLagMillis = s.atTail?0:std::max<int64_t>(0, nowMillis-s.headTimestamp);
+                        oss << " head_lag_ms=" << headLagMillis;
+                        if (headLagMillis > lagWarningMillis) {
+                            status = transport::HeartbeatMessage::Status::Warning;
+                        }
+                    }
+                    if (s.hasReader) {
+                        auto lagMillis = std::max<int64_t>(0, s.headTimestamp-s.readerTimestamp);
+                        oss << " reader_lag_items=" << (s.readerLagItemsSaturated?">=":"") << s.readerLagItems
+                            << " reader_lag_ms=" << lagMillis;
+                        if (lagMillis > lagWarningMillis) {
+                            status = transport::HeartbeatMessage::Status::Warning;
+                        }
+                    }
+                    auto folded = s.foldedItems-prev.foldedItems;
+                    auto idleCalls = s.idleCalls-prev.idleCalls;
+                    oss << " append_attempts=" << (s.appendAttempts-prev.appendAttempts)
+                        << " append_retries=" << (s.appendRetries-prev.appendRetries)
+                        << " fold_us_per_item=" << ((folded>0)?(s.foldNanos-prev.foldNanos)/1000.0/folded:0.0)
+                        << " idle_us_per_call=" << ((idleCalls>0)?(s.idleNanos-prev.idleNanos)/1000.0/idleCalls:0.0);
+                    env->setStatus("chain_metrics/"+name, status, oss.str());
+                    prev = s;
+                }
+            }
+        );
+        r.registerExporter("chainMetricsPublisher", publisher);
+        r.exportItem(publisher, r.importItem(clockImporter));
+    }
+
+}
+
+#endif
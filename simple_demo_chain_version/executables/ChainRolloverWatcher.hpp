@@ -0,0 +1,75 @@
+#ifndef SIMPLE_DEMO_CHAIN_VERSION_EXECUTABLES_CHAIN_ROLLOVER_WATCHER_HPP_
+#define SIMPLE_DEMO_CHAIN_VERSION_EXECUTABLES_CHAIN_ROLLOVER_WATCHER_HPP_
+
+#include "simple_demo_chain_version/executables/CommonInfo.hpp"
+
+#include <tm_kit/infra/ChronoUtils.hpp>
+#include <tm_kit/basic/VoidStruct.hpp>
+#include <tm_kit/basic/real_time_clock/ClockImporter.hpp>
+
+#include <cstdlib>
+#include <iostream>
+
+#ifdef _MSC_VER
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace simple_demo_chain_version {
+
+    //Every period, checks whether compact_chain --watch has started rolling
+    //the chain over to a new generation (see CommonInfo.hpp), or has already
+    //finished one that this process missed. If so, the process stops using
+    //its chain right away and starts itself again with the same arguments;
+    //on the way back up theChainLocator() waits for the new generation to
+    //be ready, and the state folders start from the checkpoints that the
+    //compaction saved in the new chain. Must be given the generation that
+    //the process's chain locator was taken from.
+    template <class R>
+    void attachChainRolloverWatcher(
+        R &r
+        , int startGeneration
+        , char **argv
+        , std::chrono::system_clock::duration period = std::chrono::milliseconds(200)
+    ) {
+        using M = typename R::AppType;
+        using Env = typename R::EnvironmentType;
+        auto *env = r.environment();
+
+        auto clockImporter = basic::real_time_clock::ClockImporter<Env>::template createRecurringClockImporter<basic::VoidStruct>(
+            env->now()
+            , infra::withtime_utils::parseLocalTodayActualTime(23, 59, 59)
+            , period
+            , [](typename Env::TimePointType const &tp) {
+                return basic::VoidStruct {};
+            }
+        );
+        r.registerImporter("chainRolloverClock", clockImporter);
+
+        auto watcher = M::template pureExporter<basic::VoidStruct>(
+            [env,startGeneration,argv](basic::VoidStruct &&) {
+                auto g = readChainGeneration();
+                if (!g.rolling && g.generation == startGeneration) {
+                    return;
+                }
+                env->log(infra::LogLevel::Info, "Chain is rolling over from generation "+std::to_string(startGeneration)+", restarting");
+                std::cout.flush();
+                std::cerr.flush();
+#ifdef _MSC_VER
+                _execv(argv[0], argv);
+#else
+                execv(argv[0], argv);
+#endif
+                //only gets here if the restart failed
+                env->log(infra::LogLevel::Error, "Cannot restart for the chain rollover, exiting");
+                std::_Exit(1);
+            }
+        );
+        r.registerExporter("chainRolloverWatcher", watcher);
+        r.exportItem(watcher, r.importItem(clockImporter));
+    }
+
+}
+
+#endif
@@ -1,15 +1,70 @@
 #include "CommonInfo.hpp"
 
 #include <tm_kit/infra/ChronoUtils.hpp>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <string>
 #include <sstream>
+#include <thread>
 
 namespace simple_demo_chain_version {
-    std::string theChainLocator() {
-        std::string today = dev::cd606::tm::infra::withtime_utils::localTimeString(std::chrono::system_clock::now()).substr(0,10);
+    namespace {
+        std::string today() {
+            return dev::cd606::tm::infra::withtime_utils::localTimeString(std::chrono::system_clock::now()).substr(0,10);
+        }
+        std::filesystem::path generationFile() {
+            return std::filesystem::temp_directory_path() / (today()+"-simple-demo-chain.generation");
+        }
+    }
+    ChainGeneration readChainGeneration() {
+        ChainGeneration g;
+        std::ifstream ifs(generationFile());
+        std::string state;
+        if (ifs >> g.generation >> state) {
+            g.rolling = (state == "rolling");
+        } else {
+            g = ChainGeneration {};
+        }
+        return g;
+    }
+    void writeChainGeneration(ChainGeneration const &g) {
+        //written to the side and renamed, so that readers never see half a file
+        auto path = generationFile();
+        auto tmpPath = path;
+        tmpPath += ".tmp";
+        {
+            std::ofstream ofs(tmpPath, std::ios::trunc);
+            ofs << g.generation << ' ' << (g.rolling?"rolling":"ready") << '\n';
+        }
+        std::filesystem::rename(tmpPath, path);
+    }
+    std::string chainSegmentNameForGeneration(int generation) {
+        std::ostringstream oss;
+        //the chain holds CompactChainData, a segment left by a CBOR chain
+        //of the same day is not picked up
+        oss << today() << "-simple-demo-compact-chain";
+        //generation 0 keeps the name from before there were generations
+        if (generation > 0) {
+            oss << "-g" << generation;
+        }
+        return oss.str();
+    }
+    std::string chainLocatorForGeneration(int generation) {
         std::ostringstream chainLocatorOss;
-        //chainLocatorOss << "in_shared_memory://::::" << today << "-simple-demo-chain[size=" << (100*1024*1024) << ",useNotification=true]";
-        chainLocatorOss << "in_shared_memory://::::" << today << "-simple-demo-chain[size=" << (100*1024*1024) << "]";
+        //chainLocatorOss << "in_shared_memory://::::" << chainSegmentNameForGeneration(generation) << "[size=" << (100*1024*1024) << ",useNotification=true]";
+        chainLocatorOss << "in_shared_memory://::::" << chainSegmentNameForGeneration(generation) << "[size=" << (100*1024*1024) << "]";
         return chainLocatorOss.str();
     }
-}
\ No newline at end of file
+    std::string theChainLocator(int *generation) {
+        auto g = readChainGeneration();
+        while (g.rolling) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            g = readChainGeneration();
+        }
+        if (generation) {
+            *generation = g.generation;
+        }
+        return chainLocatorForGeneration(g.generation);
+    }
+}
@@ -4,7 +4,27 @@
 #include <string>
 
 namespace simple_demo_chain_version {
-    extern std::string theChainLocator();
+    //The chain of the day holds CompactChainData (see
+    //chain_data/CompactChainData.hpp), print_chain and transcribe_chain need
+    //--compactChain/--compactInput to read it.
+    //
+    //The chain of the day is rolled over to a new generation (a new
+    //in_shared_memory segment) when compact_chain --watch finds the current
+    //one filling up. The current generation is kept in a small file in the
+    //temp directory; while a rollover is in progress the programs leave the
+    //old chain and wait for the new one to be ready.
+    struct ChainGeneration {
+        int generation = 0;
+        bool rolling = false;
+    };
+    extern ChainGeneration readChainGeneration();
+    extern void writeChainGeneration(ChainGeneration const &g);
+    extern std::string chainLocatorForGeneration(int generation);
+    //the shared memory segment name in the locator of this generation
+    extern std::string chainSegmentNameForGeneration(int generation);
+    //the locator of the current generation, waits while a rollover is in
+    //progress; the generation is put in *generation if given
+    extern std::string theChainLocator(int *generation=nullptr);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,8 +1,11 @@
 #include "simple_demo_chain_version/calculator_logic/CalculatorLogicProvider.hpp"
 #include "simple_demo_chain_version/calculator_logic/ExternalCalculatorWrappedAsFacility.hpp"
 #include "simple_demo_chain_version/calculator_logic/MockExternalCalculator.hpp"
+#include "simple_demo_chain_version/chain_data/CompactChainAdapters.hpp"
 #include "simple_demo_chain_version/security_keys/VerifyingKeys.hpp"
 #include "simple_demo_chain_version/executables/CommonInfo.hpp"
+#include "simple_demo_chain_version/executables/ChainMetricsHeartbeat.hpp"
+#include "simple_demo_chain_version/executables/ChainRolloverWatcher.hpp"
 
 #include <tm_kit/infra/Environments.hpp>
 #include <tm_kit/infra/TerminationController.hpp>
@@ -38,21 +41,21 @@ int main(int argc, char **argv) {
         transport::rabbitmq::RabbitMQComponent,
         transport::HeartbeatAndAlertComponent,
         transport::lock_free_in_memory_shared_chain::SharedMemoryChainComponent,
-        transport::security::SignatureWithNameHookFactoryComponent<ChainData>,
-        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData>
+        transport::security::SignatureWithNameHookFactoryComponent<CompactChainData>,
+        transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData>
     >;
     using M = infra::RealTimeApp<TheEnvironment>;
     using R = infra::AppRunner<M>;
 
     TheEnvironment env;
-    env.transport::security::SignatureWithNameHookFactoryComponent<ChainData>::operator=(
-        transport::security::SignatureWithNameHookFactoryComponent<ChainData> {
+    env.transport::security::SignatureWithNameHookFactoryComponent<CompactChainData>::operator=(
+        transport::security::SignatureWithNameHookFactoryComponent<CompactChainData> {
             "calculator"
             , calculatorKey
         }
     );
-    env.transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData>::operator=(
-        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData> {
+    env.transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData>::operator=(
+        transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData> {
             verifyingKeys
         }
     );
@@ -66,19 +69,29 @@ int main(int argc, char **argv) {
         (&env, "simple_demo_chain_version Calculator", "rabbitmq://127.0.0.1::guest:guest:amq.topic[durable=true]");
     env.setStatus("program", transport::HeartbeatMessage::Status::Good);
     transport::attachHeartbeatAndAlertComponent(r, &env, "simple_demo_chain_version.calculator.heartbeat", std::chrono::seconds(1));
+    //chain position, reader lag and append/fold/idle timings
+    attachChainMetricsToHeartbeat(r);
 
     //setting up the chain
 
-    auto chainLocator = theChainLocator();
+    int chainGeneration = 0;
+    auto chainLocator = theChainLocator(&chainGeneration);
+    //restarts on the new chain when compact_chain --watch rolls it over
+    attachChainRolloverWatcher(r, chainGeneration, argv);
 
     //Please note that this object should not be allowed to go out of scope
     transport::SharedChainCreator<M> sharedChainCreator;
 
+    //the chain holds compactly encoded items (see chain_data/CompactChainData.hpp)
+    using Folder = compact_chain_adapters::CompactChainFolder<calculator_logic::CalculatorStateFolder>;
+    using InputHandler = compact_chain_adapters::CompactChainInputHandler<calculator_logic::CalculatorFacilityInputHandler>;
+    using IdleWorker = compact_chain_adapters::CompactChainIdleWorker<calculator_logic::CalculatorIdleWorker>;
+
     auto chainFacilityFactory = sharedChainCreator.writerFactory<
-        ChainData
-        , calculator_logic::CalculatorStateFolder
-        , calculator_logic::CalculatorFacilityInputHandler
-        , calculator_logic::CalculatorIdleWorker
+        CompactChainData
+        , Folder
+        , InputHandler
+        , IdleWorker
     >(
         &env
         , chainLocator
@@ -89,7 +102,10 @@ int main(int argc, char **argv) {
         //the polling, so the throughput will be degraded. In single-pass mode, the polling policy
         //is ignored since it is single-threaded and always uses busy polling.
         //, basic::simple_shared_chain::ChainPollingPolicy().BusyLoop(true).NoYield(true)
-        , ((argc<=1)?calculator_logic::CalculatorStateFolder():calculator_logic::CalculatorStateFolder(argv[1]))
+        //Without arguments, the request groups are split automatically among
+        //all running calculators (through heartbeats on the chain). A comma-
+        //separated group list pins this calculator to those groups instead.
+        , ((argc<=1)?Folder():Folder(argv[1]))
     );
 
     auto wrappedExternalFacility = M::fromAbstractOnOrderFacility(new calculator_logic::ExternalCalculatorWrappedAsFacility<TheEnvironment>());
@@ -99,7 +115,7 @@ int main(int argc, char **argv) {
         R, basic::real_time_clock::ClockOnOrderFacility<TheEnvironment>
     >::connector("mockExternalFacility");
     */
-    auto calculatorLogicMainRes = calculator_logic::calculatorLogicMain(
+    auto calculatorLogicMainRes = calculator_logic::calculatorLogicMain<R, Folder, InputHandler, IdleWorker>(
         r
         , chainFacilityFactory
         , R::facilityConnector(wrappedExternalFacility)
@@ -0,0 +1,648 @@
+#include "simple_demo_chain_version/main_program_logic/MainProgramLogicProvider.hpp"
+#include "simple_demo_chain_version/calculator_logic/CalculatorStateFolder.hpp"
+#include "shared_chain_utils/StateCheckpoints.hpp"
+#include "simple_demo_chain_version/security_keys/VerifyingKeys.hpp"
+#include "simple_demo_chain_version/executables/CommonInfo.hpp"
+#include "simple_demo_chain_version/chain_data/CompactChainAdapters.hpp"
+
+#include <tm_kit/infra/Environments.hpp>
+#include <tm_kit/infra/TerminationController.hpp>
+#include <tm_kit/infra/SinglePassIterationApp.hpp>
+
+#include <tm_kit/basic/SpdLoggingComponent.hpp>
+#include <tm_kit/basic/single_pass_iteration_clock/ClockComponent.hpp>
+#include <tm_kit/basic/ByteDataWithTopicRecordFileImporterExporter.hpp>
+#include <tm_kit/basic/simple_shared_chain/ChainDataImporterExporter.hpp>
+#include <tm_kit/basic/simple_shared_chain/ChainWriter.hpp>
+#include <tm_kit/basic/CommonFlowUtils.hpp>
+
+#include <tm_kit/transport/CrossGuidComponent.hpp>
+#include <tm_kit/transport/SharedChainCreator.hpp>
+#include <tm_kit/transport/security/SignatureAndVerifyHookFactoryComponents.hpp>
+
+#include <filesystem>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/program_options.hpp>
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+//Rewrites a chain so that it only holds what is still needed, to keep a
+//long-running in_shared_memory chain from filling its segment:
+//
+//  - every item that belongs to a completed request lifecycle (PlaceRequest
+//    through RequestCompleted), and the calculator heartbeats, are archived
+//    to a capture file in the same format as print_chain/byte_data_chain_transcriber
+//    (topic "chain.data", CBOR-encoded ChainData)
+//  - the items of the requests that are still open are written, in their
+//    original order, to the output chain, together with the lifecycle of the
+//    request with the highest id (so that new requests keep getting new ids)
+//  - the main program and calculator states folded over the output chain are
+//    saved as checkpoints (see shared_chain_utils/StateCheckpoints.hpp) in
+//    the output chain, so that the programs start right at its end
+//
+//The input chain is read twice: a first pass that only keeps the set of
+//completed request ids and, per request id, the position of its last item,
+//and a second pass that routes each item as it comes.
+//
+//With --input/--output/--archive this compacts one chain offline: the
+//programs have to be stopped while it runs and pointed at the output chain
+//afterwards. With --watch it runs next to the programs and rolls the demo
+//chain of the day over to a compacted new generation whenever its segment
+//fills up (see watch() below and ChainRolloverWatcher.hpp), so that a
+//long-running session never hits the segment size limit. The programs do
+//restart themselves for the switch, which takes them about the grace
+//period plus the compaction time.
+//
+//The demo chain of the day holds CompactChainData (see
+//chain_data/CompactChainData.hpp), so watch mode always reads and writes
+//that; offline, --compactChain says that both chains do. The archive is
+//CBOR-encoded ChainData either way.
+
+using namespace dev::cd606::tm;
+using namespace simple_demo_chain_version;
+using namespace boost::program_options;
+
+#define CompactionInputFields \
+    ((simple_demo_chain_version::ChainData, item)) \
+    ((bool, isLast)) \
+    ((int, maxIDSoFar))
+
+TM_BASIC_CBOR_CAPABLE_STRUCT(CompactionInput, CompactionInputFields);
+TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(CompactionInput, CompactionInputFields);
+
+//the ChainData in an item of either kind of chain
+inline ChainData &plainItem(ChainData &d) {
+    return d;
+}
+inline ChainData &plainItem(CompactChainData &d) {
+    return d.data;
+}
+
+template <class ChainItem>
+using ChainItemReaderFolder = std::conditional_t<
+    std::is_same_v<ChainItem, CompactChainData>
+    , main_program_logic::TrivialCompactChainDataFolder
+    , main_program_logic::TrivialChainDataFolder
+>;
+
+struct CompactedState {
+    main_program_logic::MainProgramState mainProgramState;
+    calculator_logic::CalculatorState calculatorState;
+    std::string latestID;
+};
+
+//Folds the output chain into the two program states at once
+class CompactedStateFolder {
+private:
+    calculator_logic::CalculatorStateFolder calculatorFolder_;
+public:
+    using ResultType = CompactedState;
+    template <class Chain>
+    static ResultType initialize(void *, Chain *) {
+        ResultType res;
+        res.mainProgramState.max_id_sofar = 0;
+        res.mainProgramState.updateTimestamp = 0;
+        res.mainProgramState.foldedCount = 0;
+        res.calculatorState = calculator_logic::CalculatorState();
+        return res;
+    }
+    static std::string const &chainIDForValue(ResultType const &r) {
+        return r.latestID;
+    }
+    void foldInPlace(ResultType &state, std::string_view const &id, ChainData const &item) const {
+        main_program_logic::MainProgramStateFolder::foldInPlace(state.mainProgramState, id, item);
+        calculatorFolder_.foldInPlace(state.calculatorState, id, item);
+        state.latestID = id;
+    }
+    static std::chrono::system_clock::time_point extractTime(ResultType const &st) {
+        return main_program_logic::MainProgramStateFolder::extractTime(st.mainProgramState);
+    }
+};
+
+//Places the items on the output chain, and when placing the last one, saves
+//the checkpoints for the state as it will be right after that item
+template <class Env>
+class CompactionInputHandler {
+private:
+    calculator_logic::CalculatorStateFolder calculatorFolder_;
+public:
+    using InputType = CompactionInput;
+    using ResponseType = bool;
+
+    using RealInput = typename infra::SinglePassIterationApp<Env>::template TimedDataType<
+        typename infra::SinglePassIterationApp<Env>::template Key<InputType>
+    >;
+
+    template <class Chain>
+    void initialize(Env *env, Chain *chain) {}
+
+    template <class Chain>
+    std::tuple<
+        ResponseType
+        , std::optional<std::tuple<std::string, ChainData>>
+    > handleInput(Env *env, Chain *chain, RealInput const &input, CompactedState const &state) {
+        auto const &in = input.value.key();
+        if (!in.isLast) {
+            return {true, std::tuple<std::string, ChainData> {"", in.item}};
+        }
+        std::string id = chain->newStorageID();
+        CompactedState after = state;
+        main_program_logic::MainProgramStateFolder::foldInPlace(after.mainProgramState, id, in.item);
+        calculatorFolder_.foldInPlace(after.calculatorState, id, in.item);
+        after.mainProgramState.max_id_sofar = std::max(after.mainProgramState.max_id_sofar, in.maxIDSoFar);
+        shared_chain_utils::checkpoints::saveCheckpoint<main_program_logic::MainProgramState>(
+            chain
+            , shared_chain_utils::checkpoints::CheckpointConfig {"main_program_state", 1000, 10000, 8}
+            , after.mainProgramState
+            , id
+            , after.mainProgramState.foldedCount
+            , after.mainProgramState.updateTimestamp
+        );
+        shared_chain_utils::checkpoints::saveCheckpoint<calculator_logic::CalculatorState>(
+            chain
+            , shared_chain_utils::checkpoints::CheckpointConfig {"calculator_state", 1000, 10000, 8}
+            , after.calculatorState
+            , id
+            , after.calculatorState.foldedCount
+            , after.calculatorState.updateTimestamp
+        );
+        std::ostringstream oss;
+        oss << "Saved checkpoints at chain item " << id << " (" << after.mainProgramState.foldedCount << " items)";
+        env->log(infra::LogLevel::Info, oss.str());
+        return {true, std::tuple<std::string, ChainData> {id, in.item}};
+    }
+};
+
+//What the first pass learns about the input chain
+struct CompactionScan {
+    std::unordered_set<int> completed;
+    std::optional<int> maxID = std::nullopt;
+    //position of the last item that mentions each request id
+    std::unordered_map<int, std::size_t> lastPosition;
+    std::size_t itemCount = 0;
+
+    void add(ChainData const &d) {
+        std::visit([this](auto const &u) {
+            using T = std::decay_t<decltype(u)>;
+            if constexpr (std::is_same_v<T, ConfirmRequestReceipt>) {
+                for (auto id : u.ids) {
+                    lastPosition[id] = itemCount;
+                }
+            } else if constexpr (!std::is_same_v<T, CalculatorHeartbeat>) {
+                lastPosition[u.id] = itemCount;
+                if constexpr (std::is_same_v<T, PlaceRequest>) {
+                    if (!maxID || u.id > *maxID) {
+                        maxID = u.id;
+                    }
+                } else if constexpr (std::is_same_v<T, RequestCompleted>) {
+                    completed.insert(u.id);
+                }
+            }
+        }, d.update);
+        ++itemCount;
+    }
+    //the lifecycle of the highest id stays live so that the folded
+    //max_id_sofar is right even when the chain is folded without checkpoint
+    void finish() {
+        if (maxID) {
+            completed.erase(*maxID);
+        }
+    }
+    bool isArchived(int id) const {
+        return completed.find(id) != completed.end();
+    }
+    //position of the last item that has a live part, if any
+    std::optional<std::size_t> lastLivePosition() const {
+        std::optional<std::size_t> ret = std::nullopt;
+        for (auto const &p : lastPosition) {
+            if (!isArchived(p.first) && (!ret || p.second > *ret)) {
+                ret = p.second;
+            }
+        }
+        return ret;
+    }
+};
+
+//What happens to the n-th input item: the part (if any) that goes to the
+//archive and the part (if any) that stays live
+struct ItemPlan {
+    std::optional<ChainData> archived;
+    std::optional<CompactionInput> live;
+};
+
+ItemPlan planItem(ChainData &&d, std::size_t position, CompactionScan const &scan, std::size_t lastLivePosition) {
+    ItemPlan p;
+    std::visit([&d,&p,&scan](auto &&u) {
+        using T = std::decay_t<decltype(u)>;
+        if constexpr (std::is_same_v<T, ConfirmRequestReceipt>) {
+            ConfirmRequestReceipt archivedPart, livePart;
+            for (auto id : u.ids) {
+                (scan.isArchived(id)?archivedPart:livePart).ids.push_back(id);
+            }
+            if (!archivedPart.ids.empty()) {
+                p.archived = ChainData {d.timestamp, std::move(archivedPart)};
+            }
+            if (!livePart.ids.empty()) {
+                p.live = CompactionInput {ChainData {d.timestamp, std::move(livePart)}, false, 0};
+            }
+        } else if constexpr (std::is_same_v<T, CalculatorHeartbeat>) {
+            //the calculators announce themselves again right away
+            p.archived = std::move(d);
+        } else {
+            if (scan.isArchived(u.id)) {
+                p.archived = std::move(d);
+            } else {
+                p.live = CompactionInput {std::move(d), false, 0};
+            }
+        }
+    }, d.update);
+    if (p.live && position == lastLivePosition) {
+        p.live->isLast = true;
+        p.live->maxIDSoFar = (scan.maxID?*scan.maxID:0);
+    }
+    return p;
+}
+
+template <class ChainItem, class Env>
+CompactionScan scan(Env *env, std::string const &chainLocatorStr) {
+    using M = infra::SinglePassIterationApp<Env>;
+    using R = infra::AppRunner<M>;
+    R r(env);
+
+    transport::SharedChainCreator<M> sharedChainCreator;
+    auto chainDataSource = basic::simple_shared_chain::createChainDataSource<
+        R, ChainItem
+    >(
+        r
+        , sharedChainCreator.template readerFactory<
+            ChainItem
+            , ChainItemReaderFolder<ChainItem>
+        >(
+            env
+            , chainLocatorStr
+        )
+        , "input_chain"
+    );
+
+    CompactionScan res;
+    auto collector = M::template pureExporter<ChainItem>(
+        [&res](ChainItem &&d) {
+            res.add(plainItem(d));
+        }
+    );
+    r.registerExporter("collector", collector);
+    r.exportItem(collector, chainDataSource.clone());
+    r.finalize();
+
+    res.finish();
+    return res;
+}
+
+template <class ChainItem, class Env>
+void rewrite(Env *env, std::string const &chainLocatorStr, std::string const &outputChainLocatorStr, std::string const &archiveFile, std::shared_ptr<CompactionScan const> const &compactionScan, std::size_t lastLivePosition) {
+    using M = infra::SinglePassIterationApp<Env>;
+    using R = infra::AppRunner<M>;
+    R r(env);
+
+    transport::SharedChainCreator<M> sharedChainCreator;
+    auto chainDataSource = basic::simple_shared_chain::createChainDataSource<
+        R, ChainItem
+    >(
+        r
+        , sharedChainCreator.template readerFactory<
+            ChainItem
+            , ChainItemReaderFolder<ChainItem>
+        >(
+            env
+            , chainLocatorStr
+        )
+        , "input_chain"
+    );
+
+    //the items come in the same order as in the first pass, so the n-th one
+    //is at position n in the scan
+    auto counter = std::make_shared<std::size_t>(0);
+    auto route = M::template liftPure<ChainItem>(
+        [counter,compactionScan,lastLivePosition](ChainItem &&d) -> ItemPlan {
+            return planItem(std::move(plainItem(d)), (*counter)++, *compactionScan, lastLivePosition);
+        }
+    );
+    r.registerAction("route", route);
+    auto itemPlan = r.execute(route, chainDataSource.clone());
+
+    auto archivedPart = M::template liftMaybe<ItemPlan>(
+        [](ItemPlan &&p) -> std::optional<basic::ByteDataWithTopic> {
+            if (!p.archived) {
+                return std::nullopt;
+            }
+            return basic::ByteDataWithTopic {
+                "chain.data"
+                , basic::bytedata_utils::RunSerializer<ChainData>::apply(*(p.archived))
+            };
+        }
+    );
+    r.registerAction("archivedPart", archivedPart);
+    auto livePart = M::template liftMaybe<ItemPlan>(
+        [](ItemPlan &&p) -> std::optional<CompactionInput> {
+            return std::move(p.live);
+        }
+    );
+    r.registerAction("livePart", livePart);
+
+    std::ofstream ofs(archiveFile.c_str(), std::ios::binary);
+    auto fileWriter = basic::ByteDataWithTopicRecordFileImporterExporter<M>
+        ::template createExporter<basic::ByteDataWithTopicRecordFileFormat<std::chrono::microseconds>>(
+            ofs
+            , {(std::byte) 0x01,(std::byte) 0x23,(std::byte) 0x45,(std::byte) 0x67}
+            , {(std::byte) 0x76,(std::byte) 0x54,(std::byte) 0x32,(std::byte) 0x10}
+        );
+    r.registerExporter("fileWriter", fileWriter);
+    r.exportItem(fileWriter, r.execute(archivedPart, itemPlan.clone()));
+
+    auto keyify = M::template kleisli<CompactionInput>(basic::CommonFlowUtilComponents<M>::template keyify<CompactionInput>());
+    r.registerAction("keyify", keyify);
+    constexpr bool isCompact = std::is_same_v<ChainItem, CompactChainData>;
+    using OutputFolder = std::conditional_t<
+        isCompact
+        , compact_chain_adapters::CompactChainFolder<CompactedStateFolder>
+        , CompactedStateFolder
+    >;
+    using OutputInputHandler = std::conditional_t<
+        isCompact
+        , compact_chain_adapters::CompactChainInputHandler<CompactionInputHandler<Env>>
+        , CompactionInputHandler<Env>
+    >;
+    auto outputChainFacility = sharedChainCreator.template writerFactory<
+        ChainItem
+        , OutputFolder
+        , OutputInputHandler
+    >(env, outputChainLocatorStr)();
+    r.registerOnOrderFacility("outputChainFacility", outputChainFacility);
+    r.placeOrderWithFacilityAndForget(
+        r.execute(keyify, r.execute(livePart, itemPlan.clone()))
+        , outputChainFacility
+    );
+
+    r.finalize();
+}
+
+template <class ChainItem, class Env>
+int run(Env *env, std::string const &chainLocatorStr, std::string const &outputChainLocatorStr, std::string const &archiveFile, bool allowEmptyOutput=false) {
+    auto compactionScan = std::make_shared<CompactionScan const>(scan<ChainItem>(env, chainLocatorStr));
+    auto lastLivePosition = compactionScan->lastLivePosition();
+    {
+        std::ostringstream oss;
+        oss << "Input chain has " << compactionScan->itemCount << " items and " << compactionScan->lastPosition.size() << " request(s), " << compactionScan->completed.size() << " completed request(s) will be archived";
+        env->log(infra::LogLevel::Info, oss.str());
+    }
+    if (!lastLivePosition) {
+        if (allowEmptyOutput) {
+            //no request was ever placed, the new chain simply starts empty
+            env->log(infra::LogLevel::Info, "Nothing to keep, the output chain starts empty");
+            return 0;
+        }
+        std::cerr << "Nothing to keep on the output chain, not compacting!\n";
+        return 1;
+    }
+    rewrite<ChainItem>(env, chainLocatorStr, outputChainLocatorStr, archiveFile, compactionScan, *lastLivePosition);
+    return 0;
+}
+
+//Calls f with a freshly set up environment that signs and verifies
+//ChainItem chains
+template <class ChainItem, class F>
+auto withSignedEnvironment(F &&f) {
+    //same key as transcribe_chain, the rewritten items are signed as transcriptions
+    const transport::security::SignatureHelper::PrivateKey transcriptionKey = {
+        0x72,0x6C,0xE8,0x00,0x79,0xB9,0x13,0xD9,0x9F,0xE7,0x95,0xC8,0xAD,0x50,0xBA,0xF9,
+        0x94,0x0E,0x20,0xEE,0x1C,0xAD,0x64,0x48,0xDF,0xBB,0x64,0xFF,0x75,0x54,0x6B,0xD7,
+        0x66,0x32,0x6E,0x9F,0x1E,0xC0,0x25,0x62,0x21,0x02,0x7C,0xF6,0xD7,0xAB,0xB7,0x55,
+        0x84,0x23,0xFE,0xCF,0xAA,0x02,0x21,0x94,0x55,0x08,0x65,0x13,0x5B,0x3B,0x57,0xD6
+    };
+
+    using TheEnvironment = infra::Environment<
+        infra::CheckTimeComponent<true>,
+        infra::TrivialExitControlComponent,
+        basic::TimeComponentEnhancedWithSpdLogging<
+            basic::single_pass_iteration_clock::ClockComponent<std::chrono::system_clock::time_point>
+            , false //don't log thread ID
+        >,
+        transport::CrossGuidComponent,
+        transport::AllChainComponents,
+        transport::security::SignatureWithNameHookFactoryComponent<ChainItem>,
+        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainItem>
+    >;
+    TheEnvironment env;
+    env.transport::security::SignatureWithNameHookFactoryComponent<ChainItem>::operator=(
+        transport::security::SignatureWithNameHookFactoryComponent<ChainItem> {
+            "transcription"
+            , transcriptionKey
+        }
+    );
+    env.transport::security::VerifyUsingNameTagHookFactoryComponent<ChainItem>::operator=(
+        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainItem> {
+            verifyingKeys
+        }
+    );
+
+    return f(&env);
+}
+
+//Calls f with a freshly set up environment without signatures
+template <class F>
+auto withPlainEnvironment(F &&f) {
+    using TheEnvironment = infra::Environment<
+        infra::CheckTimeComponent<true>,
+        infra::TrivialExitControlComponent,
+        basic::TimeComponentEnhancedWithSpdLogging<
+            basic::single_pass_iteration_clock::ClockComponent<std::chrono::system_clock::time_point>
+            , false //don't log thread ID
+        >,
+        transport::CrossGuidComponent,
+        transport::AllChainComponents
+    >;
+    TheEnvironment env;
+
+    return f(&env);
+}
+
+template <class ChainItem, class F>
+auto withEnvironment(bool chainIsSigned, F &&f) {
+    if (chainIsSigned) {
+        return withSignedEnvironment<ChainItem>(std::forward<F>(f));
+    } else {
+        return withPlainEnvironment(std::forward<F>(f));
+    }
+}
+
+//how full the shared memory segment is (0 to 1), std::nullopt if there is
+//no such segment yet
+std::optional<double> segmentUsage(std::string const &segmentName) {
+    try {
+        boost::interprocess::managed_shared_memory segment(boost::interprocess::open_read_only, segmentName.c_str());
+        if (segment.get_size() == 0) {
+            return std::nullopt;
+        }
+        return 1.0-1.0*segment.get_free_memory()/segment.get_size();
+    } catch (boost::interprocess::interprocess_exception const &) {
+        return std::nullopt;
+    }
+}
+
+struct WatchSettings {
+    double threshold;
+    std::chrono::seconds pollPeriod;
+    std::chrono::seconds gracePeriod;
+    std::string archiveDir;
+    bool removeOldChain;
+};
+
+//Watch mode: polls how full the segment of the current generation of the
+//demo chain is, and once it is above the threshold rolls the chain over:
+//
+//  1. marks the generation as rolling, the running programs (see
+//     ChainRolloverWatcher.hpp) stop using the chain and restart, waiting
+//     in theChainLocator() for the next generation
+//  2. waits until the chain has not changed for gracePeriod, so that no
+//     append is still on its way
+//  3. compacts it into the next generation, archiving the completed requests
+//     to <archiveDir>/<old segment name>.archive and saving the checkpoints
+//  4. marks the next generation as ready, and the programs carry on there
+//
+//If the compaction fails, the old generation is marked as ready again and
+//the watcher stops.
+int watch(bool chainIsSigned, WatchSettings const &settings) {
+    while (true) {
+        auto g = readChainGeneration();
+        if (g.rolling) {
+            std::cerr << "Generation " << g.generation << " is marked as rolling over, another watcher may be running (or one stopped half-way)!\n";
+            return 1;
+        }
+        auto segmentName = chainSegmentNameForGeneration(g.generation);
+        auto usage = segmentUsage(segmentName);
+        if (!usage || *usage < settings.threshold) {
+            std::this_thread::sleep_for(settings.pollPeriod);
+            continue;
+        }
+        std::cout << "Chain segment '" << segmentName << "' is " << (int) (*usage*100) << "% full, rolling over to generation " << (g.generation+1) << "\n";
+
+        writeChainGeneration(ChainGeneration {g.generation, true});
+
+        auto inputLocator = chainLocatorForGeneration(g.generation);
+        auto outputLocator = chainLocatorForGeneration(g.generation+1);
+        auto countItems = [chainIsSigned,&inputLocator]() {
+            return withEnvironment<CompactChainData>(chainIsSigned, [&inputLocator](auto *env) {
+                return scan<CompactChainData>(env, inputLocator).itemCount;
+            });
+        };
+        auto itemCount = countItems();
+        while (true) {
+            std::this_thread::sleep_for(settings.gracePeriod);
+            auto newCount = countItems();
+            if (newCount == itemCount) {
+                break;
+            }
+            itemCount = newCount;
+        }
+
+        auto archiveFile = (std::filesystem::path(settings.archiveDir) / (segmentName+".archive")).string();
+        auto res = withEnvironment<CompactChainData>(chainIsSigned, [&](auto *env) {
+            return run<CompactChainData>(env, inputLocator, outputLocator, archiveFile, true);
+        });
+        if (res != 0) {
+            writeChainGeneration(ChainGeneration {g.generation, false});
+            std::cerr << "Compaction of generation " << g.generation << " failed, it stays the current one!\n";
+            return res;
+        }
+        if (countItems() != itemCount) {
+            std::cerr << "Generation " << g.generation << " changed while it was being compacted, the items appended since are not in generation " << (g.generation+1) << "!\n";
+        }
+        writeChainGeneration(ChainGeneration {g.generation+1, false});
+        std::cout << "Rolled over to generation " << (g.generation+1) << " ('" << outputLocator << "'), archived to '" << archiveFile << "'\n";
+
+        if (settings.removeOldChain) {
+            //give the readers of the old generation time to leave it
+            std::this_thread::sleep_for(settings.gracePeriod);
+            boost::interprocess::shared_memory_object::remove(segmentName.c_str());
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    options_description desc("allowed options");
+    desc.add_options()
+        ("help", "display help message")
+        ("input", value<std::string>(), "the locator string of the chain to compact")
+        ("output", value<std::string>(), "the locator string of the compacted chain (must be a new chain)")
+        ("archive", value<std::string>(), "the capture file to archive the completed requests to")
+        ("chainIsSigned", "whether chain is signed")
+        ("compactChain", "whether the input and output chains hold compactly encoded items (always the case with watch)")
+        ("watch", "instead of compacting one chain, watch the demo chain of the day and roll it over to a compacted new generation whenever its segment fills up")
+        ("threshold", value<int>(), "with watch, the segment usage (in percent) that triggers a rollover (default 80)")
+        ("pollSeconds", value<int>(), "with watch, how often to check the segment usage (default 10)")
+        ("graceSeconds", value<int>(), "with watch, how long the chain must stay unchanged before it is compacted (default 2)")
+        ("archiveDir", value<std::string>(), "with watch, where to write the archives (default the current directory)")
+        ("removeOldChain", "with watch, remove the shared memory segment of the old generation after a rollover")
+    ;
+    variables_map vm;
+    store(parse_command_line(argc, argv, desc), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << '\n';
+        return 0;
+    }
+    if (vm.count("watch")) {
+        WatchSettings settings {
+            (vm.count("threshold")?vm["threshold"].as<int>():80)/100.0
+            , std::chrono::seconds(vm.count("pollSeconds")?vm["pollSeconds"].as<int>():10)
+            , std::chrono::seconds(vm.count("graceSeconds")?vm["graceSeconds"].as<int>():2)
+            , (vm.count("archiveDir")?vm["archiveDir"].as<std::string>():std::string("."))
+            , (vm.count("removeOldChain") > 0)
+        };
+        if (settings.threshold <= 0 || settings.threshold > 1) {
+            std::cerr << "threshold must be between 1 and 100\n";
+            return 1;
+        }
+        if (settings.pollPeriod.count() <= 0 || settings.gracePeriod.count() <= 0) {
+            std::cerr << "pollSeconds and graceSeconds must be positive\n";
+            return 1;
+        }
+        return watch(vm.count("chainIsSigned") > 0, settings);
+    }
+    if (!vm.count("input")) {
+        std::cerr << "Please provide input\n";
+        return 1;
+    }
+    if (!vm.count("output")) {
+        std::cerr << "Please provide output\n";
+        return 1;
+    }
+    if (!vm.count("archive")) {
+        std::cerr << "Please provide archive\n";
+        return 1;
+    }
+    auto inputChainLocatorStr = vm["input"].as<std::string>();
+    auto outputChainLocatorStr = vm["output"].as<std::string>();
+    auto archiveFile = vm["archive"].as<std::string>();
+    if (inputChainLocatorStr == outputChainLocatorStr) {
+        std::cerr << "Output chain must be different from input chain!\n";
+        return 1;
+    }
+
+    if (vm.count("compactChain")) {
+        return withEnvironment<CompactChainData>(vm.count("chainIsSigned") > 0, [&](auto *env) {
+            return run<CompactChainData>(env, inputChainLocatorStr, outputChainLocatorStr, archiveFile);
+        });
+    }
+    return withEnvironment<ChainData>(vm.count("chainIsSigned") > 0, [&](auto *env) {
+        return run<ChainData>(env, inputChainLocatorStr, outputChainLocatorStr, archiveFile);
+    });
+}
@@ -0,0 +1,116 @@
+#include "simple_demo_chain_version/chain_data/CompactChainData.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <limits>
+#include <vector>
+
+//Checks that every kind of chain item survives the compact encoding, and
+//that truncated, extended or otherwise malformed input is rejected.
+//Returns non-zero if any check fails.
+
+using namespace dev::cd606::tm;
+using namespace simple_demo_chain_version;
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, std::string const &what) {
+        if (!ok) {
+            std::cout << "FAILED: " << what << '\n';
+            ++failures;
+        }
+    }
+
+    //ChainData has no operator==, so items are compared by their CBOR form
+    bool sameItem(ChainData const &a, ChainData const &b) {
+        return basic::bytedata_utils::RunSerializer<ChainData>::apply(a)
+            == basic::bytedata_utils::RunSerializer<ChainData>::apply(b);
+    }
+
+    std::vector<ChainData> samples() {
+        PlaceRequest place;
+        place.id = 12345;
+        place.externalID.content = std::string("external\0id", 11);
+        place.value = -3.25;
+        PlaceRequest emptyPlace;
+        emptyPlace.id = 0;
+        emptyPlace.value = std::numeric_limits<double>::infinity();
+        ConfirmRequestReceipt confirm;
+        confirm.ids = {7, 8, 9, 3, std::numeric_limits<int>::max(), std::numeric_limits<int>::min(), 0};
+        ConfirmRequestReceipt emptyConfirm;
+        RespondToRequest respond;
+        respond.id = 42;
+        respond.response = 1.5;
+        respond.isFinalResponse = true;
+        RequestCompleted completed;
+        completed.id = -1;
+        completed.fashion = RequestCompletedFashion::PartiallyHandledThenTimeout;
+        CalculatorHeartbeat heartbeat;
+        heartbeat.workerID = "worker-1";
+        return {
+            ChainData {1600000000000, place}
+            , ChainData {0, emptyPlace}
+            , ChainData {-1, confirm}
+            , ChainData {std::numeric_limits<int64_t>::max(), emptyConfirm}
+            , ChainData {1600000000001, respond}
+            , ChainData {1600000000002, completed}
+            , ChainData {1600000000003, heartbeat}
+        };
+    }
+}
+
+int main(int argc, char **argv) {
+    for (auto const &d : samples()) {
+        std::ostringstream oss;
+        oss << d;
+        auto encoded = compact_encoding::encode(d);
+
+        auto decoded = compact_encoding::decode(encoded);
+        check(decoded && sameItem(*decoded, d), "round trip of "+oss.str());
+        auto viaSerializer = basic::bytedata_utils::RunDeserializer<CompactChainData>::apply(
+            basic::bytedata_utils::RunSerializer<CompactChainData>::apply(CompactChainData {d})
+        );
+        check(viaSerializer && sameItem(viaSerializer->data, d), "serializer round trip of "+oss.str());
+
+        for (std::size_t len=0; len<encoded.length(); ++len) {
+            check(!compact_encoding::decode(std::string_view(encoded).substr(0, len)), "truncation to "+std::to_string(len)+" bytes of "+oss.str());
+        }
+        check(!compact_encoding::decode(encoded+'\0'), "trailing byte after "+oss.str());
+
+        auto otherVersion = encoded;
+        otherVersion[0] = static_cast<char>(otherVersion[0] | 0x10);
+        check(!compact_encoding::decode(otherVersion), "unknown format version for "+oss.str());
+    }
+
+    std::string badTag = compact_encoding::encode(samples()[5]);
+    badTag[0] = static_cast<char>(5);
+    check(!compact_encoding::decode(badTag), "unknown variant index");
+
+    //a ConfirmRequestReceipt claiming far more ids than there are bytes
+    std::string hugeCount = compact_encoding::encode(ChainData {0, ConfirmRequestReceipt {}});
+    hugeCount.pop_back();
+    compact_encoding::detail::putVarint(hugeCount, std::numeric_limits<uint64_t>::max());
+    check(!compact_encoding::decode(hugeCount), "oversized id count");
+
+    //a varint that never ends within 64 bits
+    std::string longVarint = compact_encoding::encode(ChainData {0, CalculatorHeartbeat {}});
+    longVarint.pop_back();
+    longVarint.append(10, static_cast<char>(0x80));
+    longVarint.push_back(0);
+    check(!compact_encoding::decode(longVarint), "overlong varint");
+
+    //a byte string longer than the rest of the input
+    std::string longBytes = compact_encoding::encode(ChainData {0, CalculatorHeartbeat {}});
+    longBytes.pop_back();
+    compact_encoding::detail::putVarint(longBytes, 100);
+    longBytes.append("short");
+    check(!compact_encoding::decode(longBytes), "byte string past the end");
+
+    if (failures == 0) {
+        std::cout << "All checks passed\n";
+        return 0;
+    }
+    std::cout << failures << " check(s) failed\n";
+    return 1;
+}
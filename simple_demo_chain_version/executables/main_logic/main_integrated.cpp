@@ -2,6 +2,8 @@
 #include "simple_demo_chain_version/security_keys/VerifyingKeys.hpp"
 #include "simple_demo_chain_version/enable_server_data/EnableServerTransactionData.hpp"
 #include "simple_demo_chain_version/executables/CommonInfo.hpp"
+#include "simple_demo_chain_version/executables/ChainMetricsHeartbeat.hpp"
+#include "simple_demo_chain_version/executables/ChainRolloverWatcher.hpp"
 
 #include <tm_kit/infra/Environments.hpp>
 #include <tm_kit/infra/TerminationController.hpp>
@@ -49,22 +51,22 @@ int main(int argc, char **argv) {
         transport::shared_memory_broadcast::SharedMemoryBroadcastComponent,
         transport::HeartbeatAndAlertComponent,
         transport::lock_free_in_memory_shared_chain::SharedMemoryChainComponent,
-        transport::security::SignatureWithNameHookFactoryComponent<ChainData>,
-        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData>,
+        transport::security::SignatureWithNameHookFactoryComponent<CompactChainData>,
+        transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData>,
         transport::ClientSideSimpleIdentityAttacherComponent<std::string, GS::Input>
     >;
     using M = infra::RealTimeApp<TheEnvironment>;
     using R = infra::AppRunner<M>;
 
     TheEnvironment env;
-    env.transport::security::SignatureWithNameHookFactoryComponent<ChainData>::operator=(
-        transport::security::SignatureWithNameHookFactoryComponent<ChainData> {
+    env.transport::security::SignatureWithNameHookFactoryComponent<CompactChainData>::operator=(
+        transport::security::SignatureWithNameHookFactoryComponent<CompactChainData> {
             "main_logic"
             , mainLogicKey
         }
     );
-    env.transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData>::operator=(
-        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData> {
+    env.transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData>::operator=(
+        transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData> {
             verifyingKeys
         }
     );
@@ -83,9 +85,14 @@ int main(int argc, char **argv) {
         (&env, "simple_demo_chain_version MainLogic Integrated", "rabbitmq://127.0.0.1::guest:guest:amq.topic[durable=true]");
     env.setStatus("program", transport::HeartbeatMessage::Status::Good);
     transport::attachHeartbeatAndAlertComponent(r, &env, "simple_demo_chain_version.main_logic.heartbeat", std::chrono::seconds(1));
+    //chain position, reader lag and append/fold/idle timings
+    attachChainMetricsToHeartbeat(r);
 
     //setting up chain
-    auto chainLocatorStr = theChainLocator();
+    int chainGeneration = 0;
+    auto chainLocatorStr = theChainLocator(&chainGeneration);
+    //restarts on the new chain when compact_chain --watch rolls it over
+    attachChainRolloverWatcher(r, chainGeneration, argv);
 
     //Please note that this object should not be allowed to go out of scope
     transport::SharedChainCreator<M> sharedChainCreator;
@@ -162,10 +169,10 @@ int main(int argc, char **argv) {
         }
     };
 
-    //main logic 
+    //main logic (the chain holds CompactChainData, see chain_data/CompactChainData.hpp)
     main_program_logic::mainProgramLogicMain(
         r
-        , std::get<0>(main_program_logic::chainBasedRequestHandler(
+        , std::get<0>(main_program_logic::chainBasedRequestHandler<R, transport::SharedChainCreator, CompactChainData>(
             r
             , sharedChainCreator 
             , chainLocatorStr
@@ -1,6 +1,8 @@
 #include "simple_demo_chain_version/main_program_logic/MainProgramLogicProvider.hpp"
 #include "simple_demo_chain_version/security_keys/VerifyingKeys.hpp"
 #include "simple_demo_chain_version/executables/CommonInfo.hpp"
+#include "simple_demo_chain_version/executables/ChainMetricsHeartbeat.hpp"
+#include "simple_demo_chain_version/executables/ChainRolloverWatcher.hpp"
 
 #include <tm_kit/infra/Environments.hpp>
 #include <tm_kit/infra/TerminationController.hpp>
@@ -36,21 +38,21 @@ int main(int argc, char **argv) {
         transport::AllNetworkTransportComponents,
         transport::HeartbeatAndAlertComponent,
         transport::lock_free_in_memory_shared_chain::SharedMemoryChainComponent,
-        transport::security::SignatureWithNameHookFactoryComponent<ChainData>,
-        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData>
+        transport::security::SignatureWithNameHookFactoryComponent<CompactChainData>,
+        transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData>
     >;
     using M = infra::RealTimeApp<TheEnvironment>;
     using R = infra::AppRunner<M>;
 
     TheEnvironment env;
-    env.transport::security::SignatureWithNameHookFactoryComponent<ChainData>::operator=(
-        transport::security::SignatureWithNameHookFactoryComponent<ChainData> {
+    env.transport::security::SignatureWithNameHookFactoryComponent<CompactChainData>::operator=(
+        transport::security::SignatureWithNameHookFactoryComponent<CompactChainData> {
             "main_logic"
             , mainLogicKey
         }
     );
-    env.transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData>::operator=(
-        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData> {
+    env.transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData>::operator=(
+        transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData> {
             verifyingKeys
         }
     );
@@ -64,14 +66,21 @@ int main(int argc, char **argv) {
         (&env, "simple_demo_chain_version MainLogic Request Placer", "rabbitmq://127.0.0.1::guest:guest:amq.topic[durable=true]");
     env.setStatus("program", transport::HeartbeatMessage::Status::Good);
     transport::attachHeartbeatAndAlertComponent(r, &env, "simple_demo_chain_version.main_logic.heartbeat", std::chrono::seconds(1));
+    //chain position, reader lag and append/fold/idle timings
+    attachChainMetricsToHeartbeat(r);
 
     //setting up chain
-    auto chainLocatorStr = theChainLocator();
+    int chainGeneration = 0;
+    auto chainLocatorStr = theChainLocator(&chainGeneration);
+    //restarts on the new chain when compact_chain --watch rolls it over
+    attachChainRolloverWatcher(r, chainGeneration, argv);
 
     //Please note that this object should not be allowed to go out of scope
     transport::SharedChainCreator<M> sharedChainCreator;
 
-    auto requestPlacer = main_program_logic::chainBasedRequestHandler(
+    //the chain holds CompactChainData (see chain_data/CompactChainData.hpp),
+    //the facility still answers with plain ChainData
+    auto requestPlacer = main_program_logic::chainBasedRequestHandler<R, transport::SharedChainCreator, CompactChainData>(
         r
         , sharedChainCreator 
         , chainLocatorStr
@@ -1,4 +1,5 @@
 #include "simple_demo_chain_version/main_program_logic/MainProgramStateFolder.hpp"
+#include "simple_demo_chain_version/chain_data/CompactChainAdapters.hpp"
 #include "simple_demo_chain_version/security_keys/VerifyingKeys.hpp"
 #include "simple_demo_chain_version/executables/CommonInfo.hpp"
 
@@ -36,20 +37,20 @@ int main(int argc, char **argv) {
         >,
         transport::CrossGuidComponent,
         transport::lock_free_in_memory_shared_chain::SharedMemoryChainComponent,
-        transport::security::SignatureWithNameHookFactoryComponent<ChainData>,
-        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData>
+        transport::security::SignatureWithNameHookFactoryComponent<CompactChainData>,
+        transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData>
     >;
     using M = infra::RealTimeApp<TheEnvironment>;
 
     TheEnvironment env;
-    env.transport::security::SignatureWithNameHookFactoryComponent<ChainData>::operator=(
-        transport::security::SignatureWithNameHookFactoryComponent<ChainData> {
+    env.transport::security::SignatureWithNameHookFactoryComponent<CompactChainData>::operator=(
+        transport::security::SignatureWithNameHookFactoryComponent<CompactChainData> {
             "place_request"
             , placeRequestKey
         }
     );
-    env.transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData>::operator=(
-        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData> {
+    env.transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData>::operator=(
+        transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData> {
             verifyingKeys
         }
     );
@@ -61,13 +62,14 @@ int main(int argc, char **argv) {
     transport::SharedChainCreator<M> sharedChainCreator;
 
     int id = -1;
+    //the chain holds compactly encoded items (see chain_data/CompactChainData.hpp)
     if (sharedChainCreator.oneShotWrite<
-        ChainData 
-        , main_program_logic::MainProgramStateFolder
+        CompactChainData 
+        , compact_chain_adapters::CompactChainFolder<main_program_logic::MainProgramStateFolder>
     >(
         &env 
         , chainLocatorStr
-        , [&env,value,&id](main_program_logic::MainProgramState const &s) -> std::optional<std::tuple<std::string, ChainData>> {
+        , [&env,value,&id](main_program_logic::MainProgramState const &s) -> std::optional<std::tuple<std::string, CompactChainData>> {
             int64_t now = infra::withtime_utils::sinceEpoch<std::chrono::milliseconds>(env.now());
             id = s.max_id_sofar+1;
             PlaceRequest r {
@@ -75,9 +77,9 @@ int main(int argc, char **argv) {
                 , env.id_to_bytes(env.new_id())
                 , value
             };
-            return std::tuple<std::string, ChainData> {
+            return std::tuple<std::string, CompactChainData> {
                 ""
-                , ChainData {now, r}
+                , CompactChainData {ChainData {now, r}}
             };
         }
     )) {
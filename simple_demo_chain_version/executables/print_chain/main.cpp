@@ -28,25 +28,50 @@ using namespace simple_demo_chain_version;
 using namespace boost::program_options;
 
 template <class Env>
-void run(Env *env, std::string const &chainLocatorStr, std::string const &outputFile) {
+void run(Env *env, std::string const &chainLocatorStr, std::string const &outputFile, bool compactChain) {
     using M = infra::SinglePassIterationApp<Env>;
     using R = infra::AppRunner<M>;
     R r(env);
 
     transport::SharedChainCreator<M> sharedChainCreator;
-    auto chainDataSource = basic::simple_shared_chain::createChainDataSource<
-        R, ChainData
-    >(
-        r 
-        , sharedChainCreator.template readerFactory<
-            ChainData
-            , main_program_logic::TrivialChainDataFolder
+    std::optional<typename R::template Source<ChainData>> chainDataSourceHolder = std::nullopt;
+    if (compactChain) {
+        auto compactChainDataSource = basic::simple_shared_chain::createChainDataSource<
+            R, CompactChainData
         >(
-            env
-            , chainLocatorStr
-        )
-        , "input_chain"
-    );
+            r 
+            , sharedChainCreator.template readerFactory<
+                CompactChainData
+                , main_program_logic::TrivialCompactChainDataFolder
+            >(
+                env
+                , chainLocatorStr
+            )
+            , "input_chain"
+        );
+        auto unwrap = M::template liftPure<CompactChainData>(
+            [](CompactChainData &&d) -> ChainData {
+                return std::move(d.data);
+            }
+        );
+        r.registerAction("unwrap", unwrap);
+        chainDataSourceHolder = r.execute(unwrap, std::move(compactChainDataSource));
+    } else {
+        chainDataSourceHolder = basic::simple_shared_chain::createChainDataSource<
+            R, ChainData
+        >(
+            r 
+            , sharedChainCreator.template readerFactory<
+                ChainData
+                , main_program_logic::TrivialChainDataFolder
+            >(
+                env
+                , chainLocatorStr
+            )
+            , "input_chain"
+        );
+    }
+    auto &chainDataSource = *chainDataSourceHolder;
 
     basic::AppRunnerUtilComponents<R>
         ::setupExitTimer(
@@ -93,7 +118,7 @@ void run(Env *env, std::string const &chainLocatorStr, std::string const &output
     }
 }
 
-void runSigned(std::string const &chainLocatorStr, std::string const &outputFile) {
+void runSigned(std::string const &chainLocatorStr, std::string const &outputFile, bool compactChain) {
     using TheEnvironment = infra::Environment<
         infra::CheckTimeComponent<true>,
         infra::TrivialExitControlComponent,
@@ -114,10 +139,10 @@ void runSigned(std::string const &chainLocatorStr, std::string const &outputFile
         }
     );
 
-    run<TheEnvironment>(&env, chainLocatorStr, outputFile); 
+    run<TheEnvironment>(&env, chainLocatorStr, outputFile, compactChain); 
 }
 
-void runPlain(std::string const &chainLocatorStr, std::string const &outputFile) {
+void runPlain(std::string const &chainLocatorStr, std::string const &outputFile, bool compactChain) {
     using TheEnvironment = infra::Environment<
         infra::CheckTimeComponent<true>,
         infra::TrivialExitControlComponent,
@@ -131,7 +156,7 @@ void runPlain(std::string const &chainLocatorStr, std::string const &outputFile)
 
     TheEnvironment env;
 
-    run<TheEnvironment>(&env, chainLocatorStr, outputFile); 
+    run<TheEnvironment>(&env, chainLocatorStr, outputFile, compactChain); 
 }
 
 int main(int argc, char **argv) {
@@ -141,6 +166,7 @@ int main(int argc, char **argv) {
         ("chain", value<std::string>(), "the locator string of the chain to print")
         ("outputFile", value<std::string>(), "the file to write to (if not given, then print on terminal")
         ("chainIsSigned", "whether chain is signed")
+        ("compactChain", "whether chain is stored with the compact encoding (see CompactChainData.hpp)")
     ;
     variables_map vm;
     store(parse_command_line(argc, argv, desc), vm);
@@ -160,11 +186,12 @@ int main(int argc, char **argv) {
         outputFile = vm["outputFile"].as<std::string>();
     }
     bool chainIsSigned = vm.count("chainIsSigned");
+    bool compactChain = vm.count("compactChain");
 
     if (chainIsSigned) {
-        runSigned(chainLocatorStr, outputFile);
+        runSigned(chainLocatorStr, outputFile, compactChain);
     } else {
-        runPlain(chainLocatorStr, outputFile);
+        runPlain(chainLocatorStr, outputFile, compactChain);
     }
     return 0;
 }
\ No newline at end of file
@@ -29,7 +29,7 @@ using namespace simple_demo_chain_version;
 using namespace boost::program_options;
 
 template <class Env, template <class E> class App>
-void runTranscription(Env *env, std::string const &inputChainLocatorStr, std::string const &outputChainLocatorStr) {
+void runTranscription(Env *env, std::string const &inputChainLocatorStr, std::string const &outputChainLocatorStr, bool compactInput, bool compactOutput) {
     using M = App<Env>;
     using R = infra::AppRunner<M>;
 
@@ -53,20 +53,41 @@ void runTranscription(Env *env, std::string const &inputChainLocatorStr, std::st
             , r.execute("parser", parser
                 , r.importItem("byteDataImporter", byteDataImporter))
         );
-
-        auto chainDataSink = basic::simple_shared_chain::createChainDataSink<
+    } else if (compactInput) {
+        auto compactChainDataSource = basic::simple_shared_chain::createChainDataSource<
+            R, CompactChainData
+        >(
+            r 
+            , sharedChainCreator.template readerFactory<
+                CompactChainData
+                , main_program_logic::TrivialCompactChainDataFolder
+            >(
+                env
+                , inputChainLocatorStr
+            )
+            , "input_chain"
+        );
+        auto unwrap = M::template liftPure<CompactChainData>(
+            [](CompactChainData &&d) -> ChainData {
+                return std::move(d.data);
+            }
+        );
+        r.registerAction("unwrap", unwrap);
+        chainDataSource = r.execute(unwrap, std::move(compactChainDataSource));
+    } else if (compactOutput) {
+        chainDataSource = basic::simple_shared_chain::createChainDataSource<
             R, ChainData
         >(
             r 
-            , sharedChainCreator.template writerFactory<
+            , sharedChainCreator.template readerFactory<
                 ChainData
-                , basic::simple_shared_chain::EmptyStateChainFolder
-                , basic::simple_shared_chain::SimplyPlaceOnChainInputHandler<ChainData>
-            >(env, outputChainLocatorStr)
-            , "output_chain"
+                , main_program_logic::TrivialChainDataFolder
+            >(
+                env
+                , inputChainLocatorStr
+            )
+            , "input_chain"
         );
-
-        r.connect(chainDataSource->clone(), chainDataSink);
     } else {
         chainDataSource = basic::simple_shared_chain::setupChainTranscriber<
             R, transport::SharedChainCreator, ChainData
@@ -82,6 +103,41 @@ void runTranscription(Env *env, std::string const &inputChainLocatorStr, std::st
         );
     }
 
+    if (compactOutput) {
+        auto wrap = M::template liftPure<ChainData>(
+            [](ChainData &&d) -> CompactChainData {
+                return CompactChainData {std::move(d)};
+            }
+        );
+        r.registerAction("wrap", wrap);
+        auto compactChainDataSink = basic::simple_shared_chain::createChainDataSink<
+            R, CompactChainData
+        >(
+            r 
+            , sharedChainCreator.template writerFactory<
+                CompactChainData
+                , basic::simple_shared_chain::EmptyStateChainFolder
+                , basic::simple_shared_chain::SimplyPlaceOnChainInputHandler<CompactChainData>
+            >(env, outputChainLocatorStr)
+            , "output_chain"
+        );
+        r.connect(r.execute(wrap, chainDataSource->clone()), compactChainDataSink);
+    } else if (inputIsCaptureFile || compactInput) {
+        auto chainDataSink = basic::simple_shared_chain::createChainDataSink<
+            R, ChainData
+        >(
+            r 
+            , sharedChainCreator.template writerFactory<
+                ChainData
+                , basic::simple_shared_chain::EmptyStateChainFolder
+                , basic::simple_shared_chain::SimplyPlaceOnChainInputHandler<ChainData>
+            >(env, outputChainLocatorStr)
+            , "output_chain"
+        );
+
+        r.connect(chainDataSource->clone(), chainDataSink);
+    }
+
     if constexpr (std::is_same_v<M, infra::SinglePassIterationApp<Env>>) {
         basic::AppRunnerUtilComponents<R>
             ::setupExitTimer(
@@ -101,7 +157,7 @@ void runTranscription(Env *env, std::string const &inputChainLocatorStr, std::st
 }
 
 template <template <class E> class App>
-void runSignedTranscription(std::string const &inputChainLocatorStr, std::string const &outputChainLocatorStr) {
+void runSignedTranscription(std::string const &inputChainLocatorStr, std::string const &outputChainLocatorStr, bool compactInput, bool compactOutput) {
     const transport::security::SignatureHelper::PrivateKey transcriptionKey = {
         0x72,0x6C,0xE8,0x00,0x79,0xB9,0x13,0xD9,0x9F,0xE7,0x95,0xC8,0xAD,0x50,0xBA,0xF9,
         0x94,0x0E,0x20,0xEE,0x1C,0xAD,0x64,0x48,0xDF,0xBB,0x64,0xFF,0x75,0x54,0x6B,0xD7,
@@ -119,7 +175,9 @@ void runSignedTranscription(std::string const &inputChainLocatorStr, std::string
         transport::CrossGuidComponent,
         transport::AllChainComponents,
         transport::security::SignatureWithNameHookFactoryComponent<ChainData>,
-        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData>
+        transport::security::VerifyUsingNameTagHookFactoryComponent<ChainData>,
+        transport::security::SignatureWithNameHookFactoryComponent<CompactChainData>,
+        transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData>
     >;
     TheEnvironment env;
     env.transport::security::SignatureWithNameHookFactoryComponent<ChainData>::operator=(
@@ -133,12 +191,23 @@ void runSignedTranscription(std::string const &inputChainLocatorStr, std::string
             verifyingKeys
         }
     );
+    env.transport::security::SignatureWithNameHookFactoryComponent<CompactChainData>::operator=(
+        transport::security::SignatureWithNameHookFactoryComponent<CompactChainData> {
+            "transcription"
+            , transcriptionKey
+        }
+    );
+    env.transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData>::operator=(
+        transport::security::VerifyUsingNameTagHookFactoryComponent<CompactChainData> {
+            verifyingKeys
+        }
+    );
 
-    runTranscription<TheEnvironment,App>(&env, inputChainLocatorStr, outputChainLocatorStr);
+    runTranscription<TheEnvironment,App>(&env, inputChainLocatorStr, outputChainLocatorStr, compactInput, compactOutput);
 }
 
 template <template <class E> class App>
-void runPlainTranscription(std::string const &inputChainLocatorStr, std::string const &outputChainLocatorStr) {
+void runPlainTranscription(std::string const &inputChainLocatorStr, std::string const &outputChainLocatorStr, bool compactInput, bool compactOutput) {
     using TheEnvironment = infra::Environment<
         infra::CheckTimeComponent<true>,
         infra::TrivialExitControlComponent,
@@ -151,7 +220,7 @@ void runPlainTranscription(std::string const &inputChainLocatorStr, std::string
     >;
     TheEnvironment env;
 
-    runTranscription<TheEnvironment,App>(&env, inputChainLocatorStr, outputChainLocatorStr);
+    runTranscription<TheEnvironment,App>(&env, inputChainLocatorStr, outputChainLocatorStr, compactInput, compactOutput);
 }
 
 int main(int argc, char **argv) {
@@ -162,6 +231,8 @@ int main(int argc, char **argv) {
         ("output", value<std::string>(), "a chain locator")
         ("chainIsSigned", "whether chain is signed")
         ("realTimeMode", "whether to run in real-time mode")
+        ("compactInput", "the input chain holds compactly encoded items (see CompactChainData.hpp), as the demo chain of the day does")
+        ("compactOutput", "store the output chain with the compact encoding (see CompactChainData.hpp) instead of CBOR")
     ;
     variables_map vm;
     store(parse_command_line(argc, argv, desc), vm);
@@ -184,18 +255,24 @@ int main(int argc, char **argv) {
     auto outputChainLocatorStr = vm["output"].as<std::string>();
     bool chainIsSigned = vm.count("chainIsSigned");
     bool realTimeMode = vm.count("realTimeMode");
+    bool compactInput = vm.count("compactInput");
+    bool compactOutput = vm.count("compactOutput");
+    if (compactInput && inputChainLocatorStr.find("://") == std::string::npos) {
+        std::cerr << "compactInput only applies to an input chain, not a capture file\n";
+        return 1;
+    }
 
     if (realTimeMode) {
         if (chainIsSigned) {
-            runSignedTranscription<infra::RealTimeApp_T>(inputChainLocatorStr, outputChainLocatorStr);
+            runSignedTranscription<infra::RealTimeApp_T>(inputChainLocatorStr, outputChainLocatorStr, compactInput, compactOutput);
         } else {
-            runPlainTranscription<infra::RealTimeApp_T>(inputChainLocatorStr, outputChainLocatorStr);
+            runPlainTranscription<infra::RealTimeApp_T>(inputChainLocatorStr, outputChainLocatorStr, compactInput, compactOutput);
         }
     } else {
         if (chainIsSigned) {
-            runSignedTranscription<infra::SinglePassIterationApp_T>(inputChainLocatorStr, outputChainLocatorStr);
+            runSignedTranscription<infra::SinglePassIterationApp_T>(inputChainLocatorStr, outputChainLocatorStr, compactInput, compactOutput);
         } else {
-            runPlainTranscription<infra::SinglePassIterationApp_T>(inputChainLocatorStr, outputChainLocatorStr);
+            runPlainTranscription<infra::SinglePassIterationApp_T>(inputChainLocatorStr, outputChainLocatorStr, compactInput, compactOutput);
         }
     }
     return 0;
@@ -2,6 +2,7 @@
 #define MAIN_PROGRAM_CHAIN_DATA_READER_HPP_
 
 #include "simple_demo_chain_version/chain_data/ChainData.hpp"
+#include "simple_demo_chain_version/chain_data/CompactChainData.hpp"
 
 #include <tm_kit/infra/ChronoUtils.hpp>
 #include <tm_kit/basic/simple_shared_chain/ChainReader.hpp>
@@ -17,6 +18,16 @@ namespace simple_demo_chain_version { namespace main_program_logic {
             }
         }
     };
+    class TrivialCompactChainDataFolder : public basic::simple_shared_chain::TrivialChainDataFetchingFolder<CompactChainData> {
+    public:
+        static std::chrono::system_clock::time_point extractTime(std::optional<CompactChainData> const &st) {
+            if (st) {
+                return infra::withtime_utils::epochDurationToTime<std::chrono::milliseconds>((*st).data.timestamp);
+            } else {
+                return infra::withtime_utils::epochDurationToTime<std::chrono::milliseconds>(0);
+            }
+        }
+    };
 } }
 
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "simple_demo_chain_version/chain_data/ChainData.hpp"
 #include "simple_demo_chain_version/main_program_logic/MainProgramStateFolder.hpp"
+#include "simple_demo_chain_version/chain_data/ChainMetrics.hpp"
 
 #include <tm_kit/infra/RealTimeApp.hpp>
 
@@ -15,7 +16,9 @@ namespace simple_demo_chain_version { namespace main_program_logic {
     template <class Env>
     class MainProgramFacilityInputHandler {
     private:
-        int64_t lastSaveTime_ = 0;
+        shared_chain_utils::checkpoints::Checkpointer<MainProgramState> checkpointer_ {
+            shared_chain_utils::checkpoints::CheckpointConfig {"main_program_state", 1000, 10000, 8}
+        };
         Env *env_ = nullptr;
     public:
         using InputType = double;
@@ -33,6 +36,8 @@ namespace simple_demo_chain_version { namespace main_program_logic {
             ResponseType
             , std::optional<std::tuple<std::string, ChainData>>
         > handleInput(Env *env, void *chain, RealInput const &input, MainProgramState const &state) {
+            static auto &metrics = chain_metrics::metricsFor("main_program");
+            metrics.recordAppendAttempt(Env::id_to_string(input.value.id()));
             if (state.outstandingIDs.size() < 2) {
                 int64_t now = infra::withtime_utils::sinceEpoch<std::chrono::milliseconds>(env->now());
                 PlaceRequest r {
@@ -58,18 +63,10 @@ namespace simple_demo_chain_version { namespace main_program_logic {
 
         template <class Chain>
         void idleCallback(Chain *chain, MainProgramState const &state) {
-            if constexpr (Chain::SupportsExtraData) {
-                int64_t now = infra::withtime_utils::sinceEpoch<std::chrono::milliseconds>(env_->now());
-                if (now > lastSaveTime_+10000) {
-                    //save state at most every 10 seconds
-                    std::thread([chain,state]() {
-                        chain->template saveExtraData<MainProgramState>(
-                            "main_program_state", state
-                        );
-                    }).detach();
-                    lastSaveTime_ = now;
-                }
-            }
+            static auto &metrics = chain_metrics::metricsFor("main_program");
+            chain_metrics::IdleTimer timer(metrics);
+            //snapshot state every 1000 items or 10 seconds
+            checkpointer_.maybeSave(chain, state, state.latestID, state.foldedCount, state.updateTimestamp);
         }
     };
 } }
@@ -2,6 +2,7 @@
 #define MAIN_PROGRAM_ID_AND_FINAL_FLAG_EXTRACTOR_HPP_
 
 #include "simple_demo_chain_version/chain_data/ChainData.hpp"
+#include "simple_demo_chain_version/chain_data/ChainMetrics.hpp"
 #include <mutex>
 #include <unordered_map>
 
@@ -17,6 +18,9 @@ namespace simple_demo_chain_version { namespace main_program_logic {
         MainProgramIDAndFinalFlagExtractor(MainProgramIDAndFinalFlagExtractor &&e) : mutex_(), idMap_(std::move(e.idMap_)) {}
         auto extract(ChainData const &data) 
         -> std::vector<std::tuple<typename Env::IDType, bool>> {
+            //this sees every item that the reader side of the facility passes on
+            static auto &metrics = chain_metrics::metricsFor("main_program");
+            metrics.recordReaderItem(data.timestamp);
             return std::visit([this](auto const &u) -> std::vector<std::tuple<typename Env::IDType, bool>> {
                 using T = std::decay_t<decltype(u)>;
                 if constexpr (std::is_same_v<T, simple_demo_chain_version::PlaceRequest>) {
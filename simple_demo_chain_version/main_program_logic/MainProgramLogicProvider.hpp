@@ -7,6 +7,7 @@
 #include "simple_demo_chain_version/main_program_logic/ProgressReporter.hpp"
 #include "simple_demo_chain_version/main_program_logic/MainProgramChainDataReader.hpp"
 #include "simple_demo_chain_version/main_program_logic/MainProgramIDAndFinalFlagExtractor.hpp"
+#include "simple_demo_chain_version/chain_data/CompactChainAdapters.hpp"
 #include "defs.pb.h"
 
 #include <tm_kit/basic/simple_shared_chain/ChainWriter.hpp>
@@ -18,10 +19,15 @@
 #include <iostream>
 #include <sstream>
 #include <cmath>
+#include <type_traits>
 
 namespace simple_demo_chain_version { namespace main_program_logic {
 
-    template <class R, template <class M> class ChainCreator>
+    //ChainItem is either ChainData or CompactChainData; in the latter case
+    //the folder, input handler and extractor go through the wrappers in
+    //chain_data/CompactChainAdapters.hpp, and the facility output is
+    //unwrapped, so that callers see std::optional<ChainData> either way
+    template <class R, template <class M> class ChainCreator, class ChainItem = ChainData>
     std::tuple<
         typename R::template FacilitioidConnector<double, std::optional<ChainData>>
         , std::string
@@ -32,34 +38,84 @@ namespace simple_demo_chain_version { namespace main_program_logic {
         , std::string const &chainLocatorStr
         , std::string const &graphPrefix
     ) {
+        using M = typename R::AppType;
+        using Env = typename R::EnvironmentType;
+        constexpr bool isCompact = std::is_same_v<ChainItem, CompactChainData>;
+        using Folder = std::conditional_t<
+            isCompact
+            , compact_chain_adapters::CompactChainFolder<MainProgramStateFolder>
+            , MainProgramStateFolder
+        >;
+        using InputHandler = std::conditional_t<
+            isCompact
+            , compact_chain_adapters::CompactChainInputHandler<MainProgramFacilityInputHandler<Env>>
+            , MainProgramFacilityInputHandler<Env>
+        >;
+        using Extractor = std::conditional_t<
+            isCompact
+            , compact_chain_adapters::CompactChainIDAndFinalFlagExtractor<MainProgramIDAndFinalFlagExtractor<Env>>
+            , MainProgramIDAndFinalFlagExtractor<Env>
+        >;
+        using ReaderFolder = std::conditional_t<
+            isCompact
+            , TrivialCompactChainDataFolder
+            , TrivialChainDataFolder
+        >;
+
         auto res = basic::simple_shared_chain::createChainBackedFacility<
             R 
-            , ChainData
-            , MainProgramStateFolder
-            , MainProgramFacilityInputHandler<typename R::EnvironmentType>
-            , MainProgramIDAndFinalFlagExtractor<typename R::EnvironmentType>
+            , ChainItem
+            , Folder
+            , InputHandler
+            , Extractor
         >(
             r 
             , chainCreator.template writerFactory<
-                ChainData
-                , MainProgramStateFolder
-                , MainProgramFacilityInputHandler<typename R::EnvironmentType>
+                ChainItem
+                , Folder
+                , InputHandler
             >(
                 r.environment()
                 , chainLocatorStr
             )
             , chainCreator.template readerFactory<
-                ChainData
-                , TrivialChainDataFolder
+                ChainItem
+                , ReaderFolder
             >(
                 r.environment()
                 , chainLocatorStr
+                //if the reader_lag_ms in the "chain_metrics/main_program" heartbeat
+                //status stays high, shorten the reader polling wait
                 /*, basic::simple_shared_chain::ChainPollingPolicy().ReaderPollingWaitDuration(std::chrono::milliseconds(10))*/
             )
-            , std::make_shared<MainProgramIDAndFinalFlagExtractor<typename R::EnvironmentType>>()
+            , std::make_shared<Extractor>()
             , graphPrefix+"/facility_combo"
         );
-        return {res.facility, res.registeredNameForFacilitioidConnector};
+        if constexpr (isCompact) {
+            auto unwrap = M::template liftPure<typename M::template KeyedData<double, std::optional<CompactChainData>>>(
+                [](typename M::template KeyedData<double, std::optional<CompactChainData>> &&x) -> typename M::template KeyedData<double, std::optional<ChainData>> {
+                    std::optional<ChainData> d = std::nullopt;
+                    if (x.data) {
+                        d = std::move(x.data->data);
+                    }
+                    return {std::move(x.key), std::move(d)};
+                }
+            );
+            r.registerAction(graphPrefix+"/unwrapCompactChainData", unwrap);
+            typename R::template FacilitioidConnector<double, std::optional<ChainData>> facility = [inner=res.facility,unwrap](
+                R &r
+                , typename R::template Source<typename M::template Key<double>> &&source
+                , std::optional<typename R::template Sink<typename M::template KeyedData<double, std::optional<ChainData>>>> const &sink
+            ) {
+                inner(r, std::move(source), r.actionAsSink(unwrap));
+                if (sink) {
+                    r.connect(r.actionAsSource(unwrap), *sink);
+                }
+            };
+            return {facility, res.registeredNameForFacilitioidConnector};
+        } else {
+            return {res.facility, res.registeredNameForFacilitioidConnector};
+        }
     }
 
     template <class R>
@@ -1,9 +1,13 @@
 #include "MainProgramStateFolder.hpp"
+#include "simple_demo_chain_version/chain_data/ChainMetrics.hpp"
 
 namespace simple_demo_chain_version { namespace main_program_logic {
     void MainProgramStateFolder::foldInPlace(MainProgramStateFolder::ResultType &state, std::string_view const &id, ChainData const &item) {
+        static auto &metrics = chain_metrics::metricsFor("main_program");
+        chain_metrics::FoldTimer timer(metrics);
         state.latestID = id;
         state.updateTimestamp = item.timestamp;
+        ++state.foldedCount;
         std::visit([&state](auto const &content) {
             using T = std::decay_t<decltype(content)>;
             if constexpr (std::is_same_v<T, simple_demo_chain_version::PlaceRequest>) {
@@ -15,5 +19,6 @@ namespace simple_demo_chain_version { namespace main_program_logic {
                 state.outstandingIDs.erase(content.id);
             }
         }, item.update);
+        metrics.recordHeadItem(state.foldedCount, item.timestamp);
     }
 } }
\ No newline at end of file
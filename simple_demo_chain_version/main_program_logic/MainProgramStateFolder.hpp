@@ -2,6 +2,7 @@
 #define MAIN_PROGRAM_STATE_FOLDER_HPP_
 
 #include "simple_demo_chain_version/chain_data/ChainData.hpp"
+#include "shared_chain_utils/StateCheckpoints.hpp"
 
 #include <tm_kit/infra/ChronoUtils.hpp>
 #include <unordered_set>
@@ -14,7 +15,8 @@ namespace simple_demo_chain_version { namespace main_program_logic {
         ((int, max_id_sofar)) \
         ((std::unordered_set<int>, outstandingIDs)) \
         ((std::string, latestID)) \
-        ((int64_t, updateTimestamp))
+        ((int64_t, updateTimestamp)) \
+        ((int64_t, foldedCount))
 
     TM_BASIC_CBOR_CAPABLE_STRUCT(MainProgramState, MainProgramStateFields);
 
@@ -24,7 +26,14 @@ namespace simple_demo_chain_version { namespace main_program_logic {
         template <class Chain>
         static ResultType initialize(void *env, Chain *chain) {
             if constexpr (Chain::SupportsExtraData) {
-                auto val = chain->template loadExtraData<ResultType>(
+                auto val = shared_chain_utils::checkpoints::loadLatestCheckpoint<ResultType>(
+                    chain, "main_program_state"
+                );
+                if (val) {
+                    return *val;
+                }
+                //snapshot written before checkpoints were versioned
+                val = chain->template loadExtraData<ResultType>(
                     "main_program_state"
                 );
                 if (val) {
@@ -33,12 +42,14 @@ namespace simple_demo_chain_version { namespace main_program_logic {
                     ResultType res;
                     res.max_id_sofar = 0;
                     res.updateTimestamp = 0;
+                    res.foldedCount = 0;
                     return res;
                 }
             } else {
                 ResultType res;
                 res.max_id_sofar = 0;
                 res.updateTimestamp = 0;
+                res.foldedCount = 0;
                 return res;
             }
         }
@@ -0,0 +1,254 @@
+#ifndef BATCH_FRAME_HPP_
+#define BATCH_FRAME_HPP_
+
+#include <boost/endian/conversion.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#ifdef TM_TRANSPORT_UTILS_HAS_LZ4
+#include <lz4.h>
+#endif
+#ifdef TM_TRANSPORT_UTILS_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+//A batch frame carries many (time, topic, content) messages as the content of
+//one published message, optionally compressed. Layout (little-endian):
+//  magic "TMB1" | codec (1 byte) | message count (uint32) | raw body size (uint32) | body
+//where the raw body is, for each message:
+//  time (int64, micros since epoch) | topic length (uint32) | topic | content length (uint32) | content
+//and the body on the wire is the raw body compressed with the codec.
+//LZ4 and zstd are only available if the build found the libraries.
+namespace batch_frame {
+
+    enum class Codec : uint8_t {
+        None = 0
+        , LZ4 = 1
+        , Zstd = 2
+    };
+
+    inline constexpr char Magic[] = "TMB1";
+    inline constexpr std::size_t HeaderSize = 4+1+4+4;
+    //the raw body size in a frame comes from the sender, so it is checked
+    //against these before anything is allocated for it
+    inline constexpr uint32_t DefaultMaxRawSize = 64*1024*1024;
+    inline constexpr std::size_t MaxCompressionRatio = 256;
+    inline constexpr std::size_t MinMessageSize = 8+4+4;
+
+    inline bool codecAvailable(Codec c) {
+        switch (c) {
+        case Codec::None:
+            return true;
+        case Codec::LZ4:
+#ifdef TM_TRANSPORT_UTILS_HAS_LZ4
+            return true;
+#else
+            return false;
+#endif
+        case Codec::Zstd:
+#ifdef TM_TRANSPORT_UTILS_HAS_ZSTD
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return false;
+        }
+    }
+    inline std::optional<Codec> parseCodec(std::string const &s) {
+        if (s == "" || s == "none") {
+            return Codec::None;
+        } else if (s == "lz4") {
+            return Codec::LZ4;
+        } else if (s == "zstd") {
+            return Codec::Zstd;
+        }
+        return std::nullopt;
+    }
+
+    namespace detail {
+        template <class T>
+        inline void put(std::string &buf, T x) {
+            x = boost::endian::native_to_little(x);
+            buf.append(reinterpret_cast<char const *>(&x), sizeof(T));
+        }
+        template <class T>
+        inline T get(char const *p) {
+            T x;
+            std::memcpy(&x, p, sizeof(T));
+            return boost::endian::little_to_native(x);
+        }
+    }
+
+    class Builder {
+    private:
+        std::string raw_;
+        uint32_t count_;
+    public:
+        Builder() : raw_(), count_(0) {}
+        void add(int64_t micros, std::string_view topic, std::string_view content) {
+            detail::put<int64_t>(raw_, micros);
+            detail::put<uint32_t>(raw_, (uint32_t) topic.length());
+            raw_.append(topic);
+            detail::put<uint32_t>(raw_, (uint32_t) content.length());
+            raw_.append(content);
+            ++count_;
+        }
+        std::size_t rawSize() const {
+            return raw_.length();
+        }
+        uint32_t count() const {
+            return count_;
+        }
+        bool empty() const {
+            return (count_ == 0);
+        }
+        //returns the encoded frame and clears the builder; falls back to
+        //no compression if the codec is unavailable or does not help
+        std::string finish(Codec codec) {
+            std::string out;
+            out.append(Magic, 4);
+            std::string body;
+            switch (codec) {
+#ifdef TM_TRANSPORT_UTILS_HAS_LZ4
+            case Codec::LZ4:
+                {
+                    body.resize((std::size_t) LZ4_compressBound((int) raw_.length()));
+                    auto n = LZ4_compress_default(raw_.data(), body.data(), (int) raw_.length(), (int) body.length());
+                    if (n > 0) {
+                        body.resize((std::size_t) n);
+                    } else {
+                        codec = Codec::None;
+                    }
+                }
+                break;
+#endif
+#ifdef TM_TRANSPORT_UTILS_HAS_ZSTD
+            case Codec::Zstd:
+                {
+                    body.resize(ZSTD_compressBound(raw_.length()));
+                    auto n = ZSTD_compress(body.data(), body.length(), raw_.data(), raw_.length(), 1);
+                    if (!ZSTD_isError(n)) {
+                        body.resize(n);
+                    } else {
+                        codec = Codec::None;
+                    }
+                }
+                break;
+#endif
+            default:
+                codec = Codec::None;
+                break;
+            }
+            //decode rejects frames that claim to expand by more than
+            //MaxCompressionRatio, so such bodies are sent uncompressed
+            if (codec != Codec::None
+                && (body.length() >= raw_.length() || body.length()*MaxCompressionRatio < raw_.length())) {
+                codec = Codec::None;
+            }
+            out.push_back((char) codec);
+            detail::put<uint32_t>(out, count_);
+            detail::put<uint32_t>(out, (uint32_t) raw_.length());
+            if (codec == Codec::None) {
+                out.append(raw_);
+            } else {
+                out.append(body);
+            }
+            raw_.clear();
+            count_ = 0;
+            return out;
+        }
+    };
+
+    inline bool isFrame(std::string_view frame) {
+        return (frame.length() >= HeaderSize && std::memcmp(frame.data(), Magic, 4) == 0);
+    }
+
+    //Calls f(int64_t micros, std::string_view topic, std::string_view content)
+    //for every message in the frame, returns false if the frame is malformed,
+    //claims a raw body larger than maxRawSize (or than the compressed body
+    //could expand to), or uses a codec that this build does not have.
+    template <class F>
+    inline bool decode(std::string_view frame, F &&f, uint32_t maxRawSize = DefaultMaxRawSize) {
+        if (!isFrame(frame)) {
+            return false;
+        }
+        auto codec = (Codec) frame[4];
+        auto count = detail::get<uint32_t>(frame.data()+5);
+        auto rawSize = detail::get<uint32_t>(frame.data()+9);
+        std::string_view body = frame.substr(HeaderSize);
+        if (rawSize > maxRawSize
+            || (std::size_t) rawSize > body.length()*MaxCompressionRatio
+            || (std::size_t) count*MinMessageSize > rawSize) {
+            return false;
+        }
+        std::string decompressed;
+        switch (codec) {
+        case Codec::None:
+            break;
+#ifdef TM_TRANSPORT_UTILS_HAS_LZ4
+        case Codec::LZ4:
+            {
+                if (rawSize > (uint32_t) LZ4_MAX_INPUT_SIZE || body.length() > (std::size_t) LZ4_MAX_INPUT_SIZE) {
+                    return false;
+                }
+                decompressed.resize(rawSize);
+                auto n = LZ4_decompress_safe(body.data(), decompressed.data(), (int) body.length(), (int) rawSize);
+                if (n < 0 || (uint32_t) n != rawSize) {
+                    return false;
+                }
+                body = decompressed;
+            }
+            break;
+#endif
+#ifdef TM_TRANSPORT_UTILS_HAS_ZSTD
+        case Codec::Zstd:
+            {
+                decompressed.resize(rawSize);
+                auto n = ZSTD_decompress(decompressed.data(), rawSize, body.data(), body.length());
+                if (ZSTD_isError(n) || n != rawSize) {
+                    return false;
+                }
+                body = decompressed;
+            }
+            break;
+#endif
+        default:
+            return false;
+        }
+        if (body.length() != rawSize) {
+            return false;
+        }
+        char const *p = body.data();
+        char const *end = p+body.length();
+        for (uint32_t ii=0; ii<count; ++ii) {
+            if (end-p < 12) {
+                return false;
+            }
+            auto micros = detail::get<int64_t>(p);
+            auto topicLen = detail::get<uint32_t>(p+8);
+            p += 12;
+            if ((std::size_t) (end-p) < (std::size_t) topicLen+4) {
+                return false;
+            }
+            std::string_view topic {p, topicLen};
+            p += topicLen;
+            auto contentLen = detail::get<uint32_t>(p);
+            p += 4;
+            if ((std::size_t) (end-p) < contentLen) {
+                return false;
+            }
+            std::string_view content {p, contentLen};
+            p += contentLen;
+            f(micros, topic, content);
+        }
+        return true;
+    }
+
+}
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef BULK_TRANSCRIBE_PIPELINE_HPP_
+#define BULK_TRANSCRIBE_PIPELINE_HPP_
+
+#include "IndexedCaptureFile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Staged pipeline used by the bulk mode of tm_byte_data_chain_transcriber:
+//
+//  read stage (one thread)  ->  convert stage (worker pool)  ->  write stage (one thread)
+//
+//The read stage cuts the input into numbered batches. Converters take
+//batches in any order and, when the output is a capture file, turn each
+//batch into one contiguous buffer of records. The write stage only ever
+//gets batches back in their original order, so the output order is the
+//input order. The number of batches between the read and the write stage
+//is bounded, so a slow writer stalls the reader instead of buffering the
+//whole input in memory.
+namespace bulk_transcribe {
+
+    inline constexpr char ChainDataTopic[] = "chain.data";
+
+    struct Batch {
+        uint64_t seq = 0;
+        //index of the first item of this batch in the whole input
+        uint64_t firstItem = 0;
+        std::size_t itemCount = 0;
+        std::vector<std::string> items;
+        //filled in by the converters when encoding for a capture file
+        std::string encoded;
+    };
+
+    //Same record layout as ByteDataWithTopicRecordFileFormat<std::chrono::microseconds>.
+    //The time of item n is n+1 microseconds after the epoch, which is what
+    //the single-pass transcriber produces from its fake clock.
+    inline void encodeAsRecords(Batch &b) {
+        std::size_t total = 0;
+        for (auto const &item : b.items) {
+            total += indexed_capture_file::RecordOverhead+sizeof(ChainDataTopic)-1+item.length();
+        }
+        b.encoded.clear();
+        b.encoded.reserve(total);
+        for (std::size_t ii=0; ii<b.items.size(); ++ii) {
+            b.encoded.append(reinterpret_cast<char const *>(indexed_capture_file::RecordMagic.data()), indexed_capture_file::RecordMagic.size());
+            indexed_capture_file::detail::put<int64_t>(b.encoded, (int64_t) (b.firstItem+ii+1));
+            indexed_capture_file::detail::put<uint32_t>(b.encoded, (uint32_t) (sizeof(ChainDataTopic)-1));
+            b.encoded.append(ChainDataTopic, sizeof(ChainDataTopic)-1);
+            indexed_capture_file::detail::put<uint32_t>(b.encoded, (uint32_t) b.items[ii].length());
+            b.encoded.append(b.items[ii]);
+            b.encoded.push_back((char) 0);
+        }
+        b.items.clear();
+        b.items.shrink_to_fit();
+    }
+
+    class Pipeline {
+    private:
+        std::size_t batchSize_;
+        std::size_t maxBatchesInFlight_;
+        bool encodeForFile_;
+
+        //only touched by the read stage
+        Batch current_;
+        uint64_t nextSeq_;
+        uint64_t itemsRead_;
+
+        std::mutex mutex_;
+        std::condition_variable toConvertCond_;
+        std::condition_variable convertedCond_;
+        std::condition_variable spaceCond_;
+        std::condition_variable writtenCond_;
+        std::deque<Batch> toConvert_;
+        std::map<uint64_t, Batch> converted_;
+        std::size_t inFlight_;
+        uint64_t nextToWrite_;
+        uint64_t totalBatches_;
+        uint64_t totalItems_;
+        bool inputDone_;
+        bool stopping_;
+        uint64_t itemsWritten_;
+        std::vector<std::thread> converters_;
+
+        std::chrono::steady_clock::time_point start_;
+        std::chrono::steady_clock::time_point lastReport_;
+        uint64_t lastReportItems_;
+        std::chrono::seconds reportInterval_;
+
+        void convertLoop() {
+            while (true) {
+                Batch b;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    toConvertCond_.wait(lock, [this]() {
+                        return stopping_ || !toConvert_.empty();
+                    });
+                    if (toConvert_.empty()) {
+                        return;
+                    }
+                    b = std::move(toConvert_.front());
+                    toConvert_.pop_front();
+                }
+                if (encodeForFile_) {
+                    encodeAsRecords(b);
+                }
+                {
+                    std::lock_guard<std::mutex> _(mutex_);
+                    auto seq = b.seq;
+                    converted_.emplace(seq, std::move(b));
+                }
+                convertedCond_.notify_all();
+            }
+        }
+        void pushBatch() {
+            current_.seq = nextSeq_++;
+            current_.itemCount = current_.items.size();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                spaceCond_.wait(lock, [this]() {
+                    return inFlight_ < maxBatchesInFlight_;
+                });
+                ++inFlight_;
+                toConvert_.push_back(std::move(current_));
+            }
+            toConvertCond_.notify_one();
+            current_ = Batch {};
+            current_.firstItem = itemsRead_;
+            current_.items.reserve(batchSize_);
+        }
+    public:
+        Pipeline(std::size_t batchSize, std::size_t converterCount, std::size_t maxBatchesInFlight, bool encodeForFile)
+            : batchSize_(std::max<std::size_t>(batchSize, 1))
+            , maxBatchesInFlight_(std::max<std::size_t>(maxBatchesInFlight, 1))
+            , encodeForFile_(encodeForFile)
+            , current_(), nextSeq_(0), itemsRead_(0)
+            , mutex_(), toConvertCond_(), convertedCond_(), spaceCond_(), writtenCond_()
+            , toConvert_(), converted_(), inFlight_(0), nextToWrite_(0)
+            , totalBatches_(0), totalItems_(0), inputDone_(false), stopping_(false)
+            , itemsWritten_(0), converters_()
+            , start_(std::chrono::steady_clock::now()), lastReport_(start_), lastReportItems_(0)
+            , reportInterval_(std::chrono::seconds(5))
+        {
+            current_.items.reserve(batchSize_);
+            for (std::size_t ii=0; ii<std::max<std::size_t>(converterCount, 1); ++ii) {
+                converters_.emplace_back(&Pipeline::convertLoop, this);
+            }
+        }
+        ~Pipeline() {
+            {
+                std::lock_guard<std::mutex> _(mutex_);
+                stopping_ = true;
+            }
+            toConvertCond_.notify_all();
+            for (auto &t : converters_) {
+                t.join();
+            }
+        }
+        Pipeline(Pipeline const &) = delete;
+        Pipeline &operator=(Pipeline const &) = delete;
+
+        //read stage: called from one thread only
+        void add(std::string &&item) {
+            if (itemsRead_ == 0) {
+                std::lock_guard<std::mutex> _(mutex_);
+                start_ = std::chrono::steady_clock::now();
+                lastReport_ = start_;
+            }
+            current_.items.push_back(std::move(item));
+            ++itemsRead_;
+            if (current_.items.size() >= batchSize_) {
+                pushBatch();
+            }
+        }
+        void finishInput() {
+            if (!current_.items.empty()) {
+                pushBatch();
+            }
+            {
+                std::lock_guard<std::mutex> _(mutex_);
+                totalBatches_ = nextSeq_;
+                totalItems_ = itemsRead_;
+                inputDone_ = true;
+            }
+            convertedCond_.notify_all();
+            writtenCond_.notify_all();
+        }
+
+        //write stage: gets the next batch in input order, returns false when
+        //there is none (yet, if wait is false; ever, if wait is true)
+        bool nextInOrder(Batch &out, bool wait) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto ready = [this]() {
+                return (!converted_.empty() && converted_.begin()->first == nextToWrite_)
+                    || (inputDone_ && nextToWrite_ >= totalBatches_);
+            };
+            if (wait) {
+                convertedCond_.wait(lock, ready);
+            } else if (!ready()) {
+                return false;
+            }
+            if (converted_.empty() || converted_.begin()->first != nextToWrite_) {
+                return false;
+            }
+            out = std::move(converted_.begin()->second);
+            converted_.erase(converted_.begin());
+            ++nextToWrite_;
+            --inFlight_;
+            lock.unlock();
+            spaceCond_.notify_one();
+            return true;
+        }
+        //write stage: items that have actually reached the output
+        void markWritten(std::size_t count) {
+            std::optional<double> rate = std::nullopt;
+            uint64_t written;
+            {
+                std::lock_guard<std::mutex> _(mutex_);
+                itemsWritten_ += count;
+                written = itemsWritten_;
+                auto now = std::chrono::steady_clock::now();
+                if (now >= lastReport_+reportInterval_) {
+                    rate = (written-lastReportItems_)/std::chrono::duration<double>(now-lastReport_).count();
+                    lastReport_ = now;
+                    lastReportItems_ = written;
+                }
+            }
+            writtenCond_.notify_all();
+            if (rate) {
+                std::cerr << "transcribed " << written << " items (" << *rate << " items/s)\n";
+            }
+        }
+        //blocks until every item of the input has been marked written
+        void waitUntilAllWritten() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            writtenCond_.wait(lock, [this]() {
+                return inputDone_ && itemsWritten_ >= totalItems_;
+            });
+        }
+        void printSummary(std::ostream &os) {
+            std::lock_guard<std::mutex> _(mutex_);
+            auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now()-start_).count();
+            os << "transcribed " << itemsWritten_ << " items in " << secs << " seconds ("
+                << ((secs > 0)?itemsWritten_/secs:0.0) << " items/s)\n";
+        }
+    };
+
+}
+
+#endif
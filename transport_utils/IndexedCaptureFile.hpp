@@ -0,0 +1,615 @@
+#ifndef INDEXED_CAPTURE_FILE_HPP_
+#define INDEXED_CAPTURE_FILE_HPP_
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/endian/conversion.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+//An indexed capture file is a normal ByteDataWithTopicRecordFileFormat<std::chrono::microseconds>
+//file (same file magic, same record magic, same record layout), with one extra
+//record appended at the end. That record has the reserved topic below, and its
+//content is a time/topic index of the file followed by a fixed-size footer.
+//Since the index is just another record, every existing reader can still read
+//an indexed file; readers that know about the index can mmap the file, locate
+//the footer at the end, and seek directly to a time range or a topic subset.
+//
+//The flip side is that a reader that does not know about the index (the
+//plain ByteDataWithTopicRecordFileImporterExporter, older builds of the
+//republisher, or any other tool that reads capture files) treats the index
+//as one more message: it is replayed last, on topic "__tm_capture_index__",
+//with binary content. Subscribers that use wildcard topics should ignore
+//that topic, or the file should be written without --indexed if it is meant
+//for such readers.
+//
+//Record layout (all integers little-endian):
+//  record magic (4 bytes) | time (int64, micros since epoch) | topic length (uint32)
+//  | topic | content length (uint32) | content | final flag (1 byte)
+//
+//Index content layout:
+//  version (uint32) | block count (uint32) | topic count (uint32)
+//  | blocks: (first time int64, last time int64, offset uint64, first record number uint64, record count uint32)...
+//  | topics: (topic length uint32, topic, message count uint64, block ref count uint32, block ids uint32...)...
+//  | footer: (index record offset uint64, first time int64, last time int64, record count uint64, footer magic 8 bytes)
+namespace indexed_capture_file {
+
+    inline constexpr std::array<std::byte,4> FileMagic {(std::byte) 0x01,(std::byte) 0x23,(std::byte) 0x45,(std::byte) 0x67};
+    inline constexpr std::array<std::byte,4> RecordMagic {(std::byte) 0x76,(std::byte) 0x54,(std::byte) 0x32,(std::byte) 0x10};
+    inline constexpr char IndexTopic[] = "__tm_capture_index__";
+    inline constexpr char FooterMagic[] = "TMCAPIDX";
+    inline constexpr std::size_t FooterSize = 8*5;
+    inline constexpr uint32_t IndexVersion = 1;
+    //fixed part of a record, without topic and content
+    inline constexpr std::size_t RecordOverhead = 4+8+4+4+1;
+
+    inline int64_t toMicros(std::chrono::system_clock::time_point const &tp) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(tp.time_since_epoch()).count();
+    }
+    inline std::chrono::system_clock::time_point fromMicros(int64_t micros) {
+        return std::chrono::system_clock::time_point {
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(micros))
+        };
+    }
+
+    namespace detail {
+        template <class T>
+        inline void put(std::string &buf, T x) {
+            x = boost::endian::native_to_little(x);
+            buf.append(reinterpret_cast<char const *>(&x), sizeof(T));
+        }
+        template <class T>
+        inline T get(char const *p) {
+            T x;
+            std::memcpy(&x, p, sizeof(T));
+            return boost::endian::little_to_native(x);
+        }
+    }
+
+    //One record as seen through the memory map, topic and content
+    //point directly into the mapped file.
+    struct RecordView {
+        int64_t micros;
+        std::string_view topic;
+        std::string_view content;
+        bool isFinal;
+    };
+
+    //Appends records in the standard capture layout, and keeps the
+    //block/topic index in memory until close() writes it out.
+    //All methods are thread-safe.
+    class Writer {
+    private:
+        struct Block {
+            int64_t firstTime;
+            int64_t lastTime;
+            uint64_t offset;
+            uint64_t firstRecordNumber;
+            uint32_t recordCount;
+            uint64_t byteCount;
+        };
+        struct TopicInfo {
+            uint64_t messageCount = 0;
+            std::vector<uint32_t> blocks;
+        };
+        std::ofstream ofs_;
+        std::vector<char> streamBuffer_;
+        std::mutex mutex_;
+        uint64_t offset_;
+        uint64_t recordCount_;
+        uint32_t maxRecordsPerBlock_;
+        uint64_t maxBytesPerBlock_;
+        std::vector<Block> blocks_;
+        std::map<std::string, TopicInfo, std::less<>> topics_;
+        std::string recordBuf_;
+        bool writeIndex_;
+        bool closed_;
+
+        void writeRecordUnlocked(int64_t micros, std::string_view topic, std::string_view content, bool isFinal) {
+            recordBuf_.clear();
+            recordBuf_.append(reinterpret_cast<char const *>(RecordMagic.data()), RecordMagic.size());
+            detail::put<int64_t>(recordBuf_, micros);
+            detail::put<uint32_t>(recordBuf_, (uint32_t) topic.length());
+            recordBuf_.append(topic);
+            detail::put<uint32_t>(recordBuf_, (uint32_t) content.length());
+            recordBuf_.append(content);
+            recordBuf_.push_back(isFinal ? (char) 1 : (char) 0);
+            ofs_.write(recordBuf_.data(), recordBuf_.length());
+            offset_ += recordBuf_.length();
+        }
+    public:
+        //with writeIndex=false the output is a plain capture file
+        Writer(std::string const &fileName, uint32_t maxRecordsPerBlock=4096, uint64_t maxBytesPerBlock=4*1024*1024, bool writeIndex=true)
+            : ofs_(), streamBuffer_(1024*1024), mutex_(), offset_(0), recordCount_(0)
+            , maxRecordsPerBlock_(maxRecordsPerBlock), maxBytesPerBlock_(maxBytesPerBlock)
+            , blocks_(), topics_(), recordBuf_(), writeIndex_(writeIndex), closed_(false)
+        {
+            ofs_.rdbuf()->pubsetbuf(streamBuffer_.data(), streamBuffer_.size());
+            ofs_.open(fileName, std::ios::binary);
+            ofs_.write(reinterpret_cast<char const *>(FileMagic.data()), FileMagic.size());
+            offset_ = FileMagic.size();
+        }
+        ~Writer() {
+            close();
+        }
+        Writer(Writer const &) = delete;
+        Writer &operator=(Writer const &) = delete;
+
+        bool good() const {
+            return ofs_.good();
+        }
+        void write(std::chrono::system_clock::time_point const &tp, std::string_view topic, std::string_view content, bool isFinal=false) {
+            auto micros = toMicros(tp);
+            std::lock_guard<std::mutex> _(mutex_);
+            if (closed_) {
+                return;
+            }
+            if (blocks_.empty()
+                || blocks_.back().recordCount >= maxRecordsPerBlock_
+                || blocks_.back().byteCount >= maxBytesPerBlock_) {
+                blocks_.push_back(Block {micros, micros, offset_, recordCount_, 0, 0});
+            }
+            auto &block = blocks_.back();
+            auto blockID = (uint32_t) (blocks_.size()-1);
+            auto startOffset = offset_;
+            writeRecordUnlocked(micros, topic, content, isFinal);
+            //capture time is not guaranteed to be monotonic across threads,
+            //so keep the real range of each block
+            block.firstTime = std::min(block.firstTime, micros);
+            block.lastTime = std::max(block.lastTime, micros);
+            ++block.recordCount;
+            block.byteCount += (offset_-startOffset);
+            ++recordCount_;
+            auto iter = topics_.find(topic);
+            if (iter == topics_.end()) {
+                iter = topics_.emplace(std::string {topic}, TopicInfo {}).first;
+            }
+            ++(iter->second.messageCount);
+            if (iter->second.blocks.empty() || iter->second.blocks.back() != blockID) {
+                iter->second.blocks.push_back(blockID);
+            }
+        }
+        void flush() {
+            std::lock_guard<std::mutex> _(mutex_);
+            if (!closed_) {
+                ofs_.flush();
+            }
+        }
+        //Writes the index record and closes the file. Records written
+        //after this are ignored.
+        void close() {
+            std::lock_guard<std::mutex> _(mutex_);
+            if (closed_) {
+                return;
+            }
+            closed_ = true;
+            if (!writeIndex_) {
+                ofs_.close();
+                return;
+            }
+            int64_t firstTime = 0, lastTime = 0;
+            for (auto const &b : blocks_) {
+                if (&b == &blocks_.front() || b.firstTime < firstTime) {
+                    firstTime = b.firstTime;
+                }
+                if (&b == &blocks_.front() || b.lastTime > lastTime) {
+                    lastTime = b.lastTime;
+                }
+            }
+            std::string index;
+            detail::put<uint32_t>(index, IndexVersion);
+            detail::put<uint32_t>(index, (uint32_t) blocks_.size());
+            detail::put<uint32_t>(index, (uint32_t) topics_.size());
+            for (auto const &b : blocks_) {
+                detail::put<int64_t>(index, b.firstTime);
+                detail::put<int64_t>(index, b.lastTime);
+                detail::put<uint64_t>(index, b.offset);
+                detail::put<uint64_t>(index, b.firstRecordNumber);
+                detail::put<uint32_t>(index, b.recordCount);
+            }
+            for (auto const &t : topics_) {
+                detail::put<uint32_t>(index, (uint32_t) t.first.length());
+                index.append(t.first);
+                detail::put<uint64_t>(index, t.second.messageCount);
+                detail::put<uint32_t>(index, (uint32_t) t.second.blocks.size());
+                for (auto id : t.second.blocks) {
+                    detail::put<uint32_t>(index, id);
+                }
+            }
+            detail::put<uint64_t>(index, offset_);
+            detail::put<int64_t>(index, firstTime);
+            detail::put<int64_t>(index, lastTime);
+            detail::put<uint64_t>(index, recordCount_);
+            index.append(FooterMagic, 8);
+            writeRecordUnlocked(lastTime, IndexTopic, index, true);
+            ofs_.close();
+        }
+    };
+
+    //Memory-maps a capture file. If the file carries an index, time range and
+    //topic queries only touch the blocks that can contain matching records;
+    //otherwise (e.g. a capture that was killed before writing its index, or a
+    //file written by the plain exporter) the file is scanned sequentially.
+    class Reader {
+    public:
+        struct Block {
+            int64_t firstTime;
+            int64_t lastTime;
+            uint64_t offset;
+            uint64_t firstRecordNumber;
+            uint32_t recordCount;
+        };
+        struct TopicInfo {
+            uint64_t messageCount;
+            std::vector<uint32_t> blocks;
+        };
+    private:
+        boost::interprocess::file_mapping mapping_;
+        boost::interprocess::mapped_region region_;
+        char const *data_;
+        std::size_t size_;
+        bool hasIndex_;
+        uint64_t bodyEnd_;
+        int64_t firstTime_;
+        int64_t lastTime_;
+        uint64_t recordCount_;
+        std::vector<Block> blocks_;
+        std::map<std::string, TopicInfo, std::less<>> topics_;
+
+        //returns the offset just after the record, or nullopt if there is no
+        //complete record at this offset
+        std::optional<uint64_t> parseRecord(uint64_t offset, RecordView &out) const {
+            if (offset+RecordOverhead > size_) {
+                return std::nullopt;
+            }
+            char const *p = data_+offset;
+            if (std::memcmp(p, RecordMagic.data(), RecordMagic.size()) != 0) {
+                return std::nullopt;
+            }
+            p += 4;
+            out.micros = detail::get<int64_t>(p);
+            p += 8;
+            auto topicLen = detail::get<uint32_t>(p);
+            p += 4;
+            if ((uint64_t) (p-data_)+topicLen+4+1 > size_) {
+                return std::nullopt;
+            }
+            out.topic = std::string_view {p, topicLen};
+            p += topicLen;
+            auto contentLen = detail::get<uint32_t>(p);
+            p += 4;
+            if ((uint64_t) (p-data_)+contentLen+1 > size_) {
+                return std::nullopt;
+            }
+            out.content = std::string_view {p, contentLen};
+            p += contentLen;
+            out.isFinal = (*p != 0);
+            ++p;
+            return (uint64_t) (p-data_);
+        }
+        bool loadIndex() {
+            //the index record ends with footer + final flag byte
+            if (size_ < FileMagic.size()+RecordOverhead+FooterSize) {
+                return false;
+            }
+            char const *footer = data_+size_-1-FooterSize;
+            if (std::memcmp(footer+FooterSize-8, FooterMagic, 8) != 0) {
+                return false;
+            }
+            auto indexRecordOffset = detail::get<uint64_t>(footer);
+            RecordView indexRecord;
+            auto end = parseRecord(indexRecordOffset, indexRecord);
+            if (!end || *end != size_ || indexRecord.topic != IndexTopic) {
+                return false;
+            }
+            char const *p = indexRecord.content.data();
+            char const *pEnd = p+indexRecord.content.size()-FooterSize;
+            auto need = [&p,pEnd](std::size_t n) {
+                return (std::size_t) (pEnd-p) >= n;
+            };
+            if (!need(12) || detail::get<uint32_t>(p) != IndexVersion) {
+                return false;
+            }
+            auto blockCount = detail::get<uint32_t>(p+4);
+            auto topicCount = detail::get<uint32_t>(p+8);
+            p += 12;
+            std::vector<Block> blocks;
+            blocks.reserve(blockCount);
+            for (uint32_t ii=0; ii<blockCount; ++ii) {
+                if (!need(36)) {
+                    return false;
+                }
+                blocks.push_back(Block {
+                    detail::get<int64_t>(p)
+                    , detail::get<int64_t>(p+8)
+                    , detail::get<uint64_t>(p+16)
+                    , detail::get<uint64_t>(p+24)
+                    , detail::get<uint32_t>(p+32)
+                });
+                p += 36;
+            }
+            std::map<std::string, TopicInfo, std::less<>> topics;
+            for (uint32_t ii=0; ii<topicCount; ++ii) {
+                if (!need(4)) {
+                    return false;
+                }
+                auto len = detail::get<uint32_t>(p);
+                p += 4;
+                if (!need(len+12)) {
+                    return false;
+                }
+                std::string topic {p, len};
+                p += len;
+                TopicInfo info;
+                info.messageCount = detail::get<uint64_t>(p);
+                auto refCount = detail::get<uint32_t>(p+8);
+                p += 12;
+                if (!need((std::size_t) refCount*4)) {
+                    return false;
+                }
+                info.blocks.reserve(refCount);
+                for (uint32_t jj=0; jj<refCount; ++jj) {
+                    info.blocks.push_back(detail::get<uint32_t>(p));
+                    p += 4;
+                }
+                topics.emplace(std::move(topic), std::move(info));
+            }
+            bodyEnd_ = indexRecordOffset;
+            firstTime_ = detail::get<int64_t>(footer+8);
+            lastTime_ = detail::get<int64_t>(footer+16);
+            recordCount_ = detail::get<uint64_t>(footer+24);
+            blocks_ = std::move(blocks);
+            topics_ = std::move(topics);
+            return true;
+        }
+        //calls f on records in [offset, bodyEnd_), stops after maxRecords
+        //records or when f returns false, returns false if f asked to stop
+        template <class F>
+        bool scan(uint64_t offset, uint64_t maxRecords, F &&f) const {
+            RecordView rec;
+            for (uint64_t ii=0; ii<maxRecords && offset<bodyEnd_; ++ii) {
+                auto next = parseRecord(offset, rec);
+                if (!next) {
+                    break;
+                }
+                if (!f(rec)) {
+                    return false;
+                }
+                offset = *next;
+            }
+            return true;
+        }
+    public:
+        //Sequential pull-style iteration over all records (except the index
+        //record), used for merging several files.
+        class Cursor {
+        private:
+            Reader const *reader_;
+            uint64_t offset_;
+        public:
+            explicit Cursor(Reader const &reader) : reader_(&reader), offset_(FileMagic.size()) {}
+            bool next(RecordView &out) {
+                while (offset_ < reader_->bodyEnd_) {
+                    auto n = reader_->parseRecord(offset_, out);
+                    if (!n) {
+                        offset_ = reader_->bodyEnd_;
+                        return false;
+                    }
+                    offset_ = *n;
+                    if (!reader_->hasIndex_ && out.topic == IndexTopic) {
+                        continue;
+                    }
+                    return true;
+                }
+                return false;
+            }
+        };
+
+        explicit Reader(std::string const &fileName)
+            : mapping_(fileName.c_str(), boost::interprocess::read_only)
+            , region_(mapping_, boost::interprocess::read_only)
+            , data_(static_cast<char const *>(region_.get_address()))
+            , size_(region_.get_size())
+            , hasIndex_(false), bodyEnd_(0), firstTime_(0), lastTime_(0), recordCount_(0)
+            , blocks_(), topics_()
+        {
+            if (size_ < FileMagic.size() || std::memcmp(data_, FileMagic.data(), FileMagic.size()) != 0) {
+                throw std::runtime_error("'"+fileName+"' is not a capture file");
+            }
+            region_.advise(boost::interprocess::mapped_region::advice_sequential);
+            bodyEnd_ = size_;
+            hasIndex_ = loadIndex();
+        }
+        Reader(Reader const &) = delete;
+        Reader &operator=(Reader const &) = delete;
+
+        bool hasIndex() const {
+            return hasIndex_;
+        }
+        //Raw access for tools that split a scan across threads: records
+        //live in [bodyBegin(), bodyEnd()), the index record (if any) starts
+        //at bodyEnd().
+        uint64_t bodyBegin() const {
+            return FileMagic.size();
+        }
+        uint64_t bodyEnd() const {
+            return bodyEnd_;
+        }
+        //returns the offset just after the record at offset, or nullopt
+        //if there is no complete record there
+        std::optional<uint64_t> recordAt(uint64_t offset, RecordView &out) const {
+            if (offset >= bodyEnd_) {
+                return std::nullopt;
+            }
+            return parseRecord(offset, out);
+        }
+        //First offset in [from, bodyEnd()) that looks like a record start,
+        //i.e. the record and up to confirm following ones parse (or reach
+        //bodyEnd() exactly). Record magic can also occur inside content, so
+        //this is a guess that callers need to verify against a sequential
+        //scan. Returns bodyEnd() if there is none.
+        uint64_t syncPoint(uint64_t from, int confirm=4) const {
+            RecordView rec;
+            for (uint64_t offset=std::max<uint64_t>(from, FileMagic.size()); offset<bodyEnd_; ++offset) {
+                auto p = static_cast<char const *>(std::memchr(data_+offset, std::to_integer<int>(RecordMagic[0]), bodyEnd_-offset));
+                if (!p) {
+                    break;
+                }
+                offset = (uint64_t) (p-data_);
+                auto next = parseRecord(offset, rec);
+                int ii = 0;
+                while (next && *next < bodyEnd_ && ii < confirm) {
+                    next = parseRecord(*next, rec);
+                    ++ii;
+                }
+                if (next && (*next <= bodyEnd_)) {
+                    return offset;
+                }
+            }
+            return bodyEnd_;
+        }
+        std::size_t fileSize() const {
+            return size_;
+        }
+        uint64_t recordCount() const {
+            return recordCount_;
+        }
+        std::vector<Block> const &blocks() const {
+            return blocks_;
+        }
+        std::map<std::string, TopicInfo, std::less<>> const &topics() const {
+            return topics_;
+        }
+        //Without an index this reads the first record.
+        std::optional<std::chrono::system_clock::time_point> firstTimePoint() const {
+            if (hasIndex_) {
+                if (recordCount_ == 0) {
+                    return std::nullopt;
+                }
+                return fromMicros(firstTime_);
+            }
+            RecordView rec;
+            if (parseRecord(FileMagic.size(), rec)) {
+                return fromMicros(rec.micros);
+            }
+            return std::nullopt;
+        }
+        std::optional<std::chrono::system_clock::time_point> lastTimePoint() const {
+            if (hasIndex_ && recordCount_ > 0) {
+                return fromMicros(lastTime_);
+            }
+            return std::nullopt;
+        }
+        //Calls f(RecordView const &) -> bool in file order for every record
+        //with start <= time < end and (if given) topic in topics. Stops early
+        //when f returns false. The index record itself is never passed to f.
+        template <class F>
+        void forEach(
+            std::optional<std::chrono::system_clock::time_point> const &start
+            , std::optional<std::chrono::system_clock::time_point> const &end
+            , std::optional<std::unordered_set<std::string>> const &topics
+            , F &&f
+        ) const {
+            int64_t startMicros = (start ? toMicros(*start) : std::numeric_limits<int64_t>::min());
+            int64_t endMicros = (end ? toMicros(*end) : std::numeric_limits<int64_t>::max());
+            auto filtered = [&](RecordView const &rec) -> bool {
+                if (rec.micros < startMicros || rec.micros >= endMicros) {
+                    return true;
+                }
+                if (topics && topics->find(std::string {rec.topic}) == topics->end()) {
+                    return true;
+                }
+                if (!hasIndex_ && rec.topic == IndexTopic) {
+                    return true;
+                }
+                return f(rec);
+            };
+            if (!hasIndex_) {
+                scan(FileMagic.size(), std::numeric_limits<uint64_t>::max(), filtered);
+                return;
+            }
+            std::vector<bool> wanted(blocks_.size(), !topics.has_value());
+            if (topics) {
+                for (auto const &t : *topics) {
+                    auto iter = topics_.find(t);
+                    if (iter == topics_.end()) {
+                        continue;
+                    }
+                    for (auto id : iter->second.blocks) {
+                        if (id < wanted.size()) {
+                            wanted[id] = true;
+                        }
+                    }
+                }
+            }
+            for (std::size_t ii=0; ii<blocks_.size(); ++ii) {
+                auto const &b = blocks_[ii];
+                if (!wanted[ii] || b.lastTime < startMicros || b.firstTime >= endMicros) {
+                    continue;
+                }
+                if (!scan(b.offset, b.recordCount, filtered)) {
+                    return;
+                }
+            }
+        }
+    };
+
+    //Calls f(std::size_t readerIndex, RecordView const &) -> bool for the
+    //records of all readers in global timestamp order (a k-way merge with a
+    //heap over one cursor per reader; ties go to the lower reader index, and
+    //each reader's own order is kept). Stops early when f returns false.
+    template <class F>
+    inline void forEachMerged(std::vector<Reader const *> const &readers, F &&f) {
+        struct Head {
+            RecordView rec;
+            std::size_t source;
+        };
+        auto later = [](Head const &a, Head const &b) {
+            if (a.rec.micros != b.rec.micros) {
+                return a.rec.micros > b.rec.micros;
+            }
+            return a.source > b.source;
+        };
+        std::vector<Reader::Cursor> cursors;
+        cursors.reserve(readers.size());
+        std::vector<Head> heap;
+        for (std::size_t ii=0; ii<readers.size(); ++ii) {
+            cursors.emplace_back(*readers[ii]);
+            Head h {RecordView {}, ii};
+            if (cursors.back().next(h.rec)) {
+                heap.push_back(h);
+            }
+        }
+        std::make_heap(heap.begin(), heap.end(), later);
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            auto &h = heap.back();
+            if (!f(h.source, h.rec)) {
+                return;
+            }
+            if (cursors[h.source].next(h.rec)) {
+                std::push_heap(heap.begin(), heap.end(), later);
+            } else {
+                heap.pop_back();
+            }
+        }
+    }
+
+}
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef LATENCY_HISTOGRAM_HPP_
+#define LATENCY_HISTOGRAM_HPP_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+//HDR-style (log-linear) histogram of non-negative integer values, meant for
+//latencies in microseconds. Values below 2048 are exact, larger values keep
+//11 significant bits (relative error below 0.1%). Values beyond MaxValue are
+//clamped into the last bucket.
+namespace latency_histogram {
+
+    class Histogram {
+    public:
+        static constexpr int SubBucketBits = 11;
+        static constexpr int64_t SubBucketCount = (int64_t) 1 << SubBucketBits;
+        static constexpr int64_t HalfSubBucketCount = SubBucketCount/2;
+        static constexpr int MaxExponent = 30;
+        static constexpr int64_t MaxValue = ((int64_t) 1 << (MaxExponent+SubBucketBits))-1;
+        static constexpr std::size_t BucketCount = (std::size_t) (SubBucketCount+MaxExponent*HalfSubBucketCount);
+
+        static std::size_t indexOf(int64_t v) {
+            if (v < 0) {
+                v = 0;
+            } else if (v > MaxValue) {
+                v = MaxValue;
+            }
+            if (v < SubBucketCount) {
+                return (std::size_t) v;
+            }
+            int msb = 63;
+            while (((v >> msb) & 1) == 0) {
+                --msb;
+            }
+            int e = msb-(SubBucketBits-1);
+            return (std::size_t) (SubBucketCount+(e-1)*HalfSubBucketCount+((v >> e)-HalfSubBucketCount));
+        }
+        //smallest value that maps to this bucket
+        static int64_t lowestValueAt(std::size_t idx) {
+            if ((int64_t) idx < SubBucketCount) {
+                return (int64_t) idx;
+            }
+            int64_t rest = (int64_t) idx-SubBucketCount;
+            int e = (int) (rest/HalfSubBucketCount)+1;
+            return (HalfSubBucketCount+rest%HalfSubBucketCount) << e;
+        }
+        //largest value that maps to this bucket
+        static int64_t highestValueAt(std::size_t idx) {
+            if (idx+1 >= BucketCount) {
+                return MaxValue;
+            }
+            return lowestValueAt(idx+1)-1;
+        }
+
+    private:
+        std::vector<uint64_t> counts_;
+        uint64_t totalCount_;
+        int64_t min_;
+        int64_t max_;
+        double sum_;
+    public:
+        Histogram() : counts_(BucketCount, 0), totalCount_(0), min_(std::numeric_limits<int64_t>::max()), max_(0), sum_(0.0) {}
+
+        void record(int64_t v, uint64_t n=1) {
+            if (n == 0) {
+                return;
+            }
+            counts_[indexOf(v)] += n;
+            totalCount_ += n;
+            min_ = std::min(min_, v);
+            max_ = std::max(max_, v);
+            sum_ += 1.0*v*n;
+        }
+        //used by Recorder, which keeps sum/min/max separately from the buckets
+        void addBucket(std::size_t idx, uint64_t n) {
+            counts_[idx] += n;
+            totalCount_ += n;
+        }
+        void mergeSumMinMax(double sum, int64_t minV, int64_t maxV) {
+            sum_ += sum;
+            min_ = std::min(min_, minV);
+            max_ = std::max(max_, maxV);
+        }
+        void merge(Histogram const &h) {
+            for (std::size_t ii=0; ii<BucketCount; ++ii) {
+                counts_[ii] += h.counts_[ii];
+            }
+            totalCount_ += h.totalCount_;
+            if (h.totalCount_ > 0) {
+                mergeSumMinMax(h.sum_, h.min_, h.max_);
+            }
+        }
+        void reset() {
+            std::fill(counts_.begin(), counts_.end(), 0);
+            totalCount_ = 0;
+            min_ = std::numeric_limits<int64_t>::max();
+            max_ = 0;
+            sum_ = 0.0;
+        }
+        uint64_t totalCount() const {
+            return totalCount_;
+        }
+        int64_t min() const {
+            return (totalCount_ > 0) ? min_ : 0;
+        }
+        int64_t max() const {
+            return max_;
+        }
+        double mean() const {
+            return (totalCount_ > 0) ? (sum_/totalCount_) : 0.0;
+        }
+        //percentile is in [0, 100], returns the highest value of the bucket
+        //that contains that rank (clamped to the recorded max)
+        int64_t valueAtPercentile(double percentile) const {
+            if (totalCount_ == 0) {
+                return 0;
+            }
+            percentile = std::clamp(percentile, 0.0, 100.0);
+            uint64_t rank = (uint64_t) std::ceil(percentile/100.0*totalCount_);
+            if (rank == 0) {
+                rank = 1;
+            }
+            uint64_t seen = 0;
+            for (std::size_t ii=0; ii<BucketCount; ++ii) {
+                seen += counts_[ii];
+                if (seen >= rank) {
+                    return std::min(highestValueAt(ii), max_);
+                }
+            }
+            return max_;
+        }
+        //percentile distribution in the HdrHistogram ".hgrm" text layout,
+        //so that dumps from different transports can be compared with the
+        //usual plotting tools
+        void writePercentileDistribution(std::ostream &os, int ticksPerHalfDistance=5) const {
+            os << std::setw(12) << "Value" << ' '
+                << std::setw(14) << "Percentile" << ' '
+                << std::setw(10) << "TotalCount" << ' '
+                << std::setw(14) << "1/(1-Percentile)" << "\n\n";
+            if (totalCount_ > 0) {
+                uint64_t seen = 0;
+                double nextReport = 0.0;
+                for (std::size_t ii=0; ii<BucketCount; ++ii) {
+                    if (counts_[ii] == 0) {
+                        continue;
+                    }
+                    seen += counts_[ii];
+                    double p = 1.0*seen/totalCount_;
+                    if (p >= nextReport || seen == totalCount_) {
+                        os << std::fixed << std::setprecision(3)
+                            << std::setw(12) << (double) std::min(highestValueAt(ii), max_) << ' '
+                            << std::setprecision(12) << std::setw(14) << p << ' '
+                            << std::setw(10) << seen << ' ';
+                        if (seen < totalCount_) {
+                            os << std::setprecision(2) << std::setw(14) << 1.0/(1.0-p);
+                        }
+                        os << '\n';
+                        //halve the remaining distance every ticksPerHalfDistance lines
+                        nextReport = p+(1.0-p)/(2.0*ticksPerHalfDistance);
+                    }
+                }
+            }
+            os << std::defaultfloat
+                << "#[Mean    = " << mean() << ", Max = " << max() << "]\n"
+                << "#[Min     = " << min() << ", TotalCount = " << totalCount_ << "]\n";
+        }
+    };
+
+    //Lock-free recording front for Histogram. Every recording thread gets its
+    //own shard of atomic buckets (registered once per thread under a mutex),
+    //so record() is an uncontended relaxed atomic add. collect() merges all
+    //shards, optionally draining them so that each collect() returns the
+    //interval since the previous one.
+    class Recorder {
+    private:
+        struct Shard {
+            std::unique_ptr<std::atomic<uint64_t>[]> counts;
+            std::atomic<int64_t> sum;
+            std::atomic<int64_t> min;
+            std::atomic<int64_t> max;
+            Shard() : counts(new std::atomic<uint64_t>[Histogram::BucketCount]), sum(0), min(std::numeric_limits<int64_t>::max()), max(0) {
+                for (std::size_t ii=0; ii<Histogram::BucketCount; ++ii) {
+                    counts[ii].store(0, std::memory_order_relaxed);
+                }
+            }
+        };
+        uint64_t id_;
+        std::mutex shardsMutex_;
+        std::vector<std::unique_ptr<Shard>> shards_;
+
+        static uint64_t nextID() {
+            static std::atomic<uint64_t> id {0};
+            return ++id;
+        }
+        Shard *myShard() {
+            //keyed by a never-reused recorder id so that several recorders
+            //can coexist, and a new recorder at an old address is not confused
+            //with the old one
+            thread_local std::vector<std::pair<uint64_t, Shard *>> mine;
+            for (auto const &x : mine) {
+                if (x.first == id_) {
+                    return x.second;
+                }
+            }
+            std::lock_guard<std::mutex> _(shardsMutex_);
+            shards_.push_back(std::make_unique<Shard>());
+            mine.push_back({id_, shards_.back().get()});
+            return shards_.back().get();
+        }
+    public:
+        Recorder() : id_(nextID()), shardsMutex_(), shards_() {}
+        Recorder(Recorder const &) = delete;
+        Recorder &operator=(Recorder const &) = delete;
+
+        void record(int64_t v) {
+            auto *s = myShard();
+            s->counts[Histogram::indexOf(v)].fetch_add(1, std::memory_order_relaxed);
+            s->sum.fetch_add(v, std::memory_order_relaxed);
+            if (v < s->min.load(std::memory_order_relaxed)) {
+                s->min.store(v, std::memory_order_relaxed);
+            }
+            if (v > s->max.load(std::memory_order_relaxed)) {
+                s->max.store(v, std::memory_order_relaxed);
+            }
+        }
+        void collect(Histogram &out, bool drain) {
+            std::lock_guard<std::mutex> _(shardsMutex_);
+            for (auto const &s : shards_) {
+                bool any = false;
+                for (std::size_t ii=0; ii<Histogram::BucketCount; ++ii) {
+                    uint64_t n = drain
+                        ? s->counts[ii].exchange(0, std::memory_order_relaxed)
+                        : s->counts[ii].load(std::memory_order_relaxed);
+                    if (n > 0) {
+                        out.addBucket(ii, n);
+                        any = true;
+                    }
+                }
+                if (any) {
+                    int64_t sum, minV, maxV;
+                    if (drain) {
+                        sum = s->sum.exchange(0, std::memory_order_relaxed);
+                        minV = s->min.exchange(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+                        maxV = s->max.exchange(0, std::memory_order_relaxed);
+                    } else {
+                        sum = s->sum.load(std::memory_order_relaxed);
+                        minV = s->min.load(std::memory_order_relaxed);
+                        maxV = s->max.load(std::memory_order_relaxed);
+                    }
+                    out.mergeSumMinMax(1.0*sum, minV, maxV);
+                }
+            }
+        }
+    };
+
+}
+
+#endif
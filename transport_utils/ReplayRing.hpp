@@ -0,0 +1,114 @@
+#ifndef REPLAY_RING_HPP_
+#define REPLAY_RING_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+//Single-producer single-consumer ring of decoded capture records, used by the
+//fast replay modes so that reading and decoding happen on a loader thread.
+//The slots are allocated up front and their strings keep their capacity, so
+//once every slot has held a message as large as the current one, push does
+//not allocate. The consumer must copy the strings out of the slot (and not
+//move them, which would leave the producer to allocate again); the copy is
+//the one allocation per message that handing it to publish needs anyway.
+//When the ring is full the producer waits, when it is empty the consumer
+//waits.
+namespace replay_ring {
+
+    struct Slot {
+        int64_t micros;
+        std::string topic;
+        std::string content;
+    };
+
+    class Ring {
+    private:
+        std::vector<Slot> slots_;
+        std::size_t mask_;
+        alignas(64) std::atomic<uint64_t> head_; //next slot to be read
+        alignas(64) std::atomic<uint64_t> tail_; //next slot to be written
+        alignas(64) std::atomic<bool> done_;
+
+        static std::size_t roundUp(std::size_t n) {
+            std::size_t ret = 1;
+            while (ret < n) {
+                ret <<= 1;
+            }
+            return ret;
+        }
+        static void backOff(unsigned &spins) {
+            if (++spins < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    public:
+        Ring(std::size_t capacity)
+            : slots_(roundUp(capacity < 2 ? 2 : capacity)), mask_(0), head_(0), tail_(0), done_(false)
+        {
+            mask_ = slots_.size()-1;
+        }
+        Ring(Ring const &) = delete;
+        Ring &operator=(Ring const &) = delete;
+
+        std::size_t capacity() const {
+            return slots_.size();
+        }
+        std::size_t size() const {
+            return (std::size_t) (tail_.load(std::memory_order_acquire)-head_.load(std::memory_order_acquire));
+        }
+        bool full() const {
+            return size() == slots_.size();
+        }
+        //producer side
+        void push(int64_t micros, std::string_view topic, std::string_view content) {
+            auto tail = tail_.load(std::memory_order_relaxed);
+            unsigned spins = 0;
+            while (tail-head_.load(std::memory_order_acquire) >= slots_.size()) {
+                backOff(spins);
+            }
+            auto &slot = slots_[tail & mask_];
+            slot.micros = micros;
+            slot.topic.assign(topic);
+            slot.content.assign(content);
+            tail_.store(tail+1, std::memory_order_release);
+        }
+        void markDone() {
+            done_.store(true, std::memory_order_release);
+        }
+        bool done() const {
+            return done_.load(std::memory_order_acquire);
+        }
+        //consumer side, returns nullptr once the producer is done and
+        //everything has been consumed; the slot stays owned by the ring
+        Slot *front() {
+            auto head = head_.load(std::memory_order_relaxed);
+            unsigned spins = 0;
+            while (true) {
+                if (tail_.load(std::memory_order_acquire) != head) {
+                    return &(slots_[head & mask_]);
+                }
+                if (done_.load(std::memory_order_acquire)) {
+                    //re-check, the last push may have raced with markDone
+                    if (tail_.load(std::memory_order_acquire) != head) {
+                        continue;
+                    }
+                    return nullptr;
+                }
+                backOff(spins);
+            }
+        }
+        void pop() {
+            head_.store(head_.load(std::memory_order_relaxed)+1, std::memory_order_release);
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef SHARDED_CAPTURE_WRITER_HPP_
+#define SHARDED_CAPTURE_WRITER_HPP_
+
+#include "IndexedCaptureFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//Writes a capture into N shard files (<output>.0 ... <output>.N-1), topics are
+//hashed to shards so that all records of one topic go to the same file. Each
+//shard has its own queue and writer thread, and serializes records into a
+//large aligned buffer that is written out in whole blocks (optionally with
+//O_DIRECT on Linux, bypassing the page cache). Every shard file is a normal
+//ByteDataWithTopicRecordFileFormat<std::chrono::microseconds> file in arrival
+//order; tm_capture_merger turns a set of shards back into one time-ordered file.
+namespace sharded_capture {
+
+    class Writer {
+    public:
+        static constexpr std::size_t Alignment = 4096;
+    private:
+        struct Item {
+            int64_t micros;
+            std::string topic;
+            std::string content;
+            bool isFinal;
+        };
+        class Shard {
+        private:
+            std::string fileName_;
+            std::size_t bufferSize_;
+            std::size_t maxQueued_;
+            bool directIO_;
+#ifdef _WIN32
+            std::ofstream ofs_;
+#else
+            int fd_;
+#endif
+            char *buffer_;
+            std::size_t used_;
+            std::mutex mutex_;
+            std::condition_variable notEmpty_;
+            std::condition_variable notFull_;
+            std::vector<Item> incoming_;
+            bool stopping_;
+            std::thread thread_;
+            std::atomic<uint64_t> written_;
+            std::atomic<uint64_t> blockedPushes_;
+            //once a write fails the shard file is incomplete, so everything
+            //after that is dropped (and counted) instead of leaving a hole
+            std::atomic<bool> failed_;
+            std::atomic<uint64_t> droppedBytes_;
+
+            void fail(std::string const &reason, std::size_t len) {
+                if (!failed_.exchange(true)) {
+                    std::cerr << "Capture shard '" << fileName_ << "' failed: " << reason << ", dropping the rest of this shard\n";
+                }
+                droppedBytes_ += len;
+            }
+            void writeOut(std::size_t len) {
+                if (failed_) {
+                    droppedBytes_ += len;
+                    return;
+                }
+#ifdef _WIN32
+                ofs_.write(buffer_, len);
+                if (!ofs_) {
+                    fail("write error", len);
+                }
+#else
+                std::size_t done = 0;
+                while (done < len) {
+                    auto n = ::write(fd_, buffer_+done, len-done);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        fail((n < 0)?std::strerror(errno):"write returned 0", len-done);
+                        return;
+                    }
+                    done += (std::size_t) n;
+                }
+#endif
+            }
+            void append(char const *p, std::size_t len) {
+                while (len > 0) {
+                    auto n = std::min(len, bufferSize_-used_);
+                    std::memcpy(buffer_+used_, p, n);
+                    used_ += n;
+                    p += n;
+                    len -= n;
+                    if (used_ == bufferSize_) {
+                        writeOut(used_);
+                        used_ = 0;
+                    }
+                }
+            }
+            void finish() {
+#ifdef _WIN32
+                writeOut(used_);
+                ofs_.close();
+#else
+                if (used_ > 0) {
+                    //O_DIRECT wants whole aligned blocks, the tail is written
+                    //through the page cache instead
+                    if (directIO_) {
+                        auto whole = used_-used_%Alignment;
+                        writeOut(whole);
+                        std::memmove(buffer_, buffer_+whole, used_-whole);
+                        used_ -= whole;
+#ifdef O_DIRECT
+                        ::fcntl(fd_, F_SETFL, ::fcntl(fd_, F_GETFL) & ~O_DIRECT);
+#endif
+                    }
+                    writeOut(used_);
+                }
+                ::close(fd_);
+#endif
+                used_ = 0;
+            }
+            void run() {
+                std::vector<Item> batch;
+                std::string rec;
+                while (true) {
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        notEmpty_.wait(lock, [this]() {
+                            return stopping_ || !incoming_.empty();
+                        });
+                        if (incoming_.empty() && stopping_) {
+                            break;
+                        }
+                        std::swap(batch, incoming_);
+                    }
+                    notFull_.notify_all();
+                    for (auto &item : batch) {
+                        rec.clear();
+                        rec.append(reinterpret_cast<char const *>(indexed_capture_file::RecordMagic.data()), indexed_capture_file::RecordMagic.size());
+                        indexed_capture_file::detail::put<int64_t>(rec, item.micros);
+                        indexed_capture_file::detail::put<uint32_t>(rec, (uint32_t) item.topic.length());
+                        rec.append(item.topic);
+                        indexed_capture_file::detail::put<uint32_t>(rec, (uint32_t) item.content.length());
+                        rec.append(item.content);
+                        rec.push_back(item.isFinal ? (char) 1 : (char) 0);
+                        append(rec.data(), rec.length());
+                    }
+                    written_ += batch.size();
+                    batch.clear();
+                }
+                finish();
+            }
+        public:
+            Shard(std::string const &fileName, std::size_t bufferSize, std::size_t maxQueued, bool directIO)
+                : fileName_(fileName), bufferSize_(bufferSize), maxQueued_(maxQueued), directIO_(directIO)
+#ifndef _WIN32
+                , fd_(-1)
+#endif
+                , buffer_(nullptr), used_(0)
+                , mutex_(), notEmpty_(), notFull_(), incoming_(), stopping_(false), thread_()
+                , written_(0), blockedPushes_(0), failed_(false), droppedBytes_(0)
+            {
+#ifdef _WIN32
+                directIO_ = false;
+                buffer_ = static_cast<char *>(std::malloc(bufferSize_));
+                ofs_.open(fileName_, std::ios::binary);
+                if (!ofs_) {
+                    throw std::runtime_error("Cannot open '"+fileName_+"' for writing");
+                }
+#else
+                if (::posix_memalign(reinterpret_cast<void **>(&buffer_), Alignment, bufferSize_) != 0) {
+                    throw std::runtime_error("Cannot allocate capture buffer");
+                }
+                int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+                if (directIO_) {
+                    flags |= O_DIRECT;
+                }
+#else
+                directIO_ = false;
+#endif
+                fd_ = ::open(fileName_.c_str(), flags, 0644);
+                if (fd_ < 0 && directIO_) {
+                    //not every file system supports O_DIRECT
+                    directIO_ = false;
+                    fd_ = ::open(fileName_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                }
+                if (fd_ < 0) {
+                    std::free(buffer_);
+                    throw std::runtime_error("Cannot open '"+fileName_+"' for writing");
+                }
+#endif
+                append(reinterpret_cast<char const *>(indexed_capture_file::FileMagic.data()), indexed_capture_file::FileMagic.size());
+                thread_ = std::thread(&Shard::run, this);
+            }
+            ~Shard() {
+                stop();
+                std::free(buffer_);
+            }
+            void push(Item &&item) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    if (stopping_) {
+                        return;
+                    }
+                    if (incoming_.size() >= maxQueued_) {
+                        //bounded queue: rather stall the listener than grow without limit
+                        ++blockedPushes_;
+                        notFull_.wait(lock, [this]() {
+                            return stopping_ || incoming_.size() < maxQueued_;
+                        });
+                        if (stopping_) {
+                            return;
+                        }
+                    }
+                    incoming_.push_back(std::move(item));
+                }
+                notEmpty_.notify_one();
+            }
+            void stop() {
+                {
+                    std::lock_guard<std::mutex> _(mutex_);
+                    stopping_ = true;
+                }
+                notEmpty_.notify_one();
+                notFull_.notify_all();
+                if (thread_.joinable()) {
+                    thread_.join();
+                }
+            }
+            std::string const &fileName() const {
+                return fileName_;
+            }
+            uint64_t written() const {
+                return written_;
+            }
+            uint64_t blockedPushes() const {
+                return blockedPushes_;
+            }
+            bool failed() const {
+                return failed_;
+            }
+            uint64_t droppedBytes() const {
+                return droppedBytes_;
+            }
+        };
+
+        std::vector<std::unique_ptr<Shard>> shards_;
+    public:
+        static std::string shardFileName(std::string const &output, std::size_t shard) {
+            return output+"."+std::to_string(shard);
+        }
+        Writer(std::string const &output, std::size_t shardCount, bool directIO=false, std::size_t bufferSize=4*1024*1024, std::size_t maxQueuedPerShard=1024*1024)
+            : shards_()
+        {
+            if (shardCount == 0) {
+                shardCount = 1;
+            }
+            //whole aligned blocks are needed for O_DIRECT
+            bufferSize = std::max(Alignment, bufferSize-bufferSize%Alignment);
+            for (std::size_t ii=0; ii<shardCount; ++ii) {
+                shards_.push_back(std::make_unique<Shard>(shardFileName(output, ii), bufferSize, maxQueuedPerShard, directIO));
+            }
+        }
+        ~Writer() {
+            close();
+        }
+        Writer(Writer const &) = delete;
+        Writer &operator=(Writer const &) = delete;
+
+        std::size_t shardCount() const {
+            return shards_.size();
+        }
+        void write(std::chrono::system_clock::time_point const &tp, std::string &&topic, std::string &&content, bool isFinal=false) {
+            auto shard = std::hash<std::string>()(topic)%shards_.size();
+            shards_[shard]->push(Item {indexed_capture_file::toMicros(tp), std::move(topic), std::move(content), isFinal});
+        }
+        //stops all writer threads after their queues are drained
+        void close() {
+            for (auto &s : shards_) {
+                s->stop();
+            }
+        }
+        uint64_t written() const {
+            uint64_t ret = 0;
+            for (auto const &s : shards_) {
+                ret += s->written();
+            }
+            return ret;
+        }
+        uint64_t blockedPushes() const {
+            uint64_t ret = 0;
+            for (auto const &s : shards_) {
+                ret += s->blockedPushes();
+            }
+            return ret;
+        }
+        //number of shards whose file could not be written completely
+        std::size_t failedShards() const {
+            std::size_t ret = 0;
+            for (auto const &s : shards_) {
+                ret += (s->failed()?1:0);
+            }
+            return ret;
+        }
+        uint64_t droppedBytes() const {
+            uint64_t ret = 0;
+            for (auto const &s : shards_) {
+                ret += s->droppedBytes();
+            }
+            return ret;
+        }
+    };
+
+}
+
+#endif
@@ -8,14 +8,19 @@
 #include <tm_kit/basic/single_pass_iteration_clock/ClockComponent.hpp>
 #include <tm_kit/basic/ByteDataWithTopicRecordFileImporterExporter.hpp>
 #include <tm_kit/basic/simple_shared_chain/ChainDataImporterExporter.hpp>
+#include <tm_kit/basic/simple_shared_chain/ChainWriter.hpp>
 #include <tm_kit/basic/CommonFlowUtils.hpp>
 #include <tm_kit/basic/AppRunnerUtils.hpp>
 
 #include <tm_kit/transport/CrossGuidComponent.hpp>
 #include <tm_kit/transport/SharedChainCreator.hpp>
 
+#include "BulkTranscribePipeline.hpp"
+
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <thread>
 
 #include <tclap/CmdLine.h>
 
@@ -33,6 +38,44 @@ public:
     }
 };
 
+//Used by the bulk mode to write to a chain: every call appends the next
+//batch from the pipeline (in input order) as one batch of chain items
+class BulkAppendIdleWorker {
+private:
+    bulk_transcribe::Pipeline *pipeline_;
+    std::size_t pending_;
+public:
+    using OffChainUpdateType = std::size_t;
+
+    BulkAppendIdleWorker(bulk_transcribe::Pipeline *pipeline=nullptr) : pipeline_(pipeline), pending_(0) {}
+
+    template <class Env, class Chain>
+    void initialize(Env *env, Chain *chain) {}
+
+    template <class Env, class Chain, class State>
+    std::tuple<
+        std::optional<OffChainUpdateType>
+        , std::vector<std::tuple<std::string, basic::ByteData>>
+    > work(Env *env, Chain *chain, State const &state) {
+        //being called again means the batch returned last time is on the chain
+        if (pending_ > 0) {
+            pipeline_->markWritten(pending_);
+            pending_ = 0;
+        }
+        bulk_transcribe::Batch b;
+        if (!pipeline_ || !pipeline_->nextInOrder(b, false)) {
+            return {std::nullopt, {}};
+        }
+        std::vector<std::tuple<std::string, basic::ByteData>> ret;
+        ret.reserve(b.items.size());
+        for (auto &item : b.items) {
+            ret.push_back({"", basic::ByteData {std::move(item)}});
+        }
+        pending_ = b.itemCount;
+        return {std::nullopt, std::move(ret)};
+    }
+};
+
 template <class R>
 auto transcribe(R &r, std::string const &inputChainLocatorStr, std::string const &outputChainLocatorStr, bool inputIsFile, bool outputIsFile) 
     -> typename R::template Source<basic::ByteData>
@@ -178,7 +221,152 @@ void runSP(std::string const &inputChainLocatorStr, std::string const &outputCha
     r.finalize();
 }
 
-void run(std::string const &inputChainLocatorStr, std::string const &outputChainLocatorStr, bool realTimeMode) {
+//Bulk mode read stage for chain input: the graph does nothing but fetch
+//items and hand them to the pipeline
+void bulkReadChain(std::string const &inputChainLocatorStr, bulk_transcribe::Pipeline &pipeline) {
+    using TheEnvironment = infra::Environment<
+        infra::CheckTimeComponent<true>,
+        infra::TrivialExitControlComponent,
+        basic::TimeComponentEnhancedWithSpdLogging<
+            basic::single_pass_iteration_clock::ClockComponent<std::chrono::system_clock::time_point>
+            , false //don't log thread ID
+        >,
+        transport::CrossGuidComponent,
+        transport::AllChainComponents
+    >;
+    using M = infra::SinglePassIterationApp<TheEnvironment>;
+    using R = infra::AppRunner<M>;
+
+    TheEnvironment env;
+    R r(&env);
+
+    transport::SharedChainCreator<M> sharedChainCreator;
+    auto chainDataSource = basic::simple_shared_chain::createChainDataSource<
+        R, basic::ByteData
+    >(
+        r 
+        , sharedChainCreator.readerFactory<
+            basic::ByteData
+            , TrivialByteDataChainFolder
+            , void //no trigger type
+            , void //no result transformer
+            , true //force separate data storage if possible
+        >(
+            &env
+            , inputChainLocatorStr
+        )
+        , "input_chain"
+    );
+    auto feeder = M::pureExporter<basic::ByteData>(
+        [&pipeline](basic::ByteData &&d) {
+            pipeline.add(std::move(d.content));
+        }
+    );
+    r.registerExporter("feeder", feeder);
+    r.exportItem(feeder, chainDataSource.clone());
+    r.finalize();
+
+    pipeline.finishInput();
+}
+
+//Bulk mode read stage for file input, straight from the memory-mapped file
+void bulkReadFile(indexed_capture_file::Reader const &reader, bulk_transcribe::Pipeline &pipeline) {
+    indexed_capture_file::Reader::Cursor cursor(reader);
+    indexed_capture_file::RecordView rec;
+    while (cursor.next(rec)) {
+        pipeline.add(std::string {rec.content});
+    }
+    pipeline.finishInput();
+}
+
+//Bulk mode write stage for file output: the batches are already encoded,
+//so this only does large sequential writes
+void bulkWriteFile(std::string const &outputFile, bulk_transcribe::Pipeline &pipeline) {
+    std::vector<char> streamBuffer(4*1024*1024);
+    std::ofstream ofs;
+    ofs.rdbuf()->pubsetbuf(streamBuffer.data(), streamBuffer.size());
+    ofs.open(outputFile.c_str(), std::ios::binary);
+    ofs.write(reinterpret_cast<char const *>(indexed_capture_file::FileMagic.data()), indexed_capture_file::FileMagic.size());
+    bulk_transcribe::Batch b;
+    while (pipeline.nextInOrder(b, true)) {
+        ofs.write(b.encoded.data(), b.encoded.length());
+        pipeline.markWritten(b.itemCount);
+    }
+    ofs.close();
+}
+
+//Bulk mode write stage for chain output. The output chain must not have
+//any other writer while this runs. Does not return: once everything is on
+//the chain it prints the summary and exits.
+void bulkWriteChain(std::string const &outputChainLocatorStr, bulk_transcribe::Pipeline &pipeline, std::thread &readStage) {
+    using TheEnvironment = infra::Environment<
+        infra::CheckTimeComponent<true>,
+        infra::TrivialExitControlComponent,
+        basic::TimeComponentEnhancedWithSpdLogging<
+            basic::real_time_clock::ClockComponent
+        >,
+        transport::CrossGuidComponent,
+        transport::AllChainComponents
+    >;
+    using M = infra::RealTimeApp<TheEnvironment>;
+    using R = infra::AppRunner<M>;
+
+    TheEnvironment env;
+    R r(&env);
+
+    transport::SharedChainCreator<M> sharedChainCreator;
+    auto chainFacility = sharedChainCreator.writerFactory<
+        basic::ByteData
+        , basic::simple_shared_chain::EmptyStateChainFolder
+        , basic::simple_shared_chain::SimplyPlaceOnChainInputHandler<basic::ByteData>
+        , BulkAppendIdleWorker
+        , true //force separate data storage if possible
+    >(
+        &env
+        , outputChainLocatorStr
+        , basic::simple_shared_chain::ChainPollingPolicy().BusyLoop(true)
+        , basic::simple_shared_chain::EmptyStateChainFolder {}
+        , basic::simple_shared_chain::SimplyPlaceOnChainInputHandler<basic::ByteData> {}
+        , BulkAppendIdleWorker {&pipeline}
+    )();
+    r.registerOnOrderFacilityWithExternalEffects("output_chain", chainFacility);
+    r.finalize();
+
+    pipeline.waitUntilAllWritten();
+    readStage.join();
+    pipeline.printSummary(std::cout);
+    env.exit();
+}
+
+void runBulk(std::string const &inputChainLocatorStr, std::string const &outputChainLocatorStr, bool inputIsFile, bool outputIsFile, std::size_t batchSize, std::size_t threadCount) {
+    std::unique_ptr<indexed_capture_file::Reader> fileReader;
+    if (inputIsFile) {
+        try {
+            fileReader = std::make_unique<indexed_capture_file::Reader>(inputChainLocatorStr);
+        } catch (std::exception const &ex) {
+            std::cerr << "Cannot read '" << inputChainLocatorStr << "': " << ex.what() << "\n";
+            return;
+        }
+    }
+    //only capture file output needs any encoding work
+    bulk_transcribe::Pipeline pipeline(batchSize, (outputIsFile?threadCount:1), 4*threadCount, outputIsFile);
+    std::thread readStage([&]() {
+        if (inputIsFile) {
+            bulkReadFile(*fileReader, pipeline);
+        } else {
+            bulkReadChain(inputChainLocatorStr, pipeline);
+        }
+    });
+    if (outputIsFile) {
+        bulkWriteFile(outputChainLocatorStr, pipeline);
+        readStage.join();
+        pipeline.printSummary(std::cout);
+    } else {
+        bulkWriteChain(outputChainLocatorStr, pipeline, readStage);
+    }
+}
+
+void run(std::string const &inputChainLocatorStr, std::string const &outputChainLocatorStr, bool realTimeMode, bool bulkMode, std::size_t batchSize, std::size_t threadCount) {
     bool inputIsFile = (inputChainLocatorStr.find("://") == std::string::npos);
     bool outputIsFile = (outputChainLocatorStr.find("://") == std::string::npos);
     if (inputIsFile && outputIsFile) {
@@ -186,6 +374,11 @@ void run(std::string const &inputChainLocatorStr, std::string const &outputChain
         return;
     }
 
+    if (bulkMode) {
+        runBulk(inputChainLocatorStr, outputChainLocatorStr, inputIsFile, outputIsFile, batchSize, threadCount);
+        return;
+    }
+
     bool actuallyRunInRealTimeMode = realTimeMode && !inputIsFile && !outputIsFile;
 
     if (actuallyRunInRealTimeMode) {
@@ -202,6 +395,11 @@ int main(int argc, char **argv) {
     cmd.add(inputArg);
     cmd.add(outputArg);    
     TCLAP::SwitchArg realTimeModeArg("r", "realTimeMode", "runs in real time mode (only meaningful if both input and output are chains)", cmd, false);
+    TCLAP::SwitchArg bulkModeArg("b", "bulk", "transcribes everything that is in the input now through a pipelined read/convert/write path and exits (an output chain must not have other writers meanwhile)", cmd, false);
+    TCLAP::ValueArg<std::size_t> batchSizeArg("s", "batchSize", "items per batch in bulk mode (default 4096)", false, 4096, "number");
+    TCLAP::ValueArg<std::size_t> threadsArg("t", "threads", "converter threads in bulk mode (default: number of cores minus 2)", false, 0, "number");
+    cmd.add(batchSizeArg);
+    cmd.add(threadsArg);
 
     cmd.parse(argc, argv);
 
@@ -216,8 +414,13 @@ int main(int argc, char **argv) {
         return 1;
     }
     auto realTimeMode = realTimeModeArg.getValue();
+    auto threadCount = threadsArg.getValue();
+    if (threadCount == 0) {
+        auto cores = std::thread::hardware_concurrency();
+        threadCount = (cores > 3)?(cores-2):1;
+    }
     
-    run(inputChainLocatorStr, outputChainLocatorStr, realTimeMode);
+    run(inputChainLocatorStr, outputChainLocatorStr, realTimeMode, bulkModeArg.getValue(), batchSizeArg.getValue(), threadCount);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "IndexedCaptureFile.hpp"
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <memory>
+
+using namespace boost::program_options;
+
+int main(int argc, char **argv) {
+    options_description desc("allowed options");
+    desc.add_options()
+        ("help", "display help message")
+        ("input", value<std::vector<std::string>>()->multitoken(), "capture files to merge, e.g. the shard files written by tm_capturer --shards")
+        ("output", value<std::string>(), "output to this file, records of all inputs in timestamp order")
+        ("indexed", "append a time/topic index to the output file (see tm_capturer --indexed)")
+    ;
+    variables_map vm;
+    store(parse_command_line(argc, argv, desc), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << '\n';
+        return 0;
+    }
+    if (!vm.count("input")) {
+        std::cerr << "No input file given!\n";
+        return 1;
+    }
+    if (!vm.count("output")) {
+        std::cerr << "No output file given!\n";
+        return 1;
+    }
+    auto inputs = vm["input"].as<std::vector<std::string>>();
+    auto output = vm["output"].as<std::string>();
+
+    std::vector<std::unique_ptr<indexed_capture_file::Reader>> readers;
+    std::vector<indexed_capture_file::Reader const *> readerPtrs;
+    for (auto const &f : inputs) {
+        try {
+            readers.push_back(std::make_unique<indexed_capture_file::Reader>(f));
+        } catch (std::exception const &ex) {
+            std::cerr << "Cannot read '" << f << "': " << ex.what() << "\n";
+            return 1;
+        }
+        readerPtrs.push_back(readers.back().get());
+    }
+
+    indexed_capture_file::Writer writer(output, 4096, 4*1024*1024, vm.count("indexed"));
+    if (!writer.good()) {
+        std::cerr << "Cannot open '" << output << "' for writing!\n";
+        return 1;
+    }
+    uint64_t count = 0;
+    int64_t lastMicros = std::numeric_limits<int64_t>::min();
+    uint64_t outOfOrder = 0;
+    indexed_capture_file::forEachMerged(
+        readerPtrs
+        , [&writer,&count,&lastMicros,&outOfOrder](std::size_t, indexed_capture_file::RecordView const &rec) {
+            if (rec.micros < lastMicros) {
+                ++outOfOrder;
+            }
+            lastMicros = rec.micros;
+            writer.write(indexed_capture_file::fromMicros(rec.micros), rec.topic, rec.content, rec.isFinal);
+            ++count;
+            return true;
+        }
+    );
+    writer.close();
+
+    std::cout << "Merged " << count << " records from " << inputs.size() << " files into '" << output << "'";
+    if (outOfOrder > 0) {
+        std::cout << " (" << outOfOrder << " records were out of timestamp order within their input file)";
+    }
+    std::cout << "\n";
+    return 0;
+}
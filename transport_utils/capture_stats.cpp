@@ -0,0 +1,476 @@
+#include "IndexedCaptureFile.hpp"
+#include "LatencyHistogram.hpp"
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace boost::program_options;
+
+//Statistics over one contiguous range of records (in file order). Ranges
+//are scanned in parallel and then combined in file order, so everything
+//that depends on the neighbouring record (gaps, bursts, interval counts)
+//keeps what is needed at both ends of the range.
+struct TopicStats {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t maxSize = 0;
+    int64_t firstMicros = 0;
+    int64_t lastMicros = 0;
+    int64_t gapSum = 0;
+    int64_t maxGap = 0;
+    //messages per interval: the first and the last run of records in the
+    //same interval stay open since they may continue in the neighbouring
+    //ranges, innerPeak covers the runs in between
+    bool oneRun = true;
+    int64_t firstInterval = 0;
+    uint64_t firstIntervalCount = 0;
+    int64_t lastInterval = 0;
+    uint64_t lastIntervalCount = 0;
+    uint64_t innerPeak = 0;
+
+    void add(int64_t micros, int64_t interval, std::size_t size) {
+        if (count == 0) {
+            firstMicros = micros;
+            firstInterval = lastInterval = interval;
+            firstIntervalCount = lastIntervalCount = 1;
+        } else {
+            auto gap = std::max<int64_t>(0, micros-lastMicros);
+            gapSum += gap;
+            maxGap = std::max(maxGap, gap);
+            if (interval == lastInterval) {
+                ++lastIntervalCount;
+                if (oneRun) {
+                    ++firstIntervalCount;
+                }
+            } else {
+                if (!oneRun) {
+                    innerPeak = std::max(innerPeak, lastIntervalCount);
+                }
+                oneRun = false;
+                lastInterval = interval;
+                lastIntervalCount = 1;
+            }
+        }
+        lastMicros = micros;
+        ++count;
+        bytes += size;
+        maxSize = std::max<uint64_t>(maxSize, size);
+    }
+    //s follows this range in file order
+    void append(TopicStats const &s) {
+        if (s.count == 0) {
+            return;
+        }
+        if (count == 0) {
+            *this = s;
+            return;
+        }
+        auto gap = std::max<int64_t>(0, s.firstMicros-lastMicros);
+        gapSum += gap+s.gapSum;
+        maxGap = std::max({maxGap, gap, s.maxGap});
+        if (s.firstInterval == lastInterval) {
+            auto joined = lastIntervalCount+s.firstIntervalCount;
+            if (oneRun && s.oneRun) {
+                firstIntervalCount = lastIntervalCount = joined;
+            } else if (oneRun) {
+                firstIntervalCount = joined;
+                innerPeak = s.innerPeak;
+                lastInterval = s.lastInterval;
+                lastIntervalCount = s.lastIntervalCount;
+                oneRun = false;
+            } else if (s.oneRun) {
+                lastIntervalCount = joined;
+            } else {
+                innerPeak = std::max({innerPeak, joined, s.innerPeak});
+                lastInterval = s.lastInterval;
+                lastIntervalCount = s.lastIntervalCount;
+            }
+        } else {
+            if (!oneRun) {
+                innerPeak = std::max(innerPeak, lastIntervalCount);
+            }
+            if (!s.oneRun) {
+                innerPeak = std::max({innerPeak, s.firstIntervalCount, s.innerPeak});
+            }
+            lastInterval = s.lastInterval;
+            lastIntervalCount = s.lastIntervalCount;
+            oneRun = false;
+        }
+        lastMicros = s.lastMicros;
+        count += s.count;
+        bytes += s.bytes;
+        maxSize = std::max(maxSize, s.maxSize);
+    }
+    uint64_t peak() const {
+        return std::max({innerPeak, firstIntervalCount, lastIntervalCount});
+    }
+};
+
+struct RangeStats {
+    uint64_t beginOffset = 0;
+    //offset of the first record not in this range (where the next range
+    //must begin), or of the first bad record
+    uint64_t endOffset = 0;
+    bool broken = false;
+
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    int64_t firstMicros = 0;
+    int64_t lastMicros = 0;
+    uint64_t outOfOrder = 0;
+    latency_histogram::Histogram gaps;
+    //a burst is a run of records whose gaps are all within burstGap
+    uint64_t leadingRun = 0;
+    uint64_t trailingRun = 0;
+    int64_t trailingRunStart = 0;
+    uint64_t maxRun = 0;
+    int64_t maxRunStart = 0;
+    std::map<std::string, TopicStats, std::less<>> topics;
+    //interval -> (messages, bytes)
+    std::map<int64_t, std::pair<uint64_t, uint64_t>> intervals;
+};
+
+RangeStats scanRange(
+    indexed_capture_file::Reader const &reader
+    , uint64_t begin
+    , uint64_t end
+    , int64_t intervalMicros
+    , int64_t burstGapMicros
+) {
+    RangeStats ret;
+    ret.beginOffset = begin;
+    ret.endOffset = begin;
+    auto offset = begin;
+    bool inLeadingRun = true;
+    indexed_capture_file::RecordView rec;
+    while (offset < end && offset < reader.bodyEnd()) {
+        auto next = reader.recordAt(offset, rec);
+        if (!next) {
+            ret.broken = true;
+            break;
+        }
+        offset = *next;
+        if (!reader.hasIndex() && rec.topic == indexed_capture_file::IndexTopic) {
+            continue;
+        }
+        auto size = rec.topic.length()+rec.content.length();
+        auto interval = rec.micros/intervalMicros-((rec.micros%intervalMicros < 0) ? 1 : 0);
+        if (ret.count == 0) {
+            ret.firstMicros = rec.micros;
+            ret.trailingRun = 1;
+            ret.trailingRunStart = rec.micros;
+        } else {
+            auto gap = rec.micros-ret.lastMicros;
+            if (gap < 0) {
+                ++ret.outOfOrder;
+                gap = 0;
+            }
+            ret.gaps.record(gap);
+            if (gap <= burstGapMicros) {
+                ++ret.trailingRun;
+            } else {
+                inLeadingRun = false;
+                ret.trailingRun = 1;
+                ret.trailingRunStart = rec.micros;
+            }
+        }
+        if (inLeadingRun) {
+            ret.leadingRun = ret.trailingRun;
+        }
+        if (ret.trailingRun > ret.maxRun) {
+            ret.maxRun = ret.trailingRun;
+            ret.maxRunStart = ret.trailingRunStart;
+        }
+        ret.lastMicros = rec.micros;
+        ++ret.count;
+        ret.bytes += size;
+        auto iter = ret.topics.find(rec.topic);
+        if (iter == ret.topics.end()) {
+            iter = ret.topics.emplace(std::string {rec.topic}, TopicStats {}).first;
+        }
+        iter->second.add(rec.micros, interval, size);
+        auto &slot = ret.intervals[interval];
+        ++slot.first;
+        slot.second += size;
+    }
+    ret.endOffset = offset;
+    return ret;
+}
+
+//s follows total in file order
+void appendRange(RangeStats &total, RangeStats &&s, int64_t burstGapMicros) {
+    if (s.count > 0) {
+        if (total.count == 0) {
+            auto endOffset = s.endOffset;
+            auto broken = s.broken;
+            total = std::move(s);
+            total.endOffset = endOffset;
+            total.broken = broken;
+            return;
+        }
+        auto gap = s.firstMicros-total.lastMicros;
+        if (gap < 0) {
+            ++total.outOfOrder;
+            gap = 0;
+        }
+        total.gaps.record(gap);
+        total.gaps.merge(s.gaps);
+        total.outOfOrder += s.outOfOrder;
+        bool allOneRun = (s.leadingRun == s.count);
+        if (gap <= burstGapMicros) {
+            auto joined = total.trailingRun+s.leadingRun;
+            if (joined > total.maxRun) {
+                total.maxRun = joined;
+                total.maxRunStart = total.trailingRunStart;
+            }
+            if (total.leadingRun == total.count) {
+                total.leadingRun += s.leadingRun;
+            }
+            if (allOneRun) {
+                total.trailingRun = joined;
+            } else {
+                total.trailingRun = s.trailingRun;
+                total.trailingRunStart = s.trailingRunStart;
+            }
+        } else {
+            total.trailingRun = s.trailingRun;
+            total.trailingRunStart = s.trailingRunStart;
+        }
+        if (s.maxRun > total.maxRun) {
+            total.maxRun = s.maxRun;
+            total.maxRunStart = s.maxRunStart;
+        }
+        total.lastMicros = s.lastMicros;
+        total.count += s.count;
+        total.bytes += s.bytes;
+        for (auto const &t : s.topics) {
+            total.topics[t.first].append(t.second);
+        }
+        for (auto const &i : s.intervals) {
+            auto &slot = total.intervals[i.first];
+            slot.first += i.second.first;
+            slot.second += i.second.second;
+        }
+    }
+    total.endOffset = s.endOffset;
+    total.broken = s.broken;
+}
+
+std::string timeString(int64_t micros) {
+    std::time_t t = (std::time_t) (micros/1000000-((micros%1000000 < 0) ? 1 : 0));
+    std::tm tm;
+#ifdef _MSC_VER
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    std::ostringstream oss;
+    oss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%S")
+        << '.' << std::setw(6) << std::setfill('0') << ((micros%1000000+1000000)%1000000);
+    return oss.str();
+}
+
+int main(int argc, char **argv) {
+    options_description desc("allowed options");
+    desc.add_options()
+        ("help", "display help message")
+        ("input", value<std::string>(), "the capture file to inspect")
+        ("threads", value<unsigned>(), "number of scanning threads (default: hardware concurrency)")
+        ("intervalMillis", value<int64_t>(), "interval for the rate-over-time figures (default: 1000)")
+        ("burstGapMicros", value<int64_t>(), "records closer than this belong to the same burst (default: 1000)")
+        ("rateOutput", value<std::string>(), "write the per-interval message and byte counts to this CSV file")
+    ;
+    variables_map vm;
+    store(parse_command_line(argc, argv, desc), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << '\n';
+        return 0;
+    }
+    if (!vm.count("input")) {
+        std::cerr << "No input file given!\n";
+        return 1;
+    }
+    auto input = vm["input"].as<std::string>();
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    if (vm.count("threads")) {
+        threads = std::max(1u, vm["threads"].as<unsigned>());
+    }
+    int64_t intervalMicros = 1000000;
+    if (vm.count("intervalMillis")) {
+        if (vm["intervalMillis"].as<int64_t>() <= 0) {
+            std::cerr << "Interval must be positive!\n";
+            return 1;
+        }
+        intervalMicros = vm["intervalMillis"].as<int64_t>()*1000;
+    }
+    int64_t burstGapMicros = 1000;
+    if (vm.count("burstGapMicros")) {
+        burstGapMicros = std::max<int64_t>(0, vm["burstGapMicros"].as<int64_t>());
+    }
+
+    std::unique_ptr<indexed_capture_file::Reader> reader;
+    try {
+        reader = std::make_unique<indexed_capture_file::Reader>(input);
+    } catch (std::exception const &ex) {
+        std::cerr << "Cannot read '" << input << "': " << ex.what() << "\n";
+        return 1;
+    }
+
+    //Split points: the index blocks when there is an index (exact record
+    //boundaries), otherwise equal slices resynchronized on the record magic.
+    //Small files are not worth the threads.
+    auto bodyBegin = reader->bodyBegin();
+    auto bodyEnd = reader->bodyEnd();
+    std::vector<uint64_t> starts;
+    if (bodyEnd-bodyBegin < 16*1024*1024) {
+        threads = 1;
+    }
+    if (threads > 1 && reader->hasIndex()) {
+        auto const &blocks = reader->blocks();
+        for (unsigned ii=0; ii<threads; ++ii) {
+            auto b = (std::size_t) ((uint64_t) blocks.size()*ii/threads);
+            if (b < blocks.size() && (starts.empty() || blocks[b].offset > starts.back())) {
+                starts.push_back(blocks[b].offset);
+            }
+        }
+    } else {
+        for (unsigned ii=0; ii<threads; ++ii) {
+            starts.push_back(bodyBegin+(bodyEnd-bodyBegin)*ii/threads);
+        }
+    }
+    if (starts.empty()) {
+        starts.push_back(bodyBegin);
+    }
+    starts[0] = bodyBegin;
+    std::vector<RangeStats> ranges(starts.size());
+    {
+        std::vector<std::thread> workers;
+        for (std::size_t ii=0; ii<starts.size(); ++ii) {
+            workers.emplace_back([&,ii]() {
+                auto end = (ii+1 < starts.size()) ? starts[ii+1] : bodyEnd;
+                auto begin = reader->hasIndex() ? starts[ii] : reader->syncPoint(starts[ii]);
+                ranges[ii] = scanRange(*reader, begin, end, intervalMicros, burstGapMicros);
+            });
+        }
+        for (auto &w : workers) {
+            w.join();
+        }
+    }
+
+    //A range is only valid if it begins exactly where the previous one
+    //ended; a wrong resync (record magic inside some content) is redone
+    //sequentially from the right offset.
+    RangeStats total;
+    total.endOffset = bodyBegin;
+    uint64_t rescanned = 0;
+    for (std::size_t ii=0; ii<ranges.size(); ++ii) {
+        if (total.broken) {
+            break;
+        }
+        auto end = (ii+1 < starts.size()) ? starts[ii+1] : bodyEnd;
+        if (ranges[ii].beginOffset != total.endOffset) {
+            ++rescanned;
+            ranges[ii] = scanRange(*reader, total.endOffset, std::max(end, total.endOffset), intervalMicros, burstGapMicros);
+        }
+        appendRange(total, std::move(ranges[ii]), burstGapMicros);
+    }
+
+    auto span = (total.count > 1) ? (total.lastMicros-total.firstMicros)/1000000.0 : 0.0;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "File: " << input << " (" << reader->fileSize() << " bytes, " << (reader->hasIndex() ? "indexed" : "not indexed")
+        << ", scanned with " << ranges.size() << " threads";
+    if (rescanned > 0) {
+        std::cout << ", " << rescanned << " ranges rescanned";
+    }
+    std::cout << ")\n";
+    if (total.broken) {
+        std::cout << "Warning: no valid record at offset " << total.endOffset << ", the rest of the file is ignored\n";
+    }
+    if (total.count == 0) {
+        std::cout << "No records\n";
+        return 0;
+    }
+    std::cout << "Records: " << total.count << ", topic+content bytes: " << total.bytes << "\n";
+    std::cout << "First: " << timeString(total.firstMicros) << ", last: " << timeString(total.lastMicros) << ", span: " << span << "s\n";
+    if (total.outOfOrder > 0) {
+        std::cout << "Records with a timestamp before the previous record: " << total.outOfOrder << "\n";
+    }
+
+    latency_histogram::Histogram perInterval;
+    int64_t peakInterval = 0;
+    uint64_t peakCount = 0;
+    for (auto const &i : total.intervals) {
+        perInterval.record((int64_t) i.second.first);
+        if (i.second.first > peakCount) {
+            peakCount = i.second.first;
+            peakInterval = i.first;
+        }
+    }
+    //intervals without any record count as zero
+    auto allIntervals = total.intervals.rbegin()->first-total.intervals.begin()->first+1;
+    perInterval.record(0, (uint64_t) allIntervals-total.intervals.size());
+    auto intervalSeconds = intervalMicros/1000000.0;
+    std::cout << "Rate: average " << ((span > 0) ? total.count/span : 0.0) << " msgs/s, "
+        << ((span > 0) ? total.bytes/span : 0.0) << " bytes/s\n";
+    std::cout << "Messages per " << intervalMicros/1000 << "ms interval (" << allIntervals << " intervals):"
+        << " p50=" << perInterval.valueAtPercentile(50)
+        << " p90=" << perInterval.valueAtPercentile(90)
+        << " p99=" << perInterval.valueAtPercentile(99)
+        << " p99.9=" << perInterval.valueAtPercentile(99.9)
+        << " max=" << peakCount << " (" << peakCount/intervalSeconds << " msgs/s at " << timeString(peakInterval*intervalMicros) << ")\n";
+    std::cout << "Inter-arrival gaps (micros):"
+        << " p50=" << total.gaps.valueAtPercentile(50)
+        << " p90=" << total.gaps.valueAtPercentile(90)
+        << " p99=" << total.gaps.valueAtPercentile(99)
+        << " p99.9=" << total.gaps.valueAtPercentile(99.9)
+        << " p99.99=" << total.gaps.valueAtPercentile(99.99)
+        << " max=" << total.gaps.max() << "\n";
+    std::cout << "Max burst (gaps <= " << burstGapMicros << " micros): " << total.maxRun << " messages starting at " << timeString(total.maxRunStart) << "\n";
+
+    std::vector<std::pair<std::string const *, TopicStats const *>> topics;
+    for (auto const &t : total.topics) {
+        topics.push_back({&t.first, &t.second});
+    }
+    std::sort(topics.begin(), topics.end(), [](auto const &a, auto const &b) {
+        return a.second->bytes > b.second->bytes;
+    });
+    std::cout << "\ntopic,messages,bytes,avg size,max size,avg msgs/s,peak msgs/s,mean gap micros,max gap micros\n";
+    for (auto const &t : topics) {
+        auto const &s = *(t.second);
+        std::cout << *(t.first)
+            << ',' << s.count
+            << ',' << s.bytes
+            << ',' << 1.0*s.bytes/s.count
+            << ',' << s.maxSize
+            << ',' << ((span > 0) ? s.count/span : 0.0)
+            << ',' << s.peak()/intervalSeconds
+            << ',' << ((s.count > 1) ? 1.0*s.gapSum/(s.count-1) : 0.0)
+            << ',' << s.maxGap
+            << '\n';
+    }
+
+    if (vm.count("rateOutput")) {
+        std::ofstream ofs(vm["rateOutput"].as<std::string>());
+        if (!ofs) {
+            std::cerr << "Cannot open '" << vm["rateOutput"].as<std::string>() << "' for writing!\n";
+            return 1;
+        }
+        ofs << "interval start,messages,bytes\n";
+        for (auto const &i : total.intervals) {
+            ofs << timeString(i.first*intervalMicros) << ',' << i.second.first << ',' << i.second.second << '\n';
+        }
+    }
+    return 0;
+}
@@ -13,6 +13,10 @@
 #include <tm_kit/transport/BoostUUIDComponent.hpp>
 #include <tm_kit/transport/MultiTransportBroadcastListenerManagingUtils.hpp>
 
+#include "IndexedCaptureFile.hpp"
+#include "ShardedCaptureWriter.hpp"
+#include "BatchFrame.hpp"
+
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string.hpp>
 
@@ -30,6 +34,11 @@ int main(int argc, char **argv) {
         ("address", value<std::string>(), "the address to listen on, with protocol info")
         ("summaryPeriod", value<int>(), "print summary every this number of seconds")
         ("output", value<std::string>(), "output to this file")
+        ("indexed", "append a time/topic index to the output file when the capture ends, so that tm_historical_republisher can seek into it (the file stays readable by all other capture file readers)")
+        ("indexBlockRecords", value<uint32_t>(), "with --indexed, number of records per index block (default: 4096)")
+        ("shards", value<unsigned>(), "hash topics to this many writer threads, each writing its own file OUTPUT.0, OUTPUT.1, ...; merge them with tm_capture_merger")
+        ("directIO", "with --shards, write with O_DIRECT where supported")
+        ("incomingBatched", "the incoming messages are batch frames (from tm_relayer with batch=...), capture the original messages with their original timestamps")
     ;
     variables_map vm;
     store(parse_command_line(argc, argv, desc), vm);
@@ -75,7 +84,47 @@ int main(int argc, char **argv) {
     TheEnvironment env;
     R r(&env);
 
-    std::ofstream ofs(vm["output"].as<std::string>(), std::ios::binary);
+    bool indexed = vm.count("indexed");
+    uint32_t indexBlockRecords = 4096;
+    if (vm.count("indexBlockRecords")) {
+        indexBlockRecords = vm["indexBlockRecords"].as<uint32_t>();
+        if (indexBlockRecords == 0) {
+            std::cerr << "Index block records cannot be zero!\n";
+            return 1;
+        }
+    }
+
+    unsigned shards = 0;
+    if (vm.count("shards")) {
+        shards = vm["shards"].as<unsigned>();
+        if (shards == 0) {
+            std::cerr << "Shards cannot be zero!\n";
+            return 1;
+        }
+        if (indexed) {
+            std::cerr << "Sharded output cannot be indexed, index the merged file with tm_capture_merger --indexed instead!\n";
+            return 1;
+        }
+    }
+
+    bool incomingBatched = vm.count("incomingBatched");
+
+    std::ofstream ofs;
+    std::shared_ptr<indexed_capture_file::Writer> indexedWriter;
+    std::shared_ptr<sharded_capture::Writer> shardedWriter;
+    if (shards > 0) {
+        shardedWriter = std::make_shared<sharded_capture::Writer>(
+            vm["output"].as<std::string>(), shards, vm.count("directIO")
+        );
+    } else if (indexed || incomingBatched) {
+        //the plain exporter can only stamp records with their arrival time,
+        //so batched input always goes through our own writer
+        indexedWriter = std::make_shared<indexed_capture_file::Writer>(
+            vm["output"].as<std::string>(), indexBlockRecords, 4*1024*1024, indexed
+        );
+    } else {
+        ofs.open(vm["output"].as<std::string>(), std::ios::binary);
+    }
 
     {
         auto dataSource = transport::MultiTransportBroadcastListenerManagingUtils<R>
@@ -86,17 +135,58 @@ int main(int argc, char **argv) {
                 , topic
             );
 
-        auto fileWriter =
-            basic::ByteDataWithTopicRecordFileImporterExporter<M>
-            ::createExporter<basic::ByteDataWithTopicRecordFileFormat<std::chrono::microseconds>>(
-                ofs
-                , {(std::byte) 0x01,(std::byte) 0x23,(std::byte) 0x45,(std::byte) 0x67}
-                , {(std::byte) 0x76,(std::byte) 0x54,(std::byte) 0x32,(std::byte) 0x10}
-                , true //separate thread
+        if (shardedWriter || indexedWriter) {
+            //with shards, the listener thread only hashes and enqueues, the
+            //shard threads do the serialization and the writing
+            auto write = [shardedWriter,indexedWriter](std::chrono::system_clock::time_point const &tp, std::string &&topic, std::string &&content, bool isFinal) {
+                if (shardedWriter) {
+                    shardedWriter->write(tp, std::move(topic), std::move(content), isFinal);
+                } else {
+                    indexedWriter->write(tp, topic, content, isFinal);
+                }
+            };
+            auto fileWriter = M::simpleExporter<basic::ByteDataWithTopic>(
+                [write,incomingBatched](M::InnerData<basic::ByteDataWithTopic> &&data) {
+                    if (incomingBatched) {
+                        bool good = batch_frame::decode(
+                            data.timedData.value.content
+                            , [&write](int64_t micros, std::string_view topic, std::string_view content) {
+                                write(
+                                    indexed_capture_file::fromMicros(micros)
+                                    , std::string {topic}
+                                    , std::string {content}
+                                    , false
+                                );
+                            }
+                        );
+                        if (!good) {
+                            data.environment->log(infra::LogLevel::Warning, "Got an undecodable batch frame on topic '"+data.timedData.value.topic+"'");
+                        }
+                    } else {
+                        write(
+                            data.timedData.timePoint
+                            , std::move(data.timedData.value.topic)
+                            , std::move(data.timedData.value.content)
+                            , data.timedData.finalFlag
+                        );
+                    }
+                }
             );
+            r.exportItem("fileWriter", fileWriter, 
+               dataSource.clone());
+        } else {
+            auto fileWriter =
+                basic::ByteDataWithTopicRecordFileImporterExporter<M>
+                ::createExporter<basic::ByteDataWithTopicRecordFileFormat<std::chrono::microseconds>>(
+                    ofs
+                    , {(std::byte) 0x01,(std::byte) 0x23,(std::byte) 0x45,(std::byte) 0x67}
+                    , {(std::byte) 0x76,(std::byte) 0x54,(std::byte) 0x32,(std::byte) 0x10}
+                    , true //separate thread
+                );
 
-        r.exportItem("fileWriter", fileWriter, 
-           dataSource.clone());
+            r.exportItem("fileWriter", fileWriter, 
+               dataSource.clone());
+        }
 
         if (summaryPeriod) {
             auto counter = M::liftPure<basic::ByteDataWithTopic>(
@@ -140,5 +230,15 @@ int main(int argc, char **argv) {
 
     infra::terminationController(infra::TerminateAfterDuration {std::chrono::hours(24)});
 
-    ofs.close();
+    if (shardedWriter) {
+        shardedWriter->close();
+        if (shardedWriter->failedShards() > 0) {
+            std::cerr << shardedWriter->failedShards() << " capture shard(s) could not be written completely, " << shardedWriter->droppedBytes() << " bytes dropped\n";
+            return 1;
+        }
+    } else if (indexedWriter) {
+        indexedWriter->close();
+    } else {
+        ofs.close();
+    }
 }
\ No newline at end of file
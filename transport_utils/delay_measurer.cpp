@@ -13,15 +13,25 @@
 #include <tm_kit/transport/MultiTransportBroadcastListenerManagingUtils.hpp>
 #include <tm_kit/transport/MultiTransportBroadcastPublisherManagingUtils.hpp>
 
+#include "LatencyHistogram.hpp"
+
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <set>
 
 using namespace dev::cd606::tm;
 using namespace boost::program_options;
 
 enum class Mode {
     Sender,
-    Receiver
+    Receiver,
+    SweepSender,
+    SweepReceiver
 };
 
 using TheEnvironment = infra::Environment<
@@ -36,6 +46,17 @@ using TheEnvironment = infra::Environment<
 using M = infra::RealTimeApp<TheEnvironment>;
 using R = infra::AppRunner<M>;
 using SendDataType = basic::CBOR<std::tuple<uint64_t, int64_t, basic::ByteData>>;
+//(step, sequence in step, send time micros, total sent in step, payload)
+//the total sent field is 0 except in the end-of-step marker, which has
+//an empty payload
+using SweepDataType = basic::CBOR<std::tuple<uint32_t, uint64_t, int64_t, uint64_t, basic::ByteData>>;
+//(step, received, missed, receive span micros, mean delay, p50, p90, p99, p99.9, max delay)
+using SweepReportType = basic::CBOR<std::tuple<uint32_t, uint64_t, uint64_t, int64_t, double, int64_t, int64_t, int64_t, int64_t, int64_t>>;
+
+struct SweepStep {
+    uint64_t rate;
+    unsigned bytes;
+};
 
 void runSender(unsigned interval, unsigned bytes, std::string const &address, std::optional<unsigned> summaryPeriod) {
     TheEnvironment env;
@@ -98,7 +119,7 @@ void runSender(unsigned interval, unsigned bytes, std::string const &address, st
     infra::terminationController(infra::RunForever {&env});
 }
 
-void runReceiver(std::string const &address, std::optional<unsigned> summaryPeriod) {
+void runReceiver(std::string const &address, std::optional<unsigned> summaryPeriod, std::optional<std::string> const &histogramFile) {
     TheEnvironment env;
     R r (&env);
 
@@ -110,42 +131,44 @@ void runReceiver(std::string const &address, std::optional<unsigned> summaryPeri
             , "test.data"
         );
 
-    struct Stats {
-        uint64_t count = 0;
-        double totalDelay = 0.0;
-        double totalDelaySq = 0.0;
-        uint64_t minID = 0;
-        uint64_t maxID = 0;
-        int64_t minDelay = std::numeric_limits<int64_t>::min();
-        int64_t maxDelay = 0;
+    //Delays go into a lock-free HDR-style histogram recorder; the summary
+    //clock drains it into an interval histogram and folds that into the
+    //cumulative one. Sequence tracking is only touched by the calcStats
+    //thread, the atomics just let the summary thread read it.
+    struct SequenceStats {
+        std::atomic<uint64_t> count = 0;
+        std::atomic<uint64_t> minID = 0;
+        std::atomic<uint64_t> maxID = 0;
+        std::atomic<uint64_t> gaps = 0;
+        std::atomic<uint64_t> reordered = 0;
     };
-    Stats stats;
-    std::mutex statsMutex;
+    latency_histogram::Recorder delayRecorder;
+    SequenceStats seqStats;
+    latency_histogram::Histogram cumulativeDelays;
    
     auto calcStats =
         M::pureExporter<SendDataType>(
-            [&env,&stats,&statsMutex](SendDataType &&data) {
+            [&env,&delayRecorder,&seqStats](SendDataType &&data) {
                 auto now = infra::withtime_utils::sinceEpoch<std::chrono::microseconds>(env.now());
                 auto delay = now-std::get<1>(data.value);
                 auto id = std::get<0>(data.value);
-                {
-                    std::lock_guard<std::mutex> _(statsMutex);
-                    ++stats.count;
-                    stats.totalDelay += 1.0*delay;
-                    stats.totalDelaySq += 1.0*delay*delay;
-                    if (stats.minID == 0 || id < stats.minID) {
-                        stats.minID = id;
-                    }
-                    if (id > stats.maxID) {
-                        stats.maxID = id;
+                delayRecorder.record(delay);
+                auto maxID = seqStats.maxID.load(std::memory_order_relaxed);
+                if (seqStats.count.load(std::memory_order_relaxed) == 0) {
+                    seqStats.minID.store(id, std::memory_order_relaxed);
+                    seqStats.maxID.store(id, std::memory_order_relaxed);
+                } else if (id > maxID) {
+                    if (id > maxID+1) {
+                        seqStats.gaps.fetch_add(1, std::memory_order_relaxed);
                     }
-                    if (stats.minDelay > delay || stats.minDelay == std::numeric_limits<int64_t>::min()) {
-                        stats.minDelay = delay;
-                    }
-                    if (stats.maxDelay < delay) {
-                        stats.maxDelay = delay;
+                    seqStats.maxID.store(id, std::memory_order_relaxed);
+                } else {
+                    if (id < seqStats.minID.load(std::memory_order_relaxed)) {
+                        seqStats.minID.store(id, std::memory_order_relaxed);
                     }
+                    seqStats.reordered.fetch_add(1, std::memory_order_relaxed);
                 }
+                seqStats.count.fetch_add(1, std::memory_order_release);
             }
         );
 
@@ -161,18 +184,39 @@ void runReceiver(std::string const &address, std::optional<unsigned> summaryPeri
                 , basic::VoidStruct {}
             );
         auto perSummaryClockUpdate = M::pureExporter<basic::VoidStruct>(
-            [&env,&stats,&statsMutex](basic::VoidStruct &&clockData) {
-                double mean, sd;
-                uint64_t missed;
-                {
-                    std::lock_guard<std::mutex> _(statsMutex);
-                    mean = (stats.count > 0) ? (stats.totalDelay/stats.count) : 0.0;
-                    sd = (stats.count > 1) ? std::sqrt((stats.totalDelaySq-mean*mean*stats.count)/(stats.count-1)) : 0.0;
-                    missed = (stats.count > 0) ? (stats.maxID-stats.minID+1-stats.count) : 0;
+            [&env,&delayRecorder,&seqStats,&cumulativeDelays,histogramFile](basic::VoidStruct &&clockData) {
+                latency_histogram::Histogram interval;
+                delayRecorder.collect(interval, true);
+                cumulativeDelays.merge(interval);
+
+                auto count = seqStats.count.load(std::memory_order_acquire);
+                uint64_t missed = 0;
+                if (count > 0) {
+                    auto span = seqStats.maxID.load(std::memory_order_relaxed)-seqStats.minID.load(std::memory_order_relaxed)+1;
+                    missed = (span > count) ? (span-count) : 0;
                 }
                 std::ostringstream oss;
-                oss << "Got " << stats.count << " messages, mean delay " << mean << " micros, std delay " << sd << " micros, missed " << missed << " messages, min delay " << stats.minDelay << " micros, max delay " << stats.maxDelay << " micros";
+                oss << "Got " << count << " messages (" << interval.totalCount() << " in last period)"
+                    << ", delay micros: mean " << interval.mean()
+                    << " min " << interval.min()
+                    << " p50 " << interval.valueAtPercentile(50.0)
+                    << " p90 " << interval.valueAtPercentile(90.0)
+                    << " p99 " << interval.valueAtPercentile(99.0)
+                    << " p99.9 " << interval.valueAtPercentile(99.9)
+                    << " p99.99 " << interval.valueAtPercentile(99.99)
+                    << " max " << interval.max()
+                    << "; overall p99 " << cumulativeDelays.valueAtPercentile(99.0)
+                    << " p99.99 " << cumulativeDelays.valueAtPercentile(99.99)
+                    << " max " << cumulativeDelays.max()
+                    << "; missed " << missed << " messages"
+                    << ", " << seqStats.gaps.load(std::memory_order_relaxed) << " gaps"
+                    << ", " << seqStats.reordered.load(std::memory_order_relaxed) << " out-of-order";
                 env.log(infra::LogLevel::Info, oss.str());
+
+                if (histogramFile) {
+                    std::ofstream ofs(*histogramFile);
+                    cumulativeDelays.writePercentileDistribution(ofs);
+                }
             }
         );
         r.exportItem("perSummaryClockUpdate", perSummaryClockUpdate, r.importItem("summaryClockImporter", summaryClockImporter));
@@ -181,15 +225,279 @@ void runReceiver(std::string const &address, std::optional<unsigned> summaryPeri
 
     infra::terminationController(infra::RunForever {&env});
 }
+//The sweep sender walks through every (rate, bytes) combination for
+//stepSeconds each. Messages are sent in batches (at most ~10000 batches
+//per second), and each batch is paced against a steady clock, so rates
+//are not limited by millisecond timer granularity. After each step an
+//end-of-step marker is sent, the receiver answers on reportAddress with
+//its view of the step, and at the end the sender prints (and optionally
+//appends to a CSV file) the throughput-vs-latency curve for this address.
+void runSweepSender(std::string const &address, std::string const &reportAddress, std::vector<SweepStep> const &steps, unsigned stepSeconds, std::optional<std::string> const &outputFile) {
+    TheEnvironment env;
+    R r (&env);
+
+    struct StepResult {
+        SweepStep step;
+        uint64_t sent = 0;
+        double sendSeconds = 0.0;
+        std::optional<SweepReportType> report = std::nullopt;
+    };
+    struct SharedState {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<StepResult> results;
+        std::size_t reportsReceived = 0;
+        bool sendingDone = false;
+    };
+    auto state = std::make_shared<SharedState>();
+    for (auto const &s : steps) {
+        state->results.push_back(StepResult {s});
+    }
+    r.preservePointer(state);
+
+    auto reportSource = transport::MultiTransportBroadcastListenerManagingUtils<R>
+        ::oneBroadcastListener<SweepReportType>(
+            r
+            , "report source"
+            , reportAddress
+            , "test.sweep.report"
+        );
+    auto collectReport = M::pureExporter<SweepReportType>(
+        [state](SweepReportType &&report) {
+            auto step = std::get<0>(report.value);
+            std::lock_guard<std::mutex> _(state->mutex);
+            if (step < state->results.size() && !state->results[step].report) {
+                state->results[step].report = std::move(report);
+                ++(state->reportsReceived);
+                state->cond.notify_one();
+            }
+        }
+    );
+    r.exportItem("collectReport", collectReport, std::move(reportSource));
+
+    auto sweeper = M::simpleImporter<basic::TypedDataWithTopic<SweepDataType>>(
+        [&env,state,stepSeconds](M::PublisherCall<basic::TypedDataWithTopic<SweepDataType>> &pub) {
+            //give the listeners time to connect
+            std::this_thread::sleep_for(std::chrono::seconds(2));
+            for (uint32_t stepIdx=0; stepIdx<state->results.size(); ++stepIdx) {
+                auto const step = state->results[stepIdx].step;
+                const basic::ByteData payload { std::string(step.bytes, ' ') };
+                uint64_t batch = std::max<uint64_t>(1, step.rate/10000);
+                auto batchPeriod = std::chrono::nanoseconds(1000000000ULL*batch/step.rate);
+                uint64_t total = step.rate*stepSeconds;
+                uint64_t seq = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (uint64_t batchIdx=0; seq<total; ++batchIdx) {
+                    auto target = start+batchIdx*batchPeriod;
+                    auto now = std::chrono::steady_clock::now();
+                    //sleeping is only accurate to tens of micros, spin the rest
+                    if (target-now > std::chrono::microseconds(100)) {
+                        std::this_thread::sleep_until(target-std::chrono::microseconds(50));
+                    }
+                    while (std::chrono::steady_clock::now() < target) {
+                    }
+                    auto sendTime = infra::withtime_utils::sinceEpoch<std::chrono::microseconds>(env.now());
+                    for (uint64_t ii=0; ii<batch && seq<total; ++ii) {
+                        pub(basic::TypedDataWithTopic<SweepDataType> {
+                            "test.sweep"
+                            , { {stepIdx, ++seq, sendTime, 0, payload} }
+                        });
+                    }
+                }
+                auto sendSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+                {
+                    std::lock_guard<std::mutex> _(state->mutex);
+                    state->results[stepIdx].sent = seq;
+                    state->results[stepIdx].sendSeconds = sendSeconds;
+                }
+                std::ostringstream oss;
+                oss << "Step " << stepIdx << ": sent " << seq << " messages of " << step.bytes << " bytes in " << sendSeconds << " seconds (requested " << step.rate << " msg/s, achieved " << (sendSeconds > 0 ? seq/sendSeconds : 0.0) << " msg/s)";
+                env.log(infra::LogLevel::Info, oss.str());
+                //let the pipeline drain, then mark the end of the step (a few
+                //times, since some transports are lossy)
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                for (int ii=0; ii<3; ++ii) {
+                    pub(basic::TypedDataWithTopic<SweepDataType> {
+                        "test.sweep"
+                        , { {stepIdx, 0, 0, seq, basic::ByteData {}} }
+                    });
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+            }
+            std::lock_guard<std::mutex> _(state->mutex);
+            state->sendingDone = true;
+            state->cond.notify_one();
+        }
+        , infra::LiftParameters<std::chrono::system_clock::time_point>()
+            .SuggestThreaded(true)
+    );
+    auto dataSink =
+        transport::MultiTransportBroadcastPublisherManagingUtils<R>
+            ::oneBroadcastPublisher<SweepDataType>
+            (
+                r, "data sink", address
+            );
+    r.connect(r.importItem("sweeper", sweeper), dataSink);
+
+    r.finalize();
+
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cond.wait(lock, [state]() {
+            return state->sendingDone;
+        });
+        state->cond.wait_for(lock, std::chrono::seconds(10), [state]() {
+            return state->reportsReceived == state->results.size();
+        });
+    }
+
+    std::ostringstream table;
+    table << "address,requested_rate,bytes,sent,send_rate,received,missed,receive_rate,mean_delay_us,p50_us,p90_us,p99_us,p99_9_us,max_us\n";
+    {
+        std::lock_guard<std::mutex> _(state->mutex);
+        for (auto const &res : state->results) {
+            table << address << ',' << res.step.rate << ',' << res.step.bytes << ','
+                << res.sent << ',' << (res.sendSeconds > 0 ? res.sent/res.sendSeconds : 0.0) << ',';
+            if (res.report) {
+                auto const &v = res.report->value;
+                auto spanMicros = std::get<3>(v);
+                table << std::get<1>(v) << ',' << std::get<2>(v) << ','
+                    << (spanMicros > 0 ? std::get<1>(v)*1000000.0/spanMicros : 0.0) << ','
+                    << std::get<4>(v) << ',' << std::get<5>(v) << ',' << std::get<6>(v) << ','
+                    << std::get<7>(v) << ',' << std::get<8>(v) << ',' << std::get<9>(v) << '\n';
+            } else {
+                table << ",,,,,,,,\n";
+            }
+        }
+    }
+    std::cout << table.str();
+    if (outputFile) {
+        std::ofstream ofs(*outputFile, std::ios::app);
+        ofs << table.str();
+    }
+    env.exit();
+}
+
+void runSweepReceiver(std::string const &address, std::string const &reportAddress) {
+    TheEnvironment env;
+    R r (&env);
+
+    auto dataSource = transport::MultiTransportBroadcastListenerManagingUtils<R>
+        ::oneBroadcastListener<SweepDataType>(
+            r 
+            , "data source"
+            , address 
+            , "test.sweep"
+        );
+
+    //only touched from the measure thread
+    struct StepStats {
+        latency_histogram::Histogram delays;
+        uint64_t minSeq = std::numeric_limits<uint64_t>::max();
+        uint64_t maxSeq = 0;
+        int64_t firstRecv = 0;
+        int64_t lastRecv = 0;
+    };
+    std::map<uint32_t, StepStats> steps;
+    std::set<uint32_t> reportedSteps;
+
+    auto measure = M::liftMaybe<SweepDataType>(
+        [&env,&steps,&reportedSteps](SweepDataType &&data) -> std::optional<basic::TypedDataWithTopic<SweepReportType>> {
+            auto now = infra::withtime_utils::sinceEpoch<std::chrono::microseconds>(env.now());
+            auto const &v = data.value;
+            auto stepIdx = std::get<0>(v);
+            if (reportedSteps.find(stepIdx) != reportedSteps.end()) {
+                return std::nullopt;
+            }
+            auto &st = steps[stepIdx];
+            auto sentInStep = std::get<3>(v);
+            if (sentInStep == 0) {
+                auto seq = std::get<1>(v);
+                st.delays.record(now-std::get<2>(v));
+                st.minSeq = std::min(st.minSeq, seq);
+                st.maxSeq = std::max(st.maxSeq, seq);
+                if (st.delays.totalCount() == 1) {
+                    st.firstRecv = now;
+                }
+                st.lastRecv = now;
+                return std::nullopt;
+            }
+            auto received = st.delays.totalCount();
+            SweepReportType report { {
+                stepIdx
+                , received
+                , (sentInStep > received) ? (sentInStep-received) : 0
+                , st.lastRecv-st.firstRecv
+                , st.delays.mean()
+                , st.delays.valueAtPercentile(50.0)
+                , st.delays.valueAtPercentile(90.0)
+                , st.delays.valueAtPercentile(99.0)
+                , st.delays.valueAtPercentile(99.9)
+                , st.delays.max()
+            } };
+            std::ostringstream oss;
+            oss << "Step " << stepIdx << ": got " << received << " of " << sentInStep << " messages"
+                << ", delay micros: mean " << st.delays.mean()
+                << " p50 " << st.delays.valueAtPercentile(50.0)
+                << " p99 " << st.delays.valueAtPercentile(99.0)
+                << " p99.9 " << st.delays.valueAtPercentile(99.9)
+                << " max " << st.delays.max();
+            env.log(infra::LogLevel::Info, oss.str());
+            reportedSteps.insert(stepIdx);
+            steps.erase(stepIdx);
+            return basic::TypedDataWithTopic<SweepReportType> {
+                "test.sweep.report"
+                , std::move(report)
+            };
+        }
+    );
+    auto reportSink =
+        transport::MultiTransportBroadcastPublisherManagingUtils<R>
+            ::oneBroadcastPublisher<SweepReportType>
+            (
+                r, "report sink", reportAddress
+            );
+    r.connect(r.execute("measure", measure, dataSource.clone()), reportSink);
+
+    r.finalize();
+
+    infra::terminationController(infra::RunForever {&env});
+}
+
+template <class T>
+std::optional<std::vector<T>> parseNumberList(std::string const &s) {
+    std::vector<std::string> parts;
+    boost::split(parts, s, boost::is_any_of(","));
+    std::vector<T> ret;
+    try {
+        for (auto const &p : parts) {
+            auto x = boost::lexical_cast<T>(boost::trim_copy(p));
+            if (x == 0) {
+                return std::nullopt;
+            }
+            ret.push_back(x);
+        }
+    } catch (boost::bad_lexical_cast const &) {
+        return std::nullopt;
+    }
+    return ret;
+}
+
 int main(int argc, char **argv) {
     options_description desc("allowed options");
     desc.add_options()
         ("help", "display help message")
-        ("mode", value<std::string>(), "sender or receiver")
+        ("mode", value<std::string>(), "sender, receiver, sweepSender or sweepReceiver")
         ("interval", value<unsigned>(), "interval time in milliseconds")
         ("bytes", value<unsigned>(), "bytes per message sent")
         ("address", value<std::string>(), "the address for measuring data, with protocol info")
         ("summaryPeriod", value<unsigned>(), "print summary every this number of seconds")
+        ("histogramFile", value<std::string>(), "for receiver, rewrite the overall delay percentile distribution (HdrHistogram .hgrm text layout) to this file at every summary")
+        ("reportAddress", value<std::string>(), "for sweep modes, the address on which the sweep receiver reports each step back to the sweep sender, with protocol info")
+        ("sweepRates", value<std::string>(), "for sweepSender, comma-separated message rates per second (default: 1000,10000,50000,100000,200000,500000,1000000,2000000)")
+        ("sweepBytes", value<std::string>(), "for sweepSender, comma-separated payload sizes (default: 64,1024)")
+        ("stepSeconds", value<unsigned>(), "for sweepSender, seconds per sweep step (default: 5)")
+        ("sweepOutput", value<std::string>(), "for sweepSender, append the resulting curve as CSV to this file")
     ;
     variables_map vm;
     store(parse_command_line(argc, argv, desc), vm);
@@ -209,8 +517,12 @@ int main(int argc, char **argv) {
         mode = Mode::Sender;
     } else if (modeStr == "receiver") {
         mode = Mode::Receiver;
+    } else if (modeStr == "sweepSender") {
+        mode = Mode::SweepSender;
+    } else if (modeStr == "sweepReceiver") {
+        mode = Mode::SweepReceiver;
     } else {
-        std::cerr << "Wrong mode '" << modeStr << "', must be sender or receiver!\n";
+        std::cerr << "Wrong mode '" << modeStr << "', must be sender, receiver, sweepSender or sweepReceiver!\n";
         return 1;
     }
     unsigned interval = 0, bytes = 0;
@@ -235,10 +547,60 @@ int main(int argc, char **argv) {
     }
     auto address = vm["address"].as<std::string>();
 
+    if (mode == Mode::SweepSender || mode == Mode::SweepReceiver) {
+        if (!vm.count("reportAddress")) {
+            std::cerr << "No report address given for sweep mode!\n";
+            return 1;
+        }
+        auto reportAddress = vm["reportAddress"].as<std::string>();
+        if (mode == Mode::SweepReceiver) {
+            runSweepReceiver(address, reportAddress);
+            return 0;
+        }
+        auto rates = parseNumberList<uint64_t>(
+            vm.count("sweepRates") ? vm["sweepRates"].as<std::string>() : std::string {"1000,10000,50000,100000,200000,500000,1000000,2000000"}
+        );
+        if (!rates) {
+            std::cerr << "Sweep rates must be a comma-separated list of positive numbers!\n";
+            return 1;
+        }
+        auto sizes = parseNumberList<unsigned>(
+            vm.count("sweepBytes") ? vm["sweepBytes"].as<std::string>() : std::string {"64,1024"}
+        );
+        if (!sizes) {
+            std::cerr << "Sweep bytes must be a comma-separated list of positive numbers!\n";
+            return 1;
+        }
+        unsigned stepSeconds = 5;
+        if (vm.count("stepSeconds")) {
+            stepSeconds = vm["stepSeconds"].as<unsigned>();
+            if (stepSeconds == 0) {
+                std::cerr << "Step seconds cannot be zero!\n";
+                return 1;
+            }
+        }
+        std::optional<std::string> sweepOutput = std::nullopt;
+        if (vm.count("sweepOutput")) {
+            sweepOutput = vm["sweepOutput"].as<std::string>();
+        }
+        std::vector<SweepStep> steps;
+        for (auto b : *sizes) {
+            for (auto rate : *rates) {
+                steps.push_back(SweepStep {rate, b});
+            }
+        }
+        runSweepSender(address, reportAddress, steps, stepSeconds, sweepOutput);
+        return 0;
+    }
+
     std::optional<unsigned> summaryPeriod = std::nullopt;
     if (vm.count("summaryPeriod")) {
         summaryPeriod = vm["summaryPeriod"].as<unsigned>();
     }
+    std::optional<std::string> histogramFile = std::nullopt;
+    if (vm.count("histogramFile")) {
+        histogramFile = vm["histogramFile"].as<std::string>();
+    }
     if (mode == Mode::Receiver && !summaryPeriod) {
         std::cerr << "No summary period given for receiver!\n";
         return 1;
@@ -247,6 +609,6 @@ int main(int argc, char **argv) {
     if (mode == Mode::Sender) {
         runSender(interval, bytes, address, summaryPeriod);
     } else {
-        runReceiver(address, summaryPeriod);
+        runReceiver(address, summaryPeriod, histogramFile);
     }
 }
\ No newline at end of file
@@ -16,6 +16,9 @@
 #include <tm_kit/transport/BoostUUIDComponent.hpp>
 #include <tm_kit/transport/MultiTransportBroadcastPublisherManagingUtils.hpp>
 
+#include "IndexedCaptureFile.hpp"
+#include "ReplayRing.hpp"
+
 #include <boost/program_options.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
@@ -24,6 +27,9 @@
 #include <iomanip>
 #include <fstream>
 #include <sstream>
+#include <unordered_set>
+#include <filesystem>
+#include <algorithm>
 
 using namespace dev::cd606::tm;
 using namespace boost::program_options;
@@ -31,6 +37,12 @@ using namespace boost::program_options;
 struct HMS {int hour; int min; int sec;};
 struct HM {int hour; int min;};
 
+enum class ReplayMode {
+    RealTime
+    , AsFastAsPossible
+    , BurstPreserving
+};
+
 struct ReplayParameter {
     std::string inputFile;
     std::string address;
@@ -38,8 +50,61 @@ struct ReplayParameter {
     HMS calibratePointHistorical;
     std::variant<int, HM> calibratePointActual;
     bool overrideDate;
+    //the following are only honored when the input is read through
+    //the memory-mapped reader, times are in the file's own time
+    std::shared_ptr<indexed_capture_file::Reader> mappedInput;
+    std::optional<std::chrono::system_clock::time_point> startTime;
+    std::optional<std::chrono::system_clock::time_point> endTime;
+    std::optional<std::unordered_set<std::string>> topics;
+    //the fast modes ignore the calibrate points and always go through
+    //the memory-mapped reader
+    ReplayMode mode;
+    std::chrono::microseconds burstGap;
+    std::size_t ringSize;
+    //with several inputs, all of them are memory-mapped and replayed
+    //merged by record time, input ii is published on mergedAddresses[ii]
+    std::vector<std::shared_ptr<indexed_capture_file::Reader>> mergedInputs;
+    std::vector<std::string> mergedAddresses;
+};
+
+//one record of a merged replay, tagged with the input it came from
+struct StreamMessage {
+    std::size_t stream;
+    std::shared_ptr<basic::ByteDataWithTopic> data;
 };
 
+std::optional<HMS> parseHMS(std::string const &s) {
+    if ((s.length() != 5 && s.length() != 8) || s[2] != ':' || (s.length() == 8 && s[5] != ':')) {
+        return std::nullopt;
+    }
+    HMS ret {0, 0, 0};
+    try {
+        ret.hour = boost::lexical_cast<int>(s.substr(0,2));
+        ret.min = boost::lexical_cast<int>(s.substr(3,2));
+        if (s.length() == 8) {
+            ret.sec = boost::lexical_cast<int>(s.substr(6,2));
+        }
+    } catch (boost::bad_lexical_cast const &) {
+        return std::nullopt;
+    }
+    if (ret.hour < 0 || ret.hour >= 24 || ret.min < 0 || ret.min >= 60 || ret.sec < 0 || ret.sec >= 60) {
+        return std::nullopt;
+    }
+    return ret;
+}
+
+std::string hmsTimeString(std::string const &dateStr, HMS const &hms) {
+    std::ostringstream oss;
+    oss << dateStr << 'T' 
+        << std::setw(2) << std::setfill('0') << hms.hour
+        << ':'
+        << std::setw(2) << std::setfill('0') << hms.min
+        << ':'
+        << std::setw(2) << std::setfill('0') << hms.sec
+        << ".000";
+    return oss.str();
+}
+
 std::chrono::system_clock::time_point fetchFirstTimePoint(ReplayParameter &&param) {
     using TheEnvironment = infra::Environment<
         infra::CheckTimeComponent<true>,
@@ -95,82 +160,334 @@ basic::VoidStruct runReplay(int which, ReplayParameter &&param, std::chrono::sys
     TheEnvironment env;
         
     auto dateStr = infra::withtime_utils::localTimeString(firstTimePoint).substr(0, 10);
-    std::ostringstream oss;
-    oss << dateStr << 'T' 
-        << std::setw(2) << std::setfill('0') << param.calibratePointHistorical.hour
-        << ':'
-        << std::setw(2) << std::setfill('0') << param.calibratePointHistorical.min
-        << ':'
-        << std::setw(2) << std::setfill('0') << param.calibratePointHistorical.sec
-        << ".000";
-    TheEnvironment::ClockSettings settings;
-    if (param.calibratePointActual.index() == 0) {
-        settings = TheEnvironment::clockSettingsWithStartPointCorrespondingToNextAlignment(
-            std::get<0>(param.calibratePointActual)
-            , oss.str()
-            , param.speed
-        );
-    } else {
-        settings = TheEnvironment::clockSettingsWithStartPoint(
-            std::get<1>(param.calibratePointActual).hour*100+std::get<1>(param.calibratePointActual).min
-            , oss.str()
-            , param.speed
+    if (param.mode == ReplayMode::RealTime) {
+        auto calibratePointStr = hmsTimeString(dateStr, param.calibratePointHistorical);
+        TheEnvironment::ClockSettings settings;
+        if (param.calibratePointActual.index() == 0) {
+            settings = TheEnvironment::clockSettingsWithStartPointCorrespondingToNextAlignment(
+                std::get<0>(param.calibratePointActual)
+                , calibratePointStr
+                , param.speed
+            );
+        } else {
+            settings = TheEnvironment::clockSettingsWithStartPoint(
+                std::get<1>(param.calibratePointActual).hour*100+std::get<1>(param.calibratePointActual).min
+                , calibratePointStr
+                , param.speed
+            );
+        }
+        
+        env.basic::real_time_clock::ClockComponent::operator=(
+            basic::real_time_clock::ClockComponent(settings)
         );
     }
-    
-    env.basic::real_time_clock::ClockComponent::operator=(
-        basic::real_time_clock::ClockComponent(settings)
-    );
     using R = infra::AppRunner<App>;
     R r(&env);
     
-    std::ifstream ifs(param.inputFile, std::ios::binary);
-    auto importer = FileComponent::createImporter<basic::ByteDataWithTopicRecordFileFormat<std::chrono::microseconds>,true>(
-        ifs, 
-        {(std::byte) 0x01,(std::byte) 0x23,(std::byte) 0x45,(std::byte) 0x67},
-        {(std::byte) 0x76,(std::byte) 0x54,(std::byte) 0x32,(std::byte) 0x10},
-        param.overrideDate
-    );
-    auto dataSink = transport::MultiTransportBroadcastPublisherManagingUtils<R>
-        ::oneByteDataBroadcastPublisher
-        (
-            r
-            , "data sink"
-            , param.address
-        );
+    auto makeSink = [&r](std::string const &name, std::string const &address) {
+        return transport::MultiTransportBroadcastPublisherManagingUtils<R>
+            ::oneByteDataBroadcastPublisher
+            (
+                r
+                , name
+                , address
+            );
+    };
 
-    auto filter = App::kleisli<basic::ByteDataWithTopic>(
-        basic::CommonFlowUtilComponents<App>
-            ::pureFilter<basic::ByteDataWithTopic>(
-                [](basic::ByteDataWithTopic const &d) {
-                    return (!d.content.empty());
+    std::ifstream ifs;
+    if (!param.mergedInputs.empty()) {
+        //All inputs are merged on one thread (a heap over one cursor per
+        //memory-mapped file) and paced against the one calibrated clock,
+        //so the streams stay in lockstep. Each record is then routed to
+        //the publisher of its own stream.
+        std::chrono::system_clock::duration dateShift {0};
+        if (param.overrideDate) {
+            std::optional<std::chrono::system_clock::time_point> earliest = std::nullopt;
+            for (auto const &input : param.mergedInputs) {
+                auto t = input->firstTimePoint();
+                if (t && (!earliest || *t < *earliest)) {
+                    earliest = t;
+                }
+            }
+            if (earliest) {
+                dateShift = 
+                    infra::withtime_utils::parseLocalTime(dateStr+"T00:00:00")
+                    - infra::withtime_utils::parseLocalTime(
+                        infra::withtime_utils::localTimeString(*earliest).substr(0, 10)+"T00:00:00"
+                    );
+            }
+        }
+        auto importer = App::simpleImporter<StreamMessage>(
+            [&env,&param,dateShift](App::PublisherCall<StreamMessage> &pub) {
+                std::vector<indexed_capture_file::Reader const *> readers;
+                for (auto const &input : param.mergedInputs) {
+                    readers.push_back(input.get());
+                }
+                int64_t startMicros = (param.startTime ? indexed_capture_file::toMicros(*param.startTime) : std::numeric_limits<int64_t>::min());
+                int64_t endMicros = (param.endTime ? indexed_capture_file::toMicros(*param.endTime) : std::numeric_limits<int64_t>::max());
+                std::vector<uint64_t> counts(readers.size(), 0);
+                indexed_capture_file::forEachMerged(
+                    readers
+                    , [&](std::size_t stream, indexed_capture_file::RecordView const &rec) {
+                        if (rec.micros >= endMicros) {
+                            //the merge is in time order, nothing later can qualify
+                            return false;
+                        }
+                        if (rec.content.empty() || rec.micros < startMicros) {
+                            return true;
+                        }
+                        if (param.topics && param.topics->find(std::string {rec.topic}) == param.topics->end()) {
+                            return true;
+                        }
+                        auto tp = indexed_capture_file::fromMicros(rec.micros)+dateShift;
+                        auto now = env.now();
+                        if (tp > now) {
+                            std::this_thread::sleep_for((tp-now)/param.speed);
+                        }
+                        pub(StreamMessage {
+                            stream
+                            , std::make_shared<basic::ByteDataWithTopic>(basic::ByteDataWithTopic {
+                                std::string {rec.topic}
+                                , std::string {rec.content}
+                            })
+                        });
+                        ++counts[stream];
+                        return true;
+                    }
+                );
+                std::ostringstream oss;
+                oss << "Replayed";
+                for (std::size_t ii=0; ii<counts.size(); ++ii) {
+                    oss << ((ii == 0) ? " " : ", ") << counts[ii] << " messages to " << param.mergedAddresses[ii];
+                }
+                oss << ", got the final update!";
+                env.log(infra::LogLevel::Info, oss.str());
+                std::thread([&env]() {
+                    std::this_thread::sleep_for(std::chrono::seconds(2));
+                    env.exit();
+                }).detach();
+            }
+            , infra::LiftParameters<std::chrono::system_clock::time_point>()
+                .SuggestThreaded(true)
+        );
+        auto mergedData = r.importItem("importer", importer);
+        //streams that share an address share one publisher
+        for (std::size_t ii=0; ii<param.mergedAddresses.size(); ++ii) {
+            auto const &address = param.mergedAddresses[ii];
+            if (std::find(param.mergedAddresses.begin(), param.mergedAddresses.begin()+ii, address) != param.mergedAddresses.begin()+ii) {
+                continue;
+            }
+            auto dataSink = makeSink("data sink "+std::to_string(ii), address);
+            for (std::size_t jj=ii; jj<param.mergedAddresses.size(); ++jj) {
+                if (param.mergedAddresses[jj] != address) {
+                    continue;
+                }
+                auto router = App::liftMaybe<StreamMessage>(
+                    [jj](StreamMessage &&m) -> std::optional<basic::ByteDataWithTopic> {
+                        if (m.stream != jj) {
+                            return std::nullopt;
+                        }
+                        if (m.data.use_count() == 1) {
+                            return std::move(*(m.data));
+                        }
+                        return *(m.data);
+                    }
+                );
+                r.connect(r.execute("router "+std::to_string(jj), router, mergedData.clone()), dataSink);
+            }
+        }
+    } else if (param.mode != ReplayMode::RealTime) {
+        auto dataSink = makeSink("data sink", param.address);
+        //A loader thread decodes records into a pre-allocated ring, and
+        //this thread only paces and publishes. The clock starts once the
+        //ring is full (or the whole selection is loaded).
+        auto importer = App::simpleImporter<basic::ByteDataWithTopic>(
+            [&env,&param](App::PublisherCall<basic::ByteDataWithTopic> &pub) {
+                replay_ring::Ring ring(param.ringSize);
+                std::thread loader([&ring,&param]() {
+                    param.mappedInput->forEach(
+                        param.startTime
+                        , param.endTime
+                        , param.topics
+                        , [&ring](indexed_capture_file::RecordView const &rec) {
+                            if (!rec.content.empty()) {
+                                ring.push(rec.micros, rec.topic, rec.content);
+                            }
+                            return true;
+                        }
+                    );
+                    ring.markDone();
+                });
+                while (!ring.full() && !ring.done()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
                 }
-            )
-    );
 
-    r.connect(
-        r.execute("filter", filter, r.importItem("importer", importer))
-        , dataSink
-    );
+                bool burst = (param.mode == ReplayMode::BurstPreserving);
+                uint64_t count = 0;
+                int64_t firstMicros = 0, prevMicros = 0;
+                std::chrono::steady_clock::duration maxLag {0};
+                auto start = std::chrono::steady_clock::now();
+                auto target = start;
+                while (auto *slot = ring.front()) {
+                    if (count == 0) {
+                        firstMicros = slot->micros;
+                    } else if (burst) {
+                        //gaps up to burstGap are kept as they are, longer
+                        //(idle) gaps are divided by the speed factor
+                        std::chrono::microseconds gap {std::max<int64_t>(0, slot->micros-prevMicros)};
+                        if (gap <= param.burstGap) {
+                            target += gap;
+                        } else {
+                            target += std::chrono::duration_cast<std::chrono::steady_clock::duration>(gap/param.speed);
+                        }
+                    }
+                    prevMicros = slot->micros;
+                    if (burst) {
+                        auto now = std::chrono::steady_clock::now();
+                        if (target > now) {
+                            //sleeping is only accurate to tens of micros, spin the rest
+                            if (target-now > std::chrono::microseconds(100)) {
+                                std::this_thread::sleep_until(target-std::chrono::microseconds(50));
+                            }
+                            while (std::chrono::steady_clock::now() < target) {
+                            }
+                        } else {
+                            maxLag = std::max(maxLag, now-target);
+                        }
+                    }
+                    //copied, so that the slot keeps its buffers for the loader
+                    pub(basic::ByteDataWithTopic {
+                        slot->topic
+                        , slot->content
+                    });
+                    ring.pop();
+                    ++count;
+                }
+                loader.join();
 
-    auto exiter = App::simpleExporter<basic::ByteDataWithTopic>(
-        [&env](App::InnerData<basic::ByteDataWithTopic> &&d) {
-            if (d.timedData.finalFlag) {
-                d.environment->log(infra::LogLevel::Info, "Got the final update!");
+                auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+                auto scheduled = std::chrono::duration<double>(target-start).count();
+                auto captured = (prevMicros-firstMicros)/1000000.0;
+                std::ostringstream oss;
+                oss << std::fixed << std::setprecision(1)
+                    << "Replayed " << count << " messages in " << elapsed << "s"
+                    << ", achieved " << ((elapsed > 0) ? count/elapsed : 0.0) << " msgs/s";
+                if (burst) {
+                    oss << ", requested " << ((scheduled > 0) ? count/scheduled : 0.0) << " msgs/s"
+                        << " (" << ((elapsed > 0) ? 100.0*scheduled/elapsed : 100.0) << "%)"
+                        << ", max lag behind schedule " << std::chrono::duration_cast<std::chrono::microseconds>(maxLag).count() << "us";
+                } else {
+                    oss << ", requested as fast as possible";
+                }
+                oss << ", captured rate " << ((captured > 0) ? count/captured : 0.0) << " msgs/s"
+                    << ", got the final update!";
+                env.log(infra::LogLevel::Info, oss.str());
                 std::thread([&env]() {
                     std::this_thread::sleep_for(std::chrono::seconds(2));
                     env.exit();
                 }).detach();
             }
+            , infra::LiftParameters<std::chrono::system_clock::time_point>()
+                .SuggestThreaded(true)
+        );
+        r.connect(r.importItem("importer", importer), dataSink);
+    } else if (param.mappedInput) {
+        auto dataSink = makeSink("data sink", param.address);
+        //Records are read straight out of the memory map, and only the
+        //index blocks that can hold the requested time range and topics
+        //are visited.
+        std::chrono::system_clock::duration dateShift {0};
+        if (param.overrideDate) {
+            auto fileFirstTimePoint = param.mappedInput->firstTimePoint();
+            if (fileFirstTimePoint) {
+                dateShift = 
+                    infra::withtime_utils::parseLocalTime(dateStr+"T00:00:00")
+                    - infra::withtime_utils::parseLocalTime(
+                        infra::withtime_utils::localTimeString(*fileFirstTimePoint).substr(0, 10)+"T00:00:00"
+                    );
+            }
         }
-    );
-    r.exportItem("exiter", exiter, r.importItem(importer));
+        auto importer = App::simpleImporter<basic::ByteDataWithTopic>(
+            [&env,&param,dateShift](App::PublisherCall<basic::ByteDataWithTopic> &pub) {
+                uint64_t count = 0;
+                param.mappedInput->forEach(
+                    param.startTime
+                    , param.endTime
+                    , param.topics
+                    , [&env,&param,&pub,&count,dateShift](indexed_capture_file::RecordView const &rec) {
+                        if (rec.content.empty()) {
+                            return true;
+                        }
+                        auto tp = indexed_capture_file::fromMicros(rec.micros)+dateShift;
+                        auto now = env.now();
+                        if (tp > now) {
+                            std::this_thread::sleep_for((tp-now)/param.speed);
+                        }
+                        pub(basic::ByteDataWithTopic {
+                            std::string {rec.topic}
+                            , std::string {rec.content}
+                        });
+                        ++count;
+                        return true;
+                    }
+                );
+                std::ostringstream oss;
+                oss << "Replayed " << count << " messages, got the final update!";
+                env.log(infra::LogLevel::Info, oss.str());
+                std::thread([&env]() {
+                    std::this_thread::sleep_for(std::chrono::seconds(2));
+                    env.exit();
+                }).detach();
+            }
+            , infra::LiftParameters<std::chrono::system_clock::time_point>()
+                .SuggestThreaded(true)
+        );
+        r.connect(r.importItem("importer", importer), dataSink);
+    } else {
+        auto dataSink = makeSink("data sink", param.address);
+        ifs.open(param.inputFile, std::ios::binary);
+        auto importer = FileComponent::createImporter<basic::ByteDataWithTopicRecordFileFormat<std::chrono::microseconds>,true>(
+            ifs, 
+            {(std::byte) 0x01,(std::byte) 0x23,(std::byte) 0x45,(std::byte) 0x67},
+            {(std::byte) 0x76,(std::byte) 0x54,(std::byte) 0x32,(std::byte) 0x10},
+            param.overrideDate
+        );
+
+        auto filter = App::kleisli<basic::ByteDataWithTopic>(
+            basic::CommonFlowUtilComponents<App>
+                ::pureFilter<basic::ByteDataWithTopic>(
+                    [](basic::ByteDataWithTopic const &d) {
+                        return (!d.content.empty());
+                    }
+                )
+        );
+
+        r.connect(
+            r.execute("filter", filter, r.importItem("importer", importer))
+            , dataSink
+        );
+
+        auto exiter = App::simpleExporter<basic::ByteDataWithTopic>(
+            [&env](App::InnerData<basic::ByteDataWithTopic> &&d) {
+                if (d.timedData.finalFlag) {
+                    d.environment->log(infra::LogLevel::Info, "Got the final update!");
+                    std::thread([&env]() {
+                        std::this_thread::sleep_for(std::chrono::seconds(2));
+                        env.exit();
+                    }).detach();
+                }
+            }
+        );
+        r.exportItem("exiter", exiter, r.importItem(importer));
+    }
 
     r.finalize();
 
     infra::terminationController(infra::RunForever { &env, std::chrono::seconds(1) });
 
-    ifs.close();
+    if (ifs.is_open()) {
+        ifs.close();
+    }
 
     return basic::VoidStruct {};
 }
@@ -179,12 +496,18 @@ int main(int argc, char **argv) {
     options_description desc("allowed options");
     desc.add_options()
         ("help", "display help message")
-        ("address", value<std::string>(), "the address to republish on, with protocol info")
-        ("input", value<std::string>(), "input from this file")
-        ("speed", value<double>(), "republish speed factor, default 1.0")
+        ("address", value<std::vector<std::string>>()->multitoken(), "the address to republish on, with protocol info; with several inputs, either one address for all of them or one address per input (in input order)")
+        ("input", value<std::vector<std::string>>()->multitoken(), "input from this file; several files (or directories, meaning all files in them in name order) are replayed merged by time")
+        ("speed", value<double>(), "republish speed factor, default 1.0; in burst mode, the factor applied to idle gaps")
+        ("mode", value<std::string>(), "realtime (default, follows the calibrated clock), asap (as fast as possible) or burst (keeps gaps up to --burstGapMicros, divides longer gaps by --speed)")
+        ("burstGapMicros", value<int64_t>(), "in burst mode, gaps up to this many micros are kept as captured (default: 1000)")
+        ("ringSize", value<std::size_t>(), "in asap and burst modes, number of pre-decoded messages to buffer (default: 1048576)")
         ("calibratePointHistorical", value<std::string>(), "calibrate time point (for historical data), format is HH:MM[:SS]")
         ("calibratePointActual", value<std::string>(), "calibrate time point (for actual clock), format is HH:MM (no second!), or +N (where N is count of minutes)")
         ("overrideDate", "override date")
+        ("topics", value<std::string>(), "only replay these topics (comma-separated), fast on files captured with tm_capturer --indexed")
+        ("startTime", value<std::string>(), "only replay records at or after this time of the captured day, format is HH:MM[:SS], fast on indexed files")
+        ("endTime", value<std::string>(), "only replay records before this time of the captured day, format is HH:MM[:SS], fast on indexed files")
     ;
     variables_map vm;
     store(parse_command_line(argc, argv, desc), vm);
@@ -200,80 +523,220 @@ int main(int argc, char **argv) {
         std::cerr << "No address given!\n";
         return 1;
     }
-    param.address = vm["address"].as<std::string>();
+    auto addresses = vm["address"].as<std::vector<std::string>>();
     if (!vm.count("input")) {
-        std::cerr << "No output file given!\n";
+        std::cerr << "No input file given!\n";
+        return 1;
+    }
+    std::vector<std::string> inputs;
+    for (auto const &input : vm["input"].as<std::vector<std::string>>()) {
+        std::error_code ec;
+        if (std::filesystem::is_directory(input, ec)) {
+            std::vector<std::string> dirInputs;
+            for (auto const &entry : std::filesystem::directory_iterator(input, ec)) {
+                if (entry.is_regular_file()) {
+                    dirInputs.push_back(entry.path().string());
+                }
+            }
+            std::sort(dirInputs.begin(), dirInputs.end());
+            inputs.insert(inputs.end(), dirInputs.begin(), dirInputs.end());
+        } else {
+            inputs.push_back(input);
+        }
+    }
+    if (inputs.empty()) {
+        std::cerr << "No input file given!\n";
         return 1;
     }
-    auto input = vm["input"].as<std::string>();
-    param.inputFile = input;
+    if (addresses.size() != 1 && addresses.size() != inputs.size()) {
+        std::cerr << "Need either one address or one address per input file (" << inputs.size() << " input files)!\n";
+        return 1;
+    }
+    param.address = addresses[0];
+    param.inputFile = inputs[0];
     double speed = 1.0;
     if (vm.count("speed")) {
         speed = vm["speed"].as<double>();
     }
-    param.speed = speed;
-    if (!vm.count("calibratePointHistorical")) {
-        std::cerr << "No historical calibrate point given!\n";
-        return 1;
-    }
-    auto calibratePointHistorical = boost::trim_copy(vm["calibratePointHistorical"].as<std::string>());
-    if ((calibratePointHistorical.length() != 5 && calibratePointHistorical.length() != 8) || calibratePointHistorical[2] != ':') {
-        std::cerr << "Historical calibrate point must be in HH:MM[:SS] format!\n";
+    //the realtime waits and the burst idle gaps are divided by it
+    if (!(speed > 0)) {
+        std::cerr << "Speed must be positive!\n";
         return 1;
     }
-    int hour_hist, min_hist, sec_hist;
-    try {
-        hour_hist = boost::lexical_cast<int>(calibratePointHistorical.substr(0,2));
-        min_hist = boost::lexical_cast<int>(calibratePointHistorical.substr(3,2));
-        if (calibratePointHistorical.length() == 8) {
-            sec_hist = boost::lexical_cast<int>(calibratePointHistorical.substr(6,2));
-        } else {
-            sec_hist = 0;
+    param.speed = speed;
+    param.mode = ReplayMode::RealTime;
+    if (vm.count("mode")) {
+        auto mode = boost::trim_copy(vm["mode"].as<std::string>());
+        if (mode == "asap") {
+            param.mode = ReplayMode::AsFastAsPossible;
+        } else if (mode == "burst") {
+            param.mode = ReplayMode::BurstPreserving;
+        } else if (mode != "realtime") {
+            std::cerr << "Mode must be realtime, asap or burst!\n";
+            return 1;
         }
-    } catch (boost::bad_lexical_cast const &) {
-        std::cerr << "Historical calibrate point must be in HH:MM[:SS] format!\n";
-        return 1;
     }
-    if (hour_hist < 0 || hour_hist >= 24 || min_hist < 0 || min_hist >= 60 || sec_hist < 0 || sec_hist >= 60) {
-        std::cerr << "Historical calibrate point must be in HH:MM[:SS] format!\n";
-        return 1;
+    param.burstGap = std::chrono::microseconds(1000);
+    if (vm.count("burstGapMicros")) {
+        param.burstGap = std::chrono::microseconds(std::max<int64_t>(0, vm["burstGapMicros"].as<int64_t>()));
     }
-    param.calibratePointHistorical = HMS {hour_hist, min_hist, sec_hist};
-    if (!vm.count("calibratePointActual")) {
-        std::cerr << "No Actual calibrate point given!\n";
-        return 1;
+    param.ringSize = 1024*1024;
+    if (vm.count("ringSize")) {
+        param.ringSize = vm["ringSize"].as<std::size_t>();
     }
-    auto calibratePointActual = boost::trim_copy(vm["calibratePointActual"].as<std::string>());
-    std::optional<int> calibrateActualMinutes = std::nullopt;
-    int hour_act=-1, min_act=-1;
-    if (calibratePointActual.length() > 1 && calibratePointActual[0] == '+') {
+    bool fastMode = (param.mode != ReplayMode::RealTime);
+    if (!fastMode) {
+        if (!vm.count("calibratePointHistorical")) {
+            std::cerr << "No historical calibrate point given!\n";
+            return 1;
+        }
+        auto calibratePointHistorical = boost::trim_copy(vm["calibratePointHistorical"].as<std::string>());
+        if ((calibratePointHistorical.length() != 5 && calibratePointHistorical.length() != 8) || calibratePointHistorical[2] != ':') {
+            std::cerr << "Historical calibrate point must be in HH:MM[:SS] format!\n";
+            return 1;
+        }
+        int hour_hist, min_hist, sec_hist;
         try {
-            calibrateActualMinutes = boost::lexical_cast<int>(calibratePointActual.substr(1));
+            hour_hist = boost::lexical_cast<int>(calibratePointHistorical.substr(0,2));
+            min_hist = boost::lexical_cast<int>(calibratePointHistorical.substr(3,2));
+            if (calibratePointHistorical.length() == 8) {
+                sec_hist = boost::lexical_cast<int>(calibratePointHistorical.substr(6,2));
+            } else {
+                sec_hist = 0;
+            }
         } catch (boost::bad_lexical_cast const &) {
-            calibrateActualMinutes = std::nullopt;
+            std::cerr << "Historical calibrate point must be in HH:MM[:SS] format!\n";
+            return 1;
+        }
+        if (hour_hist < 0 || hour_hist >= 24 || min_hist < 0 || min_hist >= 60 || sec_hist < 0 || sec_hist >= 60) {
+            std::cerr << "Historical calibrate point must be in HH:MM[:SS] format!\n";
+            return 1;
+        }
+        param.calibratePointHistorical = HMS {hour_hist, min_hist, sec_hist};
+        if (!vm.count("calibratePointActual")) {
+            std::cerr << "No Actual calibrate point given!\n";
+            return 1;
+        }
+        auto calibratePointActual = boost::trim_copy(vm["calibratePointActual"].as<std::string>());
+        std::optional<int> calibrateActualMinutes = std::nullopt;
+        int hour_act=-1, min_act=-1;
+        if (calibratePointActual.length() > 1 && calibratePointActual[0] == '+') {
+            try {
+                calibrateActualMinutes = boost::lexical_cast<int>(calibratePointActual.substr(1));
+            } catch (boost::bad_lexical_cast const &) {
+                calibrateActualMinutes = std::nullopt;
+            }
+        }
+        if (!calibrateActualMinutes) {
+            if (calibratePointActual.length() != 5 || calibratePointActual[2] != ':') {
+                std::cerr << "Actual calibrate point must be in HH:MM or +N format!\n";
+                return 1;
+            }      
+            try {
+                hour_act = boost::lexical_cast<int>(calibratePointActual.substr(0,2));
+                min_act = boost::lexical_cast<int>(calibratePointActual.substr(3,2));
+            } catch (boost::bad_lexical_cast const &) {
+                std::cerr << "Actual calibrate point must be in HH:MM or +N format!\n";
+                return 1;
+            }
+            if (hour_act < 0 || hour_act >= 24 || min_act < 0 || min_act >= 60) {
+                std::cerr << "Actual calibrate point must be in HH:MM or +N format!\n";
+                return 1;
+            }
+            param.calibratePointActual = HM {hour_act, min_act};
+        } else {
+            param.calibratePointActual = *calibrateActualMinutes;
         }
     }
-    if (!calibrateActualMinutes) {
-        if (calibratePointActual.length() != 5 || calibratePointActual[2] != ':') {
-            std::cerr << "Actual calibrate point must be in HH:MM or +N format!\n";
+    param.overrideDate = vm.count("overrideDate");
+
+    if (inputs.size() > 1) {
+        if (fastMode) {
+            std::cerr << "Multiple inputs can only be replayed in realtime mode!\n";
             return 1;
-        }      
+        }
+        for (std::size_t ii=0; ii<inputs.size(); ++ii) {
+            try {
+                param.mergedInputs.push_back(std::make_shared<indexed_capture_file::Reader>(inputs[ii]));
+            } catch (std::exception const &) {
+                std::cerr << "Cannot memory-map input file '" << inputs[ii] << "'!\n";
+                return 1;
+            }
+            param.mergedAddresses.push_back(addresses[(addresses.size() == 1) ? 0 : ii]);
+        }
+    }
+
+    //The memory-mapped reader gets the first time point from the index
+    //(or from the first record when there is no index) instead of
+    //a separate pass over the file. A file that is then replayed by the
+    //plain importer keeps the first time point taken here.
+    if (param.mergedInputs.empty()) {
         try {
-            hour_act = boost::lexical_cast<int>(calibratePointActual.substr(0,2));
-            min_act = boost::lexical_cast<int>(calibratePointActual.substr(3,2));
-        } catch (boost::bad_lexical_cast const &) {
-            std::cerr << "Actual calibrate point must be in HH:MM or +N format!\n";
+            param.mappedInput = std::make_shared<indexed_capture_file::Reader>(param.inputFile);
+        } catch (std::exception const &) {
+            param.mappedInput.reset();
+        }
+    }
+    bool needFiltering = (vm.count("topics") || vm.count("startTime") || vm.count("endTime"));
+    if (needFiltering && !param.mappedInput && param.mergedInputs.empty()) {
+        std::cerr << "Cannot memory-map input file '" << param.inputFile << "' for filtering!\n";
+        return 1;
+    }
+    if (fastMode && !param.mappedInput) {
+        std::cerr << "Cannot memory-map input file '" << param.inputFile << "' for fast replay!\n";
+        return 1;
+    }
+    std::optional<std::chrono::system_clock::time_point> fileFirstTimePoint = std::nullopt;
+    if (param.mappedInput) {
+        fileFirstTimePoint = param.mappedInput->firstTimePoint();
+        if (!fileFirstTimePoint) {
+            std::cerr << "Input file '" << param.inputFile << "' has no records!\n";
             return 1;
         }
-        if (hour_act < 0 || hour_act >= 24 || min_act < 0 || min_act >= 60) {
-            std::cerr << "Actual calibrate point must be in HH:MM or +N format!\n";
+        if (!param.mappedInput->hasIndex() && !needFiltering && !fastMode) {
+            //no index and nothing to filter, the plain importer does the same job
+            param.mappedInput.reset();
+        }
+    } else if (!param.mergedInputs.empty()) {
+        for (auto const &input : param.mergedInputs) {
+            auto t = input->firstTimePoint();
+            if (t && (!fileFirstTimePoint || *t < *fileFirstTimePoint)) {
+                fileFirstTimePoint = t;
+            }
+        }
+        if (!fileFirstTimePoint) {
+            std::cerr << "None of the input files has records!\n";
             return 1;
         }
-        param.calibratePointActual = HM {hour_act, min_act};
-    } else {
-        param.calibratePointActual = *calibrateActualMinutes;
     }
-    param.overrideDate = vm.count("overrideDate");
+    if (vm.count("topics")) {
+        std::vector<std::string> topicList;
+        boost::split(topicList, vm["topics"].as<std::string>(), boost::is_any_of(","));
+        param.topics = std::unordered_set<std::string> {};
+        for (auto const &t : topicList) {
+            auto trimmed = boost::trim_copy(t);
+            if (!trimmed.empty()) {
+                param.topics->insert(trimmed);
+            }
+        }
+    }
+    auto fileDateStr = (fileFirstTimePoint ? infra::withtime_utils::localTimeString(*fileFirstTimePoint).substr(0, 10) : std::string {});
+    if (vm.count("startTime")) {
+        auto hms = parseHMS(boost::trim_copy(vm["startTime"].as<std::string>()));
+        if (!hms) {
+            std::cerr << "Start time must be in HH:MM[:SS] format!\n";
+            return 1;
+        }
+        param.startTime = infra::withtime_utils::parseLocalTime(hmsTimeString(fileDateStr, *hms));
+    }
+    if (vm.count("endTime")) {
+        auto hms = parseHMS(boost::trim_copy(vm["endTime"].as<std::string>()));
+        if (!hms) {
+            std::cerr << "End time must be in HH:MM[:SS] format!\n";
+            return 1;
+        }
+        param.endTime = infra::withtime_utils::parseLocalTime(hmsTimeString(fileDateStr, *hms));
+    }
 
     //Following commented-out code is an experiment of using an outer-graph
     //to combine inner-graphs. It is completely equivalent to the actual two-liner
@@ -308,6 +771,8 @@ int main(int argc, char **argv) {
     std::chrono::system_clock::time_point tp;
     if (param.overrideDate) {
         tp = std::chrono::system_clock::now();
+    } else if (fileFirstTimePoint) {
+        tp = *fileFirstTimePoint;
     } else {
         tp = fetchFirstTimePoint(std::move(param));
     }
@@ -13,21 +13,163 @@
 #include <tm_kit/transport/MultiTransportBroadcastListenerManagingUtils.hpp>
 #include <tm_kit/transport/MultiTransportBroadcastPublisherManagingUtils.hpp>
 
+#include "BatchFrame.hpp"
+
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <iostream>
 #include <fstream>
+#include <regex>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 using namespace dev::cd606::tm;
 using namespace boost::program_options;
 
+//One outgoing address of the relayer. Incoming messages are wrapped once
+//into a shared_ptr and the same object is queued for every destination whose
+//filter accepts the topic, so fanning out does not copy the payload. Each
+//destination drains its own bounded queue on its own thread (a slow
+//destination drops its own messages instead of stalling the others), and the
+//payload is only copied at the publisher boundary, or moved if this
+//destination is the last one holding it.
+//
+//A destination can also batch: messages are coalesced for up to maxDelay or
+//until maxBytes of raw data, and go out as one batch frame (see
+//BatchFrame.hpp) on batchTopic, optionally compressed. A frame never grows
+//past batch_frame::DefaultMaxRawSize, which is what receivers accept; a
+//message too large to fit in a frame on its own is dropped (and counted). A relayer (or
+//capturer) started with --incomingBatched restores the original messages
+//and their original timestamps from such frames.
+struct RelayedMessage {
+    std::chrono::system_clock::time_point timePoint;
+    basic::ByteDataWithTopic data;
+};
+
+struct BatchSettings {
+    std::chrono::microseconds maxDelay;
+    std::size_t maxBytes;
+    batch_frame::Codec codec;
+    std::string topic;
+};
+
+struct Destination {
+    std::string address;
+    std::optional<std::regex> filter;
+    std::optional<std::pair<std::regex, std::string>> rewrite;
+    std::optional<BatchSettings> batch;
+    std::size_t maxQueueDepth;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::shared_ptr<RelayedMessage>> queue;
+    std::atomic<uint64_t> accepted = 0;
+    std::atomic<uint64_t> published = 0;
+    std::atomic<uint64_t> dropped = 0;
+    std::atomic<std::size_t> maxSeenDepth = 0;
+    std::atomic<uint64_t> framesSent = 0;
+    std::atomic<uint64_t> tooLarge = 0;
+
+    bool accepts(std::string const &topic) const {
+        return (!filter || std::regex_search(topic, *filter));
+    }
+    void push(std::shared_ptr<RelayedMessage> const &data) {
+        {
+            std::lock_guard<std::mutex> _(mutex);
+            if (queue.size() >= maxQueueDepth) {
+                ++dropped;
+                return;
+            }
+            queue.push_back(data);
+            if (queue.size() > maxSeenDepth) {
+                maxSeenDepth = queue.size();
+            }
+        }
+        ++accepted;
+        cond.notify_one();
+    }
+    std::size_t depth() {
+        std::lock_guard<std::mutex> _(mutex);
+        return queue.size();
+    }
+};
+
+//Outgoing spec format is
+//  ADDRESS[|filter=REGEX][|rewrite=REGEX=>FORMAT][|batch=MICROS:BYTES[:none|lz4|zstd]][|batchTopic=TOPIC]
+//where FORMAT follows std::regex_replace syntax ($1 etc.)
+std::optional<std::shared_ptr<Destination>> parseDestination(std::string const &spec, std::size_t maxQueueDepth) {
+    std::vector<std::string> parts;
+    boost::split(parts, spec, boost::is_any_of("|"));
+    auto d = std::make_shared<Destination>();
+    d->address = boost::trim_copy(parts[0]);
+    d->maxQueueDepth = maxQueueDepth;
+    if (d->address.empty()) {
+        return std::nullopt;
+    }
+    try {
+        for (std::size_t ii=1; ii<parts.size(); ++ii) {
+            auto const &p = parts[ii];
+            if (boost::starts_with(p, "filter=")) {
+                d->filter = std::regex(p.substr(std::string("filter=").length()));
+            } else if (boost::starts_with(p, "rewrite=")) {
+                auto rule = p.substr(std::string("rewrite=").length());
+                auto pos = rule.find("=>");
+                if (pos == std::string::npos) {
+                    return std::nullopt;
+                }
+                d->rewrite = std::pair<std::regex, std::string> {std::regex(rule.substr(0, pos)), rule.substr(pos+2)};
+            } else if (boost::starts_with(p, "batch=")) {
+                std::vector<std::string> batchParts;
+                boost::split(batchParts, p.substr(std::string("batch=").length()), boost::is_any_of(":"));
+                if (batchParts.size() < 2 || batchParts.size() > 3) {
+                    return std::nullopt;
+                }
+                auto codec = batch_frame::parseCodec((batchParts.size() == 3) ? batchParts[2] : std::string {});
+                if (!codec || !batch_frame::codecAvailable(*codec)) {
+                    return std::nullopt;
+                }
+                try {
+                    d->batch = BatchSettings {
+                        std::chrono::microseconds(boost::lexical_cast<int64_t>(batchParts[0]))
+                        , boost::lexical_cast<std::size_t>(batchParts[1])
+                        , *codec
+                        , (d->batch ? d->batch->topic : std::string {"tm.batch"})
+                    };
+                } catch (boost::bad_lexical_cast const &) {
+                    return std::nullopt;
+                }
+                //receivers reject frames above DefaultMaxRawSize
+                if (d->batch->maxBytes == 0 || d->batch->maxBytes > batch_frame::DefaultMaxRawSize) {
+                    return std::nullopt;
+                }
+            } else if (boost::starts_with(p, "batchTopic=")) {
+                if (!d->batch) {
+                    return std::nullopt;
+                }
+                d->batch->topic = p.substr(std::string("batchTopic=").length());
+            } else {
+                return std::nullopt;
+            }
+        }
+    } catch (std::regex_error const &) {
+        return std::nullopt;
+    }
+    return d;
+}
+
 int main(int argc, char **argv) {
     options_description desc("allowed options");
     desc.add_options()
         ("help", "display help message")
         ("incomingAddress", value<std::string>(), "the address to listen on, with protocol info")
         ("outgoingAddress", value<std::string>(), "the address to publish on, with protocol info")
+        ("outgoing", value<std::vector<std::string>>()->multitoken(), "additional outgoing destinations, each as ADDRESS[|filter=REGEX][|rewrite=REGEX=>FORMAT][|batch=MICROS:BYTES[:none|lz4|zstd]][|batchTopic=TOPIC], the filter and rewrite apply to the topic, batch coalesces messages into frames for up to MICROS microseconds or BYTES bytes (at most 64MB, the largest frame a receiver accepts)")
+        ("incomingBatched", "the incoming messages are batch frames (from a relayer with batch=...), unpack them")
+        ("maxQueueDepth", value<std::size_t>(), "per destination, messages beyond this queue depth are dropped (default: 100000)")
         ("summaryPeriod", value<int>(), "print summary every this number of seconds")
     ;
     variables_map vm;
@@ -43,11 +185,38 @@ int main(int argc, char **argv) {
         return 1;
     }
     auto incomingAddress = vm["incomingAddress"].as<std::string>();
-    if (!vm.count("outgoingAddress")) {
+    std::size_t maxQueueDepth = 100000;
+    if (vm.count("maxQueueDepth")) {
+        maxQueueDepth = vm["maxQueueDepth"].as<std::size_t>();
+        if (maxQueueDepth == 0) {
+            std::cerr << "Max queue depth cannot be zero!\n";
+            return 1;
+        }
+    }
+    std::vector<std::string> outgoingSpecs;
+    if (vm.count("outgoingAddress")) {
+        outgoingSpecs.push_back(vm["outgoingAddress"].as<std::string>());
+    }
+    if (vm.count("outgoing")) {
+        for (auto const &s : vm["outgoing"].as<std::vector<std::string>>()) {
+            outgoingSpecs.push_back(s);
+        }
+    }
+    if (outgoingSpecs.empty()) {
         std::cerr << "No outgoing address given!\n";
         return 1;
     }
-    auto outgoingAddress = vm["outgoingAddress"].as<std::string>();
+    std::vector<std::shared_ptr<Destination>> destinations;
+    for (auto const &s : outgoingSpecs) {
+        auto d = parseDestination(s, maxQueueDepth);
+        if (!d) {
+            std::cerr << "Bad outgoing spec '" << s << "', must be ADDRESS[|filter=REGEX][|rewrite=REGEX=>FORMAT][|batch=MICROS:BYTES[:none|lz4|zstd]][|batchTopic=TOPIC] (and the codec must be available in this build)!\n";
+            return 1;
+        }
+        destinations.push_back(*d);
+    }
+
+    bool incomingBatched = vm.count("incomingBatched");
 
     std::optional<int> summaryPeriod = std::nullopt;
     if (vm.count("summaryPeriod")) {
@@ -72,27 +241,156 @@ int main(int argc, char **argv) {
     {
         auto dataSource = transport::MultiTransportBroadcastListenerManagingUtils<R>
             ::oneByteDataBroadcastListener(
-                r 
-                , "data source"
-                , incomingAddress 
-            );
-        auto dataSink = transport::MultiTransportBroadcastPublisherManagingUtils<R>
-            ::oneByteDataBroadcastPublisher
-            (
                 r
-                , "data sink"
-                , outgoingAddress
+                , "data source"
+                , incomingAddress
             );
-        r.connect(dataSource.clone(), dataSink);
-        
-        if (summaryPeriod) {
-            auto counter = M::liftPure<basic::ByteDataWithTopic>(
-                [](basic::ByteDataWithTopic &&data) -> uint64_t {
-                    static uint64_t counter = 0;
-                    return (++counter);
+
+        auto incomingCounter = std::make_shared<std::atomic<uint64_t>>(0);
+        r.preservePointer(incomingCounter);
+
+        auto badFrames = std::make_shared<std::atomic<uint64_t>>(0);
+        r.preservePointer(badFrames);
+
+        auto fanOut = M::simpleExporter<basic::ByteDataWithTopic>(
+            [destinations,incomingCounter,incomingBatched,badFrames](M::InnerData<basic::ByteDataWithTopic> &&data) {
+                auto dispatch = [&destinations,&incomingCounter](std::shared_ptr<RelayedMessage> &&msg) {
+                    ++(*incomingCounter);
+                    for (auto const &d : destinations) {
+                        if (d->accepts(msg->data.topic)) {
+                            d->push(msg);
+                        }
+                    }
+                };
+                if (incomingBatched) {
+                    bool good = batch_frame::decode(
+                        data.timedData.value.content
+                        , [&dispatch](int64_t micros, std::string_view topic, std::string_view content) {
+                            dispatch(std::make_shared<RelayedMessage>(RelayedMessage {
+                                std::chrono::system_clock::time_point {
+                                    std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(micros))
+                                }
+                                , basic::ByteDataWithTopic {std::string {topic}, std::string {content}}
+                            }));
+                        }
+                    );
+                    if (!good) {
+                        ++(*badFrames);
+                    }
+                } else {
+                    dispatch(std::make_shared<RelayedMessage>(RelayedMessage {
+                        data.timedData.timePoint
+                        , std::move(data.timedData.value)
+                    }));
+                }
+            }
+        );
+        r.exportItem("fanOut", fanOut, dataSource.clone());
+
+        for (std::size_t ii=0; ii<destinations.size(); ++ii) {
+            auto d = destinations[ii];
+            auto takeMessage = [](std::shared_ptr<RelayedMessage> &item, Destination const &dest) {
+                basic::ByteDataWithTopic out;
+                if (item.use_count() == 1) {
+                    out = std::move(item->data);
+                } else {
+                    out = item->data;
+                }
+                if (dest.rewrite) {
+                    out.topic = std::regex_replace(out.topic, dest.rewrite->first, dest.rewrite->second);
+                }
+                return out;
+            };
+            auto drainer = M::simpleImporter<basic::ByteDataWithTopic>(
+                [d,takeMessage](M::PublisherCall<basic::ByteDataWithTopic> &pub) {
+                    std::deque<std::shared_ptr<RelayedMessage>> batch;
+                    if (!d->batch) {
+                        while (true) {
+                            {
+                                std::unique_lock<std::mutex> lock(d->mutex);
+                                d->cond.wait(lock, [&d]() {
+                                    return !d->queue.empty();
+                                });
+                                std::swap(batch, d->queue);
+                            }
+                            for (auto &item : batch) {
+                                pub(takeMessage(item, *d));
+                                item.reset();
+                                ++(d->published);
+                            }
+                            batch.clear();
+                        }
+                    }
+                    batch_frame::Builder builder;
+                    std::chrono::steady_clock::time_point frameDeadline;
+                    auto sendFrame = [&builder,&pub,&d]() {
+                        auto n = builder.count();
+                        pub(basic::ByteDataWithTopic {d->batch->topic, builder.finish(d->batch->codec)});
+                        d->published += n;
+                        ++(d->framesSent);
+                    };
+                    while (true) {
+                        {
+                            std::unique_lock<std::mutex> lock(d->mutex);
+                            if (builder.empty()) {
+                                d->cond.wait(lock, [&d]() {
+                                    return !d->queue.empty();
+                                });
+                            } else {
+                                d->cond.wait_until(lock, frameDeadline, [&d]() {
+                                    return !d->queue.empty();
+                                });
+                            }
+                            std::swap(batch, d->queue);
+                        }
+                        for (auto &item : batch) {
+                            if (builder.empty()) {
+                                frameDeadline = std::chrono::steady_clock::now()+d->batch->maxDelay;
+                            }
+                            auto tp = item->timePoint;
+                            auto msg = takeMessage(item, *d);
+                            item.reset();
+                            auto msgSize = batch_frame::MinMessageSize+msg.topic.length()+msg.content.length();
+                            if (msgSize > batch_frame::DefaultMaxRawSize) {
+                                //a frame holding it would be rejected, and so
+                                //would the message on its own
+                                ++(d->tooLarge);
+                                continue;
+                            }
+                            if (!builder.empty() && builder.rawSize()+msgSize > batch_frame::DefaultMaxRawSize) {
+                                sendFrame();
+                                frameDeadline = std::chrono::steady_clock::now()+d->batch->maxDelay;
+                            }
+                            builder.add(
+                                std::chrono::duration_cast<std::chrono::microseconds>(tp.time_since_epoch()).count()
+                                , msg.topic
+                                , msg.content
+                            );
+                            if (builder.rawSize() >= d->batch->maxBytes) {
+                                sendFrame();
+                            }
+                        }
+                        batch.clear();
+                        if (!builder.empty() && std::chrono::steady_clock::now() >= frameDeadline) {
+                            sendFrame();
+                        }
+                    }
                 }
+                , infra::LiftParameters<std::chrono::system_clock::time_point>()
+                    .SuggestThreaded(true)
             );
-            auto clockImporter = 
+            auto dataSink = transport::MultiTransportBroadcastPublisherManagingUtils<R>
+                ::oneByteDataBroadcastPublisher
+                (
+                    r
+                    , "data sink "+std::to_string(ii)
+                    , d->address
+                );
+            r.connect(r.importItem("drainer "+std::to_string(ii), drainer), dataSink);
+        }
+
+        if (summaryPeriod) {
+            auto clockImporter =
                 basic::real_time_clock::ClockImporter<TheEnvironment>
                 ::createRecurringClockConstImporter<basic::VoidStruct>(
                     env.now()
@@ -100,27 +398,30 @@ int main(int argc, char **argv) {
                     , std::chrono::seconds(*summaryPeriod)
                     , basic::VoidStruct {}
                 );
-            auto perClockUpdate = M::kleisli2<basic::VoidStruct,uint64_t>(
-                [](M::InnerData<std::variant<basic::VoidStruct,uint64_t>> &&data) -> M::Data<basic::VoidStruct> {
-                    static uint64_t counter = 0;
-                    if (data.timedData.value.index() == 0) {
-                        std::ostringstream oss;
-                        oss << "Got " << counter << " messages";
-                        data.environment->log(infra::LogLevel::Info, oss.str());
-                    } else {
-                        counter = std::get<1>(data.timedData.value);
+            auto perClockUpdate = M::simpleExporter<basic::VoidStruct>(
+                [destinations,incomingCounter,badFrames](M::InnerData<basic::VoidStruct> &&data) {
+                    std::ostringstream oss;
+                    oss << "Got " << *incomingCounter << " messages";
+                    if (*badFrames > 0) {
+                        oss << " (" << *badFrames << " undecodable batch frames)";
                     }
-                    return std::nullopt;
+                    for (auto const &d : destinations) {
+                        oss << "; '" << d->address << "': accepted " << d->accepted
+                            << ", published " << d->published
+                            << ", dropped " << d->dropped
+                            << ", queue depth " << d->depth()
+                            << " (max " << d->maxSeenDepth << ")";
+                        if (d->batch) {
+                            oss << ", " << d->framesSent << " batch frames";
+                            if (d->tooLarge > 0) {
+                                oss << ", " << d->tooLarge << " too large to batch";
+                            }
+                        }
+                    }
+                    data.environment->log(infra::LogLevel::Info, oss.str());
                 }
             );
-            auto emptyExporter = M::simpleExporter<basic::VoidStruct>(
-                [](M::InnerData<basic::VoidStruct> &&) {}
-            );
-            auto notUsed = r.execute("perClockUpdate", perClockUpdate, r.importItem("clockImporter", clockImporter));
-            r.execute(perClockUpdate, 
-                r.execute("counter", counter, 
-                    dataSource.clone()));
-            r.exportItem("emptyExporter", emptyExporter, std::move(notUsed));
+            r.exportItem("perClockUpdate", perClockUpdate, r.importItem("clockImporter", clockImporter));
         }
     }
 
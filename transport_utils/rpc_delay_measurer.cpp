@@ -15,8 +15,19 @@
 #include <tm_kit/transport/MultiTransportFacilityWrapper.hpp>
 #include <tm_kit/transport/HeartbeatAndAlertComponent.hpp>
 
+#include "LatencyHistogram.hpp"
+
 #include <tclap/CmdLine.h>
 
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
 using namespace dev::cd606::tm;
 
 using Environment = infra::Environment<
@@ -45,6 +56,13 @@ TM_BASIC_CBOR_CAPABLE_STRUCT(FacilityOutput, FACILITY_OUTPUT_FIELDS);
 TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(FacilityInput, FACILITY_INPUT_FIELDS);
 TM_BASIC_CBOR_CAPABLE_STRUCT_SERIALIZE_NO_FIELD_NAMES(FacilityOutput, FACILITY_OUTPUT_FIELDS);
 
+//The other clients always send positive data and get 100000 bytes of
+//padding back. The pipelined client asks for a response size by sending
+//data = -size instead, which keeps the wire format unchanged.
+FacilityOutput makeFacilityOutput(FacilityInput const &x) {
+    return {x.data*2, std::string((x.data <= 0) ? (std::size_t) (-(int64_t) x.data) : (std::size_t) 100000, ' ')};
+}
+
 void runServer(std::string const &serviceDescriptor, transport::HeartbeatAndAlertComponentTouchupParameters const &heartbeatParam, int serverDelay) {
     Environment env;
     R r(&env);
@@ -60,13 +78,13 @@ void runServer(std::string const &serviceDescriptor, transport::HeartbeatAndAler
         facility = basic::CommonFlowUtilComponents<M>::simpleTaskSpawningFacility<FacilityInput,FacilityOutput>(
             [serverDelay](FacilityInput &&x) -> FacilityOutput {
                 std::this_thread::sleep_for(std::chrono::seconds(serverDelay));
-                return {x.data*2, std::string(100000, ' ')};
+                return makeFacilityOutput(x);
             }
         );
         r.registerOnOrderFacility("facility", facility);
     } else {
         facility = _("facility", infra::LiftAsFacility{}, [](FacilityInput &&x) -> FacilityOutput {
-            return {x.data*2, std::string(100000, ' ')};
+            return makeFacilityOutput(x);
         });
     }
     transport::MultiTransportFacilityWrapper<R>::wrap<FacilityInput,FacilityOutput>(
@@ -293,15 +311,174 @@ void runClientSimOneShotMode(transport::SimpleRemoteFacilitySpec const &spec, in
     env.exit(0);
 }
 
+//Keeps up to K requests in flight for each (response size, K) step, and
+//reports throughput and latency percentiles per step as a CSV table.
+//Latencies are measured on the client's steady clock, from just before a
+//request is handed to the facility to the arrival of its response.
+struct PipelinedState {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::unordered_map<Environment::IDType, std::chrono::steady_clock::time_point, Environment::IDHash> inFlight;
+    latency_histogram::Histogram latencies;
+    uint64_t received = 0;
+    uint64_t bytesReceived = 0;
+};
+
+void runClientPipelinedMode(
+    transport::SimpleRemoteFacilitySpec const &spec
+    , std::string const &transportName
+    , int repeatTimes
+    , std::vector<int> const &inFlightCounts
+    , std::vector<int> const &responseSizes
+    , std::optional<std::string> const &outputFile
+) {
+    Environment env;
+    R r(&env);
+
+    auto facilitioidAndTrigger = transport::MultiTransportRemoteFacilityManagingUtils<R>
+        ::setupSimpleRemoteFacilitioid<FacilityInput, FacilityOutput>
+        (
+            r 
+            , spec
+            , "remoteConnection"
+        );
+
+    auto state = std::make_shared<PipelinedState>();
+    r.preservePointer(state);
+
+    auto importerPair = M::triggerImporter<M::Key<FacilityInput>>();
+
+    auto startPromise = std::make_shared<std::promise<void>>();
+    r.preservePointer(startPromise);
+
+    infra::DeclarativeGraph<R>("", {
+        {"importer", std::get<0>(importerPair)}
+        , {"exporter", [state](M::KeyedData<FacilityInput,FacilityOutput> &&data) {
+            auto now = std::chrono::steady_clock::now();
+            {
+                std::lock_guard<std::mutex> _(state->mutex);
+                auto iter = state->inFlight.find(data.key.id());
+                if (iter == state->inFlight.end()) {
+                    //late answer from a step that already gave up on it
+                    return;
+                }
+                state->latencies.record(std::chrono::duration_cast<std::chrono::microseconds>(now-iter->second).count());
+                ++(state->received);
+                state->bytesReceived += data.data.padding.length();
+                state->inFlight.erase(iter);
+            }
+            state->cond.notify_all();
+        }}
+        , {"importer", facilitioidAndTrigger.facility, "exporter"}
+        , {"waitForStart", [startPromise](basic::VoidStruct &&) {
+            startPromise->set_value();
+        }}
+        , {facilitioidAndTrigger.facilityFirstReady.clone(), "waitForStart"}
+    })(r);
+    r.finalize();
+
+    startPromise->get_future().wait();
+
+    static constexpr auto ResponseTimeout = std::chrono::seconds(10);
+    std::ostringstream table;
+    table << "transport,in_flight,response_bytes,sent,received,lost,seconds,requests_per_second,mb_per_second,mean_us,p50_us,p90_us,p99_us,p99_9_us,max_us\n";
+    for (auto size : responseSizes) {
+        for (auto k : inFlightCounts) {
+            {
+                std::lock_guard<std::mutex> _(state->mutex);
+                state->inFlight.clear();
+                state->latencies.reset();
+                state->received = 0;
+                state->bytesReceived = 0;
+            }
+            int sent = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (; sent<repeatTimes; ++sent) {
+                M::Key<FacilityInput> req(
+                    FacilityInput {infra::withtime_utils::sinceEpoch<std::chrono::microseconds>(env.now()), -size}
+                );
+                {
+                    std::unique_lock<std::mutex> lock(state->mutex);
+                    if (!state->cond.wait_for(lock, ResponseTimeout, [&state,k]() {
+                        return state->inFlight.size() < (std::size_t) k;
+                    })) {
+                        break;
+                    }
+                    state->inFlight.emplace(req.id(), std::chrono::steady_clock::now());
+                }
+                std::get<1>(importerPair)(std::move(req));
+            }
+            uint64_t lost = 0;
+            latency_histogram::Histogram latencies;
+            uint64_t received = 0, bytesReceived = 0;
+            {
+                std::unique_lock<std::mutex> lock(state->mutex);
+                state->cond.wait_for(lock, ResponseTimeout, [&state]() {
+                    return state->inFlight.empty();
+                });
+                lost = state->inFlight.size();
+                state->inFlight.clear();
+                latencies.merge(state->latencies);
+                received = state->received;
+                bytesReceived = state->bytesReceived;
+            }
+            auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+            std::ostringstream line;
+            line << transportName << ',' << k << ',' << size << ','
+                << sent << ',' << received << ',' << lost << ','
+                << seconds << ','
+                << (seconds > 0 ? received/seconds : 0.0) << ','
+                << (seconds > 0 ? bytesReceived/seconds/1000000.0 : 0.0) << ','
+                << latencies.mean() << ','
+                << latencies.valueAtPercentile(50) << ','
+                << latencies.valueAtPercentile(90) << ','
+                << latencies.valueAtPercentile(99) << ','
+                << latencies.valueAtPercentile(99.9) << ','
+                << latencies.max() << '\n';
+            env.log(infra::LogLevel::Info, line.str().substr(0, line.str().length()-1));
+            table << line.str();
+        }
+    }
+    std::cout << table.str();
+    if (outputFile) {
+        std::ofstream ofs(*outputFile, std::ios::app);
+        ofs << table.str();
+    }
+    env.log(infra::LogLevel::Info, "done");
+
+    env.exit(0);
+}
+
+std::optional<std::vector<int>> parseIntList(std::string const &s) {
+    std::vector<std::string> parts;
+    boost::split(parts, s, boost::is_any_of(","));
+    std::vector<int> ret;
+    try {
+        for (auto const &p : parts) {
+            auto x = boost::lexical_cast<int>(boost::trim_copy(p));
+            if (x < 0) {
+                return std::nullopt;
+            }
+            ret.push_back(x);
+        }
+    } catch (boost::bad_lexical_cast const &) {
+        return std::nullopt;
+    }
+    return ret;
+}
+
 int main(int argc, char **argv) {
     TCLAP::CmdLine cmd("RPC Delay Measurer", ' ', "0.0.1");
-    TCLAP::ValueArg<std::string> modeArg("m", "mode", "server, client, client-sync, client-oneshot, client-oneshot-disconnect or client-sim-oneshot", true, "", "string");
+    TCLAP::ValueArg<std::string> modeArg("m", "mode", "server, client, client-sync, client-oneshot, client-oneshot-disconnect, client-sim-oneshot or client-pipelined", true, "", "string");
     TCLAP::ValueArg<std::string> serviceDescriptorArg("d", "serviceDescriptor", "service descriptor", false, "", "string");
     TCLAP::ValueArg<std::string> heartbeatDescriptorArg("H", "heartbeatDescriptor", "heartbeat descriptor", false, "", "string");
     TCLAP::ValueArg<std::string> heartbeatTopicArg("T", "heartbeatTopic", "heartbeat topic", false, "tm.examples.heartbeats", "string");
     TCLAP::ValueArg<std::string> heartbeatIdentityArg("I", "heartbeatIdentity", "heartbeat identity", false, "rpc_delay_measurer", "string");
     TCLAP::ValueArg<int> repeatTimesArg("r", "repeatTimes", "repeat times", false, 1000, "int");
     TCLAP::ValueArg<int> serverDelayArg("D", "serverDelay", "server delay in seconds", false, 0, "int");
+    TCLAP::ValueArg<std::string> inFlightArg("k", "inFlight", "for client-pipelined, comma-separated numbers of requests to keep in flight", false, "1,4,16,64", "string");
+    TCLAP::ValueArg<std::string> responseSizesArg("z", "responseSizes", "for client-pipelined, comma-separated response padding sizes in bytes", false, "100,100000", "string");
+    TCLAP::ValueArg<std::string> sweepOutputArg("o", "sweepOutput", "for client-pipelined, append the result table as CSV to this file", false, "", "string");
     cmd.add(modeArg);
     cmd.add(serviceDescriptorArg);
     cmd.add(heartbeatDescriptorArg);
@@ -309,6 +486,9 @@ int main(int argc, char **argv) {
     cmd.add(heartbeatIdentityArg);
     cmd.add(repeatTimesArg);    
     cmd.add(serverDelayArg);
+    cmd.add(inFlightArg);
+    cmd.add(responseSizesArg);
+    cmd.add(sweepOutputArg);
     
     cmd.parse(argc, argv);
 
@@ -383,8 +563,39 @@ int main(int argc, char **argv) {
             std::cerr << "Client-sim-oneshot mode requires either service descriptor or heartbeat descriptor\n";
             return 1;
         }
+    } else if (modeArg.getValue() == "client-pipelined") {
+        auto inFlightCounts = parseIntList(inFlightArg.getValue());
+        if (!inFlightCounts || std::find(inFlightCounts->begin(), inFlightCounts->end(), 0) != inFlightCounts->end()) {
+            std::cerr << "In-flight counts must be a comma-separated list of positive numbers\n";
+            return 1;
+        }
+        auto responseSizes = parseIntList(responseSizesArg.getValue());
+        if (!responseSizes) {
+            std::cerr << "Response sizes must be a comma-separated list of non-negative numbers\n";
+            return 1;
+        }
+        std::optional<std::string> sweepOutput = std::nullopt;
+        if (sweepOutputArg.isSet()) {
+            sweepOutput = sweepOutputArg.getValue();
+        }
+        if (serviceDescriptorArg.isSet()) {
+            auto const &descriptor = serviceDescriptorArg.getValue();
+            runClientPipelinedMode(descriptor, descriptor.substr(0, descriptor.find("://")), repeatTimesArg.getValue(), *inFlightCounts, *responseSizes, sweepOutput);
+            return 0;
+        } else if (heartbeatDescriptorArg.isSet()) {
+            runClientPipelinedMode(transport::SimpleRemoteFacilitySpecByHeartbeat {
+                heartbeatDescriptorArg.getValue()
+                , heartbeatTopicArg.getValue()
+                , std::regex {heartbeatIdentityArg.getValue()}
+                , "facility"
+            }, "heartbeat", repeatTimesArg.getValue(), *inFlightCounts, *responseSizes, sweepOutput);
+            return 0;
+        } else {
+            std::cerr << "Client-pipelined mode requires either service descriptor or heartbeat descriptor\n";
+            return 1;
+        }
     } else {
-        std::cerr << "Mode must be server, client, client-sync, client-oneshot, client-oneshot-disconnect or client-sim-oneshot\n";
+        std::cerr << "Mode must be server, client, client-sync, client-oneshot, client-oneshot-disconnect, client-sim-oneshot or client-pipelined\n";
         return 1;
     }
 }
\ No newline at end of file